@@ -0,0 +1,101 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Vector.h"
+
+#include <vector>
+
+//! Uniform grid that finds the pairs of balls that may be colliding, so not every pair has to be checked.
+//! It is rebuilt every step using a counting sort, which does not allocate once the arrays have grown.
+class BallGrid {
+public:
+	BallGrid() : mCellSize(1.0f), mColumns(0), mRows(0) {}
+
+	//! sorts the positions into square cells of at least the specified size,
+	//! so balls that are closer than the cell size are in the same or neighbouring cells
+	void	build( const ci::Vec2f *positions, size_t count, float cellSize ) { build( &positions->x, &positions->y, count, cellSize, 2 ); }
+	//! same, for coordinates in separate arrays. The stride is the distance between two coordinates, in floats.
+	void	build( const float *x, const float *y, size_t count, float cellSize, size_t stride = 1 );
+
+	//! calls func(a, b) once for every pair of balls in the same or neighbouring cells
+	template<typename Func>
+	void	forEachPair( Func func ) const;
+
+	size_t	getNumCells() const { return mColumns * mRows; }
+	float	getCellSize() const { return mCellSize; }
+private:
+	//! the cells are enlarged if the balls are spread out far, to limit the number of cells per ball
+	static const size_t		kMaxCellsPerBall = 4;
+
+	float					mCellSize;
+	size_t					mColumns;
+	size_t					mRows;
+
+	//! cell of each ball
+	std::vector<uint32_t>	mCells;
+	//! first entry of each cell in mIndices, followed by the number of balls
+	std::vector<uint32_t>	mOffsets;
+	//! indices of the balls, sorted by cell
+	std::vector<uint32_t>	mIndices;
+};
+
+template<typename Func>
+void BallGrid::forEachPair( Func func ) const
+{
+	for(size_t row=0;row<mRows;++row) {
+		for(size_t column=0;column<mColumns;++column) {
+			const size_t cell = row * mColumns + column;
+
+			const uint32_t begin = mOffsets[cell];
+			const uint32_t end = mOffsets[cell + 1];
+			if(begin == end) continue;
+
+			// only check the neighbours to the right and below, the others will check this cell
+			size_t neighbours[4];
+			size_t count = 0;
+
+			if(column + 1 < mColumns) neighbours[count++] = cell + 1;
+			if(row + 1 < mRows) {
+				if(column > 0) neighbours[count++] = cell + mColumns - 1;
+				neighbours[count++] = cell + mColumns;
+				if(column + 1 < mColumns) neighbours[count++] = cell + mColumns + 1;
+			}
+
+			for(uint32_t i=begin;i<end;++i) {
+				const uint32_t a = mIndices[i];
+
+				for(uint32_t j=i+1;j<end;++j)
+					func( a, mIndices[j] );
+
+				for(size_t n=0;n<count;++n) {
+					const uint32_t last = mOffsets[neighbours[n] + 1];
+					for(uint32_t j=mOffsets[neighbours[n]];j<last;++j)
+						func( a, mIndices[j] );
+				}
+			}
+		}
+	}
+}
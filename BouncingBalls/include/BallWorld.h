@@ -0,0 +1,108 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#pragma once
+
+#include "BallGrid.h"
+
+#include "cinder/Cinder.h"
+#include "cinder/Color.h"
+#include "cinder/Vector.h"
+
+#include <vector>
+
+//! Stores all balls as a structure of arrays, with the coordinates and velocities of all balls 
+//! in contiguous arrays. This allows them to be moved and bounced off the walls with SIMD instructions
+//! (AVX, SSE2 or NEON, depending on the compiler settings), and to be drawn straight from the arrays.
+class BallWorld {
+public:
+	//! note: you can use the multiplier to tweak the speed of the system
+	static const float	kSpeed;
+public:
+	BallWorld( float radius = 10.0f ) : mRadius(radius), mGravity(kSpeed * 0.981f), mHasBeenDrawn(false), mIsSimdEnabled(true) {}
+
+	//! adds a ball with a random color, at a random position above the window
+	void	add( float width, float height );
+	//! adds a ball
+	void	add( const ci::Vec2f &position, const ci::Vec2f &velocity, const ci::Colorf &color );
+	//! removes a ball, the balls after it move down one index
+	void	erase( size_t index );
+	//! removes all balls
+	void	clear();
+
+	//! puts the ball at a random position above the window again
+	void	reset( size_t index, float width, float height );
+
+	//! moves all balls one step and bounces them off the walls of the window
+	void	update( float width, float height );
+	//! finds the colliding balls and exchanges their velocities
+	void	performCollisions( float width, float height );
+
+	//! call after drawing, so the next step starts the motion blur trail at the current position
+	void	setDrawn() { mHasBeenDrawn = true; }
+
+	//! uses the scalar version of update() if disabled, which produces exactly the same results
+	void	setSimdEnabled( bool enabled ) { mIsSimdEnabled = enabled; }
+	bool	isSimdEnabled() const { return mIsSimdEnabled; }
+	//! returns the name of the instruction set used by update()
+	static const char*	getInstructionSet();
+
+	//! note: set gravity to zero for outer space
+	void	setGravity( float gravity ) { mGravity = gravity; }
+	float	getGravity() const { return mGravity; }
+	float	getRadius() const { return mRadius; }
+
+	size_t	size() const { return mX.size(); }
+	bool	empty() const { return mX.empty(); }
+
+	// the arrays, so rendering does not have to copy them
+	const float*	getX() const { return mX.empty() ? NULL : &mX.front(); }
+	const float*	getY() const { return mY.empty() ? NULL : &mY.front(); }
+	const float*	getPrevX() const { return mPrevX.empty() ? NULL : &mPrevX.front(); }
+	const float*	getPrevY() const { return mPrevY.empty() ? NULL : &mPrevY.front(); }
+	const float*	getVelocityX() const { return mVelocityX.empty() ? NULL : &mVelocityX.front(); }
+	const float*	getVelocityY() const { return mVelocityY.empty() ? NULL : &mVelocityY.front(); }
+	const std::vector<ci::Colorf>&	getColors() const { return mColors; }
+private:
+	//! moves the balls in the range one at a time
+	void	updateScalar( size_t begin, size_t end, float width, float height );
+
+	bool	isCollidingWithWindow( size_t index, float width, float height ) const;
+	void	collideWithWindow( size_t index, float width, float height );
+	void	collide( size_t a, size_t b, float width, float height );
+private:
+	float					mRadius;
+	float					mGravity;
+	bool					mHasBeenDrawn;
+	bool					mIsSimdEnabled;
+
+	std::vector<float>		mX;
+	std::vector<float>		mY;
+	std::vector<float>		mPrevX;
+	std::vector<float>		mPrevY;
+	std::vector<float>		mVelocityX;
+	std::vector<float>		mVelocityY;
+	std::vector<ci::Colorf>	mColors;
+
+	BallGrid				mGrid;
+};
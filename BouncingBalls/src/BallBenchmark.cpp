@@ -0,0 +1,352 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "BallGrid.h"
+#include "BallWorld.h"
+
+#include "cinder/CinderMath.h"
+#include "cinder/Rand.h"
+#include "cinder/Timer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace ci;
+using namespace std;
+
+// Runs the benchmarks of the BouncingBalls application without creating a window,
+// so they can be used in automated builds. Returns EXIT_FAILURE if a result is wrong.
+
+//////////////////////////////////////////
+
+//! the size of the application's default window, which the balls bounce off
+static const float kWindowWidth = 640.0f;
+static const float kWindowHeight = 480.0f;
+
+typedef shared_ptr<class Ball> BallRef;
+
+//! The original design, which moves every ball as a separate object. It is kept only as the
+//! baseline for benchmarkUpdate(): the application moves and draws the balls using the BallWorld.
+class Ball {
+public:
+	Ball();
+
+	void	update();
+public:
+	static const int RADIUS = 10;
+private:
+	bool	isCollidingWithWindow();
+	void	collideWithWindow();
+private:
+	bool	mHasBeenDrawn;
+
+	float	mGravity;
+
+	Vec2f	mPrevPosition;
+	Vec2f	mPosition;
+	Vec2f	mVelocity;
+
+	Colorf	mColor;
+};
+
+Ball::Ball()
+{
+	// pick a random color
+	float h = Rand::randFloat(0.0f, 1.0f);
+	float s = Rand::randFloat(0.75f, 1.0f);
+	float v = Rand::randFloat(0.75f, 1.0f);
+	mColor = Colorf(CM_HSV, h, s, v);
+
+	// pick a random position
+	float x = Rand::randFloat() * kWindowWidth;
+	float y = -0.1f * kWindowHeight;
+	mPosition = Vec2f( x, y );
+	mPrevPosition = mPosition;
+
+	// note: you can use the multiplier to tweak the speed of the system
+	float multiplier = 0.5f;
+
+	// note: set gravity to zero for outer space
+	mGravity = 0.981f * multiplier;
+
+	// pick a random velocity
+	x = Rand::randFloat(-15.0f, 15.0f) * multiplier;
+	y = Rand::randFloat(-15.0f,  0.0f) * multiplier;
+	mVelocity = Vec2f(x, y);
+
+	// 
+	mHasBeenDrawn = false;
+}
+
+void Ball::update()
+{	
+	// store current position
+	if(mHasBeenDrawn) mPrevPosition = mPosition;
+
+	// first, update the ball's velocity
+	if( !isCollidingWithWindow() ) mVelocity.y += mGravity;
+
+	// next, update the ball's position
+	mPosition += mVelocity;
+
+	// finally, perform collision detection:
+	collideWithWindow();
+
+	//
+	mHasBeenDrawn = false;
+}
+
+bool Ball::isCollidingWithWindow()
+{
+	if( mPosition.x < (0.0f + RADIUS) || mPosition.x > (kWindowWidth - RADIUS) ) return true;
+	if( mPosition.y > (kWindowHeight - RADIUS) ) return true;
+
+	return false;
+}
+
+void Ball::collideWithWindow()
+{
+	//	1) check if the ball hits the left or right side of the window
+	if( mPosition.x < (0.0f + RADIUS) || mPosition.x > (kWindowWidth - RADIUS) ) {
+		// to reduce the visual effect of the ball missing the border, 
+		// set the previous position to where we are now
+		mPrevPosition = mPosition;
+		// move the ball back into window without adding energy,
+		// by placing it where it would have been without friction
+		mPosition.x -= mVelocity.x;
+		// reduce velocity due to friction
+		mVelocity.x *= -0.95f;
+	}
+	//	2) check if the ball this the bottom of the window
+	if( mPosition.y > (kWindowHeight - RADIUS) ) {		
+		// to reduce the visual effect of the ball missing the border, 
+		// set the previous position to where we are now
+		mPrevPosition = mPosition;
+		// move the ball back into window without adding energy,
+		// by placing it where it would have been without friction
+		mPosition.y -= mVelocity.y;
+		// reduce velocity due to friction
+		mVelocity.x *=  0.99f;
+		mVelocity.y *= -0.95f;
+	}
+
+	//  3) if ball is still outside window, 
+	//		it was probably moving very slow or fast. Let's reset it then.
+	if( mPosition.x < (0.0f + RADIUS) ) {
+		mPosition.x = 0.0f + (float) RADIUS;
+		mVelocity.x = 0.0f;
+	}
+	else if( mPosition.x > (kWindowWidth - RADIUS) ) {
+		mPosition.x = kWindowWidth - (float) RADIUS;
+		mVelocity.x = 0.0f;
+	}
+	if( mPosition.y > (kWindowHeight - RADIUS) ) {	
+		mPosition.y = kWindowHeight - (float) RADIUS;
+		mVelocity.y = 0.0f;	
+	}
+}
+
+
+//////////////////////////////////////////
+
+//! compares the grid with checking every pair of balls, returns FALSE if they find different collisions
+static bool benchmarkCollisions()
+{
+	// about as crowded as a window full of balls
+	const float	kSpacing = 4.0f * Ball::RADIUS;
+	const float	kDiameter = 2.0f * Ball::RADIUS;
+	const size_t	kMaxBruteForce = 20000;
+
+	Rand rnd(12345);
+	bool success = true;
+
+	cout << "Collision detection, one ball per " << kSpacing << " x " << kSpacing << " pixels:" << endl;
+
+	for(size_t count=1000;count<=1000000;count*=10) {
+		const float size = kSpacing * math<float>::sqrt( float(count) );
+
+		std::vector<Vec2f> positions( count );
+		for(size_t i=0;i<count;++i)
+			positions[i] = Vec2f( rnd.nextFloat(size), rnd.nextFloat(size) );
+
+		// repeat for at least half a second
+		BallGrid grid;
+		size_t candidates = 0;
+		size_t collisions = 0;
+		size_t steps = 0;
+
+		Timer timer(true);
+		do {
+			candidates = collisions = 0;
+
+			grid.build( &positions.front(), count, kDiameter );
+			grid.forEachPair( [&](uint32_t a, uint32_t b) {
+				candidates++;
+				if( positions[a].distanceSquared( positions[b] ) < kDiameter * kDiameter )
+					collisions++;
+			} );
+
+			steps++;
+		} while( timer.getSeconds() < 0.5 );
+
+		const double seconds = timer.getSeconds() / steps;
+
+		cout << "  " << count << " balls: grid " << (seconds * 1000.0) << " ms per step, " << (count / seconds) << " balls/s, " 
+			<< grid.getNumCells() << " cells, " << candidates << " pairs checked, " << collisions << " collisions";
+
+		// checking every pair takes too long for larger numbers
+		if(count <= kMaxBruteForce) {
+			size_t expected = 0;
+
+			timer.start();
+			for(size_t a=0;a+1<count;++a)
+				for(size_t b=a+1;b<count;++b)
+					if( positions[a].distanceSquared( positions[b] ) < kDiameter * kDiameter )
+						expected++;
+
+			cout << "; every pair " << (timer.getSeconds() * 1000.0) << " ms, " << expected << " collisions";
+
+			if(expected != collisions) success = false;
+		}
+
+		cout << endl;
+	}
+
+	if(!success) cout << "  the grid missed collisions!" << endl;
+
+	return success;
+}
+
+//! times BallWorld::performCollisions(), which builds the grid and also exchanges the velocities of the colliding balls
+static void benchmarkWorldCollisions()
+{
+	const float	kSpacing = 4.0f * Ball::RADIUS;
+
+	Rand rnd(12345);
+
+	cout << "Collision detection and response of the BallWorld, one ball per " << kSpacing << " x " << kSpacing << " pixels:" << endl;
+
+	for(size_t count=1000;count<=1000000;count*=10) {
+		const float size = kSpacing * math<float>::sqrt( float(count) );
+
+		// in outer space, so the balls stay spread out over the area
+		BallWorld world( (float) Ball::RADIUS );
+		world.setGravity( 0.0f );
+
+		for(size_t i=0;i<count;++i)
+			world.add( Vec2f( rnd.nextFloat(size), rnd.nextFloat(size) ), rnd.nextVec2f() * rnd.nextFloat(5.0f), Colorf::white() );
+
+		// move the balls between the steps like the application does, but only time the collisions
+		double seconds = 0.0;
+		size_t steps = 0;
+
+		Timer total(true);
+		do {
+			world.update( size, size );
+
+			Timer timer(true);
+			world.performCollisions( size, size );
+			seconds += timer.getSeconds();
+
+			steps++;
+		} while( total.getSeconds() < 0.5 );
+
+		seconds /= steps;
+
+		cout << "  " << count << " balls: " << (seconds * 1000.0) << " ms per step, " << (count / seconds) << " balls/s" << endl;
+	}
+}
+
+//! times moving the balls one object at a time against the BallWorld, returns FALSE if its scalar and SIMD results differ
+static bool benchmarkUpdate()
+{
+	bool success = true;
+
+	cout << "Moving balls and bouncing them off the walls of the window, on a single core:" << endl;
+
+	for(size_t count=1000;count<=1000000;count*=10) {
+		const size_t steps = std::max<size_t>( 10, 10000000 / count );
+
+		// the same balls, as objects and as arrays, which pick their random values in the same order
+		std::vector<BallRef> balls;
+		BallWorld scalar( (float) Ball::RADIUS );
+		BallWorld vectors( (float) Ball::RADIUS );
+
+		scalar.setSimdEnabled( false );
+
+		Rand::randSeed( count );
+		for(size_t i=0;i<count;++i)
+			balls.push_back( BallRef( new Ball() ) );
+
+		Rand::randSeed( count );
+		for(size_t i=0;i<count;++i)
+			scalar.add( kWindowWidth, kWindowHeight );
+
+		Rand::randSeed( count );
+		for(size_t i=0;i<count;++i)
+			vectors.add( kWindowWidth, kWindowHeight );
+
+		// none of them is drawn between the steps
+		Timer timer(true);
+		for(size_t step=0;step<steps;++step)
+			for(size_t i=0;i<count;++i)
+				balls[i]->update();
+		const double objects = timer.getSeconds();
+
+		timer.start();
+		for(size_t step=0;step<steps;++step)
+			scalar.update( kWindowWidth, kWindowHeight );
+		const double arrays = timer.getSeconds();
+
+		timer.start();
+		for(size_t step=0;step<steps;++step)
+			vectors.update( kWindowWidth, kWindowHeight );
+		const double simd = timer.getSeconds();
+
+		// the SIMD version should produce exactly the same results, the objects do not expose theirs
+		bool isIdentical = true;
+		for(size_t i=0;i<count;++i) {
+			if( scalar.getX()[i] != vectors.getX()[i] || scalar.getY()[i] != vectors.getY()[i] ) isIdentical = false;
+			if( scalar.getVelocityX()[i] != vectors.getVelocityX()[i] || scalar.getVelocityY()[i] != vectors.getVelocityY()[i] ) isIdentical = false;
+		}
+
+		const double updates = double(count * steps);
+		cout << "  " << count << " balls: objects " << (updates / objects) << " balls/s, arrays " << (updates / arrays) << " balls/s, " 
+			<< BallWorld::getInstructionSet() << " " << (updates / simd) << " balls/s" << (isIdentical ? "" : ", the results differ!") << endl;
+
+		if(!isIdentical) success = false;
+	}
+
+	return success;
+}
+
+int main( int argc, char *argv[] )
+{
+	const bool collisions = benchmarkCollisions();
+	benchmarkWorldCollisions();
+	const bool update = benchmarkUpdate();
+
+	return (collisions && update) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,104 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "BallGrid.h"
+
+#include "cinder/CinderMath.h"
+
+#include <cfloat>
+
+using namespace ci;
+
+void BallGrid::build( const float *x, const float *y, size_t count, float cellSize, size_t stride )
+{
+	mCells.resize( count );
+	mIndices.resize( count );
+
+	if(count == 0) {
+		mColumns = mRows = 0;
+		mOffsets.assign( 1, 0 );
+		return;
+	}
+
+	// find the bounds of all balls, skipping invalid positions (NaN or infinite)
+	Vec2f lower( FLT_MAX, FLT_MAX );
+	Vec2f upper( -FLT_MAX, -FLT_MAX );
+	for(size_t i=0;i<count;++i) {
+		const float px = x[i * stride];
+		const float py = y[i * stride];
+		if( !(math<float>::abs(px) <= FLT_MAX && math<float>::abs(py) <= FLT_MAX) ) continue;
+
+		lower.x = math<float>::min( lower.x, px );
+		lower.y = math<float>::min( lower.y, py );
+		upper.x = math<float>::max( upper.x, px );
+		upper.y = math<float>::max( upper.y, py );
+	}
+
+	if( lower.x > upper.x ) 
+		lower = upper = Vec2f::zero();
+
+	// larger cells are fine, they only result in more pairs to check
+	const float width = upper.x - lower.x;
+	const float height = upper.y - lower.y;
+	const float maximum = float( count * kMaxCellsPerBall );
+
+	if( (width / cellSize + 1.0f) * (height / cellSize + 1.0f) > maximum ) {
+		cellSize = math<float>::max( cellSize, math<float>::sqrt( width * height / maximum ) );
+		while( (width / cellSize + 1.0f) * (height / cellSize + 1.0f) > maximum )
+			cellSize *= 1.25f;
+	}
+
+	mCellSize = cellSize;
+	mColumns = size_t( width / cellSize ) + 1;
+	mRows = size_t( height / cellSize ) + 1;
+
+	// count the number of balls in each cell
+	const float scale = 1.0f / cellSize;
+
+	mOffsets.assign( mColumns * mRows + 1, 0 );
+	for(size_t i=0;i<count;++i) {
+		// invalid positions end up in the first or last column and row
+		const float px = (x[i * stride] - lower.x) * scale;
+		const float py = (y[i * stride] - lower.y) * scale;
+
+		const size_t column = (px > 0.0f) ? size_t( math<float>::min( px, float(mColumns - 1) ) ) : 0;
+		const size_t row = (py > 0.0f) ? size_t( math<float>::min( py, float(mRows - 1) ) ) : 0;
+		const uint32_t cell = uint32_t( row * mColumns + column );
+
+		mCells[i] = cell;
+		mOffsets[cell + 1]++;
+	}
+
+	// find the first entry of each cell
+	for(size_t i=1;i<mOffsets.size();++i)
+		mOffsets[i] += mOffsets[i - 1];
+
+	// sort the balls by cell, which moves each offset to the start of the next cell
+	for(size_t i=0;i<count;++i)
+		mIndices[ mOffsets[ mCells[i] ]++ ] = uint32_t(i);
+
+	// so move them back
+	for(size_t i=mOffsets.size()-1;i>0;--i)
+		mOffsets[i] = mOffsets[i - 1];
+	mOffsets[0] = 0;
+}
@@ -0,0 +1,414 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "BallWorld.h"
+
+#include "cinder/Rand.h"
+
+#if defined(__AVX__)
+	#include <immintrin.h>
+	#define BALLS_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define BALLS_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#include <arm_neon.h>
+	#define BALLS_NEON
+#endif
+
+using namespace ci;
+
+const float BallWorld::kSpeed = 0.5f;
+
+namespace {
+
+// a few operations on a vector of floats, so the kernel only has to be written once
+#if defined(BALLS_AVX)
+	typedef __m256	Floats;
+	typedef __m256	Mask;
+	const size_t	kWidth = 8;
+
+	inline Floats	load( const float *p ) { return _mm256_loadu_ps(p); }
+	inline void		store( float *p, Floats v ) { _mm256_storeu_ps(p, v); }
+	inline Floats	splat( float v ) { return _mm256_set1_ps(v); }
+	inline Floats	add( Floats a, Floats b ) { return _mm256_add_ps(a, b); }
+	inline Floats	sub( Floats a, Floats b ) { return _mm256_sub_ps(a, b); }
+	inline Floats	mul( Floats a, Floats b ) { return _mm256_mul_ps(a, b); }
+	inline Mask		less( Floats a, Floats b ) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	inline Mask		greater( Floats a, Floats b ) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	inline Mask		either( Mask a, Mask b ) { return _mm256_or_ps(a, b); }
+	//! returns b where the mask is set and a elsewhere
+	inline Floats	select( Mask mask, Floats a, Floats b ) { return _mm256_blendv_ps(a, b, mask); }
+	//! returns zero where the mask is set and a elsewhere
+	inline Floats	zero( Mask mask, Floats a ) { return _mm256_andnot_ps(mask, a); }
+#elif defined(BALLS_SSE2)
+	typedef __m128	Floats;
+	typedef __m128	Mask;
+	const size_t	kWidth = 4;
+
+	inline Floats	load( const float *p ) { return _mm_loadu_ps(p); }
+	inline void		store( float *p, Floats v ) { _mm_storeu_ps(p, v); }
+	inline Floats	splat( float v ) { return _mm_set1_ps(v); }
+	inline Floats	add( Floats a, Floats b ) { return _mm_add_ps(a, b); }
+	inline Floats	sub( Floats a, Floats b ) { return _mm_sub_ps(a, b); }
+	inline Floats	mul( Floats a, Floats b ) { return _mm_mul_ps(a, b); }
+	inline Mask		less( Floats a, Floats b ) { return _mm_cmplt_ps(a, b); }
+	inline Mask		greater( Floats a, Floats b ) { return _mm_cmpgt_ps(a, b); }
+	inline Mask		either( Mask a, Mask b ) { return _mm_or_ps(a, b); }
+	inline Floats	select( Mask mask, Floats a, Floats b ) { return _mm_or_ps( _mm_and_ps(mask, b), _mm_andnot_ps(mask, a) ); }
+	inline Floats	zero( Mask mask, Floats a ) { return _mm_andnot_ps(mask, a); }
+#elif defined(BALLS_NEON)
+	typedef float32x4_t	Floats;
+	typedef uint32x4_t	Mask;
+	const size_t		kWidth = 4;
+
+	inline Floats	load( const float *p ) { return vld1q_f32(p); }
+	inline void		store( float *p, Floats v ) { vst1q_f32(p, v); }
+	inline Floats	splat( float v ) { return vdupq_n_f32(v); }
+	inline Floats	add( Floats a, Floats b ) { return vaddq_f32(a, b); }
+	inline Floats	sub( Floats a, Floats b ) { return vsubq_f32(a, b); }
+	inline Floats	mul( Floats a, Floats b ) { return vmulq_f32(a, b); }
+	inline Mask		less( Floats a, Floats b ) { return vcltq_f32(a, b); }
+	inline Mask		greater( Floats a, Floats b ) { return vcgtq_f32(a, b); }
+	inline Mask		either( Mask a, Mask b ) { return vorrq_u32(a, b); }
+	inline Floats	select( Mask mask, Floats a, Floats b ) { return vbslq_f32(mask, b, a); }
+	inline Floats	zero( Mask mask, Floats a ) { return vreinterpretq_f32_u32( vbicq_u32( vreinterpretq_u32_f32(a), mask ) ); }
+#endif
+
+#if defined(BALLS_AVX) || defined(BALLS_SSE2) || defined(BALLS_NEON)
+//! moves the balls kWidth at a time, in exactly the same way as BallWorld::updateScalar(). 
+//! Returns the number of balls that were moved.
+size_t integrate( float *x, float *y, float *prevX, float *prevY, float *velocityX, float *velocityY, size_t count,
+				 bool hasBeenDrawn, float radius, float gravity, float width, float height )
+{
+	const Floats left = splat( radius );
+	const Floats right = splat( width - radius );
+	const Floats bottom = splat( height - radius );
+	const Floats g = splat( gravity );
+	const Floats bounce = splat( -0.95f );
+	const Floats friction = splat( 0.99f );
+
+	size_t i = 0;
+	for(;i+kWidth<=count;i+=kWidth) {
+		Floats px = load( x + i );
+		Floats py = load( y + i );
+		Floats vx = load( velocityX + i );
+		Floats vy = load( velocityY + i );
+
+		// store current position
+		Floats ppx = hasBeenDrawn ? px : load( prevX + i );
+		Floats ppy = hasBeenDrawn ? py : load( prevY + i );
+
+		// first, update the ball's velocity, unless it is colliding with the window
+		const Mask outside = either( either( less(px, left), greater(px, right) ), greater(py, bottom) );
+		vy = add( vy, zero( outside, g ) );
+
+		// next, update the ball's position
+		px = add( px, vx );
+		py = add( py, vy );
+
+		// finally, bounce off the left or right side of the window
+		Mask hit = either( less(px, left), greater(px, right) );
+		ppx = select( hit, ppx, px );
+		ppy = select( hit, ppy, py );
+		px = select( hit, px, sub(px, vx) );
+		vx = select( hit, vx, mul(vx, bounce) );
+
+		// and the bottom of the window
+		hit = greater(py, bottom);
+		ppx = select( hit, ppx, px );
+		ppy = select( hit, ppy, py );
+		py = select( hit, py, sub(py, vy) );
+		vx = select( hit, vx, mul(vx, friction) );
+		vy = select( hit, vy, mul(vy, bounce) );
+
+		// stop balls that are still outside the window
+		hit = less(px, left);
+		px = select( hit, px, left );
+		vx = zero( hit, vx );
+
+		hit = greater(px, right);
+		px = select( hit, px, right );
+		vx = zero( hit, vx );
+
+		hit = greater(py, bottom);
+		py = select( hit, py, bottom );
+		vy = zero( hit, vy );
+
+		store( x + i, px );
+		store( y + i, py );
+		store( prevX + i, ppx );
+		store( prevY + i, ppy );
+		store( velocityX + i, vx );
+		store( velocityY + i, vy );
+	}
+
+	return i;
+}
+#endif
+
+} // namespace
+
+const char* BallWorld::getInstructionSet()
+{
+#if defined(BALLS_AVX)
+	return "AVX";
+#elif defined(BALLS_SSE2)
+	return "SSE2";
+#elif defined(BALLS_NEON)
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+void BallWorld::add( float width, float height )
+{
+	// pick a random color
+	float h = Rand::randFloat(0.0f, 1.0f);
+	float s = Rand::randFloat(0.75f, 1.0f);
+	float v = Rand::randFloat(0.75f, 1.0f);
+
+	add( Vec2f::zero(), Vec2f::zero(), Colorf(CM_HSV, h, s, v) );
+	reset( size() - 1, width, height );
+}
+
+void BallWorld::add( const Vec2f &position, const Vec2f &velocity, const Colorf &color )
+{
+	mX.push_back( position.x );
+	mY.push_back( position.y );
+	mPrevX.push_back( position.x );
+	mPrevY.push_back( position.y );
+	mVelocityX.push_back( velocity.x );
+	mVelocityY.push_back( velocity.y );
+	mColors.push_back( color );
+}
+
+void BallWorld::erase( size_t index )
+{
+	mX.erase( mX.begin() + index );
+	mY.erase( mY.begin() + index );
+	mPrevX.erase( mPrevX.begin() + index );
+	mPrevY.erase( mPrevY.begin() + index );
+	mVelocityX.erase( mVelocityX.begin() + index );
+	mVelocityY.erase( mVelocityY.begin() + index );
+	mColors.erase( mColors.begin() + index );
+}
+
+void BallWorld::clear()
+{
+	mX.clear();
+	mY.clear();
+	mPrevX.clear();
+	mPrevY.clear();
+	mVelocityX.clear();
+	mVelocityY.clear();
+	mColors.clear();
+}
+
+void BallWorld::reset( size_t index, float width, float height )
+{
+	// pick a random position
+	mX[index] = mPrevX[index] = Rand::randFloat() * width;
+	mY[index] = mPrevY[index] = -0.1f * height;
+
+	// pick a random velocity
+	mVelocityX[index] = Rand::randFloat(-15.0f, 15.0f) * kSpeed;
+	mVelocityY[index] = Rand::randFloat(-15.0f,  0.0f) * kSpeed;
+}
+
+void BallWorld::update( float width, float height )
+{
+	size_t count = 0;
+
+#if defined(BALLS_AVX) || defined(BALLS_SSE2) || defined(BALLS_NEON)
+	if(mIsSimdEnabled && !empty())
+		count = integrate( &mX.front(), &mY.front(), &mPrevX.front(), &mPrevY.front(), &mVelocityX.front(), &mVelocityY.front(), size(),
+			mHasBeenDrawn, mRadius, mGravity, width, height );
+#endif
+
+	// the remaining balls don't fill a whole vector
+	updateScalar( count, size(), width, height );
+
+	mHasBeenDrawn = false;
+}
+
+void BallWorld::updateScalar( size_t begin, size_t end, float width, float height )
+{
+	for(size_t i=begin;i<end;++i) {
+		// store current position
+		if(mHasBeenDrawn) {
+			mPrevX[i] = mX[i];
+			mPrevY[i] = mY[i];
+		}
+
+		// first, update the ball's velocity
+		if( !isCollidingWithWindow(i, width, height) ) mVelocityY[i] += mGravity;
+
+		// next, update the ball's position
+		mX[i] += mVelocityX[i];
+		mY[i] += mVelocityY[i];
+
+		// finally, perform collision detection:
+		collideWithWindow(i, width, height);
+	}
+}
+
+void BallWorld::performCollisions( float width, float height )
+{
+	if(empty()) return;
+
+	// only balls in the same or neighbouring cells can be colliding
+	mGrid.build( &mX.front(), &mY.front(), size(), 2.0f * mRadius );
+
+	const float minimal = 4.0f * mRadius * mRadius;
+
+	mGrid.forEachPair( [&](uint32_t a, uint32_t b) {
+		const float dx = mX[b] - mX[a];
+		const float dy = mY[b] - mY[a];
+
+		if( dx * dx + dy * dy < minimal )
+			collide( a, b, width, height );
+	} );
+}
+
+bool BallWorld::isCollidingWithWindow( size_t index, float width, float height ) const
+{
+	if( mX[index] < mRadius || mX[index] > (width - mRadius) ) return true;
+	if( mY[index] > (height - mRadius) ) return true;
+
+	return false;
+}
+
+void BallWorld::collideWithWindow( size_t index, float width, float height )
+{
+	float &x = mX[index];
+	float &y = mY[index];
+	float &vx = mVelocityX[index];
+	float &vy = mVelocityY[index];
+
+	//	1) check if the ball hits the left or right side of the window
+	if( x < mRadius || x > (width - mRadius) ) {
+		// to reduce the visual effect of the ball missing the border, 
+		// set the previous position to where we are now
+		mPrevX[index] = x;
+		mPrevY[index] = y;
+		// move the ball back into window without adding energy,
+		// by placing it where it would have been without friction
+		x -= vx;
+		// reduce velocity due to friction
+		vx *= -0.95f;
+	}
+	//	2) check if the ball this the bottom of the window
+	if( y > (height - mRadius) ) {
+		mPrevX[index] = x;
+		mPrevY[index] = y;
+
+		y -= vy;
+
+		vx *=  0.99f;
+		vy *= -0.95f;
+	}
+
+	//  3) if ball is still outside window, 
+	//		it was probably moving very slow or fast. Let's reset it then.
+	if( x < mRadius ) {
+		x = mRadius;
+		vx = 0.0f;
+	}
+	else if( x > (width - mRadius) ) {
+		x = width - mRadius;
+		vx = 0.0f;
+	}
+	if( y > (height - mRadius) ) {
+		y = height - mRadius;
+		vy = 0.0f;
+	}
+}
+
+void BallWorld::collide( size_t a, size_t b, float width, float height )
+{
+	// calculate minimal distance between balls
+	const float minimal = 2.0f * mRadius;
+
+	Vec2f positionA( mX[a], mY[a] );
+	Vec2f positionB( mX[b], mY[b] );
+	Vec2f velocityA( mVelocityX[a], mVelocityY[a] );
+	Vec2f velocityB( mVelocityX[b], mVelocityY[b] );
+
+	// 1) we have already established that the two balls are colliding,
+	// let's move back in time to the moment before collision
+	positionA -= velocityA;
+	positionB -= velocityB;
+
+	// 2) convert to simple 1-dimensional collision 
+	//	by projecting onto line through both centers
+	Vec2f line = positionB - positionA;
+	if(line.x == 0.0f && line.y == 0.0f) return; // balls at the same position can not be separated
+
+	Vec2f unit = line.normalized();
+
+	float distance = line.dot(unit);
+	float velocity_a = velocityA.dot(unit);
+	float velocity_b = velocityB.dot(unit);
+
+	if(velocity_a == velocity_b) {
+		// no collision will happen
+		mX[a] = positionA.x;
+		mY[a] = positionA.y;
+		mX[b] = positionB.x;
+		mY[b] = positionB.y;
+		return;
+	}
+
+	// 3) find time of collision
+	float t = (minimal - distance) / (velocity_b - velocity_a);
+
+	// 4) move to that moment in time
+	positionA += t * velocityA;
+	positionB += t * velocityB;
+
+	// 5) exchange velocities
+	velocityA -= velocity_a * unit;
+	velocityA += velocity_b * unit;
+
+	velocityB -= velocity_b * unit;
+	velocityB += velocity_a * unit;
+
+	// 6) move forward to current time 
+	positionA += (1.0f - t) * velocityA;
+	positionB += (1.0f - t) * velocityB;
+
+	mX[a] = positionA.x;
+	mY[a] = positionA.y;
+	mX[b] = positionB.x;
+	mY[b] = positionB.y;
+	mVelocityX[a] = velocityA.x;
+	mVelocityY[a] = velocityA.y;
+	mVelocityX[b] = velocityB.x;
+	mVelocityY[b] = velocityB.y;
+
+	// 7) make sure the balls stay within window
+	collideWithWindow(a, width, height);
+	collideWithWindow(b, width, height);
+}
@@ -20,6 +20,8 @@
  POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include "BallWorld.h"
+
 #include "cinder/ImageIo.h"
 #include "cinder/Rand.h"
 #include "cinder/Timer.h"
@@ -33,226 +35,6 @@ using namespace ci::app;
 using namespace std;
 
 
-//////////////////////////////////////////
-
-typedef shared_ptr<class Ball> BallRef;
-
-class Ball {
-public:
-	Ball();
-
-	void	reset();
-
-	void	update();
-	void	draw( const gl::VboMesh &mesh, bool useMotionBlur = true );
-
-	bool	isCollidingWith( BallRef other );
-	void	collideWith( BallRef other );
-
-	bool	isCollidingWithWindow();
-	void	collideWithWindow();
-public:
-	static const int RADIUS = 10;
-private:
-	bool	mHasBeenDrawn;
-
-	float	mGravity;
-
-	Vec2f	mPrevPosition;
-	Vec2f	mPosition;
-	Vec2f	mVelocity;
-
-	Colorf	mColor;
-};
-
-Ball::Ball()
-{
-	// pick a random color
-	float h = Rand::randFloat(0.0f, 1.0f);
-	float s = Rand::randFloat(0.75f, 1.0f);
-	float v = Rand::randFloat(0.75f, 1.0f);
-	mColor = Colorf(CM_HSV, h, s, v);
-
-	reset();
-}
-
-void Ball::reset()
-{	
-	// pick a random position
-	float x = Rand::randFloat() * getWindowWidth();
-	float y = -0.1f * getWindowHeight();
-	mPosition = Vec2f( x, y );
-	mPrevPosition = mPosition;
-
-	// note: you can use the multiplier to tweak the speed of the system
-	float multiplier = 0.5f;
-
-	// note: set gravity to zero for outer space
-	mGravity = 0.981f * multiplier;
-
-	// pick a random velocity
-	x = Rand::randFloat(-15.0f, 15.0f) * multiplier;
-	y = Rand::randFloat(-15.0f,  0.0f) * multiplier;
-	mVelocity = Vec2f(x, y);
-
-	// 
-	mHasBeenDrawn = false;
-}
-
-void Ball::update()
-{	
-	// store current position
-	if(mHasBeenDrawn) mPrevPosition = mPosition;
-
-	// first, update the ball's velocity
-	if( !isCollidingWithWindow() ) mVelocity.y += mGravity;
-
-	// next, update the ball's position
-	mPosition += mVelocity;
-
-	// finally, perform collision detection:
-	collideWithWindow();
-
-	//
-	mHasBeenDrawn = false;
-}
-
-void Ball::draw( const gl::VboMesh &mesh, bool useMotionBlur )
-{
-	// store the current modelview matrix
-	gl::pushModelView();
-
-	if(useMotionBlur) {
-		// determine the number of balls that make up the motion blur trail (minimum of 3, maximum of 30)
-		float trailsize = math<float>::clamp( math<float>::floor(mPrevPosition.distance(mPosition)), 3.0f, 30.0f );
-		float segments = trailsize - 1.0f;
-	
-		// draw ball with motion blur (using additive blending)
-		gl::color( mColor / trailsize );
-
-		Vec2f offset(0.0f, 0.0f);
-		for(size_t i=0;i<trailsize;++i) {
-			Vec2f difference = mPrevPosition.lerp( i / segments, mPosition ) - offset;	
-			offset += difference;
-
-			gl::translate( difference );
-			gl::draw( mesh );
-		}		
-	}
-	else {
-		// draw ball without motion blur
-		gl::color( mColor );
-		gl::translate( mPosition );
-		gl::draw( mesh );
-	}
-
-	// restore the modelview matrix
-	gl::popModelView();
-
-	//
-	mHasBeenDrawn = true;
-}
-
-bool Ball::isCollidingWith(BallRef other)
-{
-	// this is a simplification: there is a change we will miss the collision
-	return (mPosition.distance( other->mPosition ) < (2 * RADIUS));
-}
-
-void Ball::collideWith(BallRef other)
-{
-	// calculate minimal distance between balls
-	static float minimal = 2 * RADIUS;
-
-	// 1) we have already established that the two balls are colliding,
-	// let's move back in time to the moment before collision
-	mPosition -= mVelocity;
-	other->mPosition -= other->mVelocity;
-
-	// 2) convert to simple 1-dimensional collision 
-	//	by projecting onto line through both centers
-	Vec2f line = other->mPosition - mPosition;
-	Vec2f unit = line.normalized();
-
-	float distance = line.dot(unit);
-	float velocity_a = mVelocity.dot(unit);
-	float velocity_b = other->mVelocity.dot(unit);
-	if(velocity_a == velocity_b) return; // no collision will happen
-
-	// 3) find time of collision
-	float t = (minimal - distance) / (velocity_b - velocity_a);
-
-	// 4) move to that moment in time
-	mPosition += t * mVelocity;
-	other->mPosition += t * other->mVelocity;
-
-	// 5) exchange velocities 	
-	mVelocity -= velocity_a * unit;
-	mVelocity += velocity_b * unit;
-
-	other->mVelocity -= velocity_b * unit;
-	other->mVelocity += velocity_a * unit;
-
-	// 6) move forward to current time 
-	mPosition += (1.0f - t) * mVelocity;
-	other->mPosition += (1.0f - t) * other->mVelocity;
-
-	// 7) make sure the balls stay within window
-	collideWithWindow();
-	other->collideWithWindow();
-}
-
-bool Ball::isCollidingWithWindow()
-{
-	if( mPosition.x < (0.0f + RADIUS) || mPosition.x > (getWindowWidth() - RADIUS) ) return true;
-	if( mPosition.y > (getWindowHeight() - RADIUS) ) return true;
-
-	return false;
-}
-
-void Ball::collideWithWindow()
-{
-	//	1) check if the ball hits the left or right side of the window
-	if( mPosition.x < (0.0f + RADIUS) || mPosition.x > (getWindowWidth() - RADIUS) ) {
-		// to reduce the visual effect of the ball missing the border, 
-		// set the previous position to where we are now
-		mPrevPosition = mPosition;
-		// move the ball back into window without adding energy,
-		// by placing it where it would have been without friction
-		mPosition.x -= mVelocity.x;
-		// reduce velocity due to friction
-		mVelocity.x *= -0.95f;
-	}
-	//	2) check if the ball this the bottom of the window
-	if( mPosition.y > (getWindowHeight() - RADIUS) ) {		
-		// to reduce the visual effect of the ball missing the border, 
-		// set the previous position to where we are now
-		mPrevPosition = mPosition;
-		// move the ball back into window without adding energy,
-		// by placing it where it would have been without friction
-		mPosition.y -= mVelocity.y;
-		// reduce velocity due to friction
-		mVelocity.x *=  0.99f;
-		mVelocity.y *= -0.95f;
-	}
-
-	//  3) if ball is still outside window, 
-	//		it was probably moving very slow or fast. Let's reset it then.
-	if( mPosition.x < (0.0f + RADIUS) ) {
-		mPosition.x = 0.0f + (float) RADIUS;
-		mVelocity.x = 0.0f;
-	}
-	else if( mPosition.x > (getWindowWidth() - RADIUS) ) {
-		mPosition.x = getWindowWidth() - (float) RADIUS;
-		mVelocity.x = 0.0f;
-	}
-	if( mPosition.y > (getWindowHeight() - RADIUS) ) {	
-		mPosition.y = getWindowHeight() - (float) RADIUS;
-		mVelocity.y = 0.0f;	
-	}
-}
-
-
 //////////////////////////////////////////
 
 class BouncingBallsApp : public AppBasic {
@@ -263,7 +45,8 @@ public:
 
 	void keyDown( KeyEvent event );	
 private:
-	void performCollisions();
+	//! draws a ball, with a motion blur trail from its previous position
+	void drawBall( const Vec2f &previous, const Vec2f &position, const Colorf &color );
 private:
 	bool		mUseMotionBlur;
 
@@ -272,8 +55,8 @@ private:
 	uint32_t	mStepsPerformed;
 	Timer		mTimer;
 
-	// our list of balls 
-	std::vector<BallRef> mBalls;
+	// our balls, stored as arrays
+	BallWorld	mWorld;
 
 	// mesh and texture
 	gl::VboMesh	mMesh;
@@ -297,7 +80,7 @@ void BouncingBallsApp::setup()
 
 	// create a few balls
 	for(size_t i=0;i<25;++i)
-		mBalls.push_back( BallRef( new Ball() ) );
+		mWorld.add( (float) getWindowWidth(), (float) getWindowHeight() );
 
 	// create ball mesh ( much faster than using gl::drawSolidCircle() )
 	size_t slices = 20;
@@ -316,7 +99,7 @@ void BouncingBallsApp::setup()
 
 		indices.push_back( positions.size() );
 		texcoords.push_back( Vec2f(0.5f, 0.5f) + 0.5f * v );
-		positions.push_back( Ball::RADIUS * Vec3f(v, 0.0f) );
+		positions.push_back( mWorld.getRadius() * Vec3f(v, 0.0f) );
 	}
 
 	gl::VboMesh::Layout layout;
@@ -348,15 +131,17 @@ void BouncingBallsApp::update()
 	// kill-switch
 	double t = mTimer.getSeconds() + 1.0;
 
+	// the balls bounce off the walls of the window
+	const float width = (float) getWindowWidth();
+	const float height = (float) getWindowHeight();
+
 	// perform the remaining steps
-	std::vector<BallRef>::iterator itr;
 	while( mStepsPerformed < stepsTotal && mTimer.getSeconds() < t ) {
 		// move the balls
-		for(itr=mBalls.begin();itr!=mBalls.end();++itr)
-			(*itr)->update();
+		mWorld.update( width, height );
 
 		// perform collision detection and response
-		performCollisions();
+		mWorld.performCollisions( width, height );
 
 		// done
 		mStepsPerformed++;
@@ -373,18 +158,60 @@ void BouncingBallsApp::draw()
 
 	if(mTexture) mTexture.enableAndBind();
 
-	std::vector<BallRef>::iterator itr;
-	for(itr=mBalls.begin();itr!=mBalls.end();++itr)
-		(*itr)->draw( mMesh, mUseMotionBlur );
+	// read the positions straight from the arrays
+	const float *x = mWorld.getX();
+	const float *y = mWorld.getY();
+	const float *prevX = mWorld.getPrevX();
+	const float *prevY = mWorld.getPrevY();
+	const std::vector<Colorf> &colors = mWorld.getColors();
+
+	for(size_t i=0;i<mWorld.size();++i)
+		drawBall( Vec2f(prevX[i], prevY[i]), Vec2f(x[i], y[i]), colors[i] );
+
+	mWorld.setDrawn();
 
 	if(mTexture) mTexture.unbind();
 
 	gl::disableAlphaBlending();
 }
 
+void BouncingBallsApp::drawBall( const Vec2f &previous, const Vec2f &position, const Colorf &color )
+{
+	// store the current modelview matrix
+	gl::pushModelView();
+
+	if(mUseMotionBlur) {
+		// determine the number of balls that make up the motion blur trail (minimum of 3, maximum of 30)
+		float trailsize = math<float>::clamp( math<float>::floor(previous.distance(position)), 3.0f, 30.0f );
+		float segments = trailsize - 1.0f;
+	
+		// draw ball with motion blur (using additive blending)
+		gl::color( color / trailsize );
+
+		Vec2f offset(0.0f, 0.0f);
+		for(size_t i=0;i<trailsize;++i) {
+			Vec2f difference = previous.lerp( i / segments, position ) - offset;	
+			offset += difference;
+
+			gl::translate( difference );
+			gl::draw( mMesh );
+		}		
+	}
+	else {
+		// draw ball without motion blur
+		gl::color( color );
+		gl::translate( position );
+		gl::draw( mMesh );
+	}
+
+	// restore the modelview matrix
+	gl::popModelView();
+}
+
 void BouncingBallsApp::keyDown( KeyEvent event )
 {
-	std::vector<BallRef>::iterator itr;
+	const float width = (float) getWindowWidth();
+	const float height = (float) getWindowHeight();
 
 	switch( event.getCode() )
 	{
@@ -394,8 +221,8 @@ void BouncingBallsApp::keyDown( KeyEvent event )
 		break;
 	case KeyEvent::KEY_SPACE:
 		// reset all balls
-		for(itr=mBalls.begin();itr!=mBalls.end();++itr)
-			(*itr)->reset();
+		for(size_t i=0;i<mWorld.size();++i)
+			mWorld.reset( i, width, height );
 		break;
 	case KeyEvent::KEY_RETURN:
 		// pause/resume simulation
@@ -412,13 +239,13 @@ void BouncingBallsApp::keyDown( KeyEvent event )
 	case KeyEvent::KEY_PLUS:
 	case KeyEvent::KEY_KP_PLUS:
 		// create a new ball
-		mBalls.push_back( BallRef( new Ball() ) );
+		mWorld.add( width, height );
 		break;
 	case KeyEvent::KEY_MINUS:
 	case KeyEvent::KEY_KP_MINUS:
 		// remove the oldest ball
-		if(!mBalls.empty())
-			mBalls.erase( mBalls.begin() );
+		if(!mWorld.empty())
+			mWorld.erase( 0 );
 		break;
 	case KeyEvent::KEY_f:
 		setFullScreen( !isFullScreen() );
@@ -446,20 +273,4 @@ void BouncingBallsApp::keyDown( KeyEvent event )
     //console()<<"key: "<<event.getCode()<<"\n";
 }
 
-void BouncingBallsApp::performCollisions()
-{
-	// determine which balls are colliding,
-	// by checking every pair of balls only once
-	std::vector<BallRef>::iterator itr1, itr2;
-	for(itr1=mBalls.begin();itr1<mBalls.end()-1;++itr1) {
-		for(itr2=itr1+1;itr2<mBalls.end();++itr2) {
-			// do quick check
-			if( (*itr1)->isCollidingWith(*itr2) ) {
-				// do collision
-				(*itr1)->collideWith(*itr2);
-			}
-		}
-	}
-}
-
 CINDER_APP_BASIC( BouncingBallsApp, RendererGl )
\ No newline at end of file
@@ -0,0 +1,376 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "nodes/AabbTree.h"
+
+#include "cinder/CinderMath.h"
+
+namespace ph { namespace nodes {
+
+using namespace ci;
+using namespace std;
+
+const float AabbTree::kMargin = 4.0f;
+
+AabbTree::AabbTree(void)
+	: mRoot(-1), mFreeList(-1), mProxyCount(0)
+{
+}
+
+int32_t AabbTree::createProxy( const Rectf &bounds, uint32_t userData )
+{
+	int32_t proxy = allocateNode();
+
+	mNodes[proxy].bounds = Rectf( bounds.x1 - kMargin, bounds.y1 - kMargin, bounds.x2 + kMargin, bounds.y2 + kMargin );
+	mNodes[proxy].userData = userData;
+	mNodes[proxy].height = 0;
+
+	insertLeaf( proxy );
+	mProxyCount++;
+
+	return proxy;
+}
+
+void AabbTree::destroyProxy( int32_t proxy )
+{
+	removeLeaf( proxy );
+	freeNode( proxy );
+	mProxyCount--;
+}
+
+bool AabbTree::moveProxy( int32_t proxy, const Rectf &bounds )
+{
+	// nothing to do if the rectangle still fits
+	if( contains( mNodes[proxy].bounds, bounds ) )
+		return false;
+
+	removeLeaf( proxy );
+	mNodes[proxy].bounds = Rectf( bounds.x1 - kMargin, bounds.y1 - kMargin, bounds.x2 + kMargin, bounds.y2 + kMargin );
+	insertLeaf( proxy );
+
+	return true;
+}
+
+void AabbTree::query( const Vec2f &pt, vector<uint32_t> *result ) const
+{
+	query( Rectf( pt, pt ), result );
+}
+
+void AabbTree::query( const Rectf &bounds, vector<uint32_t> *result ) const
+{
+	if( mRoot < 0 ) return;
+
+	mStack.clear();
+	mStack.push_back( mRoot );
+
+	while( ! mStack.empty() ) {
+		const TreeNode &node = mNodes[ mStack.back() ];
+		mStack.pop_back();
+
+		if( ! overlaps( node.bounds, bounds ) ) 
+			continue;
+
+		if( node.isLeaf() ) {
+			result->push_back( node.userData );
+		}
+		else {
+			mStack.push_back( node.child1 );
+			mStack.push_back( node.child2 );
+		}
+	}
+}
+
+int32_t AabbTree::allocateNode()
+{
+	int32_t node;
+	if( mFreeList >= 0 ) {
+		node = mFreeList;
+		mFreeList = mNodes[node].parent;
+	}
+	else {
+		node = (int32_t) mNodes.size();
+		mNodes.push_back( TreeNode() );
+	}
+
+	mNodes[node].parent = -1;
+	mNodes[node].child1 = -1;
+	mNodes[node].child2 = -1;
+	mNodes[node].height = 0;
+	mNodes[node].userData = 0;
+
+	return node;
+}
+
+void AabbTree::freeNode( int32_t node )
+{
+	mNodes[node].parent = mFreeList;
+	mNodes[node].height = -1;
+	mFreeList = node;
+}
+
+void AabbTree::insertLeaf( int32_t leaf )
+{
+	if( mRoot < 0 ) {
+		mRoot = leaf;
+		mNodes[mRoot].parent = -1;
+		return;
+	}
+
+	// find the best sibling, using the perimeter as cost
+	const Rectf bounds = mNodes[leaf].bounds;
+	int32_t index = mRoot;
+	while( ! mNodes[index].isLeaf() ) {
+		const int32_t child1 = mNodes[index].child1;
+		const int32_t child2 = mNodes[index].child2;
+
+		const float area = perimeter( mNodes[index].bounds );
+		const float combinedArea = perimeter( combine( mNodes[index].bounds, bounds ) );
+
+		// cost of creating a new parent for this node and the new leaf
+		const float cost = 2.0f * combinedArea;
+		// minimum cost of pushing the leaf further down the tree
+		const float inheritanceCost = 2.0f * ( combinedArea - area );
+
+		// cost of descending into each child
+		float cost1 = perimeter( combine( bounds, mNodes[child1].bounds ) ) + inheritanceCost;
+		if( ! mNodes[child1].isLeaf() )
+			cost1 -= perimeter( mNodes[child1].bounds );
+
+		float cost2 = perimeter( combine( bounds, mNodes[child2].bounds ) ) + inheritanceCost;
+		if( ! mNodes[child2].isLeaf() )
+			cost2 -= perimeter( mNodes[child2].bounds );
+
+		if( cost < cost1 && cost < cost2 )
+			break;
+
+		index = ( cost1 < cost2 ) ? child1 : child2;
+	}
+
+	// create a new parent
+	const int32_t sibling = index;
+	const int32_t oldParent = mNodes[sibling].parent;
+	const int32_t newParent = allocateNode();
+
+	mNodes[newParent].parent = oldParent;
+	mNodes[newParent].bounds = combine( bounds, mNodes[sibling].bounds );
+	mNodes[newParent].height = mNodes[sibling].height + 1;
+	mNodes[newParent].child1 = sibling;
+	mNodes[newParent].child2 = leaf;
+	mNodes[sibling].parent = newParent;
+	mNodes[leaf].parent = newParent;
+
+	if( oldParent >= 0 ) {
+		if( mNodes[oldParent].child1 == sibling )
+			mNodes[oldParent].child1 = newParent;
+		else
+			mNodes[oldParent].child2 = newParent;
+	}
+	else {
+		mRoot = newParent;
+	}
+
+	// walk back up the tree, fixing heights and bounds
+	index = mNodes[leaf].parent;
+	while( index >= 0 ) {
+		index = balance( index );
+
+		const int32_t child1 = mNodes[index].child1;
+		const int32_t child2 = mNodes[index].child2;
+
+		mNodes[index].height = 1 + math<int32_t>::max( mNodes[child1].height, mNodes[child2].height );
+		mNodes[index].bounds = combine( mNodes[child1].bounds, mNodes[child2].bounds );
+
+		index = mNodes[index].parent;
+	}
+}
+
+void AabbTree::removeLeaf( int32_t leaf )
+{
+	if( leaf == mRoot ) {
+		mRoot = -1;
+		return;
+	}
+
+	const int32_t parent = mNodes[leaf].parent;
+	const int32_t grandParent = mNodes[parent].parent;
+	const int32_t sibling = ( mNodes[parent].child1 == leaf ) ? mNodes[parent].child2 : mNodes[parent].child1;
+
+	if( grandParent >= 0 ) {
+		// destroy the parent and connect the sibling to the grand parent
+		if( mNodes[grandParent].child1 == parent )
+			mNodes[grandParent].child1 = sibling;
+		else
+			mNodes[grandParent].child2 = sibling;
+
+		mNodes[sibling].parent = grandParent;
+		freeNode( parent );
+
+		// adjust ancestor bounds
+		int32_t index = grandParent;
+		while( index >= 0 ) {
+			index = balance( index );
+
+			const int32_t child1 = mNodes[index].child1;
+			const int32_t child2 = mNodes[index].child2;
+
+			mNodes[index].bounds = combine( mNodes[child1].bounds, mNodes[child2].bounds );
+			mNodes[index].height = 1 + math<int32_t>::max( mNodes[child1].height, mNodes[child2].height );
+
+			index = mNodes[index].parent;
+		}
+	}
+	else {
+		mRoot = sibling;
+		mNodes[sibling].parent = -1;
+		freeNode( parent );
+	}
+}
+
+int32_t AabbTree::balance( int32_t iA )
+{
+	TreeNode &A = mNodes[iA];
+	if( A.isLeaf() || A.height < 2 )
+		return iA;
+
+	const int32_t iB = A.child1;
+	const int32_t iC = A.child2;
+	TreeNode &B = mNodes[iB];
+	TreeNode &C = mNodes[iC];
+
+	const int32_t balance = C.height - B.height;
+
+	// rotate C up
+	if( balance > 1 ) {
+		const int32_t iF = C.child1;
+		const int32_t iG = C.child2;
+		TreeNode &F = mNodes[iF];
+		TreeNode &G = mNodes[iG];
+
+		// swap A and C
+		C.child1 = iA;
+		C.parent = A.parent;
+		A.parent = iC;
+
+		// A's old parent should point to C
+		if( C.parent >= 0 ) {
+			if( mNodes[C.parent].child1 == iA )
+				mNodes[C.parent].child1 = iC;
+			else
+				mNodes[C.parent].child2 = iC;
+		}
+		else {
+			mRoot = iC;
+		}
+
+		// rotate
+		if( F.height > G.height ) {
+			C.child2 = iF;
+			A.child2 = iG;
+			G.parent = iA;
+			A.bounds = combine( B.bounds, G.bounds );
+			C.bounds = combine( A.bounds, F.bounds );
+
+			A.height = 1 + math<int32_t>::max( B.height, G.height );
+			C.height = 1 + math<int32_t>::max( A.height, F.height );
+		}
+		else {
+			C.child2 = iG;
+			A.child2 = iF;
+			F.parent = iA;
+			A.bounds = combine( B.bounds, F.bounds );
+			C.bounds = combine( A.bounds, G.bounds );
+
+			A.height = 1 + math<int32_t>::max( B.height, F.height );
+			C.height = 1 + math<int32_t>::max( A.height, G.height );
+		}
+
+		return iC;
+	}
+
+	// rotate B up
+	if( balance < -1 ) {
+		const int32_t iD = B.child1;
+		const int32_t iE = B.child2;
+		TreeNode &D = mNodes[iD];
+		TreeNode &E = mNodes[iE];
+
+		// swap A and B
+		B.child1 = iA;
+		B.parent = A.parent;
+		A.parent = iB;
+
+		// A's old parent should point to B
+		if( B.parent >= 0 ) {
+			if( mNodes[B.parent].child1 == iA )
+				mNodes[B.parent].child1 = iB;
+			else
+				mNodes[B.parent].child2 = iB;
+		}
+		else {
+			mRoot = iB;
+		}
+
+		// rotate
+		if( D.height > E.height ) {
+			B.child2 = iD;
+			A.child1 = iE;
+			E.parent = iA;
+			A.bounds = combine( C.bounds, E.bounds );
+			B.bounds = combine( A.bounds, D.bounds );
+
+			A.height = 1 + math<int32_t>::max( C.height, E.height );
+			B.height = 1 + math<int32_t>::max( A.height, D.height );
+		}
+		else {
+			B.child2 = iE;
+			A.child1 = iD;
+			D.parent = iA;
+			A.bounds = combine( C.bounds, D.bounds );
+			B.bounds = combine( A.bounds, E.bounds );
+
+			A.height = 1 + math<int32_t>::max( C.height, D.height );
+			B.height = 1 + math<int32_t>::max( A.height, E.height );
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
+
+Rectf AabbTree::combine( const Rectf &a, const Rectf &b )
+{
+	return Rectf( math<float>::min( a.x1, b.x1 ), math<float>::min( a.y1, b.y1 ),
+		math<float>::max( a.x2, b.x2 ), math<float>::max( a.y2, b.y2 ) );
+}
+
+bool AabbTree::contains( const Rectf &outer, const Rectf &inner )
+{
+	return outer.x1 <= inner.x1 && outer.y1 <= inner.y1 && outer.x2 >= inner.x2 && outer.y2 >= inner.y2;
+}
+
+bool AabbTree::overlaps( const Rectf &a, const Rectf &b )
+{
+	return a.x1 <= b.x2 && a.x2 >= b.x1 && a.y1 <= b.y2 && a.y2 >= b.y1;
+}
+
+} } // namespace ph::nodes
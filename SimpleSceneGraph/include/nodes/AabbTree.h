@@ -0,0 +1,100 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Rect.h"
+#include "cinder/Vector.h"
+
+#include <vector>
+
+namespace ph { namespace nodes {
+
+//! Dynamic bounding volume hierarchy of axis aligned rectangles, kept balanced with tree rotations.
+//! Each proxy stores a slightly enlarged ("fat") rectangle, so small movements don't require the
+//! tree to be modified.
+class AabbTree
+{
+public:
+	//! margin in pixels added to each side of a proxy's rectangle
+	static const float	kMargin;
+public:
+	AabbTree(void);
+	~AabbTree(void) {}
+
+	//! adds a rectangle to the tree and returns its proxy id
+	int32_t		createProxy( const ci::Rectf &bounds, uint32_t userData );
+	//! removes a proxy from the tree
+	void		destroyProxy( int32_t proxy );
+	//! moves a proxy, returns TRUE if the tree had to be modified
+	bool		moveProxy( int32_t proxy, const ci::Rectf &bounds );
+
+	//! returns the data that was passed to createProxy()
+	uint32_t			getUserData( int32_t proxy ) const { return mNodes[proxy].userData; }
+	//! returns the fat rectangle of a proxy
+	const ci::Rectf&	getFatBounds( int32_t proxy ) const { return mNodes[proxy].bounds; }
+
+	//! appends the user data of all proxies whose fat rectangle contains the point
+	void		query( const ci::Vec2f &pt, std::vector<uint32_t> *result ) const;
+	//! appends the user data of all proxies whose fat rectangle overlaps the rectangle
+	void		query( const ci::Rectf &bounds, std::vector<uint32_t> *result ) const;
+
+	//! returns the height of the tree
+	int32_t		getHeight() const { return (mRoot < 0) ? 0 : mNodes[mRoot].height; }
+	//! returns the number of proxies
+	size_t		size() const { return mProxyCount; }
+private:
+	struct TreeNode {
+		bool		isLeaf() const { return child1 < 0; }
+
+		ci::Rectf	bounds;
+		uint32_t	userData;
+		int32_t		parent;		// also used as 'next' in the free list
+		int32_t		child1;
+		int32_t		child2;
+		int32_t		height;		// leaf = 0, free = -1
+	};
+
+	int32_t		allocateNode();
+	void		freeNode( int32_t node );
+
+	void		insertLeaf( int32_t leaf );
+	void		removeLeaf( int32_t leaf );
+	//! performs a left or right rotation if the node is imbalanced, returns the new root of the subtree
+	int32_t		balance( int32_t node );
+
+	static ci::Rectf	combine( const ci::Rectf &a, const ci::Rectf &b );
+	static float		perimeter( const ci::Rectf &r ) { return 2.0f * ( (r.x2 - r.x1) + (r.y2 - r.y1) ); }
+	static bool			contains( const ci::Rectf &outer, const ci::Rectf &inner );
+	static bool			overlaps( const ci::Rectf &a, const ci::Rectf &b );
+private:
+	std::vector<TreeNode>	mNodes;
+	int32_t					mRoot;
+	int32_t					mFreeList;
+	size_t					mProxyCount;
+
+	//! traversal stack, kept to avoid allocations
+	mutable std::vector<int32_t>	mStack;
+};
+
+} } // namespace ph::nodes
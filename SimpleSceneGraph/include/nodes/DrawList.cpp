@@ -0,0 +1,229 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "nodes/DrawList.h"
+#include "nodes/Node.h"
+
+#include "cinder/gl/gl.h"
+
+#include <algorithm>
+
+namespace ph { namespace nodes {
+
+using namespace ci;
+using namespace std;
+
+//! commands that may not be sorted are kept at the end of the list, in their drawing order
+static const uint64_t kUnsorted = uint64_t(1) << 63;
+
+void GlDrawBackend::setState( const DrawCommand *previous, const DrawCommand &next )
+{
+	if(previous) previous->node->postdraw();
+	next.node->predraw();
+}
+
+void GlDrawBackend::end( const DrawCommand *last )
+{
+	if(last) last->node->postdraw();
+}
+
+void GlDrawBackend::push( const DrawCommand &cmd )
+{
+	cmd.node->predraw();
+}
+
+void GlDrawBackend::pop( const DrawCommand &cmd )
+{
+	cmd.node->postdraw();
+}
+
+void GlDrawBackend::draw( const DrawCommand &cmd, const Matrix44f &world )
+{
+	gl::pushModelView();
+	gl::multModelView( world );
+
+	cmd.node->draw();
+
+	gl::popModelView();
+}
+
+void DrawList::compile( Node *root )
+{
+	// a different tree has to be compiled completely
+	const bool invalid = (root != mRoot);
+	mRoot = root;
+
+	if(!root) {
+		mCommands.clear();
+		mOrder.clear();
+		return;
+	}
+
+	if( !invalid && !(root->mDrawFlags & (Node::DRAW_INVALID | Node::DRAW_CHILD_INVALID)) )
+		return;
+
+	mBuffer.clear();
+	mBuffer.reserve( mCommands.size() );
+
+	compile( root, 0, invalid );
+
+	mCommands.swap( mBuffer );
+	mIsSortInvalid = true;
+}
+
+void DrawList::compile( Node *node, uint32_t previous, bool invalid )
+{
+	const uint32_t first = (uint32_t) mBuffer.size();
+
+	invalid |= (node->mDrawFlags & Node::DRAW_INVALID) != 0;
+
+	if( !invalid && !(node->mDrawFlags & Node::DRAW_CHILD_INVALID) ) {
+		// nothing has changed, copy the commands of this subtree from the previous list
+		mBuffer.insert( mBuffer.end(), mCommands.begin() + previous, mCommands.begin() + previous + node->mDrawCount );
+	}
+	else {
+		if( node->mIsVisible ) {
+			DrawCommand cmd;
+			cmd.transform = node->mTransformHandle;
+			cmd.state = node->getStateKey();
+			cmd.mesh = node->getMeshKey();
+			cmd.depth = 0;
+			cmd.count = 1;
+			cmd.node = node;
+
+			// the highest bit of the state is reserved
+			if( node->isSortable() )
+				cmd.sortKey = ( uint64_t(cmd.state & 0x7FFFFFFF) << 32 ) | cmd.mesh;
+			else
+				cmd.sortKey = kUnsorted;
+
+			mBuffer.push_back( cmd );
+
+			for(Node *child=node->getFirstChild();child;child=child->getNextSibling()) {
+				// the offset of each child is relative to its parent
+				const uint32_t offset = (uint32_t) mBuffer.size() - first;
+				compile( child, previous + child->mDrawOffset, invalid );
+				child->mDrawOffset = offset;
+			}
+
+			mBuffer[first].count = (uint32_t) mBuffer.size() - first;
+		}
+
+		node->mDrawFlags = 0;
+	}
+
+	node->mDrawCount = (uint32_t) mBuffer.size() - first;
+}
+
+void DrawList::replay( DrawBackend *backend )
+{
+	if( mIsSortInvalid ) sort();
+
+	// make sure all world transforms are up to date
+	transforms().update();
+
+	backend->begin();
+
+	const DrawCommand *previous = NULL;
+
+	// sorted commands come first, grouped by state
+	std::vector<uint32_t>::const_iterator itr;
+	for(itr=mOrder.begin();itr!=mOrder.end();++itr) {
+		const DrawCommand &cmd = mCommands[*itr];
+		if( cmd.sortKey & kUnsorted ) break;
+
+		// a state key of zero means the node's state can not be shared
+		if( !previous || cmd.state == 0 || cmd.state != previous->state )
+			backend->setState( previous, cmd );
+
+		if( !cmd.node->mIsSetup ) {
+			cmd.node->setup();
+			cmd.node->mIsSetup = true;
+		}
+
+		backend->draw( cmd, transforms().getWorld( cmd.transform ) );
+
+		previous = &cmd;
+	}
+
+	backend->end( previous );
+
+	// unsorted commands follow in drawing order, so each node's state can be nested around its subtree
+	mStack.clear();
+	for(;itr!=mOrder.end();++itr) {
+		const DrawCommand &cmd = mCommands[*itr];
+
+		// leave the subtrees that end before this command
+		while( !mStack.empty() && mCommands[mStack.back()].depth + mCommands[mStack.back()].count <= cmd.depth ) {
+			backend->pop( mCommands[mStack.back()] );
+			mStack.pop_back();
+		}
+
+		if( !cmd.node->mIsSetup ) {
+			cmd.node->setup();
+			cmd.node->mIsSetup = true;
+		}
+
+		backend->push( cmd );
+		backend->draw( cmd, transforms().getWorld( cmd.transform ) );
+
+		mStack.push_back( *itr );
+	}
+
+	while( !mStack.empty() ) {
+		backend->pop( mCommands[mStack.back()] );
+		mStack.pop_back();
+	}
+}
+
+void DrawList::clear()
+{
+	mCommands.clear();
+	mOrder.clear();
+	mRoot = NULL;
+}
+
+void DrawList::sort()
+{
+	const size_t count = mCommands.size();
+
+	mOrder.resize( count );
+	for(size_t i=0;i<count;++i) {
+		DrawCommand &cmd = mCommands[i];
+		cmd.depth = (uint32_t) i;
+
+		// commands that may not be sorted keep their drawing order
+		if( cmd.sortKey & kUnsorted )
+			cmd.sortKey = kUnsorted | i;
+
+		mOrder[i] = (uint32_t) i;
+	}
+
+	// commands with the same state and mesh stay in drawing order
+	const std::vector<DrawCommand> &commands = mCommands;
+	std::stable_sort( mOrder.begin(), mOrder.end(), 
+		[&commands](uint32_t a, uint32_t b) { return commands[a].sortKey < commands[b].sortKey; } );
+
+	mIsSortInvalid = false;
+}
+
+} } // namespace ph::nodes
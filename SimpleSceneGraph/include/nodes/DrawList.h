@@ -0,0 +1,130 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Matrix.h"
+
+#include <vector>
+
+namespace ph { namespace nodes {
+
+class Node;
+
+//! A single draw call, created for each visible node by DrawList::compile()
+struct DrawCommand {
+	uint64_t	sortKey;
+	//! handle of the node's world transform in the transform store
+	uint32_t	transform;
+	//! render state (shader, material) key, see Node::getStateKey()
+	uint32_t	state;
+	//! geometry key, see Node::getMeshKey()
+	uint32_t	mesh;
+	//! position in the drawing order of the tree
+	uint32_t	depth;
+	//! number of commands of the node and its decendants
+	uint32_t	count;
+	//!
+	Node		*node;
+};
+
+//! Executes the commands of a draw list
+class DrawBackend
+{
+public:
+	virtual ~DrawBackend(void) {}
+
+	//! called before the first command
+	virtual void	begin() {}
+	//! called when the render state of the sorted commands changes. 'previous' is the last command using the old state, or NULL.
+	virtual void	setState( const DrawCommand *previous, const DrawCommand &next ) = 0;
+	//! called after the last sorted command, which may be NULL if there were none
+	virtual void	end( const DrawCommand *last ) {}
+	//! called before an unsorted command. Unsorted commands are replayed in the drawing order of the tree, 
+	//! after all sorted commands, and the state of a node applies to all its unsorted decendants.
+	virtual void	push( const DrawCommand &cmd ) {}
+	//! called after the last unsorted command of the node's subtree
+	virtual void	pop( const DrawCommand &cmd ) {}
+	//! draws a single command
+	virtual void	draw( const DrawCommand &cmd, const ci::Matrix44f &world ) = 0;
+};
+
+//! Draws the nodes using OpenGL. For nodes that are not sortable, predraw() and postdraw() are nested
+//! around their subtree, like treeDraw() does. Sortable nodes are drawn first and grouped by state:
+//! predraw() is only called on the first node of a group and postdraw() on the last one, and they are 
+//! not drawn inside the predraw() and postdraw() of their ancestors.
+class GlDrawBackend
+	: public DrawBackend
+{
+public:
+	virtual void	setState( const DrawCommand *previous, const DrawCommand &next );
+	virtual void	end( const DrawCommand *last );
+	virtual void	push( const DrawCommand &cmd );
+	virtual void	pop( const DrawCommand &cmd );
+	virtual void	draw( const DrawCommand &cmd, const ci::Matrix44f &world );
+};
+
+//! Flattens a tree of visible nodes into a list of draw commands, sorted by render state. Only the
+//! subtrees that have been invalidated (see Node::invalidateDrawList) are compiled again, the commands
+//! of all other subtrees are copied from the previous list. Transformations are looked up when
+//! the list is replayed, so moving a node does not require the list to be compiled.
+class DrawList
+{
+public:
+	DrawList(void) : mRoot(NULL), mIsSortInvalid(false) {}
+	~DrawList(void) {}
+
+	//! updates the list if the tree has changed
+	void	compile( Node *root );
+	//! draws all commands
+	void	replay( DrawBackend *backend );
+	//! compiles and replays the list in one go
+	void	draw( Node *root, DrawBackend *backend ) { compile(root); replay(backend); }
+
+	//! forces the list to be rebuilt completely by the next call to compile()
+	void	clear();
+
+	//! returns the commands, in the drawing order of the tree
+	const std::vector<DrawCommand>&	getCommands() const { return mCommands; }
+	//! returns the indices of the commands, in the order in which they are replayed
+	const std::vector<uint32_t>&	getOrder() const { return mOrder; }
+private:
+	//! compiles a subtree, 'previous' is the index of its commands in the previous list
+	void	compile( Node *node, uint32_t previous, bool invalid );
+	//! sorts the commands by render state, preserving the drawing order of commands that are not sortable
+	void	sort();
+private:
+	//! commands in the drawing order of the tree
+	std::vector<DrawCommand>	mCommands;
+	std::vector<DrawCommand>	mBuffer;
+
+	//! command indices in replay order
+	std::vector<uint32_t>		mOrder;
+	//! unsorted commands whose subtree is being replayed
+	std::vector<uint32_t>		mStack;
+
+	Node						*mRoot;
+	bool						mIsSortInvalid;
+};
+
+} } // namespace ph::nodes
@@ -21,6 +21,8 @@
 */
 
 #include "nodes/Node.h"
+#include "nodes/NodeSnapshot.h"
+#include "nodes/UpdatePool.h"
 #include "cinder/app/AppBasic.h"
 
 using namespace ci;
@@ -30,18 +32,29 @@ using namespace std;
 namespace ph { namespace nodes {
 
 int				Node::nodeCount = 0;
-unsigned int	Node::uuidCount = 1;
 NodeMap			Node::uuidLookup;
 
+AabbTree		Node::spatialIndex;
+uint32_t		Node::structureVersion = 0;
+const Node*		Node::drawOrderRoot = NULL;
+uint32_t		Node::drawOrderVersion = 0;
+
+std::vector<NodeWeakRef>	Node::hovered;
+NodeWeakRef					Node::captured;
+
+//! nodes without bounds are stored in the spatial index with very large bounds
+static const float kUnbounded = 1.0e30f;
+
 Node::Node(void)
-	: mUuid(uuidCount), 
-	mIsVisible(true), mIsClickable(true), mIsSelected(false), mIsSetup(false),
-	mIsTransformInvalidated(true)
+	: mUuid( uuidLookup.insert(this) ), 
+	mIsVisible(true), mIsClickable(true), mIsSelected(false),
+	mLastChild(NULL), mPrevSibling(NULL), mNumChildren(0), mIsSetup(false),
+	mTransformHandle( transforms().create(this) ), mProxy(-1), mDrawOrder(0),
+	mDrawFlags(DRAW_INVALID), mDrawOffset(0), mDrawCount(0), mTypes(0), mKnownTypes(0)
 {
 	// default constructor for [Node]
 	nodeCount++;
-	uuidCount++;
-	
+
 	mTransform.setToIdentity();
 	mWorldTransform.setToIdentity();
 }
@@ -56,6 +69,40 @@ Node::~Node(void)
 
 	// remove from lookup table
 	uuidLookup.erase(mUuid);
+
+	// release transform
+	transforms().destroy(mTransformHandle);
+
+	// remove from spatial index
+	if(mProxy >= 0) spatialIndex.destroyProxy(mProxy);
+}
+
+void Node::setParent(NodeRef node)
+{
+	// structural changes made during a parallel update are deferred
+	if( UpdatePool::isDeferring() ) {
+		NodeRef self = shared_from_this();
+		UpdatePool::defer( [=]() { self->setParent(node); } );
+		return;
+	}
+
+	mParent = NodeWeakRef(node);
+	structureVersion++;
+
+	// the node has to be compiled again in its new location
+	invalidateDrawList();
+
+	transforms().setParent( mTransformHandle, node ? node->mTransformHandle : TransformStore::kInvalid );
+}
+
+NodeRef Node::findNode(unsigned int uuid)
+{
+	Node **node = uuidLookup.find(uuid);
+	if(!node) return NodeRef();
+
+	// nodes that are not owned by a shared pointer can not be returned
+	try { return (*node)->shared_from_this(); }
+	catch( const boost::bad_weak_ptr & ) { return NodeRef(); }
 }
 
 void Node::removeFromParent()
@@ -66,54 +113,69 @@ void Node::removeFromParent()
 
 void Node::addChild(NodeRef node)
 {
+	if( UpdatePool::isDeferring() ) {
+		NodeRef self = shared_from_this();
+		UpdatePool::defer( [=]() { self->addChild(node); } );
+		return;
+	}
+
 	if(node && !hasChild(node))
 	{
 		// remove child from current parent
 		NodeRef parent = node->getParent();
 		if(parent) parent->removeChild(node);
 
-		// add to children
-		mChildren.push_back(node);
+		// add to the end of the list of children
+		linkChild(node, mLastChild);
+		invalidateDrawList();
 
 		// set parent
 		node->setParent( shared_from_this() );
-
-		// store nodes in lookup table if not done yet
-		uuidLookup[mUuid] = NodeWeakRef( shared_from_this() );
-		uuidLookup[node->mUuid] = NodeWeakRef( node );
 	}
 }
 
 void Node::removeChild(NodeRef node)
 {
-	NodeList::iterator itr = std::find(mChildren.begin(), mChildren.end(), node);
-	if(itr != mChildren.end()) 
+	if( UpdatePool::isDeferring() ) {
+		NodeRef self = shared_from_this();
+		UpdatePool::defer( [=]() { self->removeChild(node); } );
+		return;
+	}
+
+	if(hasChild(node)) 
 	{
 		// reset parent
-		(*itr)->setParent( NodeRef() );
+		node->setParent( NodeRef() );
 
 		// remove from children
-		mChildren.erase(itr);
+		unlinkChild( node.get() );
+		invalidateDrawList();
 	}
 }
 
 void Node::removeChildren()
 {
-	NodeList::iterator itr;
-	for(itr=mChildren.begin();itr!=mChildren.end();)
+	if( UpdatePool::isDeferring() ) {
+		NodeRef self = shared_from_this();
+		UpdatePool::defer( [=]() { self->removeChildren(); } );
+		return;
+	}
+
+	while(mFirstChild)
 	{
 		// reset parent
-		(*itr)->setParent( NodeRef() );
+		mFirstChild->setParent( NodeRef() );
 
-		// remove from children
-		itr = mChildren.erase(itr);
+		// remove from children, one at a time to prevent deep recursion
+		unlinkChild( mFirstChild.get() );
 	}
+
+	invalidateDrawList();
 }
 
 bool Node::hasChild(NodeRef node) const 
 {
-	NodeList::const_iterator itr = std::find(mChildren.begin(), mChildren.end(), node);
-	return(itr != mChildren.end());
+	return node && node->mParent.lock().get() == this;
 }
 
 void Node::putOnTop()
@@ -124,14 +186,18 @@ void Node::putOnTop()
 
 void Node::putOnTop(NodeRef node)
 {
-	// remove from list
-	NodeList::iterator itr = std::find(mChildren.begin(), mChildren.end(), node);
-	if(itr==mChildren.end()) return;
+	if( UpdatePool::isDeferring() ) {
+		NodeRef self = shared_from_this();
+		UpdatePool::defer( [=]() { self->putOnTop(node); } );
+		return;
+	}
 
-	mChildren.erase(itr);
+	if(!hasChild(node) || mLastChild == node.get()) return;
 
-	// add to end of list
-	mChildren.push_back(node);
+	// move to the end of the list
+	linkChild( unlinkChild( node.get() ), mLastChild );
+	structureVersion++;
+	invalidateDrawList();
 }
 
 bool Node::isOnTop() const 
@@ -143,9 +209,7 @@ bool Node::isOnTop() const
 
 bool Node::isOnTop(NodeConstRef node) const 
 {
-	if(mChildren.empty()) return false;
-	if(mChildren.back() == node) return true;
-	return false;
+	return node && mLastChild == node.get();
 }
 
 void Node::moveToBottom()
@@ -156,14 +220,37 @@ void Node::moveToBottom()
 
 void Node::moveToBottom(NodeRef node)
 {
-	// remove from list
-	NodeList::iterator itr = std::find(mChildren.begin(), mChildren.end(), node);
-	if(itr==mChildren.end()) return;
+	if( UpdatePool::isDeferring() ) {
+		NodeRef self = shared_from_this();
+		UpdatePool::defer( [=]() { self->moveToBottom(node); } );
+		return;
+	}
 
-	mChildren.erase(itr);
+	if(!hasChild(node) || mFirstChild == node) return;
 
-	// add to start of list
-	mChildren.push_front(node);
+	// move to the start of the list
+	linkChild( unlinkChild( node.get() ), NULL );
+	structureVersion++;
+	invalidateDrawList();
+}
+
+void Node::invalidateDrawList()
+{
+	// the ancestors may be shared with other subtrees during a parallel update
+	if( UpdatePool::isDeferring() ) {
+		NodeRef self = shared_from_this();
+		UpdatePool::defer( [=]() { self->invalidateDrawList(); } );
+		return;
+	}
+
+	mDrawFlags |= DRAW_INVALID;
+
+	// let the ancestors know they contain an invalid subtree
+	NodeRef node = mParent.lock();
+	while( node && !(node->mDrawFlags & DRAW_CHILD_INVALID) ) {
+		node->mDrawFlags |= DRAW_CHILD_INVALID;
+		node = node->mParent.lock();
+	}
 }
 
 NodeRef Node::findChild(unsigned int uuid)
@@ -171,31 +258,81 @@ NodeRef Node::findChild(unsigned int uuid)
 	if(mUuid == uuid) return shared_from_this();
 
 	NodeRef node;
-	NodeList::iterator itr;
-	for(itr=mChildren.begin();itr!=mChildren.end();++itr) {
-		node = (*itr)->findChild(uuid);
+	for(Node *child=getFirstChild();child;child=child->getNextSibling()) {
+		node = child->findChild(uuid);
 		if(node) return node;
 	}
 
 	return node;
 }
 
+void Node::linkChild( NodeRef node, Node *after )
+{
+	node->mPrevSibling = after;
+
+	if(after) {
+		node->mNextSibling = after->mNextSibling;
+		after->mNextSibling = node;
+	}
+	else {
+		node->mNextSibling = mFirstChild;
+		mFirstChild = node;
+	}
+
+	if(node->mNextSibling) node->mNextSibling->mPrevSibling = node.get();
+	else mLastChild = node.get();
+
+	mNumChildren++;
+}
+
+NodeRef Node::unlinkChild( Node *node )
+{
+	// the previous sibling (or this node) owns the child
+	Node *prev = node->mPrevSibling;
+	NodeRef result = prev ? prev->mNextSibling : mFirstChild;
+
+	if(prev) prev->mNextSibling = node->mNextSibling;
+	else mFirstChild = node->mNextSibling;
+
+	if(node->mNextSibling) node->mNextSibling->mPrevSibling = prev;
+	else mLastChild = prev;
+
+	node->mNextSibling.reset();
+	node->mPrevSibling = NULL;
+
+	mNumChildren--;
+
+	return result;
+}
+
+uint64_t Node::nextTypeBit()
+{
+	static int count = 0;
+	return (count < 64) ? (uint64_t(1) << count++) : 0;
+}
+
 void Node::treeSetup()
 {
 	setup();
 
-	NodeList nodes(mChildren);
-	NodeList::iterator itr;
-	for(itr=nodes.begin();itr!=nodes.end();++itr)
-		(*itr)->treeSetup();
+	// keep a reference to the next sibling, in case a child removes itself
+	NodeRef node = mFirstChild;
+	while(node) {
+		NodeRef next = node->mNextSibling;
+		node->treeSetup();
+		node = next;
+	}
 }
 
 void Node::treeShutdown()
 {
-	NodeList nodes(mChildren);
-	NodeList::reverse_iterator itr;
-	for(itr=nodes.rbegin();itr!=nodes.rend();++itr)
-		(*itr)->treeShutdown();
+	// keep a reference to the previous sibling, in case a child removes itself
+	NodeRef node = getLastChildRef();
+	while(node) {
+		NodeRef prev = node->getPrevSiblingRef();
+		node->treeShutdown();
+		node = prev;
+	}
 
 	shutdown();
 }
@@ -206,10 +343,45 @@ void Node::treeUpdate(double elapsed)
 	update(elapsed);
 
 	// update this node's children
-	NodeList nodes(mChildren);
-	NodeList::iterator itr;
-	for(itr=nodes.begin();itr!=nodes.end();++itr)
-		(*itr)->treeUpdate(elapsed);
+	// keep a reference to the next sibling, in case a child removes itself
+	NodeRef node = mFirstChild;
+	while(node) {
+		NodeRef next = node->mNextSibling;
+		node->treeUpdate(elapsed);
+		node = next;
+	}
+}
+
+void Node::treeUpdate(UpdatePool &pool, double elapsed)
+{
+	std::vector<NodeRef> subtrees;
+	collectUpdate( elapsed, &subtrees );
+
+	// world transforms are recalculated after the update, so the pool's threads can safely read them
+	transforms().setDeferred(true);
+	try {
+		pool.update( subtrees, elapsed );
+	}
+	catch( ... ) {
+		transforms().setDeferred(false);
+		throw;
+	}
+	transforms().setDeferred(false);
+}
+
+void Node::collectUpdate( double elapsed, std::vector<NodeRef> *subtrees )
+{
+	update(elapsed);
+
+	NodeRef node = mFirstChild;
+	while(node) {
+		NodeRef next = node->mNextSibling;
+		if( node->isUpdateParallelSafe() )
+			subtrees->push_back(node);
+		else
+			node->collectUpdate(elapsed, subtrees);
+		node = next;
+	}
 }
 
 void Node::treeDraw()
@@ -222,25 +394,21 @@ void Node::treeDraw()
 		mIsSetup = true;
 	}
 
-	// update transform matrix by calling derived class's function
-	if(mIsTransformInvalidated) transform();
-
 	// let derived class know we are about to draw stuff
 	predraw();
 
 	// apply transform
 	gl::pushModelView();
 
-	// usual way to update modelview matrix
-	gl::multModelView( mTransform );
+	// usual way to update modelview matrix (the transform store will call transform() if needed)
+	gl::multModelView( getTransform() );
 
 	// draw this node by calling derived class
 	draw();
 
 	// draw this node's children
-	NodeList::iterator itr;
-	for(itr=mChildren.begin();itr!=mChildren.end();++itr)
-		(*itr)->treeDraw();
+	for(Node *node=getFirstChild();node;node=node->getNextSibling())
+		node->treeDraw();
 	
 	// restore transform
 	gl::popModelView();
@@ -249,38 +417,60 @@ void Node::treeDraw()
 	postdraw();
 }
 
-// Note: the scene graph implementation is currently not fast enough to support mouseMove events
-//  when there are more than a few nodes. 
 bool Node::treeMouseMove( MouseEvent event )
 {
 	if(!mIsVisible) return false;
 
-	// test children first, from top to bottom
-	NodeList nodes(mChildren);
-	NodeList::reverse_iterator itr;
-	bool handled = false;
-	for(itr=nodes.rbegin();itr!=nodes.rend() && !handled;++itr)
-		handled = (*itr)->treeMouseMove(event);
+	// find the nodes under the mouse, top-most first
+	NodeList nodes;
+	pick( event.getPos(), &nodes );
 
-	// if not handled, test this node
-	if(!handled) handled = mouseMove(event);
+	// also notify the nodes that were under the mouse during the previous event,
+	// so they know the mouse has left them
+	std::vector<NodeWeakRef> previous;
+	previous.swap(hovered);
+
+	NodeList::iterator itr;
+	for(itr=nodes.begin();itr!=nodes.end();++itr)
+		hovered.push_back( NodeWeakRef(*itr) );
+
+	const size_t count = nodes.size();
+	std::vector<NodeWeakRef>::iterator pitr;
+	for(pitr=previous.begin();pitr!=previous.end();++pitr) {
+		NodeRef node = pitr->lock();
+		if( node && node->isVisibleFrom(this) && std::find(nodes.begin(), nodes.begin() + count, node) == nodes.begin() + count )
+			nodes.push_back(node);
+	}
+
+	// restore the drawing order
+	if( nodes.size() > count )
+		std::stable_sort( nodes.begin(), nodes.end(), [](const NodeRef &a, const NodeRef &b) { return a->mDrawOrder > b->mDrawOrder; } );
+
+	bool handled = false;
+	for(itr=nodes.begin();itr!=nodes.end() && !handled;++itr)
+		handled = (*itr)->mouseMove(event);
 
 	return handled;
-}//*/
+}
 
 bool Node::treeMouseDown( MouseEvent event )
 {
 	if(!mIsVisible) return false;
 
-	// test children first, from top to bottom
-	NodeList nodes(mChildren);
-	NodeList::reverse_iterator itr;
+	// find the nodes under the mouse, top-most first
+	NodeList nodes;
+	pick( event.getPos(), &nodes );
+
+	captured.reset();
+
+	NodeList::iterator itr;
 	bool handled = false;
-	for(itr=nodes.rbegin();itr!=nodes.rend()&&!handled;++itr)
-		handled = (*itr)->treeMouseDown(event);
+	for(itr=nodes.begin();itr!=nodes.end()&&!handled;++itr) {
+		handled = (*itr)->mouseDown(event);
 
-	// if not handled, test this node
-	if(!handled) handled = mouseDown(event);
+		// the node that handled the event will receive all drag events
+		if(handled) captured = NodeWeakRef(*itr);
+	}
 
 	return handled;
 }
@@ -289,15 +479,19 @@ bool Node::treeMouseDrag( MouseEvent event )
 {
 	if(!mIsVisible) return false;
 
-	// test children first, from top to bottom
-	NodeList nodes(mChildren);
-	NodeList::reverse_iterator itr;
-	bool handled = false;
-	for(itr=nodes.rbegin();itr!=nodes.rend()&&!handled;++itr)
-		handled = (*itr)->treeMouseDrag(event);
+	// the node that handled the mouseDown event receives the event, even if the mouse has left it
+	NodeRef node = captured.lock();
+	if(node && node->isVisibleFrom(this)) 
+		return node->mouseDrag(event);
 
-	// if not handled, test this node
-	if(!handled) handled = mouseDrag(event);
+	// otherwise, pass it to the nodes under the mouse
+	NodeList nodes;
+	pick( event.getPos(), &nodes );
+
+	NodeList::iterator itr;
+	bool handled = false;
+	for(itr=nodes.begin();itr!=nodes.end()&&!handled;++itr)
+		handled = (*itr)->mouseDrag(event);
 
 	return handled;
 }
@@ -306,19 +500,105 @@ bool Node::treeMouseUp( MouseEvent event )
 {
 	if(!mIsVisible) return false;
 
-	// test children first, from top to bottom
-	NodeList nodes(mChildren);
-	NodeList::reverse_iterator itr;
-	bool handled = false;
-	for(itr=nodes.rbegin();itr!=nodes.rend()&&!handled;++itr)
-		(*itr)->treeMouseUp(event); // don't care about 'handled' for now
+	NodeList nodes;
+	pick( event.getPos(), &nodes );
 
-	// if not handled, test this node
-	if(!handled) handled = mouseUp(event);
+	// the node that handled the mouseDown event receives the event, even if the mouse has left it
+	NodeRef node = captured.lock();
+	if(node && node->isVisibleFrom(this) && std::find(nodes.begin(), nodes.end(), node) == nodes.end())
+		nodes.push_front(node);
+
+	captured.reset();
+
+	NodeList::iterator itr;
+	bool handled = false;
+	for(itr=nodes.begin();itr!=nodes.end();++itr)
+		handled |= (*itr)->mouseUp(event); // don't stop if handled, so all nodes can reset their state
 
 	return handled;
 }
 
+void Node::pick( const Vec2f &pt, NodeList *nodes )
+{
+	// make sure the spatial index and the drawing order are up to date
+	transforms().update();
+	updateDrawOrder();
+
+	// The point is specified in world space, which equals screen space if the root is drawn 
+	// using gl::setMatricesWindow(). The same assumption is made by Node2D::screenToParent().
+	static std::vector<uint32_t> candidates;
+	candidates.clear();
+	spatialIndex.query( pt, &candidates );
+
+	// the index stores enlarged bounds, so test the actual bounds of the candidates
+	std::vector< std::pair<uint32_t, Node*> > hits;
+	std::vector<uint32_t>::const_iterator itr;
+	for(itr=candidates.begin();itr!=candidates.end();++itr) {
+		Node **node = uuidLookup.find(*itr);
+		if(!node || !(*node)->isVisibleFrom(this)) continue;
+
+		Rectf bounds;
+		if( (*node)->getWorldBounds(&bounds) && !bounds.contains(pt) ) continue;
+
+		hits.push_back( std::make_pair( (*node)->mDrawOrder, *node ) );
+	}
+
+	// nodes that are drawn last are on top
+	std::sort( hits.begin(), hits.end(), 
+		[](const std::pair<uint32_t, Node*> &a, const std::pair<uint32_t, Node*> &b) { return a.first > b.first; } );
+
+	std::vector< std::pair<uint32_t, Node*> >::const_iterator hitr;
+	for(hitr=hits.begin();hitr!=hits.end();++hitr)
+		nodes->push_back( hitr->second->shared_from_this() );
+}
+
+void Node::worldTransformChanged() const
+{
+	Rectf bounds;
+	if( !getWorldBounds(&bounds) )
+		bounds = Rectf( -kUnbounded, -kUnbounded, kUnbounded, kUnbounded );
+
+	if(mProxy < 0)
+		mProxy = spatialIndex.createProxy( bounds, mUuid );
+	else
+		spatialIndex.moveProxy( mProxy, bounds );
+}
+
+void Node::updateDrawOrder()
+{
+	if( drawOrderRoot == this && drawOrderVersion == structureVersion )
+		return;
+
+	uint32_t order = 0;
+	assignDrawOrder( &order );
+
+	drawOrderRoot = this;
+	drawOrderVersion = structureVersion;
+}
+
+void Node::assignDrawOrder( uint32_t *order )
+{
+	// parents are drawn before their children, children in the order of the list
+	mDrawOrder = (*order)++;
+
+	for(Node *node=getFirstChild();node;node=node->getNextSibling())
+		node->assignDrawOrder( order );
+}
+
+bool Node::isVisibleFrom( const Node *root ) const
+{
+	const Node *node = this;
+	while(node) {
+		if(!node->mIsVisible) return false;
+		if(node == root) return true;
+
+		node = node->mParent.lock().get();
+	}
+
+	// not part of the tree
+	return false;
+}
+
 bool Node::mouseMove( MouseEvent event )
 {
 	return false; 
@@ -349,11 +629,13 @@ bool Node::treeKeyDown( KeyEvent event )
 	if(!mIsVisible) return false;
 
 	// test children first, from top to bottom
-	NodeList nodes(mChildren);
-	NodeList::reverse_iterator itr;
+	NodeRef node = getLastChildRef();
 	bool handled = false;
-	for(itr=nodes.rbegin();itr!=nodes.rend()&&!handled;++itr)
-		handled = (*itr)->treeKeyDown(event);
+	while(node && !handled) {
+		NodeRef prev = node->getPrevSiblingRef();
+		handled = node->treeKeyDown(event);
+		node = prev;
+	}
 
 	// if not handled, test this node
 	if(!handled) handled = keyDown(event);
@@ -366,11 +648,13 @@ bool Node::treeKeyUp( KeyEvent event )
 	if(!mIsVisible) return false;
 
 	// test children first, from top to bottom
-	NodeList nodes(mChildren);
-	NodeList::reverse_iterator itr;
+	NodeRef node = getLastChildRef();
 	bool handled = false;
-	for(itr=nodes.rbegin();itr!=nodes.rend()&&!handled;++itr)
-		handled = (*itr)->treeKeyUp(event);
+	while(node && !handled) {
+		NodeRef prev = node->getPrevSiblingRef();
+		handled = node->treeKeyUp(event);
+		node = prev;
+	}
 
 	// if not handled, test this node
 	if(!handled) handled = keyUp(event);
@@ -391,11 +675,13 @@ bool Node::keyUp( KeyEvent event )
 bool Node::treeResize()
 {
 	// test children first, from top to bottom
-	NodeList nodes(mChildren);
-	NodeList::reverse_iterator itr;
+	NodeRef node = getLastChildRef();
 	bool handled = false;
-	for(itr=nodes.rbegin();itr!=nodes.rend()&&!handled;++itr)
-		handled = (*itr)->treeResize();
+	while(node && !handled) {
+		NodeRef prev = node->getPrevSiblingRef();
+		handled = node->treeResize();
+		node = prev;
+	}
 
 	// if not handled, test this node
 	if(!handled) handled = resize();
@@ -415,7 +701,7 @@ Vec2f Node::project(float x, float y) const
 	Matrix44f	projection = gl::getProjection();
 
 	// find the modelview-projection-matrix
-	Matrix44f mvp = projection * mWorldTransform;
+	Matrix44f mvp = projection * getWorldTransform();
 
 	//
 	Vec4f in(x, y, 0.0f, 1.0f);
@@ -444,7 +730,7 @@ Vec3f Node::unproject(float x, float y, float z) const
 	Matrix44f projection = gl::getProjection();
 
 	// find the inverse modelview-projection-matrix
-	Matrix44f mvp = projection * mWorldTransform;
+	Matrix44f mvp = projection * getWorldTransform();
 	mvp.invert(0.0f);
 
 	// map x and y from window coordinates
@@ -479,6 +765,9 @@ Node2D::Node2D(void)
 	mScale		= Vec2f::one();
 	mAnchor		= Vec2f::zero();
 
+	mWidth		= 0.0f;
+	mHeight		= 0.0f;
+
 	mAnchorIsPercentage = false;
 }
 
@@ -486,6 +775,54 @@ Node2D::~Node2D(void)
 {
 }
 
+void Node2D::writeSnapshot( SnapshotWriter &out ) const
+{
+	NodeGL::writeSnapshot(out);
+
+	out.write( mPosition );
+	out.write( mRotation );
+	out.write( mScale );
+	out.write( mAnchor );
+	out.write( uint8_t( mAnchorIsPercentage ? 1 : 0 ) );
+	out.write( mWidth );
+	out.write( mHeight );
+}
+
+void Node2D::readSnapshot( SnapshotReader &in )
+{
+	NodeGL::readSnapshot(in);
+
+	uint8_t anchorIsPercentage;
+
+	in.read( &mPosition );
+	in.read( &mRotation );
+	in.read( &mScale );
+	in.read( &mAnchor );
+	in.read( &anchorIsPercentage );
+	in.read( &mWidth );
+	in.read( &mHeight );
+
+	mAnchorIsPercentage = (anchorIsPercentage != 0);
+}
+
+bool Node2D::getWorldBounds( Rectf *bounds ) const
+{
+	const Matrix44f &world = getWorldTransform();
+	const Rectf r = getBounds();
+
+	Vec3f p = world.transformPointAffine( Vec3f(r.x1, r.y1, 0.0f) );
+	*bounds = Rectf( p.x, p.y, p.x, p.y );
+
+	p = world.transformPointAffine( Vec3f(r.x2, r.y1, 0.0f) );
+	bounds->include( Vec2f(p.x, p.y) );
+	p = world.transformPointAffine( Vec3f(r.x2, r.y2, 0.0f) );
+	bounds->include( Vec2f(p.x, p.y) );
+	p = world.transformPointAffine( Vec3f(r.x1, r.y2, 0.0f) );
+	bounds->include( Vec2f(p.x, p.y) );
+
+	return true;
+}
+
 Vec2f Node2D::screenToParent( const Vec2f &pt ) const
 {
 	Vec2f p = pt;
@@ -523,13 +860,13 @@ Vec2f Node2D::parentToScreen( const Vec2f &pt ) const
 
 Vec2f Node2D::parentToObject( const Vec2f &pt ) const
 {
-	Vec3f p = mTransform.inverted(5.96e-8f).transformPointAffine( Vec3f(pt, 0.0f) );
+	Vec3f p = getTransform().inverted(5.96e-8f).transformPointAffine( Vec3f(pt, 0.0f) );
 	return Vec2f(p.x, p.y);
 }
 
 Vec2f Node2D::objectToParent( const Vec2f &pt ) const
 {
-	Vec3f p = mTransform.transformPointAffine( Vec3f(pt, 0.0f) );
+	Vec3f p = getTransform().transformPointAffine( Vec3f(pt, 0.0f) );
 	return Vec2f(p.x, p.y);
 }
 
@@ -552,6 +889,26 @@ Node3D::~Node3D(void)
 {
 }
 
+void Node3D::writeSnapshot( SnapshotWriter &out ) const
+{
+	NodeGL::writeSnapshot(out);
+
+	out.write( mPosition );
+	out.write( mRotation );
+	out.write( mScale );
+	out.write( mAnchor );
+}
+
+void Node3D::readSnapshot( SnapshotReader &in )
+{
+	NodeGL::readSnapshot(in);
+
+	in.read( &mPosition );
+	in.read( &mRotation );
+	in.read( &mScale );
+	in.read( &mAnchor );
+}
+
 void Node3D::treeDrawWireframe()
 {
 	if(!mIsVisible) return;
@@ -560,17 +917,15 @@ void Node3D::treeDrawWireframe()
 	gl::pushModelView();
 
 	// usual way to update modelview matrix
-	gl::multModelView( mTransform );
+	gl::multModelView( getTransform() );
 
 	// draw this node by calling derived class
 	drawWireframe();
 
 	// draw this node's children
-	NodeList::iterator itr;
-	for(itr=mChildren.begin();itr!=mChildren.end();++itr) {
+	for(Node *node=getFirstChild();node;node=node->getNextSibling()) {
 		// only call other Node3D's
-		Node3DRef node = boost::dynamic_pointer_cast<Node3D>(*itr);
-		if(node) node->treeDrawWireframe();
+		if(node->isType<Node3D>()) static_cast<Node3D*>(node)->treeDrawWireframe();
 	}
 	
 	// restore transform
@@ -38,28 +38,46 @@ namespace cinder {
 #include "cinder/gl/GlslProg.h"
 #include "cinder/gl/Material.h"
 
+#include "nodes/AabbTree.h"
+#include "nodes/DrawList.h"
+#include "nodes/NodeArena.h"
+#include "nodes/SlotMap.h"
+#include "nodes/TransformStore.h"
+
 #include <boost/enable_shared_from_this.hpp>
 #include <iostream>
 #include <deque>
-#include <map>
+#include <vector>
 
 namespace ph { namespace nodes {
 
+class UpdatePool;
+class SnapshotWriter;
+class SnapshotReader;
+
 typedef boost::shared_ptr<class Node>		NodeRef;
 typedef boost::shared_ptr<const class Node>	NodeConstRef;
 typedef boost::weak_ptr<class Node>			NodeWeakRef;
 typedef std::deque<NodeRef>					NodeList;
-typedef std::map<unsigned int, NodeWeakRef>	NodeMap;
+typedef SlotMap<class Node*>				NodeMap;
 
 class Node
 	: public boost::enable_shared_from_this<Node>
 {
+	friend class TransformStore;
+	friend class DrawList;
+	friend class GlDrawBackend;
+	friend class NodeSnapshot;
 public:
 	Node(void);
 	virtual ~Node(void);
+
+	//! nodes are allocated from the node arena
+	static void*	operator new( size_t size ) { return nodeArena().allocate(size); }
+	static void		operator delete( void *ptr, size_t size ) { nodeArena().deallocate(ptr, size); }
 	
 	//! sets the node's parent node (using weak reference to avoid objects not getting destroyed)
-	void setParent(NodeRef node){ mParent = NodeWeakRef(node); }
+	void setParent(NodeRef node);
 	//! returns the node's parent node 
 	NodeRef	getParent() const { return mParent.lock(); }
 	//! returns the node's parent node (provide a templated function for easier down-casting of nodes)
@@ -86,7 +104,10 @@ public:
 	static unsigned int	colorToUuid(ci::Color color){ return colorToUuid( (unsigned char)(color.r * 255), (unsigned char)(color.g * 255), (unsigned char)(color.b * 255) ); }
 	static unsigned int	colorToUuid(unsigned char r, unsigned char g, unsigned char b){ return r + (g << 8) + (b << 16); }
 
-	static NodeRef		findNode(unsigned int uuid){ return uuidLookup[uuid].lock(); }
+	//! returns the node with the specified uuid, or an empty reference if it no longer exists
+	static NodeRef		findNode(unsigned int uuid);
+	//! returns wether the node with the specified uuid still exists
+	static bool			isValidUuid(unsigned int uuid){ return uuidLookup.contains(uuid); }
 
 	// parent functions
 	//! returns wether this node has a specific child
@@ -104,15 +125,45 @@ public:
 	//! puts a specific child below all other children of this node
 	void moveToBottom(NodeRef node);
 
+	//! returns the number of children of this node
+	size_t	getNumChildren() const { return mNumChildren; }
+	//! returns the first (bottom) child of this node, or NULL
+	Node*	getFirstChild() const { return mFirstChild.get(); }
+	//! returns the last (top) child of this node, or NULL
+	Node*	getLastChild() const { return mLastChild; }
+	//! returns the sibling above this node, or NULL
+	Node*	getNextSibling() const { return mNextSibling.get(); }
+	//! returns the sibling below this node, or NULL
+	Node*	getPrevSibling() const { return mPrevSibling; }
+
+	//! returns the first child of the specified type, or NULL. Use it together with getNextSibling<T>()
+	//! to iterate over the children of a specific type without creating a list.
+	template <class T>
+	T*		getFirstChild() const { return findSibling<T>( mFirstChild.get() ); }
+	//! returns the next sibling of the specified type, or NULL
+	template <class T>
+	T*		getNextSibling() const { return findSibling<T>( mNextSibling.get() ); }
+
+	//! returns wether this node is of the specified type. The result is cached in a bitmask,
+	//! so the (slow) dynamic cast is performed only once per node and type.
+	template <class T>
+	bool	isType() const {
+		const uint64_t bit = getTypeBit<T>();
+		if(!bit) return dynamic_cast<const T*>(this) != NULL;
+
+		if(!(mKnownTypes & bit)) {
+			if(dynamic_cast<const T*>(this)) mTypes |= bit;
+			mKnownTypes |= bit;
+		}
+		return (mTypes & bit) != 0;
+	}
+
 	//! returns a list of all children of the specified type
 	template <class T>
 	std::deque< boost::shared_ptr<T> > getChildren() {
 		std::deque< boost::shared_ptr<T> > result;
-		NodeList::iterator itr;
-		for(itr=mChildren.begin(); itr!=mChildren.end(); ++itr) {
-			boost::shared_ptr<T>  node = boost::dynamic_pointer_cast<T>(*itr); 
-			if(node) result.push_back(node);
-		}
+		for(T *node=getFirstChild<T>(); node; node=node->template getNextSibling<T>())
+			result.push_back( boost::static_pointer_cast<T>( node->shared_from_this() ) );
 		return result;
 	}
 
@@ -130,7 +181,7 @@ public:
 	void moveToBottom();
 
 	//! enables or disables visibility of this node (invisible nodes are not drawn and can not receive events, but they still receive updates)
-	virtual void setVisible(bool visible=true){ mIsVisible = visible; }
+	virtual void setVisible(bool visible=true){ if(mIsVisible != visible) { mIsVisible = visible; invalidateDrawList(); } }
 	//! returns wether this node is visible
 	virtual bool isVisible() const { return mIsVisible; }
 	//!
@@ -142,11 +193,17 @@ public:
 	virtual bool isClickable() const { return mIsClickable; }
 
 	//! returns the transformation matrix of this node
-	const ci::Matrix44f& getTransform() const { if(mIsTransformInvalidated) transform(); return mTransform; }
+	const ci::Matrix44f& getTransform() const { return transforms().getLocal(mTransformHandle); }
 	//! returns the accumulated transformation matrix of this node
-	const ci::Matrix44f& getWorldTransform() const { if(mIsTransformInvalidated) transform(); return mWorldTransform; }
-	//!
-	void invalidateTransform() const { mIsTransformInvalidated = true; }
+	const ci::Matrix44f& getWorldTransform() const { return transforms().getWorld(mTransformHandle); }
+	//! the transformation matrix will be recalculated by calling transform() when it is needed
+	void invalidateTransform() const { transforms().invalidate(mTransformHandle); }
+
+	//! returns the bounds of this node in world space, or FALSE if the node has no bounds and should receive all mouse events.
+	//! Call invalidateTransform() if the bounds change, so the spatial index will be updated.
+	virtual bool getWorldBounds( ci::Rectf *bounds ) const { return false; }
+	//! finds the visible nodes of this tree whose world bounds contain the point, top-most first
+	void pick( const ci::Vec2f &pt, NodeList *nodes );
 
 	//! 
 	virtual void setSelected(bool selected=true){ mIsSelected = selected; }
@@ -155,15 +212,13 @@ public:
 
 	//! signal parent that this node has been clicked or activated
 	virtual void selectChild(NodeRef node) {
-		NodeList::iterator itr;
-		for(itr=mChildren.begin(); itr!=mChildren.end(); ++itr) 
-			(*itr)->setSelected( *itr == node );
+		for(Node *child=getFirstChild(); child; child=child->getNextSibling()) 
+			child->setSelected( child == node.get() );
 	}
 	//! signal parent that this node has been released or deactivated
 	virtual void deselectChild(NodeRef node) {
-		NodeList::iterator itr;
-		for(itr=mChildren.begin(); itr!=mChildren.end(); ++itr) 
-			(*itr)->setSelected( false );
+		for(Node *child=getFirstChild(); child; child=child->getNextSibling()) 
+			child->setSelected( false );
 	}
 
 	// tree parse functions
@@ -173,22 +228,42 @@ public:
 	void treeShutdown();
 	//! calls the update() function of this node and all its decendants
 	void treeUpdate(double elapsed=0.0);
+	//! calls the update() function of this node and all its decendants. Subtrees that are parallel safe 
+	//! are updated by the pool's threads, after all other nodes have been updated.
+	void treeUpdate(UpdatePool &pool, double elapsed=0.0);
+	//! returns wether this node and its decendants may be updated on another thread. Their update() methods should 
+	//! only modify the subtree itself and should not create or destroy nodes. Adding, removing and reordering nodes is deferred
+	//! until all subtrees have been updated. World transforms are not recalculated during the update.
+	virtual bool isUpdateParallelSafe() const { return false; }
 	//! calls the draw() function of this node and all its decendants
 	void treeDraw();
 
+	//! returns a key identifying the render state (shader, material) of this node. Sortable nodes with the same
+	//! key are drawn together by a DrawList, which only calls predraw() and postdraw() when the key changes. 
+	//! Zero means the state can not be shared.
+	virtual uint32_t	getStateKey() const { return 0; }
+	//! returns a key identifying the geometry drawn by this node
+	virtual uint32_t	getMeshKey() const { return 0; }
+	//! returns wether a DrawList may change the order in which this node is drawn. Only opaque nodes
+	//! that do not depend on the state set by their ancestors, and whose decendants do not depend
+	//! on the state set by this node, should be sortable.
+	virtual bool		isSortable() const { return false; }
+	//! causes a DrawList to compile this node and its decendants again, call it if any of the keys above change
+	void				invalidateDrawList();
+
 	virtual void setup() {}
 	virtual void shutdown() {}
 	virtual void update( double elapsed=0.0 ) {}
 	virtual void draw() {}
 
-	// supported events
-	//! calls the mouseMove() function of this node and all its decendants until a TRUE is passed back
+	// supported events. Mouse events are only passed to the nodes under the mouse, which are found using pick().
+	//! calls the mouseMove() function of the nodes under the mouse, and of the nodes the mouse just left, until a TRUE is passed back
 	bool treeMouseMove( ci::app::MouseEvent event );
-	//! calls the mouseDown() function of this node and all its decendants until a TRUE is passed back
+	//! calls the mouseDown() function of the nodes under the mouse until a TRUE is passed back
 	bool treeMouseDown( ci::app::MouseEvent event );
-	//! calls the mouseDrag() function of this node and all its decendants until a TRUE is passed back
+	//! calls the mouseDrag() function of the node that handled the mouseDown event, or of the nodes under the mouse until a TRUE is passed back
 	bool treeMouseDrag( ci::app::MouseEvent event );
-	//! calls the mouseUp() function of this node and all its decendants until a TRUE is passed back
+	//! calls the mouseUp() function of the node that handled the mouseDown event and of all nodes under the mouse
 	bool treeMouseUp( ci::app::MouseEvent event );
 
 	virtual bool mouseMove( ci::app::MouseEvent event );
@@ -212,6 +287,13 @@ public:
 
 	virtual bool resize();
 
+	// snapshot support (see: class NodeSnapshot). Flags, color and transform are stored for all nodes.
+	//! writes the data specific to this node type, derived classes should call the base class first
+	virtual void writeSnapshot( SnapshotWriter &out ) const {}
+	//! reads the data written by writeSnapshot(), in the same order. Use direct assignments instead of 
+	//! setters: the stored transform is applied afterwards.
+	virtual void readSnapshot( SnapshotReader &in ) {}
+
 	// stream support
 	virtual inline std::string toString() const { return "Node"; }
 	friend std::ostream& operator<<(std::ostream& s, const Node& o){ return s << "[" << o.toString() << "]"; }
@@ -223,13 +305,24 @@ protected:
 	const unsigned int		mUuid;
 
 	NodeWeakRef				mParent;
-	NodeList				mChildren;
+
+	//! children are kept in a doubly linked list, each node owns its next sibling
+	NodeRef					mFirstChild;
+	Node*					mLastChild;
+	NodeRef					mNextSibling;
+	Node*					mPrevSibling;
+	size_t					mNumChildren;
 
 	ci::ColorA				mColor;
 
-	mutable bool			mIsTransformInvalidated;
+	//! copies of the matrices in the TransformStore, updated whenever the world transform changes.
+	//! Kept for existing subclasses: a transform() method that sets mTransform instead of
+	//! calling setTransform() still works, but reading them may return a stale matrix until the next update.
 	mutable ci::Matrix44f	mTransform;
 	mutable ci::Matrix44f	mWorldTransform;
+
+	//! handle of this node's transformation matrices in the TransformStore
+	const uint32_t			mTransformHandle;
 protected:
 	//! helper function for coordinate transformations
 	ci::Vec2f	project( float x, float y ) const ;
@@ -245,17 +338,77 @@ protected:
 	//! function that is called right after drawing this node
 	virtual void postdraw(){}
 
-	//! required transform() function to populate the transform matrix
+	//! required transform() function to populate the transform matrix, by calling setTransform()
 	virtual void transform() const = 0;
+	//! sets the transformation matrix of this node, relative to its parent
+	void setTransform( const ci::Matrix44f &transform ) const { transforms().setLocal(mTransformHandle, transform); }
+private:
+	//! called by the transform store when the world transform has changed, updates the spatial index
+	void worldTransformChanged() const;
+	//! numbers the nodes of this tree in the order in which they are drawn
+	void updateDrawOrder();
+	void assignDrawOrder( uint32_t *order );
+	//! returns TRUE if this node is part of the tree and it and all its ancestors are visible
+	bool isVisibleFrom( const Node *root ) const;
+	//! updates the nodes that are not parallel safe and collects the subtrees that are
+	void collectUpdate( double elapsed, std::vector<NodeRef> *subtrees );
+
+	//! inserts a child into the list of children, after the specified child (or at the start if NULL)
+	void linkChild( NodeRef node, Node *after );
+	//! removes a child from the list of children, the returned reference keeps it alive
+	NodeRef unlinkChild( Node *node );
+	//! return references that keep the last child and the previous sibling alive while iterating backwards
+	NodeRef getLastChildRef() const { return mLastChild ? mLastChild->shared_from_this() : NodeRef(); }
+	NodeRef getPrevSiblingRef() const { return mPrevSibling ? mPrevSibling->shared_from_this() : NodeRef(); }
+
+	//! returns the first node of the specified type, starting at 'node' and following the siblings
+	template <class T>
+	static T* findSibling( Node *node ) {
+		while(node && !node->isType<T>()) node = node->mNextSibling.get();
+		return static_cast<T*>(node);
+	}
+
+	//! returns the bit used to cache the result of isType<T>(), or zero if all bits are in use
+	template <class T>
+	static uint64_t getTypeBit() { static const uint64_t bit = nextTypeBit(); return bit; }
+	static uint64_t nextTypeBit();
 private:
 	bool				mIsSetup;
 
+	//! proxy of this node's world bounds in the spatial index
+	mutable int32_t		mProxy;
+	//! position in the drawing order, assigned by updateDrawOrder()
+	uint32_t			mDrawOrder;
+
+	enum { DRAW_INVALID = 1, DRAW_CHILD_INVALID = 2 };
+	//! state of this node in the DrawList
+	uint8_t				mDrawFlags;
+	//! position of this node's commands in the DrawList, relative to its parent
+	uint32_t			mDrawOffset;
+	//! number of commands of this node and its decendants in the DrawList
+	uint32_t			mDrawCount;
+
+	//! types for which isType() returned TRUE, and types for which the result is known
+	mutable uint64_t	mTypes;
+	mutable uint64_t	mKnownTypes;
+
 	//! nodeCount is used to count the number of Node instances for debugging purposes
 	static int			nodeCount;
-	//! uuidCount is used to generate new unique id's
-	static unsigned int uuidCount;
-	//! uuidLookup allows us to quickly find a Node by id
+	//! uuidLookup generates the unique id's (24 bits, never zero) and allows us to quickly find a Node by id
 	static NodeMap		uuidLookup;
+
+	//! spatialIndex contains the world bounds of all nodes, used to quickly find the nodes under the mouse
+	static AabbTree		spatialIndex;
+	//! structureVersion is incremented each time a node is added, removed or reordered
+	static uint32_t		structureVersion;
+	//! the root and version for which the drawing order was last assigned
+	static const Node*	drawOrderRoot;
+	static uint32_t		drawOrderVersion;
+
+	//! the nodes that were under the mouse during the last mouseMove event
+	static std::vector<NodeWeakRef>	hovered;
+	//! the node that handled the last mouseDown event
+	static NodeWeakRef				captured;
 };
 
 // Basic support for OpenGL nodes
@@ -337,11 +490,18 @@ public:
 	virtual ci::Rectf	getBounds() const { return ci::Rectf(ci::Vec2f::zero(), getSize()); }
 	virtual ci::Rectf	getScaledBounds() const { return ci::Rectf(ci::Vec2f::zero(), getScaledSize()); }
 
-	virtual void		setWidth(float w){ mWidth=w; }
-	virtual void		setHeight(float h){ mHeight=h; }
-	virtual void		setSize(float w, float h){ mWidth=w; mHeight=h; }
-	virtual void		setSize( const ci::Vec2i &size ){ mWidth=(float)size.x; mHeight=(float)size.y; }
-	virtual void		setBounds( const ci::Rectf &bounds ){ mWidth=bounds.getWidth(); mHeight=bounds.getHeight(); }
+	virtual void		setWidth(float w){ mWidth=w; invalidateTransform(); }
+	virtual void		setHeight(float h){ mHeight=h; invalidateTransform(); }
+	virtual void		setSize(float w, float h){ mWidth=w; mHeight=h; invalidateTransform(); }
+	virtual void		setSize( const ci::Vec2i &size ){ mWidth=(float)size.x; mHeight=(float)size.y; invalidateTransform(); }
+	virtual void		setBounds( const ci::Rectf &bounds ){ mWidth=bounds.getWidth(); mHeight=bounds.getHeight(); invalidateTransform(); }
+
+	//! returns the axis aligned bounding box of the transformed bounds
+	virtual bool		getWorldBounds( ci::Rectf *bounds ) const ;
+
+	// snapshot support
+	virtual void writeSnapshot( SnapshotWriter &out ) const ;
+	virtual void readSnapshot( SnapshotReader &in );
 
 	// conversions from screen to world to object coordinates and vice versa
 	virtual ci::Vec2f screenToParent( const ci::Vec2f &pt ) const ;
@@ -367,23 +527,19 @@ protected:
 	// required function (see: class Node)
 	virtual void transform() const {
 		// construct transformation matrix
-		mTransform.setToIdentity();
-		mTransform.translate( ci::Vec3f( mPosition, 0.0f ) );
-		mTransform *= mRotation.toMatrix44();
-		mTransform.scale( ci::Vec3f( mScale, 1.0f ) );
+		ci::Matrix44f transform;
+		transform.setToIdentity();
+		transform.translate( ci::Vec3f( mPosition, 0.0f ) );
+		transform *= mRotation.toMatrix44();
+		transform.scale( ci::Vec3f( mScale, 1.0f ) );
 
 		if( mAnchorIsPercentage )
-			mTransform.translate( ci::Vec3f( -mAnchor * getSize(), 0.0f ) );
+			transform.translate( ci::Vec3f( -mAnchor * getSize(), 0.0f ) );
 		else
-			mTransform.translate( ci::Vec3f( -mAnchor, 0.0f ) );
-
-		// update world matrix (TODO will not work with cached matrix!)
-		Node2DRef parent = getParent<Node2D>();
-		if(parent)
-			mWorldTransform = parent->mWorldTransform * mTransform;
-		else mWorldTransform = mTransform;
+			transform.translate( ci::Vec3f( -mAnchor, 0.0f ) );
 
-		// TODO set mIsTransformValidated to false once the world matrix stuff has been rewritten
+		// the world matrix is calculated by the transform store
+		setTransform( transform );
 	}
 };
 
@@ -421,6 +577,10 @@ public:
 	virtual void		setAnchor( float x, float y, float z ){ mAnchor = ci::Vec3f(x, y, z); invalidateTransform(); }
 	virtual void		setAnchor( const ci::Vec3f &pt ){ mAnchor = pt; invalidateTransform(); }
 
+	// snapshot support
+	virtual void writeSnapshot( SnapshotWriter &out ) const ;
+	virtual void readSnapshot( SnapshotReader &in );
+
 	// stream support
 	virtual inline std::string toString() const { return "Node3D"; }
 protected: 
@@ -434,17 +594,15 @@ protected:
 	// required function (see: class Node)
 	virtual void transform() const {
 		// construct transformation matrix
-		mTransform.setToIdentity();
-		mTransform.translate( mPosition );
-		mTransform *= mRotation.toMatrix44();
-		mTransform.scale( mScale );
-		mTransform.translate( -mAnchor );
-
-		// update world matrix
-		Node3DRef parent = getParent<Node3D>();
-		if(parent)
-			mWorldTransform = parent->mWorldTransform * mTransform;
-		else mWorldTransform = mTransform;
+		ci::Matrix44f transform;
+		transform.setToIdentity();
+		transform.translate( mPosition );
+		transform *= mRotation.toMatrix44();
+		transform.scale( mScale );
+		transform.translate( -mAnchor );
+
+		// the world matrix is calculated by the transform store
+		setTransform( transform );
 	}
 };
 
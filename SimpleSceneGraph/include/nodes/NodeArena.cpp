@@ -0,0 +1,142 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "nodes/NodeArena.h"
+
+#include <new>
+
+namespace ph { namespace nodes {
+
+using namespace std;
+
+NodeArena::~NodeArena(void)
+{
+	vector<char*>::iterator itr;
+	for(itr=mChunks.begin();itr!=mChunks.end();++itr)
+		::operator delete( *itr );
+
+	mChunks.clear();
+}
+
+void* NodeArena::allocate( size_t size )
+{
+	if( size == 0 ) size = 1;
+	if( size > kMaxBlockSize ) 
+		return ::operator new( size );
+
+	const size_t sizeClass = getSizeClass( size );
+	const size_t blockSize = (sizeClass + 1) * kGranularity;
+
+	mBytesInUse += blockSize;
+	mBlocksInUse++;
+
+	// reuse a freed block if available
+	void *block = mFreeLists[sizeClass];
+	if( block ) {
+		mFreeLists[sizeClass] = *static_cast<void**>( block );
+		return block;
+	}
+
+	// otherwise, take it from the current chunk
+	if( mRemaining < blockSize ) {
+		// keep the rest of the current chunk in the free lists
+		while( mRemaining >= kGranularity ) {
+			const size_t remainder = getSizeClass( mRemaining + 1 ) - 1;
+			const size_t remainderSize = (remainder + 1) * kGranularity;
+
+			*static_cast<void**>( (void*) mCurrent ) = mFreeLists[remainder];
+			mFreeLists[remainder] = mCurrent;
+
+			mCurrent += remainderSize;
+			mRemaining -= remainderSize;
+		}
+
+		mCurrent = static_cast<char*>( ::operator new( kChunkSize ) );
+		mRemaining = kChunkSize;
+		mChunks.push_back( mCurrent );
+	}
+
+	block = mCurrent;
+	mCurrent += blockSize;
+	mRemaining -= blockSize;
+
+	return block;
+}
+
+void NodeArena::deallocate( void *ptr, size_t size )
+{
+	if( !ptr ) return;
+
+	if( size == 0 ) size = 1;
+	if( size > kMaxBlockSize ) {
+		::operator delete( ptr );
+		return;
+	}
+
+	const size_t sizeClass = getSizeClass( size );
+
+	mBytesInUse -= (sizeClass + 1) * kGranularity;
+	mBlocksInUse--;
+
+	*static_cast<void**>( ptr ) = mFreeLists[sizeClass];
+	mFreeLists[sizeClass] = ptr;
+}
+
+void NodeArena::reserve( size_t size, size_t count )
+{
+	if( size == 0 || size > kMaxBlockSize ) return;
+
+	const size_t sizeClass = getSizeClass( size );
+	const size_t blockSize = (sizeClass + 1) * kGranularity;
+
+	// count the blocks that are already available
+	size_t available = 0;
+	for(void *block=mFreeLists[sizeClass];block && available < count;block=*static_cast<void**>(block))
+		++available;
+
+	if( available >= count ) return;
+	count -= available;
+
+	// divide new chunks into blocks, linked in address order
+	const size_t blocksPerChunk = kChunkSize / blockSize;
+	while( count > 0 ) {
+		char *chunk = static_cast<char*>( ::operator new( kChunkSize ) );
+		mChunks.push_back( chunk );
+
+		const size_t n = (count < blocksPerChunk) ? count : blocksPerChunk;
+		for(size_t i=n;i>0;--i) {
+			void *block = chunk + (i - 1) * blockSize;
+			*static_cast<void**>( block ) = mFreeLists[sizeClass];
+			mFreeLists[sizeClass] = block;
+		}
+
+		count -= n;
+	}
+}
+
+NodeArena& nodeArena()
+{
+	static NodeArena arena;
+	return arena;
+}
+
+} } // namespace ph::nodes
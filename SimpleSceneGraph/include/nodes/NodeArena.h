@@ -0,0 +1,80 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+
+#include <vector>
+
+namespace ph { namespace nodes {
+
+//! Pool allocator for nodes. Memory is taken from large chunks and divided into blocks of a few
+//! size classes, freed blocks are kept in a list per size class and reused. Chunks are only released 
+//! when the arena is destroyed. Like the nodes themselves, the arena is not thread-safe.
+class NodeArena
+{
+public:
+	//! block sizes are a multiple of this value
+	static const size_t	kGranularity = 16;
+	//! larger allocations are passed on to the global operator new
+	static const size_t	kMaxBlockSize = 1024;
+	//!
+	static const size_t	kChunkSize = 256 * 1024;
+public:
+	NodeArena(void) : mCurrent(NULL), mRemaining(0), mBytesInUse(0), mBlocksInUse(0), mFreeLists( kMaxBlockSize / kGranularity, NULL ) {}
+	~NodeArena(void);
+
+	//!
+	void*	allocate( size_t size );
+	//! 'size' should be the same as the size passed to allocate()
+	void	deallocate( void *ptr, size_t size );
+
+	//! reserves memory for the specified number of blocks of the specified size
+	void	reserve( size_t size, size_t count );
+
+	//! returns the number of bytes taken from the system
+	size_t	getBytesReserved() const { return mChunks.size() * kChunkSize; }
+	//! returns the number of bytes handed out, including padding
+	size_t	getBytesInUse() const { return mBytesInUse; }
+	//! returns the number of blocks handed out
+	size_t	getBlocksInUse() const { return mBlocksInUse; }
+private:
+	//! returns the size class of the specified size
+	static size_t	getSizeClass( size_t size ) { return (size + kGranularity - 1) / kGranularity - 1; }
+private:
+	std::vector<char*>	mChunks;
+
+	char*				mCurrent;
+	size_t				mRemaining;
+
+	size_t				mBytesInUse;
+	size_t				mBlocksInUse;
+
+	//! singly linked lists of free blocks, stored in the blocks themselves
+	std::vector<void*>	mFreeLists;
+};
+
+//! returns the arena shared by all nodes
+NodeArena&	nodeArena();
+
+} } // namespace ph::nodes
@@ -0,0 +1,329 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "nodes/NodeSnapshot.h"
+#include "text/MappedFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ph { namespace nodes {
+
+using namespace ci;
+using namespace std;
+
+// a snapshot starts with a fixed size header, followed by 16-byte aligned blocks that can be used in place
+#pragma pack(push, 1)
+struct SnapshotHeader {
+	uint8_t		magic[4];		// 'PHSG'
+	uint16_t	version;		// 0x0001
+	uint16_t	flags;
+	uint32_t	typeOffset;		// array of SnapshotType
+	uint32_t	typeCount;
+	uint32_t	nodeOffset;		// array of SnapshotNode, parents precede their children
+	uint32_t	nodeCount;
+	uint32_t	payloadOffset;	// per-type data of all nodes
+	uint32_t	payloadSize;
+};
+
+struct SnapshotType {
+	char		name[56];		// null terminated
+	uint32_t	count;			// number of nodes of this type
+	uint32_t	reserved;
+};
+
+struct SnapshotNode {
+	uint32_t	parent;			// index of the parent node, kNoParent for the root
+	uint16_t	type;			// index in the type table
+	uint16_t	flags;
+	float		color[4];
+	float		transform[16];	// local transform, column major
+	uint32_t	payloadOffset;	// relative to the payload block
+	uint32_t	payloadSize;
+};
+#pragma pack(pop)
+
+static const uint16_t	kVersion = 0x0001;
+static const uint32_t	kNoParent = 0xFFFFFFFF;
+static const uint32_t	kBlockAlignment = 16;
+
+enum { NODE_VISIBLE = 1, NODE_CLICKABLE = 2, NODE_SELECTED = 4 };
+
+static uint32_t align( uint32_t offset )
+{
+	return (offset + kBlockAlignment - 1) & ~(kBlockAlignment - 1);
+}
+
+void SnapshotWriter::writeData( const void *data, size_t size )
+{
+	const uint8_t *ptr = static_cast<const uint8_t*>( data );
+	mBuffer->insert( mBuffer->end(), ptr, ptr + size );
+}
+
+void SnapshotReader::readData( void *data, size_t size )
+{
+	if( size > mRemaining ) throw SnapshotInvalidSourceExc();
+
+	std::memcpy( data, mData, size );
+	mData += size;
+	mRemaining -= size;
+}
+
+NodeTypeRegistry::NodeTypeRegistry(void)
+{
+	add<Node2D>( "Node2D" );
+	add<Node3D>( "Node3D" );
+}
+
+void NodeTypeRegistry::add( const std::string &name, const std::type_info &type, size_t size, Factory factory )
+{
+	// the name should fit in the type table of the snapshot
+	if( name.empty() || name.size() >= sizeof(SnapshotType().name) ) return;
+
+	Entry entry;
+	entry.name = name;
+	entry.type = &type;
+	entry.size = size;
+	entry.factory = factory;
+
+	// registering a type again replaces it
+	vector<Entry>::iterator itr;
+	for(itr=mEntries.begin();itr!=mEntries.end();++itr) {
+		if( *itr->type == type || itr->name == name ) {
+			*itr = entry;
+			return;
+		}
+	}
+
+	mEntries.push_back( entry );
+}
+
+const NodeTypeRegistry::Entry* NodeTypeRegistry::find( const std::type_info &type ) const
+{
+	vector<Entry>::const_iterator itr;
+	for(itr=mEntries.begin();itr!=mEntries.end();++itr)
+		if( *itr->type == type ) return &(*itr);
+
+	return NULL;
+}
+
+const NodeTypeRegistry::Entry* NodeTypeRegistry::find( const std::string &name ) const
+{
+	vector<Entry>::const_iterator itr;
+	for(itr=mEntries.begin();itr!=mEntries.end();++itr)
+		if( itr->name == name ) return &(*itr);
+
+	return NULL;
+}
+
+NodeTypeRegistry& snapshotTypes()
+{
+	static NodeTypeRegistry registry;
+	return registry;
+}
+
+void NodeSnapshot::write( const NodeRef &root, const DataTargetRef target )
+{
+	if( !root || !target ) throw SnapshotInvalidTargetExc();
+
+	// make sure the local transforms are up to date
+	transforms().update();
+
+	const NodeTypeRegistry &registry = snapshotTypes();
+
+	vector<const NodeTypeRegistry::Entry*>	entries;
+	vector<SnapshotType>					types;
+	vector<SnapshotNode>					records;
+	vector<uint8_t>							payload;
+
+	SnapshotWriter writer( &payload );
+
+	// visit the nodes parents first, children in the order in which they are drawn
+	vector< pair<const Node*, uint32_t> > stack;
+	stack.push_back( make_pair( root.get(), kNoParent ) );
+
+	while( !stack.empty() ) {
+		const Node *node = stack.back().first;
+		const uint32_t parent = stack.back().second;
+		stack.pop_back();
+
+		// find the index of the node's type
+		const NodeTypeRegistry::Entry *entry = registry.find( typeid(*node) );
+		if( !entry ) throw SnapshotInvalidTargetExc();
+
+		size_t type = std::find( entries.begin(), entries.end(), entry ) - entries.begin();
+		if( type == entries.size() ) {
+			SnapshotType t;
+			std::memset( &t, 0, sizeof(t) );
+			std::memcpy( t.name, entry->name.data(), entry->name.size() );
+
+			entries.push_back( entry );
+			types.push_back( t );
+		}
+		types[type].count++;
+
+		SnapshotNode r;
+		r.parent = parent;
+		r.type = (uint16_t) type;
+		r.flags = (node->mIsVisible ? NODE_VISIBLE : 0) | (node->mIsClickable ? NODE_CLICKABLE : 0) | (node->mIsSelected ? NODE_SELECTED : 0);
+		r.color[0] = node->mColor.r;
+		r.color[1] = node->mColor.g;
+		r.color[2] = node->mColor.b;
+		r.color[3] = node->mColor.a;
+		std::memcpy( r.transform, node->getTransform().m, sizeof(r.transform) );
+
+		r.payloadOffset = (uint32_t) payload.size();
+		node->writeSnapshot( writer );
+		r.payloadSize = (uint32_t) payload.size() - r.payloadOffset;
+
+		const uint32_t index = (uint32_t) records.size();
+		records.push_back( r );
+
+		// push the children in reverse, so the first child is visited first
+		for(const Node *child=node->getLastChild();child;child=child->getPrevSibling())
+			stack.push_back( make_pair( child, index ) );
+	}
+
+	if( types.size() > 0xFFFF ) throw SnapshotInvalidTargetExc();
+
+	// lay out the file
+	SnapshotHeader header;
+	std::memcpy( header.magic, "PHSG", 4 );
+	header.version = kVersion;
+	header.flags = 0;
+	header.typeOffset = align( sizeof(SnapshotHeader) );
+	header.typeCount = (uint32_t) types.size();
+	header.nodeOffset = align( header.typeOffset + header.typeCount * sizeof(SnapshotType) );
+	header.nodeCount = (uint32_t) records.size();
+	header.payloadOffset = align( header.nodeOffset + header.nodeCount * sizeof(SnapshotNode) );
+	header.payloadSize = (uint32_t) payload.size();
+
+	// write everything in a few large blocks
+	OStreamRef out = target->getStream();
+
+	const uint8_t padding[kBlockAlignment] = { 0 };
+	uint32_t offset = 0;
+
+	out->writeData( &header, sizeof(header) );
+	offset += sizeof(header);
+
+	out->writeData( padding, header.typeOffset - offset );
+	out->writeData( &types[0], types.size() * sizeof(SnapshotType) );
+	offset = header.typeOffset + header.typeCount * sizeof(SnapshotType);
+
+	out->writeData( padding, header.nodeOffset - offset );
+	out->writeData( &records[0], records.size() * sizeof(SnapshotNode) );
+	offset = header.nodeOffset + header.nodeCount * sizeof(SnapshotNode);
+
+	out->writeData( padding, header.payloadOffset - offset );
+	if( !payload.empty() ) out->writeData( &payload[0], payload.size() );
+}
+
+NodeRef NodeSnapshot::read( const DataSourceRef source )
+{
+	if( !source ) throw SnapshotInvalidSourceExc();
+
+	// memory map files, so the records can be read in place
+	text::MappedFileRef mapping;
+	if( !source->getFilePath().empty() ) 
+		mapping = text::MappedFile::create( source->getFilePath() );
+
+	if( mapping ) 
+		return read( mapping->getData(), mapping->getSize() );
+
+	Buffer &buffer = source->getBuffer();
+	return read( static_cast<const uint8_t*>( buffer.getData() ), buffer.getDataSize() );
+}
+
+NodeRef NodeSnapshot::read( const uint8_t *data, size_t size )
+{
+	SnapshotHeader header;
+	if( size < sizeof(header) ) throw SnapshotInvalidSourceExc();
+
+	std::memcpy( &header, data, sizeof(header) );
+	if( std::memcmp( header.magic, "PHSG", 4 ) != 0 || header.version != kVersion ) throw SnapshotInvalidSourceExc();
+
+	// validate the blocks before using them (all values are little endian, like the platforms we run on)
+	if( uint64_t(header.typeOffset) + uint64_t(header.typeCount) * sizeof(SnapshotType) > size
+		|| uint64_t(header.nodeOffset) + uint64_t(header.nodeCount) * sizeof(SnapshotNode) > size
+		|| uint64_t(header.payloadOffset) + header.payloadSize > size
+		|| header.typeOffset % kBlockAlignment != 0
+		|| header.nodeOffset % kBlockAlignment != 0
+		|| header.nodeCount == 0 )
+		throw SnapshotInvalidSourceExc();
+
+	const SnapshotType *types = reinterpret_cast<const SnapshotType*>( data + header.typeOffset );
+	const SnapshotNode *records = reinterpret_cast<const SnapshotNode*>( data + header.nodeOffset );
+	const uint8_t *payload = data + header.payloadOffset;
+
+	// find the registered types and reserve memory for all nodes up front
+	const NodeTypeRegistry &registry = snapshotTypes();
+
+	vector<const NodeTypeRegistry::Entry*> entries( header.typeCount );
+	for(uint32_t i=0;i<header.typeCount;++i) {
+		const char *name = types[i].name;
+		const NodeTypeRegistry::Entry *entry = registry.find( std::string( name, std::find( name, name + sizeof(types[i].name), '\0' ) ) );
+		if( !entry ) throw SnapshotInvalidSourceExc();
+
+		nodeArena().reserve( entry->size, types[i].count );
+		entries[i] = entry;
+	}
+
+	// parents precede their children, so the tree can be built in a single pass
+	vector<Node*> nodes( header.nodeCount );
+	NodeRef root;
+
+	for(uint32_t i=0;i<header.nodeCount;++i) {
+		const SnapshotNode &r = records[i];
+
+		if( r.type >= header.typeCount
+			|| (i == 0) != (r.parent == kNoParent)
+			|| (i > 0 && r.parent >= i)
+			|| uint64_t(r.payloadOffset) + r.payloadSize > header.payloadSize )
+			throw SnapshotInvalidSourceExc();
+
+		NodeRef node( entries[r.type]->factory() );
+
+		node->mIsVisible = (r.flags & NODE_VISIBLE) != 0;
+		node->mIsClickable = (r.flags & NODE_CLICKABLE) != 0;
+		node->mIsSelected = (r.flags & NODE_SELECTED) != 0;
+		node->mColor = ColorA( r.color[0], r.color[1], r.color[2], r.color[3] );
+
+		SnapshotReader reader( payload + r.payloadOffset, r.payloadSize );
+		node->readSnapshot( reader );
+
+		// use the stored transform, so transform() does not have to be called for each node
+		Matrix44f transform;
+		std::memcpy( transform.m, r.transform, sizeof(r.transform) );
+		node->setTransform( transform );
+
+		// the parent keeps the node alive
+		if( i == 0 ) root = node;
+		else nodes[r.parent]->addChild( node );
+
+		nodes[i] = node.get();
+	}
+
+	return root;
+}
+
+} } // namespace ph::nodes
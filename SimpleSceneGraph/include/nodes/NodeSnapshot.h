@@ -0,0 +1,136 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/DataSource.h"
+#include "cinder/DataTarget.h"
+
+#include "nodes/Node.h"
+
+#include <exception>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace ph { namespace nodes {
+
+//! Collects the per-type data of a node while writing a snapshot. Values are copied as-is,
+//! so only use it for plain types. Like the file itself, the data is little endian.
+class SnapshotWriter
+{
+public:
+	SnapshotWriter( std::vector<uint8_t> *buffer ) : mBuffer(buffer) {}
+
+	template <typename T>
+	void	write( const T &value ) { writeData( &value, sizeof(T) ); }
+	void	writeData( const void *data, size_t size );
+private:
+	std::vector<uint8_t>	*mBuffer;
+};
+
+//! Reads the per-type data of a node from a snapshot, in the order in which it was written. 
+//! Throws a SnapshotInvalidSourceExc if a node reads beyond the end of its data.
+class SnapshotReader
+{
+public:
+	SnapshotReader( const uint8_t *data, size_t size ) : mData(data), mRemaining(size) {}
+
+	template <typename T>
+	void	read( T *value ) { readData( value, sizeof(T) ); }
+	void	readData( void *data, size_t size );
+
+	//! returns the number of bytes that have not been read yet
+	size_t	getRemaining() const { return mRemaining; }
+private:
+	const uint8_t	*mData;
+	size_t			mRemaining;
+};
+
+//! Maps type names to node types. Only registered types can be written to and read from a snapshot.
+//! Node2D and Node3D are registered by default.
+class NodeTypeRegistry
+{
+public:
+	typedef Node* (*Factory)();
+
+	struct Entry {
+		std::string				name;
+		const std::type_info	*type;
+		size_t					size;
+		Factory					factory;
+	};
+public:
+	NodeTypeRegistry(void);
+	~NodeTypeRegistry(void) {}
+
+	//! registers a node type, which should have a default constructor. The name is stored in the snapshot.
+	template <class T>
+	void	add( const std::string &name ) { add( name, typeid(T), sizeof(T), &create<T> ); }
+	void	add( const std::string &name, const std::type_info &type, size_t size, Factory factory );
+
+	//! returns the entry of the type, or NULL if it was not registered
+	const Entry*	find( const std::type_info &type ) const;
+	const Entry*	find( const std::string &name ) const;
+private:
+	template <class T>
+	static Node*	create() { return new T(); }
+private:
+	std::vector<Entry>	mEntries;
+};
+
+//! returns the type registry used by all snapshots
+NodeTypeRegistry&	snapshotTypes();
+
+//! Stores a tree of nodes in a binary file, which can be loaded much faster than building the tree 
+//! procedurally. The file contains a table of type names, followed by a fixed size record per node 
+//! (parent, type, flags, color and local transform) and a block with the per-type data. Nodes are 
+//! stored parents first, so the tree is rebuilt in a single pass.
+class NodeSnapshot
+{
+public:
+	//! writes the node and its decendants, throws a SnapshotInvalidTargetExc if a node type was not registered
+	static void		write( const NodeRef &root, const ci::DataTargetRef target );
+	//! reads a tree and returns its root. Files are memory mapped and all nodes are allocated 
+	//! from the node arena, which is reserved up front. Throws a SnapshotInvalidSourceExc on failure.
+	static NodeRef	read( const ci::DataSourceRef source );
+private:
+	static NodeRef	read( const uint8_t *data, size_t size );
+};
+
+class SnapshotExc : public std::exception {
+ public:
+	virtual const char* what() const throw() { return "Snapshot exception"; }
+};
+
+class SnapshotInvalidSourceExc : public SnapshotExc {
+ public:
+	virtual const char* what() const throw() { return "Snapshot exception: could not load from the specified source"; }
+};
+
+class SnapshotInvalidTargetExc : public SnapshotExc {
+ public:
+	virtual const char* what() const throw() { return "Snapshot exception: could not write to the specified target"; }
+};
+
+} } // namespace ph::nodes
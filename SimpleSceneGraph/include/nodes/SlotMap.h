@@ -0,0 +1,134 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+
+#include <deque>
+#include <vector>
+
+namespace ph { namespace nodes {
+
+//! Generational slot map with O(1) insert, erase and lookup. Handles combine a slot index with
+//! the generation of the slot, so handles to erased values are detected when the slot is reused.
+//! Erased slots are reused in the order they were freed, so a stale handle only matches a new value
+//! after its slot has been reused as many times as there are generations.
+//! Handles are never zero and fit in 24 bits, so they can be encoded as a color.
+template<typename T>
+class SlotMap
+{
+public:
+	//! number of bits used for the slot index, allows for 262144 values
+	static const uint32_t	kIndexBits = 18;
+	//! number of bits used for the generation
+	static const uint32_t	kGenerationBits = 6;
+
+	static const uint32_t	kIndexMask = (1 << kIndexBits) - 1;
+	static const uint32_t	kGenerationMask = (1 << kGenerationBits) - 1;
+public:
+	SlotMap(void) : mSize(0) {}
+	~SlotMap(void) {}
+
+	//! stores a value and returns its handle, or 0 if the map is full
+	uint32_t	insert( const T &value )
+	{
+		uint32_t index;
+		if( ! mFree.empty() ) {
+			index = mFree.front();
+			mFree.pop_front();
+		}
+		else if( mSlots.size() <= kIndexMask ) {
+			index = (uint32_t) mSlots.size();
+			mSlots.push_back( Slot() );
+		}
+		else return 0;
+
+		Slot &slot = mSlots[index];
+		slot.value = value;
+		slot.used = true;
+
+		mSize++;
+
+		return (slot.generation << kIndexBits) | index;
+	}
+
+	//! removes the value, returns FALSE if the handle was invalid or stale
+	bool		erase( uint32_t handle )
+	{
+		Slot *slot = getSlot( handle );
+		if( !slot ) return false;
+
+		slot->value = T();
+		slot->used = false;
+
+		// invalidate existing handles, generation 0 is skipped so handles are never zero
+		slot->generation = ( slot->generation + 1 ) & kGenerationMask;
+		if( slot->generation == 0 ) slot->generation = 1;
+
+		mFree.push_back( handle & kIndexMask );
+		mSize--;
+
+		return true;
+	}
+
+	//! returns TRUE if the handle refers to a stored value
+	bool		contains( uint32_t handle ) const { return getSlot( handle ) != NULL; }
+
+	//! returns a pointer to the value, or NULL if the handle was invalid or stale
+	T*			find( uint32_t handle ) { Slot *slot = getSlot( handle ); return slot ? &slot->value : NULL; }
+	const T*	find( uint32_t handle ) const { const Slot *slot = getSlot( handle ); return slot ? &slot->value : NULL; }
+
+	//! returns the number of stored values
+	size_t		size() const { return mSize; }
+	//! returns TRUE if no values are stored
+	bool		empty() const { return mSize == 0; }
+private:
+	struct Slot {
+		Slot() : value(), generation(1), used(false) {}
+
+		T			value;
+		uint32_t	generation;
+		bool		used;
+	};
+
+	Slot*		getSlot( uint32_t handle )
+	{
+		const uint32_t index = handle & kIndexMask;
+		if( index >= mSlots.size() ) return NULL;
+
+		Slot &slot = mSlots[index];
+		if( !slot.used || slot.generation != (handle >> kIndexBits) ) return NULL;
+
+		return &slot;
+	}
+
+	const Slot*	getSlot( uint32_t handle ) const { return const_cast<SlotMap*>(this)->getSlot( handle ); }
+private:
+	std::vector<Slot>		mSlots;
+	//! erased slots, oldest first
+	std::deque<uint32_t>	mFree;
+
+	size_t					mSize;
+};
+
+} } // namespace ph::nodes
@@ -0,0 +1,343 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "nodes/TransformStore.h"
+#include "nodes/Node.h"
+
+namespace ph { namespace nodes {
+
+using namespace ci;
+using namespace std;
+
+TransformStore& transforms()
+{
+	static TransformStore store;
+	return store;
+}
+
+uint32_t TransformStore::create( const Node *node )
+{
+	uint32_t handle;
+	uint32_t index;
+
+	if( ! mFree.empty() ) {
+		// reuse a released transform, it has no parent and no children
+		handle = mFree.back();
+		mFree.pop_back();
+
+		index = mIndices[handle];
+	}
+	else {
+		handle = (uint32_t) mIndices.size();
+		index = (uint32_t) mHandles.size();
+
+		mIndices.push_back( index );
+		mHandles.push_back( handle );
+		mParents.push_back( -1 );
+		mFlags.push_back( 0 );
+		mLocal.push_back( Matrix44f::identity() );
+		mWorld.push_back( Matrix44f::identity() );
+		mNodes.push_back( NULL );
+	}
+
+	mNodes[index] = node;
+	mParents[index] = -1;
+	mFlags[index] = LOCAL_INVALID | WORLD_INVALID;
+	mLocal[index].setToIdentity();
+	mWorld[index].setToIdentity();
+
+	mIsInvalid = true;
+
+	return handle;
+}
+
+void TransformStore::destroy( uint32_t handle )
+{
+	const uint32_t index = mIndices[handle];
+
+	mNodes[index] = NULL;
+	mParents[index] = -1;
+	mFlags[index] = 0;
+
+	mFree.push_back( handle );
+}
+
+void TransformStore::setParent( uint32_t handle, uint32_t parent )
+{
+	const uint32_t index = mIndices[handle];
+
+	if( parent == kInvalid ) {
+		mParents[index] = -1;
+	}
+	else {
+		mParents[index] = (int32_t) mIndices[parent];
+
+		// the order is only broken if the parent comes after its new child
+		if( mIndices[parent] > index )
+			mIsOrderInvalid = true;
+	}
+
+	mFlags[index] |= WORLD_INVALID;
+	mIsInvalid = true;
+}
+
+void TransformStore::invalidate( uint32_t handle )
+{
+	const uint32_t index = mIndices[handle];
+
+	mFlags[index] |= LOCAL_INVALID;
+
+	// each thread only writes the flags of its own nodes, the store is invalidated when it is no longer deferred
+	if( !mIsDeferred ) markInvalid( index );
+}
+
+void TransformStore::setLocal( uint32_t handle, const Matrix44f &transform )
+{
+	const uint32_t index = mIndices[handle];
+
+	mLocal[index] = transform;
+	mFlags[index] = (mFlags[index] & ~LOCAL_INVALID) | WORLD_INVALID;
+
+	// see invalidate()
+	if( !mIsDeferred ) markInvalid( index );
+}
+
+const Matrix44f& TransformStore::getLocal( uint32_t handle )
+{
+	const uint32_t index = mIndices[handle];
+
+	// prevent recursion if a node's transform() method asks for its own transform
+	if( (mFlags[index] & LOCAL_INVALID) && !mIsUpdating && !mIsDeferred ) {
+		mIsUpdating = true;
+		mCursor = mHandles.size();
+
+		calculateLocal( index );
+
+		mIsUpdating = false;
+	}
+
+	return mLocal[index];
+}
+
+const Matrix44f& TransformStore::getWorld( uint32_t handle )
+{
+	const uint32_t index = mIndices[handle];
+
+	// during update(), parents have already been processed when their children ask for them
+	if( !mIsInvalid || mIsUpdating || mIsDeferred )
+		return mWorld[index];
+
+	// find the topmost ancestor whose transform is out of date
+	size_t top = 0;
+
+	mPath.clear();
+	for(int32_t i=(int32_t) index;i>=0;i=mParents[i]) {
+		mPath.push_back( (uint32_t) i );
+		if( mFlags[i] & (LOCAL_INVALID | WORLD_INVALID) ) top = mPath.size();
+	}
+
+	if( top == 0 )
+		return mWorld[index];
+
+	mIsUpdating = true;
+	mCursor = mHandles.size();
+
+	// recalculate the path down from there, the flags are kept so update() will still notify the nodes
+	while( top-- > 0 ) {
+		const uint32_t i = mPath[top];
+
+		if( mFlags[i] & LOCAL_INVALID )
+			calculateLocal( i );
+
+		const int32_t parent = mParents[i];
+		if( parent >= 0 )
+			mWorld[i] = mWorld[parent] * mLocal[i];
+		else
+			mWorld[i] = mLocal[i];
+	}
+
+	mIsUpdating = false;
+
+	return mWorld[index];
+}
+
+void TransformStore::calculateLocal( size_t index )
+{
+	const Node *node = mNodes[index];
+	if( node ) node->transform();
+
+	// the node did not call setTransform()
+	if( mFlags[index] & LOCAL_INVALID ) {
+		if( node ) mLocal[index] = node->mTransform;
+		mFlags[index] = (mFlags[index] & ~LOCAL_INVALID) | WORLD_INVALID;
+	}
+}
+
+void TransformStore::update()
+{
+	// prevent recursion if a node's transform() method asks for a transform
+	if( !mIsInvalid || mIsUpdating || mIsDeferred ) return;
+	mIsUpdating = true;
+
+	// transforms invalidated during this pass will mark the store as invalid again,
+	// unless they come after the cursor and will still be processed
+	mIsInvalid = false;
+
+	if( mIsOrderInvalid )
+		sort();
+
+	// parents precede their children, so a single pass is enough to propagate the flags
+	const size_t count = mHandles.size();
+	for(size_t i=0;i<count;++i) {
+		mCursor = i;
+
+		uint8_t flags = mFlags[i] & (LOCAL_INVALID | WORLD_INVALID);
+
+		// let the node calculate its local transform
+		if( flags & LOCAL_INVALID ) {
+			calculateLocal( i );
+			flags = (mFlags[i] & WORLD_INVALID) | WORLD_INVALID;
+		}
+
+		// the flags of this transform have been processed, invalidations from here on are for the next update
+		mFlags[i] = 0;
+		mCursor = i + 1;
+
+		const int32_t parent = mParents[i];
+		if( parent >= 0 && (mFlags[parent] & WORLD_CHANGED) )
+			flags |= WORLD_INVALID;
+
+		if( flags & WORLD_INVALID ) {
+			if( parent >= 0 )
+				mWorld[i] = mWorld[parent] * mLocal[i];
+			else
+				mWorld[i] = mLocal[i];
+
+			// tell the children to follow
+			mFlags[i] |= WORLD_CHANGED;
+
+			// the nodes are notified after the sweep, so it only touches the arrays
+			mChanged.push_back( (uint32_t) i );
+		}
+	}
+
+	// invalidations by the nodes are for the next update
+	mCursor = count;
+
+	for(size_t j=0;j<mChanged.size();++j) {
+		const uint32_t i = mChanged[j];
+
+		// the node may have been destroyed by the notification of another node
+		const Node *node = mNodes[i];
+		if( !node ) continue;
+
+		// keep the copies of nodes that still read Node::mTransform and Node::mWorldTransform up to date
+		node->mTransform = mLocal[i];
+		node->mWorldTransform = mWorld[i];
+
+		// let the node update anything that depends on its world transform
+		node->worldTransformChanged();
+	}
+
+	mChanged.clear();
+
+	mCursor = 0;
+	mIsUpdating = false;
+}
+
+void TransformStore::sort()
+{
+	const size_t count = mHandles.size();
+
+	// find the depth of each transform
+	std::vector<uint32_t> depths( count, uint32_t(kInvalid) );
+	std::vector<uint32_t> path;
+	uint32_t maximum = 0;
+
+	for(size_t i=0;i<count;++i) {
+		// walk up until we find a transform with a known depth
+		uint32_t index = (uint32_t) i;
+		while( depths[index] == kInvalid && mParents[index] >= 0 ) {
+			path.push_back( index );
+			index = (uint32_t) mParents[index];
+		}
+
+		uint32_t depth = ( depths[index] == kInvalid ) ? 0 : depths[index];
+		depths[index] = depth;
+
+		// assign depths on the way back down
+		while( ! path.empty() ) {
+			depths[ path.back() ] = ++depth;
+			path.pop_back();
+		}
+
+		maximum = math<uint32_t>::max( maximum, depth );
+	}
+
+	// counting sort by depth, which keeps siblings in their current order
+	std::vector<uint32_t> offsets( maximum + 2, 0 );
+	for(size_t i=0;i<count;++i)
+		offsets[ depths[i] + 1 ]++;
+	for(size_t i=1;i<offsets.size();++i)
+		offsets[i] += offsets[i-1];
+
+	std::vector<uint32_t> order( count );
+	for(size_t i=0;i<count;++i)
+		order[ offsets[ depths[i] ]++ ] = (uint32_t) i;
+
+	// find the new index of each transform
+	std::vector<uint32_t> remap( count );
+	for(size_t i=0;i<count;++i)
+		remap[ order[i] ] = (uint32_t) i;
+
+	// permute the arrays
+	std::vector<uint32_t>		handles( count );
+	std::vector<int32_t>		parents( count );
+	std::vector<uint8_t>		flags( count );
+	std::vector<Matrix44f>		local( count );
+	std::vector<Matrix44f>		world( count );
+	std::vector<const Node*>	nodes( count );
+
+	for(size_t i=0;i<count;++i) {
+		const uint32_t from = order[i];
+
+		handles[i] = mHandles[from];
+		parents[i] = ( mParents[from] >= 0 ) ? (int32_t) remap[ mParents[from] ] : -1;
+		flags[i] = mFlags[from];
+		local[i] = mLocal[from];
+		world[i] = mWorld[from];
+		nodes[i] = mNodes[from];
+
+		mIndices[ handles[i] ] = (uint32_t) i;
+	}
+
+	mHandles.swap( handles );
+	mParents.swap( parents );
+	mFlags.swap( flags );
+	mLocal.swap( local );
+	mWorld.swap( world );
+	mNodes.swap( nodes );
+
+	mIsOrderInvalid = false;
+}
+
+} } // namespace ph::nodes
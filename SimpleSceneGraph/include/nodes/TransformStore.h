@@ -0,0 +1,115 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Matrix.h"
+
+#include <vector>
+
+namespace ph { namespace nodes {
+
+class Node;
+
+//! Stores the local and world transforms of all nodes in flat arrays (structure of arrays),
+//! ordered so that parents always precede their children. Invalidated transforms are
+//! recalculated in a single linear pass, without recursion or pointer chasing.
+class TransformStore
+{
+public:
+	static const uint32_t	kInvalid = 0xFFFFFFFF;
+public:
+	TransformStore(void) : mIsInvalid(false), mIsOrderInvalid(false), mIsUpdating(false), mIsDeferred(false), mCursor(0) {}
+	~TransformStore(void) {}
+
+	//! allocates a transform for the node and returns its handle
+	uint32_t	create( const Node *node );
+	//! releases the transform, its handle will be reused
+	void		destroy( uint32_t handle );
+
+	//! sets the parent of a transform (kInvalid if it has no parent)
+	void		setParent( uint32_t handle, uint32_t parent );
+
+	//! the node's transform() method will be called during the next update
+	void		invalidate( uint32_t handle );
+	//! sets the local transform, the world transforms of the node and its descendants will be recalculated.
+	//! If the node's transform() method has not been called yet, it no longer will be.
+	void		setLocal( uint32_t handle, const ci::Matrix44f &transform );
+
+	//! returns the local transform, only calling the node's transform() method if it was invalidated
+	const ci::Matrix44f&	getLocal( uint32_t handle );
+	//! returns the accumulated (world) transform. If it is out of date, only the transforms of
+	//! the node and its ancestors are recalculated. The nodes are notified during the next update().
+	const ci::Matrix44f&	getWorld( uint32_t handle );
+
+	//! recalculates all invalidated transforms and notifies the nodes whose world transform has changed
+	void		update();
+
+	//! while deferred, update() does nothing, so transforms can be read and invalidated from multiple threads
+	void		setDeferred( bool deferred ) { mIsDeferred = deferred; if(!deferred) mIsInvalid = true; }
+
+	//! returns the number of transforms in use
+	size_t		size() const { return mIndices.size() - mFree.size(); }
+private:
+	//! reorders the arrays, so that parents precede their children
+	void		sort();
+	//! calls the node's transform() method. Nodes that still set Node::mTransform instead of
+	//! calling Node::setTransform() are supported by copying their matrix.
+	void		calculateLocal( size_t index );
+	//! marks the store as invalid, unless the current update() will still process the transform
+	void		markInvalid( size_t index ) { if( !mIsUpdating || index < mCursor ) mIsInvalid = true; }
+private:
+	//! WORLD_CHANGED is set on transforms whose world transform was recalculated during the last update(),
+	//! so their children know they have to follow
+	enum { LOCAL_INVALID = 1, WORLD_INVALID = 2, WORLD_CHANGED = 4 };
+
+	//! index of each handle in the arrays below
+	std::vector<uint32_t>		mIndices;
+	//! handles that can be reused
+	std::vector<uint32_t>		mFree;
+
+	//! parent-ordered arrays
+	std::vector<uint32_t>		mHandles;
+	std::vector<int32_t>		mParents;
+	std::vector<uint8_t>		mFlags;
+	std::vector<ci::Matrix44f>	mLocal;
+	std::vector<ci::Matrix44f>	mWorld;
+	std::vector<const Node*>	mNodes;
+
+	bool						mIsInvalid;
+	bool						mIsOrderInvalid;
+	bool						mIsUpdating;
+	bool						mIsDeferred;
+
+	//! during update(), the index of the first transform whose flags have not been processed yet
+	size_t						mCursor;
+	//! scratch buffer for getWorld()
+	std::vector<uint32_t>		mPath;
+	//! scratch buffer for update(), the indices of the transforms whose world transform has changed
+	std::vector<uint32_t>		mChanged;
+};
+
+//! returns the transform store shared by all nodes
+TransformStore&	transforms();
+
+} } // namespace ph::nodes
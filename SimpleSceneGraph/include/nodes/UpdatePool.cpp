@@ -0,0 +1,198 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "nodes/UpdatePool.h"
+#include "nodes/Node.h"
+
+namespace ph { namespace nodes {
+
+using namespace std;
+
+boost::thread_specific_ptr<UpdatePool::Task>	UpdatePool::current( &UpdatePool::release );
+
+UpdatePool::UpdatePool( size_t threads )
+	: mElapsed(0.0), mGeneration(0), mRemaining(0)
+{
+	if( threads == 0 ) {
+		unsigned int numThreads = boost::thread::hardware_concurrency();
+		threads = (numThreads > 1) ? numThreads - 1 : 0;
+	}
+
+	// the calling thread uses the first queue
+	for(size_t i=0;i<=threads;++i)
+		mQueues.push_back( boost::shared_ptr<WorkQueue>( new WorkQueue() ) );
+
+	for(size_t i=1;i<=threads;++i)
+		mThreads.push_back( boost::shared_ptr<boost::thread>( new boost::thread( &UpdatePool::work, this, i ) ) );
+}
+
+UpdatePool::~UpdatePool(void)
+{
+	// stop worker threads and wait for them to finish
+	std::vector< boost::shared_ptr<boost::thread> >::const_iterator itr;
+	for(itr=mThreads.begin();itr!=mThreads.end();++itr) {
+		(*itr)->interrupt();
+		(*itr)->join();
+	}
+
+	mThreads.clear();
+}
+
+void UpdatePool::update( const std::vector<NodeRef> &subtrees, double elapsed )
+{
+	if( subtrees.empty() ) return;
+
+	mTasks.clear();
+	mTasks.resize( subtrees.size() );
+	for(size_t i=0;i<subtrees.size();++i)
+		mTasks[i].node = subtrees[i];
+
+	mElapsed = elapsed;
+
+	// start the round before queueing any task: a worker that is still leaving the previous round 
+	// may take one of the new tasks right away, and must count it against the new round
+	{
+		boost::mutex::scoped_lock lock( mMutex );
+		mRemaining = mTasks.size();
+		mException = std::exception_ptr();
+		++mGeneration;
+	}
+
+	// divide the tasks evenly, the workers will balance the load by stealing
+	const size_t count = mQueues.size();
+	for(size_t i=0;i<count;++i) {
+		boost::mutex::scoped_lock lock( mQueues[i]->mutex );
+		for(size_t j=i;j<mTasks.size();j+=count)
+			mQueues[i]->tasks.push_back( (uint32_t) j );
+	}
+
+	// wake up the workers
+	{
+		boost::mutex::scoped_lock lock( mMutex );
+		mStart.notify_all();
+	}
+
+	// help out, then wait for the remaining tasks to finish
+	process(0);
+
+	std::exception_ptr exception;
+	{
+		boost::mutex::scoped_lock lock( mMutex );
+		while( mRemaining > 0 )
+			mDone.wait( lock );
+
+		exception.swap( mException );
+	}
+
+	// the tree may be in an inconsistent state, so the deferred changes are not applied
+	if( exception ) {
+		mTasks.clear();
+		std::rethrow_exception( exception );
+	}
+
+	// sync point: apply the deferred changes in the order of the subtrees
+	std::vector<Task>::iterator itr;
+	for(itr=mTasks.begin();itr!=mTasks.end();++itr) {
+		std::vector< boost::function<void()> >::iterator fitr;
+		for(fitr=itr->deferred.begin();fitr!=itr->deferred.end();++fitr)
+			(*fitr)();
+	}
+
+	mTasks.clear();
+}
+
+void UpdatePool::work( size_t index )
+{
+	uint32_t generation = 0;
+
+	// run until interrupted
+	try {
+		for(;;) {
+			{
+				boost::mutex::scoped_lock lock( mMutex );
+				while( mGeneration == generation )
+					mStart.wait( lock );
+				generation = mGeneration;
+			}
+
+			process( index );
+		}
+	}
+	catch( const boost::thread_interrupted & ) {}
+}
+
+void UpdatePool::process( size_t index )
+{
+	uint32_t task;
+	while( pop( index, &task ) || steal( index, &task ) ) {
+		// the subtree is updated in the usual order, structural changes are deferred
+		std::exception_ptr exception;
+		try {
+			CurrentTask guard( &mTasks[task] );
+			mTasks[task].node->treeUpdate( mElapsed );
+		}
+		catch( ... ) {
+			// keep the exception for the thread that called update(), which would otherwise wait forever
+			exception = std::current_exception();
+		}
+
+		boost::mutex::scoped_lock lock( mMutex );
+		if( exception && !mException )
+			mException = exception;
+
+		if( --mRemaining == 0 )
+			mDone.notify_all();
+	}
+}
+
+bool UpdatePool::pop( size_t index, uint32_t *task )
+{
+	WorkQueue &queue = *mQueues[index];
+
+	boost::mutex::scoped_lock lock( queue.mutex );
+	if( queue.tasks.empty() ) return false;
+
+	*task = queue.tasks.back();
+	queue.tasks.pop_back();
+
+	return true;
+}
+
+bool UpdatePool::steal( size_t index, uint32_t *task )
+{
+	const size_t count = mQueues.size();
+	for(size_t i=1;i<count;++i) {
+		WorkQueue &queue = *mQueues[ (index + i) % count ];
+
+		boost::mutex::scoped_lock lock( queue.mutex );
+		if( queue.tasks.empty() ) continue;
+
+		*task = queue.tasks.front();
+		queue.tasks.pop_front();
+
+		return true;
+	}
+
+	return false;
+}
+
+} } // namespace ph::nodes
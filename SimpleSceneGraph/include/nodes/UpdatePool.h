@@ -0,0 +1,111 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <exception>
+#include <vector>
+
+namespace ph { namespace nodes {
+
+typedef boost::shared_ptr<class Node>	NodeRef;
+
+//! Updates independent subtrees of nodes on a pool of worker threads. Each worker has its own queue of 
+//! subtrees and steals from the other queues when it runs out of work. Structural changes requested
+//! during the update (see defer) are applied afterwards, in the order of the subtrees.
+class UpdatePool
+{
+public:
+	//! creates the pool, using one thread less than the number of CPU's if 'threads' is zero.
+	//! The calling thread also performs work.
+	UpdatePool( size_t threads = 0 );
+	~UpdatePool(void);
+
+	//! calls treeUpdate() on each subtree and blocks until all of them have been updated. If a subtree
+	//! throws an exception, the other subtrees are still updated, their deferred changes are discarded
+	//! and the first exception is rethrown.
+	void	update( const std::vector<NodeRef> &subtrees, double elapsed );
+
+	//! returns the number of threads performing work, including the calling thread
+	size_t	getNumThreads() const { return mQueues.size(); }
+
+	//! returns TRUE if called from a subtree that is being updated by the pool
+	static bool	isDeferring() { return current.get() != NULL; }
+	//! stores a function that will be called after all subtrees have been updated. Only call this if isDeferring() returns TRUE.
+	static void	defer( const boost::function<void()> &fn ) { current->deferred.push_back( fn ); }
+private:
+	struct Task {
+		NodeRef								node;
+		std::vector< boost::function<void()> >	deferred;
+	};
+
+	struct WorkQueue {
+		boost::mutex			mutex;
+		std::deque<uint32_t>	tasks;
+	};
+
+	//! the pool owns the tasks, so the thread specific pointer should not delete them
+	static void	release( Task *task ) {}
+
+	//! makes a task the current task of this thread for as long as it exists
+	struct CurrentTask {
+		CurrentTask( Task *task ) { current.reset( task ); }
+		~CurrentTask() { current.reset(); }
+	};
+
+	//! thread function of the workers
+	void	work( size_t index );
+	//! performs tasks until all queues are empty
+	void	process( size_t index );
+	//! takes a task from the back of the worker's own queue
+	bool	pop( size_t index, uint32_t *task );
+	//! takes a task from the front of another worker's queue
+	bool	steal( size_t index, uint32_t *task );
+private:
+	std::vector< boost::shared_ptr<boost::thread> >	mThreads;
+	std::vector< boost::shared_ptr<WorkQueue> >		mQueues;
+
+	std::vector<Task>			mTasks;
+	double						mElapsed;
+
+	//! protects the members below
+	boost::mutex				mMutex;
+	boost::condition_variable	mStart;
+	boost::condition_variable	mDone;
+
+	uint32_t					mGeneration;
+	size_t						mRemaining;
+	//! the first exception thrown by a subtree, rethrown by update()
+	std::exception_ptr			mException;
+
+	//! the task that is being performed by the current thread
+	static boost::thread_specific_ptr<Task>	current;
+};
+
+} } // namespace ph::nodes
@@ -64,10 +64,8 @@ void NodeRectangle::draw()
 
 	// draw lines to the origin of each child
 	gl::color( Color(0,1,1) );
-	NodeRectangleList nodes = getChildren<NodeRectangle>();
-	NodeRectangleList::iterator itr;
-	for(itr=nodes.begin(); itr!=nodes.end(); ++itr) 
-		gl::drawLine( getAnchor(), (*itr)->getPosition() );
+	for(NodeRectangle *node=getFirstChild<NodeRectangle>(); node; node=node->getNextSibling<NodeRectangle>()) 
+		gl::drawLine( getAnchor(), node->getPosition() );
 }
 
 bool NodeRectangle::mouseMove(MouseEvent event)
@@ -23,14 +23,69 @@
 #include "cinder/app/AppBasic.h"
 #include "cinder/gl/gl.h"
 #include "cinder/gl/Texture.h"
+#include "cinder/Rand.h"
+#include "cinder/Timer.h"
+#include "cinder/Utilities.h"
 
 #include "NodeRectangle.h"
+#include "nodes/NodeSnapshot.h"
+#include "nodes/UpdatePool.h"
 
 using namespace ci;
 using namespace ci::app;
 using namespace std;
 using namespace ph::nodes;
 
+//! Backend that does not draw anything, used to measure the draw list without OpenGL
+class DrawCounter : public DrawBackend {
+public:
+	DrawCounter(void) { clear(); }
+
+	void	clear() { mStates = 0; mDraws = 0; }
+
+	void	setState( const DrawCommand *previous, const DrawCommand &next ) { ++mStates; }
+	void	push( const DrawCommand &cmd ) { ++mStates; }
+	void	draw( const DrawCommand &cmd, const Matrix44f &world ) { ++mDraws; }
+
+	size_t	mStates;
+	size_t	mDraws;
+};
+
+//! Opaque rectangle using one of a few render states, used by the benchmark
+class SortableRectangle : public Node2D {
+public:
+	SortableRectangle( uint32_t state ) : mState(state) {}
+
+	uint32_t	getStateKey() const { return mState; }
+	bool		isSortable() const { return true; }
+protected:
+	uint32_t	mState;
+};
+
+//! Rectangle that eases towards a target, used by the benchmark. It only changes its own 
+//! state, so it can safely be updated on another thread.
+class AnimatedRectangle : public Node2D {
+public:
+	AnimatedRectangle( const Vec2f &target ) : mTarget(target), mVelocity(Vec2f::zero()) {}
+
+	bool	isUpdateParallelSafe() const { return true; }
+
+	void	update( double elapsed ) {
+		// damped spring, integrated in small steps
+		Vec2f position = getPosition();
+		for(int i=0;i<20;++i) {
+			Vec2f force = 40.0f * (mTarget - position) - 5.0f * mVelocity;
+			mVelocity += force * 0.001f;
+			position += mVelocity * 0.001f;
+		}
+		setPosition( position );
+		setRotation( math<float>::atan2( mVelocity.y, mVelocity.x ) );
+	}
+protected:
+	Vec2f	mTarget;
+	Vec2f	mVelocity;
+};
+
 class SimpleSceneGraphApp : public AppBasic {
 public:
 	void prepareSettings( Settings *settings );
@@ -49,11 +104,29 @@ public:
 	void keyUp( KeyEvent event );
 
 	void resize();
+
+	//! measures hit testing of a large number of rectangles, without drawing them
+	void benchmarkPicking();
+	//! measures compiling and sorting a draw list of a large number of rectangles, without drawing them
+	void benchmarkDrawList();
+	//! measures updating a large number of animated nodes, with and without worker threads
+	void benchmarkUpdate();
+	//! measures building, reordering and destroying a large tree, and the memory used by its nodes
+	void benchmarkNodes();
+	//! measures writing a large tree to a snapshot and reading it back
+	void benchmarkSnapshot();
 protected:
 	//! The root node
 	Node2DRef			mRoot;
 	//! The big rectangle that acts as a parent for the smaller ones
 	NodeRectangleRef	mParent;
+
+	//! The compiled list of draw commands and the backend that draws them
+	DrawList			mDrawList;
+	GlDrawBackend		mDrawBackend;
+	//! If FALSE, the tree is drawn by calling treeDraw(). Both call predraw() and postdraw() around
+	//! each subtree, except that the draw list groups sortable nodes by state (see GlDrawBackend).
+	bool				mUseDrawList;
 };
 
 void SimpleSceneGraphApp::prepareSettings( Settings *settings )
@@ -63,6 +136,11 @@ void SimpleSceneGraphApp::prepareSettings( Settings *settings )
 
 void SimpleSceneGraphApp::setup()
 {
+	mUseDrawList = true;
+
+	// node types that can be stored in a snapshot
+	snapshotTypes().add<NodeRectangle>( "NodeRectangle" );
+
 	// create the root node
 	mRoot = Node2DRef( new Node2D() );
 
@@ -137,8 +215,12 @@ void SimpleSceneGraphApp::draw()
 	gl::clear();
 	gl::setMatricesWindow( getWindowSize(), true );
 
-	// draw all nodes, starting with the root node
-	mRoot->treeDraw();
+	// draw all nodes, starting with the root node. The draw list only 
+	// visits the nodes again if the tree has changed.
+	if( mUseDrawList )
+		mDrawList.draw( mRoot.get(), &mDrawBackend );
+	else
+		mRoot->treeDraw();
 
 	// example of coordinate conversion: 
 	// convert big rectangle's origin to screen coordinates and draw a red circle there
@@ -148,29 +230,27 @@ void SimpleSceneGraphApp::draw()
 
 void SimpleSceneGraphApp::mouseMove( MouseEvent event )
 {
-	// pass the mouseMove event to all nodes. Important: this can easily bring your
-	// frame rate down if you have a lot of nodes and none of them does anything with
-	// this event. Only use it if you have just a few nodes, like in this sample,
-	// or catch it as soon as possible by returning TRUE in your mouseMove() method.
+	// pass the mouseMove event to the nodes under the mouse. They are found 
+	// using a spatial index, so this is quick even if you have a lot of nodes.
 	mRoot->treeMouseMove(event);
 }
 
 void SimpleSceneGraphApp::mouseDown( MouseEvent event )
 {
-	// pass the mouseDown event to all nodes. This is usually very quick because
-	// it starts at the top nodes and they often catch the event.
+	// pass the mouseDown event to the nodes under the mouse, starting with the top node.
 	mRoot->treeMouseDown(event);
 }
 
 void SimpleSceneGraphApp::mouseDrag( MouseEvent event )
 {
-	// pass the mouseDrag event to all nodes. This is usually very quick.
+	// pass the mouseDrag event to the node that handled the mouseDown event.
 	mRoot->treeMouseDrag(event);
 }
 
 void SimpleSceneGraphApp::mouseUp( MouseEvent event )
 {
-	// pass the mouseUp event to all nodes. This is usually very quick.
+	// pass the mouseUp event to the node that handled the mouseDown event
+	// and to the nodes under the mouse.
 	mRoot->treeMouseUp(event);
 }
 
@@ -182,6 +262,24 @@ void SimpleSceneGraphApp::keyDown( KeyEvent event )
 		case KeyEvent::KEY_ESCAPE:
 			quit();
 			break;
+		case KeyEvent::KEY_b:
+			benchmarkPicking();
+			break;
+		case KeyEvent::KEY_c:
+			mUseDrawList = !mUseDrawList;
+			break;
+		case KeyEvent::KEY_d:
+			benchmarkDrawList();
+			break;
+		case KeyEvent::KEY_n:
+			benchmarkNodes();
+			break;
+		case KeyEvent::KEY_s:
+			benchmarkSnapshot();
+			break;
+		case KeyEvent::KEY_u:
+			benchmarkUpdate();
+			break;
 		case KeyEvent::KEY_RETURN:
 			if(event.isAltDown()) {
 				setFullScreen( !isFullScreen() );
@@ -201,4 +299,347 @@ void SimpleSceneGraphApp::resize()
 	mRoot->treeResize();
 }
 
+void SimpleSceneGraphApp::benchmarkPicking()
+{
+	const size_t	kNodes = 100000;
+	const size_t	kQueries = 10000;
+	const float		kSize = 4000.0f;
+
+	Rand rnd(12345);
+
+	// create a separate tree, it will not be drawn
+	Timer timer(true);
+
+	Node2DRef root( new Node2D() );
+	std::vector<Node2DRef> nodes;
+	nodes.reserve(kNodes);
+
+	for(size_t i=0;i<kNodes;++i) {
+		NodeRectangleRef node( new NodeRectangle() );
+		node->setPosition( rnd.nextFloat(kSize), rnd.nextFloat(kSize) );
+		node->setRotation( toRadians( rnd.nextFloat(-15.0f, 15.0f) ) );
+		node->setSize( rnd.nextFloat(10.0f, 50.0f), rnd.nextFloat(10.0f, 50.0f) );
+		root->addChild(node);
+
+		nodes.push_back(node);
+	}
+
+	double create = timer.getSeconds();
+
+	// the first query builds the spatial index
+	NodeList hits;
+
+	timer.start();
+	root->pick( Vec2f::zero(), &hits );
+	double build = timer.getSeconds();
+
+	// random queries using the spatial index
+	std::vector<Vec2f> points(kQueries);
+	for(size_t i=0;i<kQueries;++i)
+		points[i] = Vec2f( rnd.nextFloat(kSize), rnd.nextFloat(kSize) );
+
+	size_t picked = 0;
+
+	timer.start();
+	for(size_t i=0;i<kQueries;++i) {
+		hits.clear();
+		root->pick( points[i], &hits );
+		picked += hits.size();
+	}
+	double query = timer.getSeconds();
+
+	// the same queries, testing the bounds of every node
+	size_t tested = 0;
+	const size_t kBruteForce = kQueries / 100;
+
+	timer.start();
+	for(size_t i=0;i<kBruteForce;++i) {
+		Rectf bounds;
+
+		std::vector<Node2DRef>::const_iterator itr;
+		for(itr=nodes.begin();itr!=nodes.end();++itr)
+			if( (*itr)->getWorldBounds(&bounds) && bounds.contains( points[i] ) ) tested++;
+	}
+	double brute = timer.getSeconds();
+
+	size_t expected = 0;
+	for(size_t i=0;i<kBruteForce;++i) {
+		hits.clear();
+		root->pick( points[i], &hits );
+		expected += hits.size();
+	}
+
+	// move 1% of the nodes, the spatial index is updated by the next query
+	timer.start();
+	for(size_t i=0;i<kNodes;i+=100)
+		nodes[i]->setPosition( nodes[i]->getPosition() + rnd.nextVec2f() * 10.0f );
+
+	hits.clear();
+	root->pick( Vec2f::zero(), &hits );
+	double move = timer.getSeconds();
+
+	console() << "Picking " << kNodes << " rectangles:" << std::endl;
+	console() << "  created in " << (1000.0 * create) << " ms, index built in " << (1000.0 * build) << " ms" << std::endl;
+	console() << "  spatial index: " << (1.0e6 * query / kQueries) << " us per query, " << (double(picked) / kQueries) << " hits per query" << std::endl;
+	console() << "  brute force:   " << (1.0e6 * brute / kBruteForce) << " us per query, " << (tested == expected ? "same hits" : "DIFFERENT hits") << std::endl;
+	console() << "  moving " << (kNodes / 100) << " nodes: " << (1000.0 * move) << " ms" << std::endl;
+}
+
+void SimpleSceneGraphApp::benchmarkDrawList()
+{
+	const size_t	kGroups = 1000;
+	const size_t	kNodesPerGroup = 100;
+	const uint32_t	kStates = 8;
+	const int		kCount = 10;
+
+	Rand rnd(12345);
+
+	// create a separate tree of groups, containing rectangles in random render states
+	Node2DRef root( new Node2D() );
+	std::vector<Node2DRef> groups;
+
+	for(size_t i=0;i<kGroups;++i) {
+		Node2DRef group( new Node2D() );
+		root->addChild(group);
+		groups.push_back(group);
+
+		for(size_t j=0;j<kNodesPerGroup;++j) {
+			Node2DRef node( new SortableRectangle( 1 + rnd.nextUint(kStates) ) );
+			node->setPosition( rnd.nextFloat(800.0f), rnd.nextFloat(600.0f) );
+			node->setSize( 20.0f, 20.0f );
+			group->addChild(node);
+		}
+	}
+
+	// calculate the transforms up front, so they are not part of the measurements
+	transforms().update();
+
+	DrawList list;
+	DrawCounter counter;
+
+	// compile the complete tree
+	Timer timer(true);
+	list.compile( root.get() );
+	double full = timer.getSeconds();
+
+	timer.start();
+	list.replay( &counter );
+	double sort = timer.getSeconds();
+
+	// count the state changes if the list would not have been sorted
+	size_t unsorted = 0;
+	const std::vector<DrawCommand> &commands = list.getCommands();
+	for(size_t i=0;i<commands.size();++i)
+		if( i == 0 || commands[i].state != commands[i-1].state ) unsorted++;
+
+	// compiling an unchanged tree does nothing
+	timer.start();
+	for(int i=0;i<kCount;++i)
+		list.compile( root.get() );
+	double unchanged = timer.getSeconds() / kCount;
+
+	// moving nodes does not require compiling either
+	timer.start();
+	for(int i=0;i<kCount;++i) {
+		for(size_t j=0;j<kGroups;++j)
+			groups[j]->setPosition( rnd.nextVec2f() * 10.0f );
+		list.compile( root.get() );
+	}
+	double moved = timer.getSeconds() / kCount;
+
+	// reordering the children of a single group only compiles that group
+	timer.start();
+	for(int i=0;i<kCount;++i) {
+		groups[ rnd.nextUint(kGroups) ]->getFirstChild()->putOnTop();
+		list.compile( root.get() );
+	}
+	double reordered = timer.getSeconds() / kCount;
+
+	// sort the list before measuring the replay
+	list.replay( &counter );
+
+	timer.start();
+	for(int i=0;i<kCount;++i) {
+		counter.clear();
+		list.replay( &counter );
+	}
+	double replay = timer.getSeconds() / kCount;
+
+	console() << "Draw list of " << commands.size() << " nodes:" << std::endl;
+	console() << "  full compile: " << (1000.0 * full) << " ms, sort: " << (1000.0 * sort) << " ms" << std::endl;
+	console() << "  compile unchanged: " << (1000.0 * unchanged) << " ms, after moving: " << (1000.0 * moved) << " ms, after reordering one group: " << (1000.0 * reordered) << " ms" << std::endl;
+	console() << "  replay: " << (1000.0 * replay) << " ms, " << counter.mDraws << " draws, " << counter.mStates << " state changes (" << unsorted << " unsorted)" << std::endl;
+}
+
+void SimpleSceneGraphApp::benchmarkUpdate()
+{
+	const size_t	kSubtrees = 500;
+	const size_t	kNodesPerSubtree = 200;
+	const int		kCount = 10;
+
+	Rand rnd(12345);
+
+	// each subtree is a chain of groups, so the update order within a subtree matters
+	Node2DRef root( new Node2D() );
+	for(size_t i=0;i<kSubtrees;++i) {
+		NodeRef parent = root;
+		for(size_t j=0;j<kNodesPerSubtree;++j) {
+			Node2DRef node( new AnimatedRectangle( Vec2f( rnd.nextFloat(800.0f), rnd.nextFloat(600.0f) ) ) );
+			parent->addChild(node);
+			if( j % 10 == 9 ) parent = node;
+		}
+	}
+
+	// calculate the initial transforms up front
+	transforms().update();
+
+	// serial
+	Timer timer(true);
+	for(int i=0;i<kCount;++i)
+		root->treeUpdate();
+	double serial = timer.getSeconds() / kCount;
+
+	// parallel, using all CPU's
+	UpdatePool pool;
+
+	timer.start();
+	for(int i=0;i<kCount;++i)
+		root->treeUpdate( pool );
+	double parallel = timer.getSeconds() / kCount;
+
+	// the transforms are recalculated after the update
+	timer.start();
+	transforms().update();
+	double transform = timer.getSeconds();
+
+	console() << "Updating " << (kSubtrees * kNodesPerSubtree) << " nodes in " << kSubtrees << " subtrees:" << std::endl;
+	console() << "  serial: " << (1000.0 * serial) << " ms, parallel: " << (1000.0 * parallel) << " ms on " << pool.getNumThreads() << " threads" << std::endl;
+	console() << "  recalculating the transforms afterwards: " << (1000.0 * transform) << " ms" << std::endl;
+}
+
+void SimpleSceneGraphApp::benchmarkNodes()
+{
+	const size_t	kGroups = 100;
+	const size_t	kNodesPerGroup = 1000;
+	const int		kCount = 100000;
+
+	Rand rnd(12345);
+
+	const size_t blocks = nodeArena().getBlocksInUse();
+	const size_t bytes = nodeArena().getBytesInUse();
+
+	// build a separate tree, it will not be drawn
+	Timer timer(true);
+
+	Node2DRef root( new Node2D() );
+	std::vector<Node2DRef> groups;
+	for(size_t i=0;i<kGroups;++i) {
+		Node2DRef group( new Node2D() );
+		root->addChild(group);
+		groups.push_back(group);
+
+		for(size_t j=0;j<kNodesPerGroup;++j) {
+			NodeRectangleRef node( new NodeRectangle() );
+			node->setPosition( rnd.nextVec2f() * 100.0f );
+			group->addChild(node);
+		}
+	}
+	double build = timer.getSeconds();
+
+	const size_t nodes = nodeArena().getBlocksInUse() - blocks;
+	const size_t size = nodeArena().getBytesInUse() - bytes;
+
+	// move random children to the top or bottom of their group
+	timer.start();
+	for(int i=0;i<kCount;++i) {
+		Node2DRef group = groups[ rnd.nextUint(kGroups) ];
+		if( i & 1 ) group->getFirstChild()->putOnTop();
+		else group->moveToBottom( group->getLastChild()->shared_from_this() );
+	}
+	double reorder = timer.getSeconds();
+
+	// iterate over all children of a specific type
+	timer.start();
+	size_t found = 0;
+	for(size_t i=0;i<kGroups;++i)
+		for(NodeRectangle *node=groups[i]->getFirstChild<NodeRectangle>();node;node=node->getNextSibling<NodeRectangle>())
+			++found;
+	double iterate = timer.getSeconds();
+
+	groups.clear();
+
+	timer.start();
+	root.reset();
+	double destroy = timer.getSeconds();
+
+	console() << "Building a tree of " << nodes << " nodes: " << (1000.0 * build) << " ms, destroying it: " << (1000.0 * destroy) << " ms" << std::endl;
+	console() << "  " << kCount << " reorders: " << (1000.0 * reorder) << " ms, iterating over " << found << " children: " << (1000.0 * iterate) << " ms" << std::endl;
+	console() << "  arena: " << (size / nodes) << " bytes per node, " << (nodeArena().getBytesReserved() / 1024) << " KB reserved" << std::endl;
+}
+
+void SimpleSceneGraphApp::benchmarkSnapshot()
+{
+	const size_t	kGroups = 100;
+	const size_t	kNodesPerGroup = 1000;
+
+	Rand rnd(12345);
+
+	// build a separate tree procedurally, it will not be drawn
+	Timer timer(true);
+
+	Node2DRef root( new Node2D() );
+	for(size_t i=0;i<kGroups;++i) {
+		Node2DRef group( new Node2D() );
+		group->setPosition( rnd.nextFloat(800.0f), rnd.nextFloat(600.0f) );
+		root->addChild(group);
+
+		for(size_t j=0;j<kNodesPerGroup;++j) {
+			NodeRectangleRef node( new NodeRectangle() );
+			node->setPosition( rnd.nextVec2f() * 100.0f );
+			node->setRotation( rnd.nextFloat( 2.0f * (float) M_PI ) );
+			node->setSize( 10.0f, 10.0f );
+			group->addChild(node);
+		}
+	}
+	transforms().update();
+	double build = timer.getSeconds();
+
+	const fs::path path = getTemporaryDirectory() / "SimpleSceneGraph.snapshot";
+
+	timer.start();
+	NodeSnapshot::write( root, writeFile(path) );
+	double write = timer.getSeconds();
+
+	timer.start();
+	NodeRef loaded = NodeSnapshot::read( loadFile(path) );
+	transforms().update();
+	double read = timer.getSeconds();
+
+	// compare the world transforms of both trees
+	size_t nodes = 0;
+	float error = 0.0f;
+
+	std::vector< std::pair<Node*, Node*> > stack;
+	stack.push_back( std::make_pair( root.get(), loaded.get() ) );
+	while( !stack.empty() ) {
+		Node *a = stack.back().first;
+		Node *b = stack.back().second;
+		stack.pop_back();
+
+		for(int k=0;k<16;++k)
+			error = math<float>::max( error, math<float>::abs( a->getWorldTransform().m[k] - b->getWorldTransform().m[k] ) );
+		++nodes;
+
+		for(a=a->getFirstChild(),b=b->getFirstChild();a&&b;a=a->getNextSibling(),b=b->getNextSibling())
+			stack.push_back( std::make_pair( a, b ) );
+		if(a || b) error = std::numeric_limits<float>::max();
+	}
+
+	console() << "Snapshot of " << nodes << " nodes, " << (fs::file_size(path) / 1024) << " KB:" << std::endl;
+	console() << "  building: " << (1000.0 * build) << " ms, writing: " << (1000.0 * write) << " ms, reading: " << (1000.0 * read) << " ms" << std::endl;
+	console() << "  largest difference in the world transforms: " << error << std::endl;
+
+	fs::remove(path);
+}
+
 CINDER_APP_BASIC( SimpleSceneGraphApp, RendererGl )
\ No newline at end of file
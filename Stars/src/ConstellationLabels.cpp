@@ -70,7 +70,7 @@ void ConstellationLabels::load( DataSourceRef source )
 {
 	console() << "Loading constellation label database from CSV, please wait..." << std::endl;
 
-	mLabels.clear();
+	clear();
 
 	// load the star database
 	std::string	names = loadString( source );
@@ -105,7 +105,7 @@ void ConstellationLabels::load( DataSourceRef source )
 
 			Vec3f position = 2000.0f * Vec3f((float) (sin(alpha) * cos(delta)), (float) sin(delta), (float) (cos(alpha) * cos(delta)));
 
-			mLabels.addLabel( position, name );
+			addLabel( position, name );
 		}
 		catch(...) {
 			// some of the data was invalid, ignore 
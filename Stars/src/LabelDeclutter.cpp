@@ -0,0 +1,280 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LabelDeclutter.h"
+
+#include "cinder/CinderMath.h"
+
+#include <algorithm>
+
+using namespace ci;
+using namespace std;
+
+const float LabelDeclutter::kPadding = 2.0f;
+const float LabelDeclutter::kTolerance = 1.0f;
+
+LabelDeclutter::LabelDeclutter(void)
+	: mColumns(0), mRows(0), mInvalid(true), mNumVisible(0), mNumEvaluated(0)
+{
+}
+
+LabelDeclutter::~LabelDeclutter(void)
+{
+}
+
+void LabelDeclutter::clear()
+{
+	mLabels.clear();
+	mOrder.clear();
+	mVisibility.clear();
+
+	mInvalid = true;
+}
+
+void LabelDeclutter::addLabel( const Vec3f &anchor, const Rectf &bounds, float magnitude )
+{
+	Label label;
+	label.anchor = anchor;
+	label.bounds = bounds;
+	label.magnitude = magnitude;
+	label.rect = Rectf(0.0f, 0.0f, 0.0f, 0.0f);
+	label.previous = label.rect;
+	label.brightness = magnitude;
+	label.onscreen = false;
+	label.changed = true;
+
+	mOrder.push_back( (uint32_t) mLabels.size() );
+	mLabels.push_back( label );
+	mVisibility.push_back( 0 );
+
+	mInvalid = true;
+}
+
+bool LabelDeclutter::update( const Camera &camera, const Vec2i &size )
+{
+	const Matrix44f matrix = camera.getProjectionMatrix() * camera.getModelViewMatrix();
+
+	// nothing to do if the camera did not move
+	if( !mInvalid && size == mSize && matrix == mMatrix )
+		return false;
+
+	const bool force = mInvalid || size != mSize;
+
+	mMatrix = matrix;
+	mSize = size;
+	mInvalid = false;
+
+	// resize the grid
+	if( force ) {
+		mColumns = math<int32_t>::max( 1, (size.x + kCellSize - 1) / kCellSize );
+		mRows = math<int32_t>::max( 1, (size.y + kCellSize - 1) / kCellSize );
+
+		mCells.resize( mColumns * mRows );
+		mDirty.resize( mColumns * mRows );
+	}
+
+	project( matrix, camera.getEyePoint(), force );
+	sort( force );
+
+	// clear the grid, but keep the memory
+	for(size_t i=0;i<mCells.size();++i)
+		mCells[i].clear();
+	std::fill( mDirty.begin(), mDirty.end(), 0 );
+
+	// accept labels from bright to faint, unless they overlap a brighter label
+	bool modified = false;
+
+	mNumVisible = 0;
+	mNumEvaluated = 0;
+
+	for(size_t i=0;i<mOrder.size();++i) {
+		const uint32_t index = mOrder[i];
+		Label &label = mLabels[index];
+
+		const bool wasVisible = ( mVisibility[index] != 0 );
+		bool visible = wasVisible;
+
+		if( !label.onscreen ) {
+			// make room for other labels
+			if( wasVisible ) markDirty( label.previous );
+			visible = false;
+		}
+		else if( label.changed || isDirty( label.rect ) ) {
+			visible = !overlaps( label.rect );
+			++mNumEvaluated;
+
+			if( label.changed || visible != wasVisible ) {
+				if( wasVisible ) markDirty( label.previous );
+				if( visible ) markDirty( label.rect );
+			}
+		}
+
+		if( visible ) {
+			insert( index );
+			++mNumVisible;
+		}
+
+		if( visible != wasVisible ) {
+			mVisibility[index] = visible ? 255 : 0;
+			modified = true;
+		}
+	}
+
+	return modified;
+}
+
+void LabelDeclutter::project( const Matrix44f &matrix, const Vec3f &eye, bool force )
+{
+	const Rectf screen( 0.0f, 0.0f, (float) mSize.x, (float) mSize.y );
+
+	vector<Label>::iterator itr;
+	for(itr=mLabels.begin();itr!=mLabels.end();++itr) {
+		// convert anchor to screen space (in pixels, y pointing down)
+		Vec4f pt = matrix * Vec4f( itr->anchor, 1.0f );
+
+		bool onscreen = false;
+		Rectf rect( 0.0f, 0.0f, 0.0f, 0.0f );
+
+		if( pt.w > 0.0f ) {
+			Vec2f position( (0.5f + 0.5f * pt.x / pt.w) * mSize.x, (0.5f - 0.5f * pt.y / pt.w) * mSize.y );
+			rect = itr->bounds.getOffset( position );
+			onscreen = rect.intersects( screen );
+		}
+
+		// labels that barely moved keep the rectangle of their last evaluation
+		itr->previous = itr->rect;
+		itr->changed = force || onscreen != itr->onscreen
+			|| ( onscreen && rect.getUpperLeft().distanceSquared( itr->rect.getUpperLeft() ) > kTolerance * kTolerance );
+		itr->onscreen = onscreen;
+
+		if( itr->changed )
+			itr->rect = rect;
+
+		// apparent magnitude, assuming distances in parsecs
+		float distance = math<float>::max( eye.distance( itr->anchor ), 0.001f );
+		itr->brightness = itr->magnitude + 5.0f * ( math<float>::log10( distance ) - 1.0f );
+	}
+}
+
+void LabelDeclutter::sort( bool force )
+{
+	const vector<Label> &labels = mLabels;
+	
+	if( !force ) {
+		// the order rarely changes much from one update to the next, an insertion sort is almost linear.
+		// Labels that change rank are re-evaluated.
+		size_t shifts = 0;
+		const size_t limit = 16 * mOrder.size();
+
+		for(size_t i=1;i<mOrder.size() && shifts<limit;++i) {
+			const uint32_t index = mOrder[i];
+			const float brightness = labels[index].brightness;
+
+			size_t j = i;
+			while( j > 0 && labels[ mOrder[j-1] ].brightness > brightness ) {
+				mOrder[j] = mOrder[j-1];
+				mLabels[ mOrder[j] ].changed = true;
+				--j;
+			}
+
+			if( j != i ) {
+				mOrder[j] = index;
+				mLabels[index].changed = true;
+				shifts += i - j;
+			}
+		}
+
+		if( shifts < limit )
+			return;
+	}
+
+	// the order changed too much, sort from scratch and re-evaluate everything
+	std::sort( mOrder.begin(), mOrder.end(), [&labels]( uint32_t a, uint32_t b ) { return labels[a].brightness < labels[b].brightness; } );
+
+	vector<Label>::iterator itr;
+	for(itr=mLabels.begin();itr!=mLabels.end();++itr)
+		itr->changed = true;
+}
+
+bool LabelDeclutter::getCells( const Rectf &rect, int32_t *x1, int32_t *y1, int32_t *x2, int32_t *y2 ) const
+{
+	*x1 = math<int32_t>::max( 0, (int32_t) math<float>::floor( (rect.x1 - kPadding) / kCellSize ) );
+	*y1 = math<int32_t>::max( 0, (int32_t) math<float>::floor( (rect.y1 - kPadding) / kCellSize ) );
+	*x2 = math<int32_t>::min( mColumns - 1, (int32_t) math<float>::floor( (rect.x2 + kPadding) / kCellSize ) );
+	*y2 = math<int32_t>::min( mRows - 1, (int32_t) math<float>::floor( (rect.y2 + kPadding) / kCellSize ) );
+
+	return (*x1 <= *x2) && (*y1 <= *y2);
+}
+
+void LabelDeclutter::markDirty( const Rectf &rect )
+{
+	int32_t x1, y1, x2, y2;
+	if( !getCells( rect, &x1, &y1, &x2, &y2 ) ) return;
+
+	for(int32_t y=y1;y<=y2;++y)
+		for(int32_t x=x1;x<=x2;++x)
+			mDirty[y * mColumns + x] = 1;
+}
+
+bool LabelDeclutter::isDirty( const Rectf &rect ) const
+{
+	int32_t x1, y1, x2, y2;
+	if( !getCells( rect, &x1, &y1, &x2, &y2 ) ) return false;
+
+	for(int32_t y=y1;y<=y2;++y)
+		for(int32_t x=x1;x<=x2;++x)
+			if( mDirty[y * mColumns + x] ) return true;
+
+	return false;
+}
+
+bool LabelDeclutter::overlaps( const Rectf &rect ) const
+{
+	int32_t x1, y1, x2, y2;
+	if( !getCells( rect, &x1, &y1, &x2, &y2 ) ) return false;
+
+	for(int32_t y=y1;y<=y2;++y) {
+		for(int32_t x=x1;x<=x2;++x) {
+			const vector<uint32_t> &cell = mCells[y * mColumns + x];
+
+			vector<uint32_t>::const_iterator itr;
+			for(itr=cell.begin();itr!=cell.end();++itr) {
+				const Rectf &other = mLabels[*itr].rect;
+				if( rect.x1 < other.x2 + kPadding && rect.x2 + kPadding > other.x1 &&
+					rect.y1 < other.y2 + kPadding && rect.y2 + kPadding > other.y1 )
+					return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void LabelDeclutter::insert( uint32_t index )
+{
+	int32_t x1, y1, x2, y2;
+	if( !getCells( mLabels[index].rect, &x1, &y1, &x2, &y2 ) ) return;
+
+	for(int32_t y=y1;y<=y2;++y)
+		for(int32_t x=x1;x<=x2;++x)
+			mCells[y * mColumns + x].push_back( index );
+}
@@ -0,0 +1,111 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Camera.h"
+#include "cinder/Matrix.h"
+#include "cinder/Rect.h"
+#include "cinder/Vector.h"
+
+#include <vector>
+
+//! Decides which labels to show, so they don't overlap on screen. Labels are ranked by their
+//! apparent magnitude and accepted greedily, using a uniform grid to find overlapping labels.
+//! Labels that barely moved since the previous update and are not near a label that changed
+//! keep their previous state, so only the changed regions of the screen are re-evaluated.
+class LabelDeclutter
+{
+public:
+	LabelDeclutter(void);
+	~LabelDeclutter(void);
+
+	//! removes all labels
+	void	clear();
+	//! adds a label. The bounds are in pixels, relative to the projected anchor.
+	void	addLabel( const ci::Vec3f &anchor, const ci::Rectf &bounds, float magnitude );
+	//! returns the number of labels
+	size_t	size() const { return mLabels.size(); }
+
+	//! decides which labels are visible. Returns TRUE if the visibility has changed.
+	bool	update( const ci::Camera &camera, const ci::Vec2i &size );
+
+	//! visibility of each label, in the order they were added: 0 (hidden) or 255 (visible)
+	const std::vector<uint8_t>&	getVisibility() const { return mVisibility; }
+	//! returns the number of visible labels
+	size_t	getNumVisible() const { return mNumVisible; }
+	//! returns the number of labels that were tested against the grid during the last update
+	size_t	getNumEvaluated() const { return mNumEvaluated; }
+private:
+	struct Label {
+		ci::Vec3f	anchor;
+		ci::Rectf	bounds;
+		float		magnitude;
+
+		ci::Rectf	rect;		// screen space rectangle at the time of the last evaluation
+		ci::Rectf	previous;	// screen space rectangle before that
+		float		brightness;	// apparent magnitude as seen from the camera, smaller is brighter
+		bool		onscreen;
+		bool		changed;
+	};
+
+	//! projects all anchors and flags the labels that moved or entered or left the screen
+	void	project( const ci::Matrix44f &matrix, const ci::Vec3f &eye, bool force );
+	//! sorts the labels from bright to faint, flags the labels that changed rank
+	void	sort( bool force );
+
+	//! returns the range of grid cells covered by a rectangle
+	bool	getCells( const ci::Rectf &rect, int32_t *x1, int32_t *y1, int32_t *x2, int32_t *y2 ) const;
+	//! marks the cells covered by the rectangle, labels in them need to be re-evaluated
+	void	markDirty( const ci::Rectf &rect );
+	//! returns TRUE if any of the cells covered by the rectangle is dirty
+	bool	isDirty( const ci::Rectf &rect ) const;
+	//! returns TRUE if the rectangle overlaps any of the accepted labels
+	bool	overlaps( const ci::Rectf &rect ) const;
+	//! adds an accepted label to the grid
+	void	insert( uint32_t index );
+private:
+	//! size of a grid cell in pixels
+	static const int32_t	kCellSize = 64;
+	//! minimum distance in pixels between labels
+	static const float		kPadding;
+	//! labels that moved less than this (in pixels) keep their previous state
+	static const float		kTolerance;
+
+	std::vector<Label>		mLabels;
+	//! label indices, sorted from bright to faint
+	std::vector<uint32_t>	mOrder;
+	std::vector<uint8_t>	mVisibility;
+
+	//! uniform grid containing the indices of the accepted labels
+	std::vector< std::vector<uint32_t> >	mCells;
+	std::vector<uint8_t>	mDirty;
+	int32_t					mColumns;
+	int32_t					mRows;
+
+	ci::Matrix44f			mMatrix;
+	ci::Vec2i				mSize;
+	bool					mInvalid;
+
+	size_t					mNumVisible;
+	size_t					mNumEvaluated;
+};
@@ -33,7 +33,7 @@ using namespace ci::app;
 using namespace ph;
 
 Labels::Labels(void)
-	: mAttenuation(1.0f)
+	: mAttenuation(1.0f), mDeclutterRevision(0), mDeclutterValid(false)
 {
 }
 
@@ -54,7 +54,20 @@ void Labels::setup()
 	double delta = toRadians( -29.00780555 );
 	Vec3f position = 8330.0 * Vec3f((float) (sin(alpha) * cos(delta)), (float) sin(delta), (float) (cos(alpha) * cos(delta)));
 
-	mLabels.addLabel( position, "Center of the Galaxy" );
+	// always show this label
+	addLabel( position, "Center of the Galaxy", -100.0f );
+}
+
+void Labels::update( const Camera &camera, const Vec2i &size )
+{
+	// the label sizes change when labels are added or when the font is replaced, (re)loaded or receives new glyphs
+	text::FontRef font = mLabels.getFont();
+	if( mDeclutter.size() != mLabels.size() || font != mDeclutterFont || 
+		( font && ( font->getRevision() != mDeclutterRevision || font->isValid() != mDeclutterValid ) ) )
+		createDeclutter();
+
+	if( mDeclutter.update( camera, size ) )
+		mLabels.setVisibility( mDeclutter.getVisibility() );
 }
 
 void Labels::draw()
@@ -88,7 +101,7 @@ void Labels::load( DataSourceRef source )
 {
 	console() << "Loading label database from CSV, please wait..." << std::endl;
 
-	mLabels.clear();
+	clear();
 
 	// load the star database
 	std::string	stars = loadString( source );
@@ -120,12 +133,15 @@ void Labels::load( DataSourceRef source )
 			double dec = Conversions::toDouble(tokens[8]);
 			float distance = Conversions::toFloat(tokens[9]);
 
+			// absolute magnitude of the star
+			float magnitude = Conversions::toFloat(tokens[14]);
+
 			double alpha = toRadians( ra * 15.0 );
 			double delta = toRadians( dec );
 
 			Vec3f position = distance * Vec3f((float) (sin(alpha) * cos(delta)), (float) sin(delta), (float) (cos(alpha) * cos(delta)));
 
-			mLabels.addLabel( position, name );
+			addLabel( position, name, magnitude );
 		}
 		catch(...) {
 			// some of the data was invalid, ignore 
@@ -138,7 +154,7 @@ void Labels::read(DataSourceRef source)
 {
 	IStreamRef in = source->createStream();
 	
-	mLabels.clear();
+	clear();
 
 	uint8_t versionNumber;
 	in->read( &versionNumber );
@@ -149,10 +165,12 @@ void Labels::read(DataSourceRef source)
 	for( size_t idx = 0; idx < numLabels; ++idx ) {
 		Vec3f position;
 		in->readLittle( &position.x ); in->readLittle( &position.y ); in->readLittle( &position.z );
+		float magnitude = 0.0f;
+		if( versionNumber > 1 ) in->readLittle( &magnitude );
 		std::string name;
 		in->read( &name );
 
-		mLabels.addLabel( position, name );
+		addLabel( position, name, magnitude );
 	}
 }
 
@@ -160,15 +178,55 @@ void Labels::write(DataTargetRef target)
 {
 	OStreamRef out = target->getStream();
 	
-	const uint8_t versionNumber = 1;
+	const uint8_t versionNumber = 2;
 	out->write( versionNumber );
 	
 	out->writeLittle( static_cast<uint32_t>( mLabels.size() ) );
 	
-	for( text::TextLabelListConstIter it = mLabels.begin(); it != mLabels.end(); ++it ) {
+	size_t index = 0;
+	for( text::TextLabelListConstIter it = mLabels.begin(); it != mLabels.end(); ++it, ++index ) {
 		Vec3f position = it->first;
 		out->writeLittle( position.x ); out->writeLittle( position.y ); out->writeLittle( position.z );
+		out->writeLittle( index < mMagnitudes.size() ? mMagnitudes[index] : 0.0f );
 		std::string name = toUtf8( it->second );
 		out->write( name );
 	}
-}
\ No newline at end of file
+}
+
+void Labels::addLabel( const Vec3f &position, const std::string &name, float magnitude )
+{
+	mLabels.addLabel( position, name );
+	mMagnitudes.push_back( magnitude );
+}
+
+void Labels::clear()
+{
+	mLabels.clear();
+	mMagnitudes.clear();
+	mDeclutter.clear();
+}
+
+void Labels::createDeclutter()
+{
+	mDeclutter.clear();
+
+	text::FontRef font = mLabels.getFont();
+
+	mDeclutterFont = font;
+	mDeclutterRevision = font ? font->getRevision() : 0;
+	mDeclutterValid = font ? font->isValid() : false;
+
+	if( !font ) return;
+
+	// labels are rendered as a single line, starting at the projected anchor
+	const float size = mLabels.getFontSize();
+	const float height = font->getAscent( size ) + font->getDescent( size );
+
+	size_t index = 0;
+	for( text::TextLabelListConstIter it = mLabels.begin(); it != mLabels.end(); ++it, ++index ) {
+		float width = font->measureWidth( it->second, size );
+		float magnitude = index < mMagnitudes.size() ? mMagnitudes[index] : 0.0f;
+
+		mDeclutter.addLabel( it->first, Rectf( 0.0f, 0.0f, width, height ), magnitude );
+	}
+}
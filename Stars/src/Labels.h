@@ -22,12 +22,15 @@
 
 #pragma once
 
+#include "cinder/Camera.h"
 #include "cinder/DataSource.h"
 #include "cinder/DataTarget.h"
 #include "cinder/Utilities.h"
 
 #include "text/TextLabels.h"
 
+#include "LabelDeclutter.h"
+
 class Labels
 {
 public:
@@ -35,7 +38,8 @@ public:
 	virtual ~Labels(void);
 
 	virtual void setup();
-	virtual void update() {};
+	//! decides which labels to show, so they don't overlap on screen
+	virtual void update( const ci::Camera &camera, const ci::Vec2i &size );
 	virtual void draw();
 	
 	virtual void setCameraDistance( float distance );
@@ -47,8 +51,22 @@ public:
 	void	read( ci::DataSourceRef source );
 	//! writes a binary label data file
 	void	write( ci::DataTargetRef target );
+protected:
+	//! adds a label, brighter (smaller) magnitudes take precedence when labels overlap
+	void	addLabel( const ci::Vec3f &position, const std::string &name, float magnitude = 0.0f );
+	//! removes all labels
+	void	clear();
+	//! passes all labels and their size on screen to the declutter pass
+	void	createDeclutter();
 protected:
 	ph::text::TextLabels	mLabels;
+	std::vector<float>		mMagnitudes;
+
+	LabelDeclutter			mDeclutter;
+	//! the font, and its revision and validity, that were used to measure the labels for the declutter pass
+	ph::text::FontRef		mDeclutterFont;
+	uint32_t				mDeclutterRevision;
+	bool					mDeclutterValid;
 
 	float					mAttenuation;
 };
@@ -274,6 +274,10 @@ void StarsApp::update()
 	mConstellationLabels.setCameraDistance( distance );
 	mUserInterface.setCameraDistance( distance );
 
+	// decide which labels to show, so they don't overlap
+	mLabels.update( mCamera.getCamera(), getWindowSize() );
+	mConstellationLabels.update( mCamera.getCamera(), getWindowSize() );
+
 	//
 	if(mSoundEngine) {
 		// send camera position to sound engine (for 3D sounds)
@@ -0,0 +1,110 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace ph;
+
+void LatencyHistogram::add( uint64_t microseconds )
+{
+	// relaxed ordering is enough, the counters are independent
+	mBuckets[ getBucket(microseconds) ].fetch_add(1, std::memory_order_relaxed);
+
+	mCount.fetch_add(1, std::memory_order_relaxed);
+	mTotal.fetch_add(microseconds, std::memory_order_relaxed);
+
+	uint64_t max = mMax.load(std::memory_order_relaxed);
+	while(microseconds > max && !mMax.compare_exchange_weak(max, microseconds, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::clear()
+{
+	for(size_t i=0;i<kNumBuckets;++i)
+		mBuckets[i] = 0;
+
+	mCount = 0;
+	mTotal = 0;
+	mMax = 0;
+}
+
+double LatencyHistogram::getMean() const
+{
+	const uint64_t count = mCount;
+	return count ? double(mTotal) / count : 0.0;
+}
+
+uint64_t LatencyHistogram::getPercentile( double fraction ) const
+{
+	const uint64_t count = mCount;
+	if(count == 0) return 0;
+
+	// the number of values at or below the percentile
+	const uint64_t target = std::max<uint64_t>(1, uint64_t(fraction * count + 0.5));
+
+	uint64_t total = 0;
+	for(size_t i=0;i<kNumBuckets;++i) {
+		total += mBuckets[i];
+		if(total >= target) return std::min<uint64_t>(getValue(i), mMax);
+	}
+
+	return mMax;
+}
+
+std::string LatencyHistogram::toString() const
+{
+	std::stringstream s;
+
+	const uint64_t values[] = { getPercentile(0.5), getPercentile(0.99), getPercentile(0.999), getMax() };
+	const char *names[] = { "p50 ", ", p99 ", ", p999 ", ", max " };
+
+	for(size_t i=0;i<4;++i) {
+		s << names[i];
+		if(values[i] < 1000) s << values[i] << " us";
+		else s << (values[i] / 1000.0) << " ms";
+	}
+
+	return s.str();
+}
+
+size_t LatencyHistogram::getBucket( uint64_t value )
+{
+	if(value < kSubBuckets) return size_t(value);
+
+	// find the power of two, so that the value is shifted into [kSubBuckets, 2 * kSubBuckets)
+	size_t shift = 0;
+	while((value >> shift) >= 2 * kSubBuckets) ++shift;
+
+	return (shift + 1) * kSubBuckets + size_t(value >> shift) - kSubBuckets;
+}
+
+uint64_t LatencyHistogram::getValue( size_t bucket )
+{
+	if(bucket < kSubBuckets) return bucket;
+
+	const size_t shift = bucket / kSubBuckets - 1;
+	const uint64_t base = bucket % kSubBuckets + kSubBuckets;
+
+	return ((base + 1) << shift) - 1;
+}
@@ -0,0 +1,71 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace ph
+{
+
+//! Counts latencies in logarithmic buckets, with 32 linear sub-buckets per power of two, so percentiles 
+//! are accurate to about 3%. Values can be added from any thread without locking.
+class LatencyHistogram
+{
+public:
+	static const size_t	kSubBuckets = 32;
+	//! enough buckets for any 64-bit value
+	static const size_t	kNumBuckets = (64 - 5 + 1) * kSubBuckets;
+public:
+	LatencyHistogram(void) { clear(); }
+	~LatencyHistogram(void) {}
+
+	//! adds a latency, in microseconds
+	void		add( uint64_t microseconds );
+	//! removes all values. Values added at the same time by other threads may be lost.
+	void		clear();
+
+	uint64_t	getCount() const { return mCount; }
+	uint64_t	getMax() const { return mMax; }
+	//! returns the average, in microseconds
+	double		getMean() const;
+	//! returns the value below which the specified fraction (0..1) of the latencies falls, in microseconds
+	uint64_t	getPercentile( double fraction ) const;
+
+	//! returns a summary, like "p50 120 us, p99 480 us, p999 1.2 ms, max 3.4 ms"
+	std::string	toString() const;
+private:
+	//! returns the bucket of a value
+	static size_t	getBucket( uint64_t value );
+	//! returns the largest value that falls into a bucket
+	static uint64_t	getValue( size_t bucket );
+private:
+	std::atomic<uint64_t>	mBuckets[kNumBuckets];
+
+	std::atomic<uint64_t>	mCount;
+	std::atomic<uint64_t>	mTotal;
+	std::atomic<uint64_t>	mMax;
+};
+
+} // namespace
@@ -0,0 +1,199 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LoadGenerator.h"
+#include "Console.h"
+
+#include "cinder/Timer.h"
+
+#include <cstring>
+#include <boost/chrono/process_cpu_clocks.hpp>
+#include <boost/lexical_cast.hpp>
+
+using namespace ci;
+
+using namespace ph;
+
+//! returns the time in microseconds, used to timestamp the messages
+static uint64_t now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+//! returns the CPU time used by all threads of the process, in seconds
+static double cpuTime()
+{
+	const boost::chrono::process_cpu_clock::times times = boost::chrono::process_cpu_clock::now().time_since_epoch().count();
+	return 1.0e-9 * (times.user + times.system);
+}
+
+LoadGenerator::Options LoadGenerator::parse( const std::vector<std::string> &args )
+{
+	Options options;
+
+	for(size_t i=0;i+1<args.size();++i) {
+		try {
+			const size_t value = boost::lexical_cast<size_t>( args[i+1] );
+
+			if(args[i] == "--clients") options.clients = std::max<size_t>(1, std::min<size_t>(value, 1000));
+			else if(args[i] == "--size") options.size = std::max<size_t>(8, value);
+			else if(args[i] == "--rate") options.rate = std::max<size_t>(1, value);
+			else if(args[i] == "--seconds") options.seconds = double(value);
+			else if(args[i] == "--threads") options.threads = value;
+			else if(args[i] == "--restarts") options.restarts = value;
+			else if(args[i] == "--reconnect-delay") options.reconnectDelay = value;
+		}
+		catch(const boost::bad_lexical_cast &) {
+			// not an option with a value
+		}
+	}
+
+	return options;
+}
+
+bool LoadGenerator::run( const Options &options )
+{
+	mHistogram.clear();
+	mReceived = 0;
+	mBytesReceived = 0;
+	mConnected = 0;
+
+	console() << "Load test: " << options.clients << " clients, " << options.size << " bytes per message, " << options.rate << " messages/s per client, " 
+		<< options.seconds << " seconds" << std::endl;
+
+	LoopbackServer server;
+	server.setEcho(true);
+	server.start();
+
+	const unsigned short port = server.getPort();
+
+	// binary messages, starting with the time they were sent
+	const TcpFramingRef framing( new LengthPrefixFraming(LengthPrefixFraming::HEADER_U32, false) );
+
+	TcpClientPool pool(options.threads);
+	pool.sConnected.connect( [&](const TcpClientRef&, const boost::asio::ip::tcp::endpoint&){ ++mConnected; } );
+	pool.sDisconnected.connect( [&](const TcpClientRef&, const boost::asio::ip::tcp::endpoint&){ --mConnected; } );
+
+	std::vector<TcpClientRef> clients;
+	for(size_t i=0;i<options.clients;++i) {
+		TcpClientRef client = pool.create();
+		client->setFraming(framing);
+		client->setReconnectDelay( std::chrono::milliseconds(options.reconnectDelay) );
+		client->sMessageView.connect( boost::bind(&LoadGenerator::onMessage, this, _1) );
+		clients.push_back(client);
+	}
+
+	// connect
+	Timer timer(true);
+
+	for(size_t i=0;i<clients.size();++i)
+		clients[i]->connect("127.0.0.1", port);
+
+	bool success = waitForConnections(pool, clients.size(), 10.0);
+	console() << "  connect: " << mConnected << " clients in " << timer.getSeconds() * 1000.0 << " ms" << std::endl;
+
+	// send messages at a fixed rate, the main thread only writes
+	std::string msg(options.size, '.');
+	size_t sent = 0;
+
+	const double cpu = cpuTime();
+	timer.start();
+
+	size_t count = 0;
+	for(;;) {
+		const double elapsed = timer.getSeconds();
+		if(elapsed >= options.seconds) break;
+
+		// the number of messages each client should have sent by now
+		const size_t due = size_t(elapsed * options.rate);
+
+		for(;count<due;++count) {
+			for(size_t i=0;i<clients.size();++i) {
+				const uint64_t stamp = now();
+				std::memcpy(&msg[0], &stamp, sizeof(stamp));
+
+				clients[i]->write(msg);
+				sent++;
+			}
+		}
+
+		pool.update();
+		boost::this_thread::sleep( boost::posix_time::milliseconds(1) );
+	}
+
+	// wait for the last replies
+	Timer drain(true);
+	while(mReceived < sent && drain.getSeconds() < 5.0) {
+		pool.update();
+		boost::this_thread::sleep( boost::posix_time::milliseconds(1) );
+	}
+
+	const double seconds = timer.getSeconds();
+	const double cpuSeconds = cpuTime() - cpu;
+
+	if(mReceived < sent) success = false;
+
+	console() << "  echo: " << mReceived << " of " << sent << " messages, " << (mReceived / seconds) << " msgs/s, " 
+		<< (mBytesReceived / seconds / 1048576.0) << " MB/s, " << (cpuSeconds * 1.0e6 / std::max<size_t>(1, mReceived)) << " us CPU per message (client and server)" << std::endl;
+	console() << "  round trip: " << mHistogram.toString() << std::endl;
+
+	// kill the server, then restart it once all clients have noticed
+	for(size_t restart=0;restart<options.restarts;++restart) {
+		server.stop();
+
+		if(!waitForConnections(pool, 0, 10.0)) success = false;
+
+		server.start(port);
+
+		timer.start();
+		if(!waitForConnections(pool, clients.size(), 10.0 + options.reconnectDelay / 1000.0)) success = false;
+
+		console() << "  reconnect storm: " << mConnected << " of " << clients.size() << " clients reconnected in " << timer.getSeconds() * 1000.0 
+			<< " ms, with a reconnect delay of " << options.reconnectDelay << " ms" << std::endl;
+	}
+
+	return success;
+}
+
+bool LoadGenerator::waitForConnections( TcpClientPool &pool, size_t count, double timeout )
+{
+	Timer timer(true);
+	while(mConnected != count && timer.getSeconds() < timeout) {
+		pool.update();
+		boost::this_thread::sleep( boost::posix_time::milliseconds(1) );
+	}
+
+	return mConnected == count;
+}
+
+void LoadGenerator::onMessage( const boost::string_ref &msg )
+{
+	// ignore the heartbeat
+	uint64_t stamp;
+	if(msg.size() < sizeof(stamp)) return;
+
+	std::memcpy(&stamp, msg.data(), sizeof(stamp));
+	mHistogram.add( now() - stamp );
+
+	mReceived++;
+	mBytesReceived += msg.size();
+}
@@ -0,0 +1,90 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+// To make sure boost::asio is loaded first, include our header file first
+#include "TcpClientPool.h"
+#include "LoopbackServer.h"
+#include "LatencyHistogram.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace ph
+{
+
+//! Opens any number of clients to a local echo server, sends timestamped messages at a fixed rate and 
+//! measures throughput, round-trip times and CPU time per message. Then kills and restarts the server 
+//! to measure how quickly all clients reconnect. Needs no network connection or window.
+class LoadGenerator
+{
+public:
+	struct Options {
+		Options() : clients(100), size(64), rate(100), seconds(2.0), threads(0), restarts(1), reconnectDelay(250) {}
+
+		//! number of connections (1 to 1000)
+		size_t		clients;
+		//! size of each message in bytes, at least 8
+		size_t		size;
+		//! messages per second per client
+		size_t		rate;
+		//! duration of the load
+		double		seconds;
+		//! number of I/O threads, one per CPU if zero
+		size_t		threads;
+		//! number of times the server is killed and restarted
+		size_t		restarts;
+		//! time the clients wait before reconnecting, in milliseconds
+		size_t		reconnectDelay;
+	};
+public:
+	LoadGenerator(void) : mReceived(0), mBytesReceived(0) {}
+	virtual ~LoadGenerator(void) {}
+
+	//! reads the options from command line arguments, like: --clients 100 --size 64 --rate 100 
+	//! --seconds 2 --threads 0 --restarts 1 --reconnect-delay 250
+	static Options	parse( const std::vector<std::string> &args );
+
+	//! runs the test and prints the results to the console. Returns FALSE if messages were lost
+	//! or clients failed to (re)connect.
+	bool	run( const Options &options );
+
+	//! returns the round-trip times of the last run
+	const LatencyHistogram&	getHistogram() const { return mHistogram; }
+protected:
+	//! polls the pool until the number of connected clients equals 'count', returns FALSE on timeout
+	bool	waitForConnections( TcpClientPool &pool, size_t count, double timeout );
+	//! called by the I/O threads
+	void	onMessage( const boost::string_ref &msg );
+protected:
+	LatencyHistogram		mHistogram;
+
+	std::atomic<size_t>		mReceived;
+	std::atomic<size_t>		mBytesReceived;
+
+	//! only accessed by the thread that calls run()
+	size_t					mConnected;
+};
+
+} // namespace
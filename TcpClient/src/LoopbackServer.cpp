@@ -0,0 +1,231 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LoopbackServer.h"
+
+using namespace ph;
+
+LoopbackServer::LoopbackServer()
+	: mAcceptor(mIos), mPort(0), mReadBuffer(64 * 1024), mReadRate(0), mIsEcho(false), mBytesReceived(0)
+{
+}
+
+LoopbackServer::~LoopbackServer(void)
+{
+	stop();
+}
+
+void LoopbackServer::start(unsigned short port)
+{
+	if(isRunning()) return;
+
+	boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+
+	mAcceptor.open(endpoint.protocol());
+	mAcceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+	mAcceptor.bind(endpoint);
+	mAcceptor.listen();
+
+	mPort = mAcceptor.local_endpoint().port();
+
+	accept();
+
+	// run until all connections have been closed
+	mThread = boost::thread( boost::bind(&boost::asio::io_service::run, &mIos) );
+}
+
+void LoopbackServer::stop()
+{
+	if(!isRunning()) return;
+
+	// safe way to request the server to close all connections
+	mIos.post(boost::bind(&LoopbackServer::do_stop, this));
+	mThread.join();
+
+	// allow the server to be started again
+	mIos.reset();
+}
+
+void LoopbackServer::send(const std::string &msg)
+{
+	if(!isRunning()) return;
+
+	// safe way to request the server to send the message
+	mIos.post(boost::bind(&LoopbackServer::do_send, this, msg));
+}
+
+void LoopbackServer::read(SocketRef socket)
+{
+	// read in small steps if the rate is limited, about a hundred per second
+	size_t size = mReadBuffer.size();
+	if(mReadRate > 0) size = std::max<size_t>(1, std::min(size, mReadRate / 100));
+
+	socket->async_read_some(boost::asio::buffer(&mReadBuffer[0], size),
+		boost::bind(&LoopbackServer::handle_read, this, socket, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void LoopbackServer::echo_read(SocketRef socket, BufferRef buffer)
+{
+	// read in small steps if the rate is limited, about a hundred per second
+	size_t size = buffer->size();
+	if(mReadRate > 0) size = std::max<size_t>(1, std::min(size, mReadRate / 100));
+
+	socket->async_read_some(boost::asio::buffer(&(*buffer)[0], size),
+		boost::bind(&LoopbackServer::handle_echo_read, this, socket, buffer, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void LoopbackServer::accept()
+{
+	SocketRef socket( new boost::asio::ip::tcp::socket(mIos) );
+
+	// wait for a client to connect, then call handle_accept
+	mAcceptor.async_accept(*socket,
+		boost::bind(&LoopbackServer::handle_accept, this, socket, boost::asio::placeholders::error));
+}
+
+// callbacks
+
+void LoopbackServer::handle_accept(SocketRef socket, const boost::system::error_code& error)
+{
+	if(error) return;
+
+	mSockets.push_back(socket);
+
+	// do not hold back small echoes until the client acknowledges the previous ones
+	boost::system::error_code ignored;
+	socket->set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+
+	// send the greeting
+	if(!mGreeting.empty()) {
+		boost::asio::async_write(*socket, boost::asio::buffer(mGreeting),
+			boost::bind(&LoopbackServer::handle_write, this, socket, boost::asio::placeholders::error));
+	}
+
+	// a small receive window lets the client notice a slow link, instead of filling the buffers of the OS. 
+	// It should hold a few segments, which are 64 kB on the loopback interface, or the window only opens 
+	// when the client probes it.
+	if(mReadRate > 0) {
+		boost::system::error_code ignored;
+		socket->set_option(boost::asio::socket_base::receive_buffer_size(256 * 1024), ignored);
+	}
+
+	if(mIsEcho) {
+		// each connection needs its own buffer, which is kept alive by the handlers
+		BufferRef buffer( new std::vector<char>(16 * 1024) );
+		echo_read(socket, buffer);
+	}
+	else {
+		// discard everything the client sends
+		read(socket);
+	}
+
+	// wait for the next client
+	accept();
+}
+
+void LoopbackServer::handle_read(SocketRef socket, const boost::system::error_code& error, size_t bytes_transferred)
+{
+	if(error) return;
+
+	mBytesReceived += bytes_transferred;
+
+	if(mReadRate > 0) {
+		// wait as long as the link would need to transfer the data
+		TimerRef timer( new boost::asio::steady_timer(mIos) );
+		timer->expires_from_now(std::chrono::microseconds(bytes_transferred * 1000000 / mReadRate));
+		timer->async_wait(boost::bind(&LoopbackServer::handle_wait, this, socket, timer, boost::asio::placeholders::error));
+		return;
+	}
+
+	read(socket);
+}
+
+void LoopbackServer::handle_wait(SocketRef socket, TimerRef timer, const boost::system::error_code& error)
+{
+	if(error) return;
+
+	read(socket);
+}
+
+void LoopbackServer::handle_write(SocketRef socket, const boost::system::error_code& error)
+{
+}
+
+void LoopbackServer::handle_echo_read(SocketRef socket, BufferRef buffer, const boost::system::error_code& error, size_t bytes_transferred)
+{
+	if(error) return;
+
+	mBytesReceived += bytes_transferred;
+
+	// send the data back, then read again
+	boost::asio::async_write(*socket, boost::asio::buffer(&(*buffer)[0], bytes_transferred),
+		boost::bind(&LoopbackServer::handle_echo_write, this, socket, buffer, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void LoopbackServer::handle_echo_write(SocketRef socket, BufferRef buffer, const boost::system::error_code& error, size_t bytes_transferred)
+{
+	if(error) return;
+
+	if(mReadRate > 0) {
+		// wait as long as the link would need to transfer the data
+		TimerRef timer( new boost::asio::steady_timer(mIos) );
+		timer->expires_from_now(std::chrono::microseconds(bytes_transferred * 1000000 / mReadRate));
+		timer->async_wait(boost::bind(&LoopbackServer::handle_echo_wait, this, socket, buffer, timer, boost::asio::placeholders::error));
+		return;
+	}
+
+	echo_read(socket, buffer);
+}
+
+void LoopbackServer::handle_echo_wait(SocketRef socket, BufferRef buffer, TimerRef timer, const boost::system::error_code& error)
+{
+	if(error) return;
+
+	echo_read(socket, buffer);
+}
+
+void LoopbackServer::do_send(const std::string &msg)
+{
+	std::vector< boost::weak_ptr<boost::asio::ip::tcp::socket> >::iterator itr;
+	for(itr=mSockets.begin();itr!=mSockets.end();++itr) {
+		SocketRef socket = itr->lock();
+		if(!socket) continue;
+
+		// blocks the server thread, but keeps the messages in order without queueing them
+		boost::system::error_code error;
+		boost::asio::write(*socket, boost::asio::buffer(msg), error);
+	}
+}
+
+void LoopbackServer::do_stop()
+{
+	boost::system::error_code error;
+	mAcceptor.close(error);
+
+	std::vector< boost::weak_ptr<boost::asio::ip::tcp::socket> >::iterator itr;
+	for(itr=mSockets.begin();itr!=mSockets.end();++itr) {
+		SocketRef socket = itr->lock();
+		if(socket) socket->close(error);
+	}
+
+	mSockets.clear();
+}
@@ -0,0 +1,116 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+// defines the value of _WIN32_WINNT needed by boost asio (WINDOWS ONLY)
+#ifdef WIN32
+    #include <sdkddkver.h>
+#endif
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+
+namespace ph
+{
+
+typedef boost::shared_ptr<class LoopbackServer> LoopbackServerRef;
+
+//! Local server used to test and benchmark the TcpClient without a network connection.
+//! It runs on its own thread, sends the greeting to every client that connects and 
+//! discards everything it receives, optionally at a limited rate to simulate a slow link.
+//! In echo mode, it sends everything it receives back to the client instead.
+class LoopbackServer
+{
+public:
+	LoopbackServer();
+	virtual ~LoopbackServer(void);
+
+	//! starts listening on the loopback interface, pass 0 to use any free port
+	virtual void start(unsigned short port = 0);
+	//! closes all connections and stops the thread
+	virtual void stop();
+
+	bool isRunning(){ return mThread.joinable(); };
+
+	unsigned short getPort(){ return mPort; };
+
+	std::string getGreeting(){ return mGreeting; };
+	void setGreeting(const std::string &greeting){ mGreeting = greeting; };
+
+	//! sends the message to all connected clients, can be called from any thread
+	virtual void send(const std::string &msg);
+
+	//! sends received data back to the client instead of discarding it. Set before starting.
+	void setEcho(bool echo){ mIsEcho = echo; };
+
+	//! limits the number of bytes read (and echoed) per second from each client, 0 means unlimited. Set before starting.
+	void setReadRate(size_t bytesPerSecond){ mReadRate = bytesPerSecond; };
+
+	//! returns the number of bytes received from all clients, can be called from any thread
+	size_t getBytesReceived(){ return mBytesReceived; };
+protected:
+	typedef boost::shared_ptr<boost::asio::ip::tcp::socket>	SocketRef;
+	typedef boost::shared_ptr<boost::asio::steady_timer>		TimerRef;
+	typedef boost::shared_ptr< std::vector<char> >				BufferRef;
+
+	virtual void accept();
+	virtual void read(SocketRef socket);
+	virtual void echo_read(SocketRef socket, BufferRef buffer);
+
+	// callbacks
+	virtual void handle_accept(SocketRef socket, const boost::system::error_code& error);
+	virtual void handle_read(SocketRef socket, const boost::system::error_code& error, size_t bytes_transferred);
+	virtual void handle_write(SocketRef socket, const boost::system::error_code& error);
+	virtual void handle_wait(SocketRef socket, TimerRef timer, const boost::system::error_code& error);
+	virtual void handle_echo_read(SocketRef socket, BufferRef buffer, const boost::system::error_code& error, size_t bytes_transferred);
+	virtual void handle_echo_write(SocketRef socket, BufferRef buffer, const boost::system::error_code& error, size_t bytes_transferred);
+	virtual void handle_echo_wait(SocketRef socket, BufferRef buffer, TimerRef timer, const boost::system::error_code& error);
+
+	virtual void do_send(const std::string &msg);
+	virtual void do_stop();
+protected:
+	boost::asio::io_service						mIos;
+	boost::asio::ip::tcp::acceptor				mAcceptor;
+	boost::thread								mThread;
+
+	unsigned short								mPort;
+
+	//! open connections, closed when the server stops
+	std::vector< boost::weak_ptr<boost::asio::ip::tcp::socket> >	mSockets;
+
+	std::string									mGreeting;
+	//! received data is discarded
+	std::vector<char>							mReadBuffer;
+	size_t										mReadRate;
+	bool										mIsEcho;
+	std::atomic<size_t>							mBytesReceived;
+};
+
+} // namespace
@@ -21,39 +21,132 @@
 */
 
 #include "TcpClient.h"
+#include "Console.h"
+
+#include <cmath>
+#include <cstring>
 
 using namespace ci;
 using namespace ci::app;
 
 using namespace ph;
 
+boost::thread_specific_ptr<boost::asio::io_service>	TcpClient::sIoService( &TcpClient::ignore );
+
+TcpClient::IoThreadScope::IoThreadScope(boost::asio::io_service &ios)
+	: mPrevious( sIoService.get() )
+{
+	sIoService.reset( &ios );
+}
+
+TcpClient::IoThreadScope::~IoThreadScope()
+{
+	sIoService.reset( mPrevious );
+}
+
 TcpClient::TcpClient()
-	: mIsConnected(false), mIsClosing(false),
-	mSocket(mIos), mHeartBeatTimer(mIos), mReconnectTimer(mIos), mHeartBeat("PING")
+	: mIsConnected(false), mIsClosing(false), mOwnIos(new boost::asio::io_service()), mIos(*mOwnIos), mStrand(mIos),
+	mSocket(mIos), mReadBuffer(kReadBufferSize), mReadBegin(0), mReadEnd(0), mReadScan(0), mReadRequired(0),
+	mPendingBegin(0), mSendBufferSize(0), mQueueCapacity(kMaxQueueSize), mQueueMessageCapacity(SIZE_MAX), mQueuePolicy(DROP_NEWEST), mQueueStats(),
+	mIsWriteRequested(false), mIsWriting(false), mIsWriteDelayed(false), mWriteDelay(0), mWriteTimer(mIos),
+	mHeartBeatTimer(mIos), mReconnectTimer(mIos), mReconnectDelay(5000), mHeartBeat("PING")
 {	
-	// for servers that terminate their messages with a null-byte
-	mDelimiter = "\0"; 
+	init();
 }
 
 TcpClient::TcpClient( const std::string &heartbeat )
-	: mIsConnected(false), mIsClosing(false),
-	mSocket(mIos), mHeartBeatTimer(mIos), mReconnectTimer(mIos), mHeartBeat(heartbeat)
+	: mIsConnected(false), mIsClosing(false), mOwnIos(new boost::asio::io_service()), mIos(*mOwnIos), mStrand(mIos),
+	mSocket(mIos), mReadBuffer(kReadBufferSize), mReadBegin(0), mReadEnd(0), mReadScan(0), mReadRequired(0),
+	mPendingBegin(0), mSendBufferSize(0), mQueueCapacity(kMaxQueueSize), mQueueMessageCapacity(SIZE_MAX), mQueuePolicy(DROP_NEWEST), mQueueStats(),
+	mIsWriteRequested(false), mIsWriting(false), mIsWriteDelayed(false), mWriteDelay(0), mWriteTimer(mIos),
+	mHeartBeatTimer(mIos), mReconnectTimer(mIos), mReconnectDelay(5000), mHeartBeat(heartbeat)
 {	
+	init();
+}
+
+TcpClient::TcpClient( boost::asio::io_service &ios, const std::string &heartbeat )
+	: mIsConnected(false), mIsClosing(false), mIos(ios), mStrand(mIos),
+	mSocket(mIos), mReadBuffer(kReadBufferSize), mReadBegin(0), mReadEnd(0), mReadScan(0), mReadRequired(0),
+	mPendingBegin(0), mSendBufferSize(0), mQueueCapacity(kMaxQueueSize), mQueueMessageCapacity(SIZE_MAX), mQueuePolicy(DROP_NEWEST), mQueueStats(),
+	mIsWriteRequested(false), mIsWriting(false), mIsWriteDelayed(false), mWriteDelay(0), mWriteTimer(mIos),
+	mHeartBeatTimer(mIos), mReconnectTimer(mIos), mReconnectDelay(5000), mHeartBeat(heartbeat)
+{	
+	init();
+}
+
+void TcpClient::init()
+{
 	// for servers that terminate their messages with a null-byte
-	mDelimiter = "\0"; 
+	setDelimiter( std::string(1, '\0') );
+
+	mHeartBeatInterval = mHeartBeatCurrent = std::chrono::milliseconds(5000);
+	mHeartBeatMinimum = std::chrono::milliseconds(250);
+	mIsHeartBeatAdaptive = false;
+	mHeartBeatSent = 0;
+
+	mHandlers = 0;
+
+	mBytesIn = mBytesOut = mMessagesIn = mMessagesOut = 0;
+	mConnects = mDisconnects = mReconnectAttempts = mHeartBeatsSent = mHeartBeatsLost = 0;
+
+	std::memset(&mStats, 0, sizeof(mStats));
+	mRateTime = std::chrono::steady_clock::now();
+	mRateMessagesIn = mRateMessagesOut = 0;
+	mStats.heartBeatInterval = double(mHeartBeatCurrent.count());
 }
 
 TcpClient::~TcpClient(void)
 {
-	disconnect();
+	if(mOwnIos) {
+		disconnect();
+		return;
+	}
+
+	// the handlers on the shared io_service refer to this client, the other handlers would have to wait for this one
+	if(mStrand.running_in_this_thread()) {
+		do_close();
+		return;
+	}
+
+	// close the connection on the I/O threads, then wait until all handlers have been called
+	mStrand.dispatch(track(boost::bind(&TcpClient::do_close, this)));
+
+	boost::mutex::scoped_lock lock(mHandlerMutex);
+	while(mHandlers > 0 && !mIos.stopped())
+		mHandlerCondition.timed_wait(lock, boost::posix_time::milliseconds(100));
 }
 
 void TcpClient::update()
 {
+	// a shared io_service is run by its own threads
+	if(!mOwnIos) return;
+
+	// remember who runs the io_service, so blocking writers do not wait for themselves
+	if(mPollThread != boost::this_thread::get_id()) {
+		boost::mutex::scoped_lock lock(mWriteMutex);
+		mPollThread = boost::this_thread::get_id();
+	}
+
 	// calls the poll() function to process network messages
 	mIos.poll();
 }
 
+bool TcpClient::isIoThread()
+{
+	boost::mutex::scoped_lock lock(mWriteMutex);
+	return isIoThread(lock);
+}
+
+bool TcpClient::isIoThread(const boost::mutex::scoped_lock &lock)
+{
+	if(mStrand.running_in_this_thread()) return true;
+
+	// until update() has been called, any thread may be the one that will call it
+	if(mOwnIos) return mPollThread == boost::thread::id() || mPollThread == boost::this_thread::get_id();
+
+	return sIoService.get() == &mIos;
+}
+
 void TcpClient::connect(const std::string &ip, unsigned short port)
 {
 	// connect socket
@@ -63,7 +156,7 @@ void TcpClient::connect(const std::string &ip, unsigned short port)
 		connect(endpoint);
 	}
 	catch(const std::exception &e) {
-		ci::app::console() << "Server exception:" << e.what() << std::endl;
+		ph::console() << "Server exception:" << e.what() << std::endl;
 	}
 }
 
@@ -84,7 +177,7 @@ void TcpClient::connect(const Url &url, const std::string &protocol)
 		connect(endpoint);
 	}
 	catch(const std::exception &e) {
-		ci::app::console() << "Server exception:" << e.what() << std::endl;
+		ph::console() << "Server exception:" << e.what() << std::endl;
 	}
 }
 
@@ -95,15 +188,21 @@ void TcpClient::connect(boost::asio::ip::tcp::endpoint& endpoint)
 
 	mEndPoint = endpoint;
 
-	ci::app::console() << "Trying to connect to port " << endpoint.port() << " @ " << endpoint.address().to_string() << std::endl;
+	ph::console() << "Trying to connect to port " << endpoint.port() << " @ " << endpoint.address().to_string() << std::endl;
 
 	// try to connect, then call handle_connect
 	mSocket.async_connect(endpoint,
-        boost::bind(&TcpClient::handle_connect, this, boost::asio::placeholders::error));
+        mStrand.wrap(track(boost::bind(&TcpClient::handle_connect, this, boost::asio::placeholders::error))));
 }
 
 void TcpClient::disconnect()
 {		
+	// a shared io_service keeps running, so the timers have to be cancelled as well
+	if(!mOwnIos) {
+		mStrand.post(track(boost::bind(&TcpClient::do_close, this)));
+		return;
+	}
+
 	// tell socket to close the connection
 	close();
 	
@@ -114,13 +213,173 @@ void TcpClient::disconnect()
 	mIsClosing = false;
 }
 
+void TcpClient::release()
+{
+	// the destructor may be waiting for the last handler
+	boost::mutex::scoped_lock lock(mHandlerMutex);
+	if(--mHandlers == 0) mHandlerCondition.notify_all();
+}
+
+void TcpClient::setDelimiter(const std::string &delimiter)
+{
+	mDelimiter = delimiter;
+	setFraming( TcpFramingRef( new DelimiterFraming(delimiter) ) );
+}
+
+void TcpClient::setFraming(const TcpFramingRef &framing)
+{
+	if(!framing) return;
+
+	// write() uses the framing from other threads
+	boost::mutex::scoped_lock lock(mWriteMutex);
+	mFraming = framing;
+}
+
+void TcpClient::setQueueCapacity(size_t bytes, size_t messages)
+{
+	boost::mutex::scoped_lock lock(mWriteMutex);
+	mQueueCapacity = bytes;
+	mQueueMessageCapacity = messages;
+}
+
+void TcpClient::setQueuePolicy(QueuePolicy policy)
+{
+	boost::mutex::scoped_lock lock(mWriteMutex);
+	mQueuePolicy = policy;
+
+	// waiting writers should apply the new policy
+	mWriteCondition.notify_all();
+}
+
+TcpClient::QueueStats TcpClient::getQueueStats()
+{
+	boost::mutex::scoped_lock lock(mWriteMutex);
+	return mQueueStats;
+}
+
 void TcpClient::write(const std::string &msg)
 {
-	if(!mIsConnected) return;
-	if(mIsClosing) return;
+	bool request;
+	{
+		boost::mutex::scoped_lock lock(mWriteMutex);
+
+		if(mIsClosing) {
+			mQueueStats.dropped++;
+			return;
+		}
+
+		if(!reserve(lock, msg.size())) return;
+
+		const size_t bytes = mQueueStats.bytes;
+		const size_t size = mPending.size();
+		if(!mFraming->encode(msg.data(), msg.size(), &mPending)) {
+			ph::console() << "Client error: message of " << msg.size() << " bytes can not be framed" << std::endl;
+			return;
+		}
+
+		mPendingSizes.push_back(mPending.size() - size);
+		mQueueStats.messages++;
+		mQueueStats.bytes += mPending.size() - size;
+
+		// only request a write if none is pending, or if a delayed write should be started right away
+		request = !mIsWriteRequested || (bytes < kMaxBatchSize && mQueueStats.bytes >= kMaxBatchSize);
+		mIsWriteRequested = true;
+	}
+
+	// safe way to request the client to write the pending messages
+	if(request) mStrand.post(track(boost::bind(&TcpClient::do_write, this)));
+}
+
+void TcpClient::writeLatest(const std::string &key, const std::string &msg)
+{
+	bool request;
+	{
+		boost::mutex::scoped_lock lock(mWriteMutex);
+
+		if(mIsClosing) {
+			mQueueStats.dropped++;
+			return;
+		}
+
+		const size_t bytes = mQueueStats.bytes;
+
+		std::map<std::string, std::vector<char> >::iterator itr = mLatest.find(key);
+		bool isNew = (itr == mLatest.end());
+		if(isNew) {
+			if(!reserve(lock, msg.size())) return;
+
+			// another thread may have queued the same key while we were waiting
+			std::pair<std::map<std::string, std::vector<char> >::iterator, bool> result = mLatest.insert( std::make_pair(key, std::vector<char>()) );
+			itr = result.first;
+			isNew = result.second;
+		}
+
+		// the message is framed right away, so the queue stats count the bytes that will be written
+		const size_t previous = itr->second.size();
+		itr->second.clear();
+		if(!mFraming->encode(msg.data(), msg.size(), &itr->second)) {
+			ph::console() << "Client error: message of " << msg.size() << " bytes can not be framed" << std::endl;
+
+			mQueueStats.bytes -= previous;
+			if(!isNew) mQueueStats.messages--;
+			mLatest.erase(itr);
+			return;
+		}
+
+		if(isNew) mQueueStats.messages++;
+		else mQueueStats.coalesced++;
+
+		mQueueStats.bytes = mQueueStats.bytes - previous + itr->second.size();
+
+		request = !mIsWriteRequested || (bytes < kMaxBatchSize && mQueueStats.bytes >= kMaxBatchSize);
+		mIsWriteRequested = true;
+	}
+
+	if(request) mStrand.post(track(boost::bind(&TcpClient::do_write, this)));
+}
 
-	// safe way to request the client to write a message
-	mIos.post(boost::bind(&TcpClient::do_write, this, msg));
+bool TcpClient::reserve(boost::mutex::scoped_lock &lock, size_t bytes)
+{
+	for(;;) {
+		// a single message always fits, so it can not block forever
+		if(mQueueStats.messages == 0) return true;
+		if(mQueueStats.messages < mQueueMessageCapacity && mQueueStats.bytes + bytes <= mQueueCapacity) return true;
+
+		switch(mQueuePolicy) {
+		case BLOCK:
+			// waiting on a thread that runs the io_service would prevent the write that makes room
+			if(!mIsConnected || mIsClosing || isIoThread(lock)) {
+				mQueueStats.dropped++;
+				return false;
+			}
+
+			mWriteCondition.wait(lock);
+			break;
+		case DROP_OLDEST:
+			if(mPendingSizes.empty()) {
+				mQueueStats.dropped++;
+				return false;
+			}
+
+			// the data stays in the buffer until it is swapped
+			mPendingBegin += mPendingSizes.front();
+			mQueueStats.messages--;
+			mQueueStats.bytes -= mPendingSizes.front();
+			mQueueStats.dropped++;
+			mPendingSizes.pop_front();
+			break;
+		default:
+			mQueueStats.dropped++;
+			return false;
+		}
+	}
+}
+
+void TcpClient::notify_writers()
+{
+	// lock the mutex, so a writer can not miss the notification between checking the connection and waiting
+	boost::mutex::scoped_lock lock(mWriteMutex);
+	mWriteCondition.notify_all();
 }
 
 void TcpClient::close()
@@ -128,7 +387,7 @@ void TcpClient::close()
 	if(!mIsConnected) return;
 
 	// safe way to request the client to close the connection
-	mIos.post(boost::bind(&TcpClient::do_close, this));
+	mStrand.post(track(boost::bind(&TcpClient::do_close, this)));
 }
 
 void TcpClient::read()
@@ -136,9 +395,67 @@ void TcpClient::read()
 	if(!mIsConnected) return;
 	if(mIsClosing) return;
 
-	// wait for a message to arrive, then call handle_read
-	boost::asio::async_read_until(mSocket, mBuffer, mDelimiter,
-          boost::bind(&TcpClient::handle_read, this, boost::asio::placeholders::error));
+	// the incomplete message and at least kMinReadSize bytes should fit, or the whole message if its size is known
+	const size_t required = std::max(mReadRequired, mReadEnd - mReadBegin + kMinReadSize);
+
+	// move the incomplete message to the front of the buffer if we run out of space
+	if(mReadBuffer.size() - mReadBegin < required && mReadBegin > 0) {
+		std::memmove(&mReadBuffer[0], &mReadBuffer[mReadBegin], mReadEnd - mReadBegin);
+
+		mReadEnd -= mReadBegin;
+		mReadBegin = 0;
+	}
+
+	// grow the buffer if the message does not fit, to its exact size if the framing knows it
+	if(mReadBuffer.size() < required)
+		mReadBuffer.resize( mReadRequired == required ? required : std::max(required, mReadBuffer.size() * 2) );
+
+	// read as much as is available, then call handle_read
+	mSocket.async_read_some(boost::asio::buffer(&mReadBuffer[mReadEnd], mReadBuffer.size() - mReadEnd),
+          mStrand.wrap(track(boost::bind(&TcpClient::handle_read, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred))));
+}
+
+bool TcpClient::parse()
+{
+	// copy the framing, in case a listener changes it. setFraming() may be called from any thread.
+	TcpFramingRef framing;
+	{
+		boost::mutex::scoped_lock lock(mWriteMutex);
+		framing = mFraming;
+	}
+
+	const char *data = &mReadBuffer[0];
+
+	boost::string_ref message;
+	size_t frameSize;
+
+	for(;;) {
+		const TcpFraming::Result result = framing->decode(data + mReadBegin, mReadEnd - mReadBegin, &mReadScan, &message, &frameSize);
+
+		if(result == TcpFraming::INVALID) return false;
+
+		if(result == TcpFraming::INCOMPLETE) {
+			mReadRequired = frameSize;
+			break;
+		}
+
+		// create signal to notify listeners, skipping replies to heartbeats and empty messages if the framing does not allow them
+		if((!message.empty() || framing->isEmptyMessageValid()) && !handle_heartbeat_reply(message)) {
+			mMessagesIn++;
+
+			sMessageView( message );
+			if(!sMessage.empty()) sMessage( std::string(message.data(), message.size()) );
+		}
+
+		mReadBegin += frameSize;
+		mReadScan = 0;
+	}
+
+	// start at the front of the buffer again if all data has been processed
+	if(mReadBegin == mReadEnd)
+		mReadBegin = mReadEnd = mReadScan = 0;
+
+	return true;
 }
 
 // callbacks
@@ -151,12 +468,31 @@ void TcpClient::handle_connect(const boost::system::error_code& error)
 		// we are connected!
 		mIsConnected = true;
 
+		if(mSendBufferSize > 0) {
+			boost::system::error_code ignored;
+			mSocket.set_option(boost::asio::socket_base::send_buffer_size(int(mSendBufferSize)), ignored);
+		}
+
+		// discard data of the previous connection
+		mReadBegin = mReadEnd = mReadScan = mReadRequired = 0;
+
+		// send the messages that were queued while we were disconnected
+		mIsWriting = false;
+		do_write();
+
+		mConnects++;
+
 		// let listeners know
 		sConnected(mEndPoint);
 
 		// start heartbeat timer (optional)
-		mHeartBeatTimer.expires_from_now(std::chrono::seconds(5));
-		mHeartBeatTimer.async_wait(boost::bind(&TcpClient::do_heartbeat, this, boost::asio::placeholders::error));
+		mHeartBeatSent = 0;
+		mHeartBeatCurrent = mHeartBeatInterval;
+		{
+			boost::mutex::scoped_lock lock(mStatsMutex);
+			mStats.heartBeatInterval = double(mHeartBeatCurrent.count());
+		}
+		schedule_heartbeat();
 
 		// await the first message
 		read();
@@ -166,98 +502,158 @@ void TcpClient::handle_connect(const boost::system::error_code& error)
 		mIsConnected = false;
 
 		//
-		ci::app::console() << "Server error:" << error.message() << std::endl;
+		ph::console() << "Server error:" << error.message() << std::endl;
 
-		// schedule a timer to reconnect after 5 seconds		
-		mReconnectTimer.expires_from_now(std::chrono::seconds(5));
-		mReconnectTimer.async_wait(boost::bind(&TcpClient::do_reconnect, this, boost::asio::placeholders::error));
+		// schedule a timer to reconnect after 5 seconds (by default)
+		mReconnectTimer.expires_from_now(mReconnectDelay);
+		mReconnectTimer.async_wait(mStrand.wrap(track(boost::bind(&TcpClient::do_reconnect, this, boost::asio::placeholders::error))));
 	}
 }
 
-void TcpClient::handle_read(const boost::system::error_code& error)
+void TcpClient::handle_read(const boost::system::error_code& error, size_t bytes_transferred)
 {
 	if (!error)
 	{
-		std::string msg;
-		std::istream is(&mBuffer);
-		std::getline(is, msg); 
-		
-		if(msg.empty()) return;
+		mReadEnd += bytes_transferred;
+		mBytesIn += bytes_transferred;
 
-		ci::app::console() << "Server message:" << msg << std::endl;
+		if(parse()) {
+			// restart heartbeat timer (optional), unless heartbeats are sent regularly
+			if(mHeartBeatReply.empty()) schedule_heartbeat();
 
-		// TODO: you could do some message processing here, like breaking it up
-		//       into smaller parts, rejecting unknown messages or handling the message protocol
+			// wait for the next message
+			read();
+			return;
+		}
 
-		// create signal to notify listeners
-		sMessage(msg);
+		// the stream can not be recovered once the framing is lost
+		ph::console() << "Server error: invalid message" << std::endl;
+		mSocket.close();
+	}
 
-		// restart heartbeat timer (optional)
-		mHeartBeatTimer.expires_from_now(std::chrono::seconds(5));
-		mHeartBeatTimer.async_wait(boost::bind(&TcpClient::do_heartbeat, this, boost::asio::placeholders::error));
+	// try to reconnect if external host disconnects
+	mIsConnected = false;
+	mDisconnects++;
 
-		// wait for the next message
-		read();
-	}
-	else
-	{
-		// try to reconnect if external host disconnects
-		if(error.value() != 0) {
-			mIsConnected = false;
-
-			// let listeners know
-			sDisconnected(mEndPoint);
-
-			// cancel timers
-			mHeartBeatTimer.cancel();
-			mReconnectTimer.cancel();
-			
-			// schedule a timer to reconnect after 5 seconds
-			mReconnectTimer.expires_from_now(std::chrono::seconds(5));
-			mReconnectTimer.async_wait(boost::bind(&TcpClient::do_reconnect, this, boost::asio::placeholders::error));
-		}
-		else
-			do_close();
-	}
+	// let listeners know
+	sDisconnected(mEndPoint);
+
+	// writers waiting for room should give up
+	notify_writers();
+
+	// do not reconnect if we closed the connection ourselves
+	if(mIsClosing) return;
+
+	// cancel timers
+	mHeartBeatTimer.cancel();
+	mReconnectTimer.cancel();
+	
+	// schedule a timer to reconnect after 5 seconds (by default)
+	mReconnectTimer.expires_from_now(mReconnectDelay);
+	mReconnectTimer.async_wait(mStrand.wrap(track(boost::bind(&TcpClient::do_reconnect, this, boost::asio::placeholders::error))));
 }
 
 void TcpClient::handle_write(const boost::system::error_code& error)
 {
+	if(!error) mBytesOut += mWriting.size();
+
+	// keep the capacity of the buffer, so it can be reused
+	mWriting.clear();
+	mIsWriting = false;
+
 	if(!error && !mIsClosing)
 	{
-		// write next message
-		mMessages.pop_front();
-		if (!mMessages.empty())
+		// write the messages that were queued in the meantime, they have waited long enough
+		do_flush();
+
+		// restart heartbeat timer (optional), unless heartbeats are sent regularly
+		if(!mIsWriting && mHeartBeatReply.empty()) schedule_heartbeat();
+	}
+}
+
+void TcpClient::handle_write_delay(const boost::system::error_code& error)
+{
+	// the timer is cancelled if the write was started earlier
+	if(error) return;
+
+	mIsWriteDelayed = false;
+	do_flush();
+}
+
+void TcpClient::do_write()
+{
+	if(!mIsConnected) return;
+	if(mIsClosing) return;
+
+	// the pending messages will be written when the current write completes
+	if(mIsWriting) return;
+
+	if(mWriteDelay.count() > 0) {
+		size_t size;
 		{
-			ci::app::console() << "Client message:" << mMessages.front() << std::endl;
+			boost::mutex::scoped_lock lock(mWriteMutex);
+			size = mQueueStats.bytes;
+		}
 
-			boost::asio::async_write(mSocket,
-				boost::asio::buffer(mMessages.front()),
-				boost::bind(&TcpClient::handle_write, this, boost::asio::placeholders::error));
+		// wait for more messages, unless we have enough of them
+		if(size < kMaxBatchSize) {
+			if(!mIsWriteDelayed) {
+				mIsWriteDelayed = true;
+				mWriteTimer.expires_from_now(mWriteDelay);
+				mWriteTimer.async_wait(mStrand.wrap(track(boost::bind(&TcpClient::handle_write_delay, this, boost::asio::placeholders::error))));
+			}
+			return;
 		}
-		else {
-			// restart heartbeat timer (optional)
-			mHeartBeatTimer.expires_from_now(std::chrono::seconds(5));
-			mHeartBeatTimer.async_wait(boost::bind(&TcpClient::do_heartbeat, this, boost::asio::placeholders::error));
+
+		if(mIsWriteDelayed) {
+			mIsWriteDelayed = false;
+			mWriteTimer.cancel();
 		}
 	}
+
+	do_flush();
 }
 
-void TcpClient::do_write(const std::string &msg)
+void TcpClient::do_flush()
 {
 	if(!mIsConnected) return;
+	if(mIsClosing) return;
+	if(mIsWriting) return;
 
-	bool write_in_progress = !mMessages.empty();
-	mMessages.push_back(msg + mDelimiter);
-
-	if (!write_in_progress && !mIsClosing)
 	{
-		ci::app::console() << "Client message:" << mMessages.front() << std::endl;
+		boost::mutex::scoped_lock lock(mWriteMutex);
+
+		if(mPendingBegin > 0) {
+			mWriting.assign(mPending.begin() + mPendingBegin, mPending.end());
+			mPending.clear();
+			mPendingBegin = 0;
+		}
+		else
+			mPending.swap(mWriting);
+
+		std::map<std::string, std::vector<char> >::const_iterator itr;
+		for(itr=mLatest.begin();itr!=mLatest.end();++itr)
+			mWriting.insert(mWriting.end(), itr->second.begin(), itr->second.end());
 
-		boost::asio::async_write(mSocket,
-			boost::asio::buffer(mMessages.front()),
-			boost::bind(&TcpClient::handle_write, this, boost::asio::placeholders::error));
+		mMessagesOut += mQueueStats.messages;
+
+		mLatest.clear();
+		mPendingSizes.clear();
+		mQueueStats.messages = 0;
+		mQueueStats.bytes = 0;
+		mIsWriteRequested = false;
+
+		// there is room for new messages
+		mWriteCondition.notify_all();
 	}
+
+	if(mWriting.empty()) return;
+
+	// send all messages at once
+	mIsWriting = true;
+	boost::asio::async_write(mSocket,
+		boost::asio::buffer(mWriting),
+		mStrand.wrap(track(boost::bind(&TcpClient::handle_write, this, boost::asio::placeholders::error))));
 }
 
 void TcpClient::do_close()
@@ -266,7 +662,15 @@ void TcpClient::do_close()
 	
 	mIsClosing = true;
 
+	// a shared io_service keeps running until all timers have expired
+	mHeartBeatTimer.cancel();
+	mReconnectTimer.cancel();
+	mWriteTimer.cancel();
+
 	mSocket.close();
+
+	// writers waiting for room should give up
+	notify_writers();
 }
 
 void TcpClient::do_reconnect(const boost::system::error_code& error)
@@ -274,12 +678,14 @@ void TcpClient::do_reconnect(const boost::system::error_code& error)
 	if(mIsConnected) return;
 	if(mIsClosing) return;
 
+	mReconnectAttempts++;
+
 	// close current socket if necessary
 	mSocket.close();
 
 	// try to reconnect, then call handle_connect
 	mSocket.async_connect(mEndPoint,
-        boost::bind(&TcpClient::handle_connect, this, boost::asio::placeholders::error));
+        mStrand.wrap(track(boost::bind(&TcpClient::handle_connect, this, boost::asio::placeholders::error))));
 }
 
 void TcpClient::do_heartbeat(const boost::system::error_code& error)
@@ -288,6 +694,136 @@ void TcpClient::do_heartbeat(const boost::system::error_code& error)
 	// I usualy send a PING and then the server replies with a PONG
 
 	// for now, send a QUIT to disconnect so we can see how this class can auto-reconnect
-	if(!error) write( mHeartBeat );
+	if(error) return;
+	if(!mIsConnected) return;
+	if(mIsClosing) return;
+
+	if(mHeartBeatReply.empty()) {
+		// there is no need to keep the connection alive while messages are waiting, and it would add to the queue
+		if(mIsWriting) return;
+		if(getQueueStats().messages > 0) return;
+
+		write( mHeartBeat );
+		mHeartBeatsSent++;
+		return;
+	}
+
+	// the previous heartbeat has not been answered in time
+	if(mHeartBeatSent != 0) {
+		mHeartBeatsLost++;
+
+		if(mIsHeartBeatAdaptive) {
+			mHeartBeatCurrent = std::max(mHeartBeatMinimum, mHeartBeatCurrent / 2);
+
+			boost::mutex::scoped_lock lock(mStatsMutex);
+			mStats.heartBeatInterval = double(mHeartBeatCurrent.count());
+		}
+	}
+
+	// the timestamp is echoed by the server, so we do not have to remember when each heartbeat was sent
+	mHeartBeatSent = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	write( mHeartBeat + " " + std::to_string(mHeartBeatSent) );
+	mHeartBeatsSent++;
+
+	schedule_heartbeat();
 }
 
+void TcpClient::schedule_heartbeat()
+{
+	// an adaptive interval never exceeds the configured one
+	const std::chrono::milliseconds interval = mIsHeartBeatAdaptive ? std::min(mHeartBeatCurrent, mHeartBeatInterval) : mHeartBeatInterval;
+	if(interval != mHeartBeatCurrent) {
+		mHeartBeatCurrent = interval;
+
+		boost::mutex::scoped_lock lock(mStatsMutex);
+		mStats.heartBeatInterval = double(interval.count());
+	}
+
+	mHeartBeatTimer.expires_from_now(mHeartBeatCurrent);
+	mHeartBeatTimer.async_wait(mStrand.wrap(track(boost::bind(&TcpClient::do_heartbeat, this, boost::asio::placeholders::error))));
+}
+
+bool TcpClient::handle_heartbeat_reply(const boost::string_ref &msg)
+{
+	if(mHeartBeatReply.empty()) return false;
+
+	// the reply should look like "PONG 1234567"
+	const size_t prefix = mHeartBeatReply.size();
+	if(msg.size() < prefix + 2 || !msg.starts_with(mHeartBeatReply) || msg[prefix] != ' ') return false;
+
+	uint64_t sent = 0;
+	for(size_t i=prefix+1;i<msg.size();++i) {
+		if(msg[i] < '0' || msg[i] > '9') return false;
+		sent = sent * 10 + (msg[i] - '0');
+	}
+
+	const uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	if(sent > now) return false;
+
+	// late replies are still measured, but only the latest heartbeat counts as answered
+	if(sent == mHeartBeatSent) mHeartBeatSent = 0;
+
+	const uint64_t microseconds = now - sent;
+	mRoundTripHistogram.add(microseconds);
+
+	const double roundTrip = 0.001 * microseconds;
+
+	boost::mutex::scoped_lock lock(mStatsMutex);
+
+	bool isLate = false;
+	if(mStats.roundTripAverage == 0.0) {
+		mStats.roundTripAverage = roundTrip;
+		mStats.roundTripDeviation = 0.5 * roundTrip;
+	}
+	else {
+		isLate = roundTrip > mStats.roundTripAverage + 4.0 * mStats.roundTripDeviation;
+
+		mStats.roundTripDeviation = 0.75 * mStats.roundTripDeviation + 0.25 * std::abs(mStats.roundTripAverage - roundTrip);
+		mStats.roundTripAverage = 0.875 * mStats.roundTripAverage + 0.125 * roundTrip;
+	}
+
+	mStats.roundTrip = roundTrip;
+
+	// check more often while the link degrades, then slowly back off
+	if(mIsHeartBeatAdaptive) {
+		if(isLate) mHeartBeatCurrent = std::max(mHeartBeatMinimum, mHeartBeatCurrent / 2);
+		else mHeartBeatCurrent = std::min(mHeartBeatInterval, mHeartBeatCurrent * 5 / 4);
+
+		mStats.heartBeatInterval = double(mHeartBeatCurrent.count());
+	}
+
+	return true;
+}
+
+TcpClient::Stats TcpClient::getStats()
+{
+	boost::mutex::scoped_lock lock(mStatsMutex);
+
+	const uint64_t messagesIn = mMessagesIn;
+	const uint64_t messagesOut = mMessagesOut;
+
+	// update the rates about once per second, so they do not jump around when polled every frame
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	const double elapsed = std::chrono::duration<double>(now - mRateTime).count();
+	if(elapsed >= 1.0) {
+		mStats.messagesInPerSecond = (messagesIn - mRateMessagesIn) / elapsed;
+		mStats.messagesOutPerSecond = (messagesOut - mRateMessagesOut) / elapsed;
+
+		mRateTime = now;
+		mRateMessagesIn = messagesIn;
+		mRateMessagesOut = messagesOut;
+	}
+
+	Stats stats = mStats;
+	stats.bytesIn = mBytesIn;
+	stats.bytesOut = mBytesOut;
+	stats.messagesIn = messagesIn;
+	stats.messagesOut = messagesOut;
+	stats.connects = mConnects;
+	stats.disconnects = mDisconnects;
+	stats.reconnectAttempts = mReconnectAttempts;
+	stats.heartBeatsSent = mHeartBeatsSent;
+	stats.heartBeatsLost = mHeartBeatsLost;
+
+	return stats;
+}
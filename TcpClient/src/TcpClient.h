@@ -29,18 +29,31 @@
     #include <sdkddkver.h>
 #endif
 
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
 #include <string>
 #include <iostream>
 #include <boost/asio.hpp>
 #include <boost/asio/steady_timer.hpp>
 #include <boost/bind.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/signals2.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/utility/string_ref.hpp>
 
 #include "cinder/app/AppBasic.h"
 #include "cinder/Url.h"
 #include "cinder/Utilities.h"
 
+#include "TcpFraming.h"
+#include "LatencyHistogram.h"
+
 namespace ph
 {
 
@@ -48,64 +61,332 @@ typedef boost::shared_ptr<class TcpClient> TcpClientRef;
 
 class TcpClient
 {
+public:
+	//! initial size of the receive buffer, it grows if a message does not fit
+	static const size_t	kReadBufferSize = 64 * 1024;
+	//! minimum number of bytes requested from the socket per read
+	static const size_t	kMinReadSize = 4 * 1024;
+	//! a delayed write is started immediately once this many bytes are waiting
+	static const size_t	kMaxBatchSize = 64 * 1024;
+	//! default maximum number of bytes waiting to be written
+	static const size_t	kMaxQueueSize = 16 * 1024 * 1024;
+
+	//! what write() does if the outbound queue is full
+	typedef enum { 
+		//! waits until there is room, or until the connection is closed. Can not wait on a thread that runs 
+		//! the io_service (see isIoThread), the message is dropped instead. A client that owns its io_service 
+		//! can therefore only block threads other than the one calling update().
+		BLOCK, 
+		//! removes the oldest messages that have not been written yet, messages passed to writeLatest() are kept
+		DROP_OLDEST, 
+		//! drops the message
+		DROP_NEWEST 
+	} QueuePolicy;
+
+	//! 
+	struct QueueStats {
+		//! number of messages waiting to be written
+		size_t	messages;
+		//! number of bytes waiting to be written
+		size_t	bytes;
+		//! number of messages dropped because the queue was full
+		size_t	dropped;
+		//! number of messages replaced by a newer message with the same key
+		size_t	coalesced;
+	};
+	//! health of the connection, see getStats()
+	struct Stats {
+		uint64_t	bytesIn;
+		uint64_t	bytesOut;
+		uint64_t	messagesIn;
+		uint64_t	messagesOut;
+		//! averaged over about a second, updated when polled
+		double		messagesInPerSecond;
+		double		messagesOutPerSecond;
+
+		uint32_t	connects;
+		uint32_t	disconnects;
+		uint32_t	reconnectAttempts;
+
+		//! round trip times of the timestamped heartbeats in milliseconds, zero until the first reply. 
+		//! The average and deviation are smoothed like TCP does (RFC 6298).
+		double		roundTrip;
+		double		roundTripAverage;
+		double		roundTripDeviation;
+
+		uint32_t	heartBeatsSent;
+		//! heartbeats that were not answered before the next one was sent
+		uint32_t	heartBeatsLost;
+		//! current heartbeat interval in milliseconds
+		double		heartBeatInterval;
+	};
 public:
 	TcpClient();
 	TcpClient( const std::string &heartbeat );
+	//! creates a client that runs on a shared io_service, see TcpClientPool. Its handlers are serialized
+	//! by a strand, so the io_service can be run by multiple threads. Signals are emitted on those threads.
+	//! The destructor closes the connection and waits until all handlers have been called, so it should
+	//! not be called from the client's own handlers or signals.
+	TcpClient( boost::asio::io_service &ios, const std::string &heartbeat = "PING" );
 	virtual ~TcpClient(void);
 
+	//! processes network messages, does nothing if the client runs on a shared io_service
 	virtual void update();
 	
+	//! queues a message, can be called from any thread. All messages queued while the previous write 
+	//! is in progress are sent together. Messages queued while disconnected are sent once the connection
+	//! is (re)established, messages written while the connection is being closed are counted as dropped.
 	virtual void write(const std::string &msg);
+	//! queues a message that replaces any queued message with the same key, for state updates where only 
+	//! the latest matters. Keyed messages are written after the other queued messages, in the order of their keys.
+	virtual void writeLatest(const std::string &key, const std::string &msg);
 
 	virtual void connect(const std::string &ip, unsigned short port);
 	virtual void connect(const ci::Url &url, const std::string &protocol);
 	virtual void connect(boost::asio::ip::tcp::endpoint& endpoint);
 
+	//! closes the connection. A client that runs on a shared io_service can not connect again.
 	virtual void disconnect();
 
 	bool isConnected(){ return mIsConnected; };
 	
 	std::string getDelimiter(){ return mDelimiter; };
-	void setDelimiter(const std::string &delimiter){ mDelimiter = delimiter; };
+	//! messages are terminated by the delimiter, replaces the current framing
+	void setDelimiter(const std::string &delimiter);
+
+	//! returns the framing used to split the received data into messages and to frame outgoing messages
+	TcpFramingRef getFraming(){ return mFraming; };
+	//! replaces the framing. Should be set before connecting, because received data is not reinterpreted.
+	void setFraming(const TcpFramingRef &framing);
+
+	//! returns the maximum time messages are held back, so they can be sent together with the next ones
+	std::chrono::microseconds getWriteDelay(){ return mWriteDelay; };
+	//! holds back messages for at most the specified time, similar to Nagle's algorithm (disabled by default)
+	void setWriteDelay(const std::chrono::microseconds &delay){ mWriteDelay = delay; };
+
+	//! returns the time between heartbeats
+	std::chrono::milliseconds getHeartBeatInterval(){ return mHeartBeatInterval; };
+	//! sets the time between heartbeats (5 seconds by default). Heartbeats are only sent while the connection 
+	//! is idle, unless a reply is expected. Takes effect after the next heartbeat.
+	void setHeartBeatInterval(const std::chrono::milliseconds &interval){ mHeartBeatInterval = interval; };
+	//! if the server answers heartbeats, pass the start of its reply. Heartbeats are then sent regularly with a timestamp 
+	//! ("PING 1234567") and replies that start with 'reply' and end with the same timestamp are used to measure the round 
+	//! trip time. Replies are not passed to the listeners. Use the heartbeat itself for servers that echo.
+	void setHeartBeatReply(const std::string &reply){ mHeartBeatReply = reply; };
+	//! sends heartbeats more often (down to the minimum interval) while replies are late or lost, 
+	//! and returns to the normal interval while the round trip time is stable
+	void setAdaptiveHeartBeat(bool enabled, const std::chrono::milliseconds &minimum = std::chrono::milliseconds(250)){ mIsHeartBeatAdaptive = enabled; mHeartBeatMinimum = minimum; };
+
+	//! returns a snapshot of the connection's health, cheap enough to call every frame from any thread
+	Stats getStats();
+	//! returns the round trip times of all heartbeats, values can be read from any thread
+	const LatencyHistogram& getRoundTripHistogram(){ return mRoundTripHistogram; };
+
+	//! returns the time to wait before reconnecting after the connection was lost or could not be made
+	std::chrono::milliseconds getReconnectDelay(){ return mReconnectDelay; };
+	//! sets the time to wait before reconnecting (5 seconds by default)
+	void setReconnectDelay(const std::chrono::milliseconds &delay){ mReconnectDelay = delay; };
+
+	//! limits the number of bytes and messages waiting to be written, a single message always fits
+	void setQueueCapacity(size_t bytes, size_t messages = SIZE_MAX);
+	//! sets what happens to messages that do not fit in the outbound queue (DROP_NEWEST by default)
+	void setQueuePolicy(QueuePolicy policy);
+	//! returns the depth of the outbound queue and its drop counters, can be called from any thread
+	QueueStats getQueueStats();
+
+	//! returns TRUE if the calling thread runs the client's io_service: the thread that calls update() if the
+	//! client owns its io_service, otherwise a thread that is running a handler of a TcpClient on the same 
+	//! io_service, or a thread marked by an IoThreadScope (like the threads of TcpClientPool)
+	bool isIoThread();
+
+	//! limits the send buffer of the OS, so a slow link fills the outbound queue sooner and the policies
+	//! apply to more of the unsent messages. 0 keeps the default of the OS. Takes effect on the next connection.
+	void setSendBufferSize(size_t bytes){ mSendBufferSize = bytes; };
+public:
+	//! marks the calling thread as running the io_service for as long as it exists, see isIoThread()
+	class IoThreadScope {
+	public:
+		IoThreadScope(boost::asio::io_service &ios);
+		~IoThreadScope();
+	private:
+		boost::asio::io_service	*mPrevious;
+	};
 public:
 	// signals
 	boost::signals2::signal<void(const boost::asio::ip::tcp::endpoint&)>	sConnected;
 	boost::signals2::signal<void(const boost::asio::ip::tcp::endpoint&)>	sDisconnected;
 	
+	//! passes a copy of each message to the listeners. Only connect to it if you need to keep the message.
 	boost::signals2::signal<void(const std::string&)>						sMessage;
+	//! passes each message straight from the receive buffer, without copying it. 
+	//! The data is only valid for the duration of the call.
+	boost::signals2::signal<void(const boost::string_ref&)>					sMessageView;
 protected:
+	//! Calls a handler and counts it as completed. All handlers are tracked, so the destructor of 
+	//! a client on a shared io_service can wait until none of them refers to the client anymore.
+	template<typename Handler>
+	class Tracked {
+	public:
+		Tracked(TcpClient *client, const Handler &handler) : mClient(client), mHandler(handler) {}
+
+		template<typename... Args>
+		void operator()(const Args&... args) {
+			IoThreadScope scope(mClient->mIos);
+
+			// also count the handler as completed if a listener throws
+			try { mHandler(args...); }
+			catch(...) { mClient->release(); throw; }
+			mClient->release();
+		}
+	private:
+		TcpClient	*mClient;
+		Handler		mHandler;
+	};
+
+	//! wraps a handler that will be passed to the io_service, see Tracked
+	template<typename Handler>
+	Tracked<Handler> track(const Handler &handler){ mHandlers++; return Tracked<Handler>(this, handler); }
+	//! called after each tracked handler
+	void release();
+
+	//! initializes the members that all constructors share
+	void init();
+
 	virtual void read();
 	virtual void close();
 
+	//! isIoThread() for callers that hold the lock on mWriteMutex
+	bool isIoThread(const boost::mutex::scoped_lock &lock);
+	//! makes room in the outbound queue according to the policy, returns FALSE if the message should be dropped.
+	//! The lock on mWriteMutex may be released while waiting.
+	virtual bool reserve(boost::mutex::scoped_lock &lock, size_t bytes);
+	//! wakes up threads that are waiting for room in the outbound queue
+	virtual void notify_writers();
+
+	//! passes all complete messages in the receive buffer to the listeners, 
+	//! returns FALSE if the data is not valid according to the framing
+	virtual bool parse();
+
 	// callbacks
 	virtual void handle_connect(const boost::system::error_code& error);
-	virtual void handle_read(const boost::system::error_code& error);
+	virtual void handle_read(const boost::system::error_code& error, size_t bytes_transferred);
 	virtual void handle_write(const boost::system::error_code& error);
+	virtual void handle_write_delay(const boost::system::error_code& error);
 
-	virtual void do_write(const std::string &msg);
+	virtual void do_write();
+	virtual void do_flush();
 	virtual void do_close();
 
 	virtual void do_reconnect(const boost::system::error_code& error);
 	virtual void do_heartbeat(const boost::system::error_code& error);
+	//! (re)starts the heartbeat timer at the current interval
+	virtual void schedule_heartbeat();
+	//! returns TRUE if the message is a reply to a heartbeat, and updates the round trip time
+	virtual bool handle_heartbeat_reply(const boost::string_ref &msg);
 protected:
-	bool							mIsConnected;
-	bool							mIsClosing;
+	//! can be read from any thread
+	std::atomic<bool>				mIsConnected;
+	std::atomic<bool>				mIsClosing;
 
 	boost::asio::ip::tcp::endpoint	mEndPoint;
 
-	boost::asio::io_service			mIos;
+	//! only set if the client owns its io_service
+	boost::scoped_ptr<boost::asio::io_service>	mOwnIos;
+	boost::asio::io_service			&mIos;
+	//! serializes the handlers, in case the io_service is run by multiple threads
+	boost::asio::io_service::strand	mStrand;
 	boost::asio::ip::tcp::socket	mSocket;
 
-	boost::asio::streambuf			mBuffer;
+	//! received data. Messages are passed to the listeners straight from this buffer,
+	//! the incomplete message at the end is moved to the front when it runs out of space.
+	std::vector<char>				mReadBuffer;
+	//! start of the first incomplete message
+	size_t							mReadBegin;
+	//! end of the received data
+	size_t							mReadEnd;
+	//! position (relative to mReadBegin) from which to continue looking for the end of the message
+	size_t							mReadScan;
+	//! size of the incomplete message, if the framing already knows it
+	size_t							mReadRequired;
+
+	//! to be written to server. Messages are appended to the pending buffer, which is swapped with 
+	//! the buffer being written once the previous write has completed. Both keep their capacity.
+	std::vector<char>				mPending;
+	std::vector<char>				mWriting;
+	//! start of the first message in the pending buffer, older messages have been dropped
+	size_t							mPendingBegin;
+	//! size of each framed message in the pending buffer
+	std::deque<size_t>				mPendingSizes;
+	//! keyed messages, already framed
+	std::map<std::string, std::vector<char> >	mLatest;
 
-	//! to be written to server
-	std::deque<std::string>			mMessages;	
+	size_t							mSendBufferSize;
+	size_t							mQueueCapacity;
+	size_t							mQueueMessageCapacity;
+	QueuePolicy						mQueuePolicy;
+	QueueStats						mQueueStats;
+
+	//! protects the pending buffer, the queue members and the flag below
+	boost::mutex					mWriteMutex;
+	//! signalled when the pending buffer has been swapped or the connection has been closed
+	boost::condition_variable		mWriteCondition;
+	//! TRUE if do_write() has been posted, but the pending buffer has not been swapped yet
+	bool							mIsWriteRequested;
+	//! the thread that calls update() if the client owns its io_service
+	boost::thread::id				mPollThread;
+	bool							mIsWriting;
+	bool							mIsWriteDelayed;
+
+	std::chrono::microseconds		mWriteDelay;
+	boost::asio::steady_timer		mWriteTimer;
 
 	boost::asio::steady_timer		mHeartBeatTimer;
 	boost::asio::steady_timer		mReconnectTimer;
+	std::chrono::milliseconds		mReconnectDelay;
 
 	std::string						mDelimiter;
+	TcpFramingRef					mFraming;
 	std::string						mHeartBeat;
+	std::string						mHeartBeatReply;
+	std::chrono::milliseconds		mHeartBeatInterval;
+	std::chrono::milliseconds		mHeartBeatMinimum;
+	//! the interval may be shorter than mHeartBeatInterval if it is adaptive
+	std::chrono::milliseconds		mHeartBeatCurrent;
+	bool							mIsHeartBeatAdaptive;
+	//! time the unanswered heartbeat was sent, in microseconds, zero if all have been answered
+	uint64_t						mHeartBeatSent;
+
+	//! counters of the stats, written by the handlers and read by getStats()
+	std::atomic<uint64_t>			mBytesIn;
+	std::atomic<uint64_t>			mBytesOut;
+	std::atomic<uint64_t>			mMessagesIn;
+	std::atomic<uint64_t>			mMessagesOut;
+	std::atomic<uint32_t>			mConnects;
+	std::atomic<uint32_t>			mDisconnects;
+	std::atomic<uint32_t>			mReconnectAttempts;
+	std::atomic<uint32_t>			mHeartBeatsSent;
+	std::atomic<uint32_t>			mHeartBeatsLost;
+
+	//! protects the members below, which change at most once per heartbeat or per second
+	boost::mutex					mStatsMutex;
+	Stats							mStats;
+	//! time and counters at the start of the current rate measurement
+	std::chrono::steady_clock::time_point	mRateTime;
+	uint64_t						mRateMessagesIn;
+	uint64_t						mRateMessagesOut;
+
+	LatencyHistogram				mRoundTripHistogram;
+
+	//! number of tracked handlers that have not been called yet
+	std::atomic<size_t>				mHandlers;
+	boost::mutex					mHandlerMutex;
+	//! signalled when the last handler has been called
+	boost::condition_variable		mHandlerCondition;
+
+	//! the io_service run by the current thread, see IoThreadScope
+	static boost::thread_specific_ptr<boost::asio::io_service>	sIoService;
+	//! the thread specific pointer does not own the io_service
+	static void	ignore(boost::asio::io_service *ios) {}
 };
 
 } // namespace
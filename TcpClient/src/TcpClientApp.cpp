@@ -22,16 +22,115 @@
 
 // To make sure boost::asio is loaded first, include our header file first
 #include "TcpClient.h"
+#include "TcpClientPool.h"
+#include "TcpServer.h"
+#include "LoopbackServer.h"
+#include "LoadGenerator.h"
 
 #include "cinder/app/AppBasic.h"
 #include "cinder/gl/Texture.h"
 #include "cinder/Font.h"
 #include "cinder/Text.h"
+#include "cinder/Timer.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
 
 using namespace ci;
 using namespace ci::app;
 using namespace std;
 
+// count all memory allocations, so the benchmarks can report them
+static std::atomic<size_t>	sAllocations(0);
+
+void* operator new(size_t size)
+{
+	++sAllocations;
+
+	void *ptr = std::malloc(size ? size : 1);
+	if(!ptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void *ptr) throw()
+{
+	std::free(ptr);
+}
+
+//! Client that counts its writes, used by the benchmark
+class CountingClient : public ph::TcpClient {
+public:
+	CountingClient() : mWrites(0) {}
+
+	size_t	mWrites;
+protected:
+	void handle_write(const boost::system::error_code& error){ ++mWrites; ph::TcpClient::handle_write(error); }
+};
+
+//! Writes messages the way the TcpClient did before it sent them together: each message is copied
+//! into the posted handler and written separately. Used by the benchmark.
+class SeparateWriter {
+public:
+	SeparateWriter(boost::asio::io_service &ios, boost::asio::ip::tcp::socket &socket) : mWrites(0), mIos(ios), mSocket(socket) {}
+
+	void write(const std::string &msg){ mIos.post(boost::bind(&SeparateWriter::do_write, this, msg)); }
+
+	size_t	mWrites;
+protected:
+	void do_write(const std::string &msg) {
+		bool write_in_progress = !mMessages.empty();
+		mMessages.push_back(msg + "\n");
+		if(!write_in_progress) start();
+	}
+	void handle_write(const boost::system::error_code& error) {
+		mMessages.pop_front();
+		if(!error && !mMessages.empty()) start();
+	}
+	void start() {
+		++mWrites;
+		boost::asio::async_write(mSocket, boost::asio::buffer(mMessages.front()),
+			boost::bind(&SeparateWriter::handle_write, this, boost::asio::placeholders::error));
+	}
+protected:
+	boost::asio::io_service			&mIos;
+	boost::asio::ip::tcp::socket	&mSocket;
+	std::deque<std::string>			mMessages;
+};
+
+//! Collects latencies from any thread, used by the benchmark
+class LatencyStats {
+public:
+	LatencyStats() : mCount(0), mTotal(0), mMax(0) {}
+
+	//! the message contains the time it was sent, in microseconds
+	void add(const boost::string_ref &msg) {
+		uint64_t sent = 0;
+		for(size_t i=0;i<msg.size();++i)
+			sent = sent * 10 + (msg[i] - '0');
+
+		const uint64_t latency = now() - sent;
+
+		boost::mutex::scoped_lock lock(mMutex);
+		mCount++;
+		mTotal += latency;
+		mMax = std::max(mMax, latency);
+	}
+
+	static uint64_t now() {
+		return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	}
+
+	size_t	getCount() { boost::mutex::scoped_lock lock(mMutex); return mCount; }
+	double	getAverage() { boost::mutex::scoped_lock lock(mMutex); return mCount ? 0.001 * mTotal / mCount : 0.0; }
+	double	getMax() { boost::mutex::scoped_lock lock(mMutex); return 0.001 * mMax; }
+protected:
+	boost::mutex	mMutex;
+	size_t			mCount;
+	uint64_t		mTotal;
+	uint64_t		mMax;
+};
+
 //
 class TcpClientApp : public AppBasic {
 public:
@@ -42,6 +141,25 @@ public:
 
 	void resize();
 
+	void keyDown( KeyEvent event );
+
+	//! measures receiving a large number of small messages from a local server
+	void benchmarkReceive();
+	//! measures sending a large number of small messages to a local server
+	void benchmarkWrite();
+	//! compares the throughput of the framings and verifies the received messages
+	void benchmarkFraming();
+	//! compares the receive latency of clients that are polled once per frame and clients run by a pool
+	void benchmarkPool();
+	//! sends state updates faster than a slow link can handle, using each of the queue policies
+	void benchmarkQueue();
+	//! runs the load generator with its default options
+	void benchmarkLoad();
+	//! measures the round trip time with heartbeats while the link is loaded
+	void benchmarkHealth();
+	//! broadcasts messages to a thousand local clients, then shows how slow clients are handled
+	void benchmarkBroadcast();
+
 	// slots that are called by the server
 	void onConnected(const boost::asio::ip::tcp::endpoint&);
 	void onDisconnected(const boost::asio::ip::tcp::endpoint&);
@@ -89,6 +207,158 @@ void TcpClientApp::resize()
 {	
 	if(mTextBoxRef) mTextBoxRef->setSize( getWindowSize() - Vec2i(20, 20) );
 }
+
+void TcpClientApp::keyDown( KeyEvent event )
+{
+	switch( event.getCode() ) {
+	case KeyEvent::KEY_r:
+		benchmarkReceive();
+		break;
+	case KeyEvent::KEY_w:
+		benchmarkWrite();
+		break;
+	case KeyEvent::KEY_f:
+		benchmarkFraming();
+		break;
+	case KeyEvent::KEY_p:
+		benchmarkPool();
+		break;
+	case KeyEvent::KEY_q:
+		benchmarkQueue();
+		break;
+	case KeyEvent::KEY_l:
+		benchmarkLoad();
+		break;
+	case KeyEvent::KEY_h:
+		benchmarkHealth();
+		break;
+	case KeyEvent::KEY_b:
+		benchmarkBroadcast();
+		break;
+	}
+}
+
+//! connects the client and polls it until the expected number of messages has been received. 
+//! Returns the elapsed time in seconds and the number of allocations.
+static double receiveAll( ph::TcpClient &client, unsigned short port, const size_t &count, size_t expected, size_t *allocations )
+{
+	const size_t before = sAllocations;
+
+	// the time needed to connect is included, local connections are very fast
+	Timer timer(true);
+
+	client.connect("127.0.0.1", port);
+	while(count < expected && timer.getSeconds() < 10.0)
+		client.update();
+
+	*allocations = sAllocations - before;
+
+	return timer.getSeconds();
+}
+
+//! writes the messages in bursts, polling after each burst like an application does once per frame.
+//! Returns the elapsed time in seconds, when the server has received all data, and the number of allocations.
+static double writeAll( const std::function<void(const std::string&)> &write, const std::function<void()> &poll, ph::LoopbackServer &server, 
+					   const std::string &msg, size_t count, size_t burst, size_t *allocations )
+{
+	const size_t expected = server.getBytesReceived() + count * (msg.size() + 1);
+	const size_t before = sAllocations;
+
+	Timer timer(true);
+
+	for(size_t i=0;i<count;++i) {
+		write(msg);
+		if(i % burst == burst - 1) poll();
+	}
+
+	while(server.getBytesReceived() < expected && timer.getSeconds() < 10.0)
+		poll();
+
+	*allocations = sAllocations - before;
+
+	return timer.getSeconds();
+}
+
+void TcpClientApp::benchmarkReceive()
+{
+	const size_t	kMessages = 200000;
+	const size_t	kSize = 64;
+
+	// the server sends all messages as soon as a client connects
+	std::string data;
+	data.reserve(kMessages * kSize);
+	for(size_t i=0;i<kMessages;++i) {
+		data.append(kSize - 1, 'x');
+		data.append(1, '\n');
+	}
+
+	ph::LoopbackServer server;
+	server.setGreeting(data);
+	server.start();
+
+	// messages passed straight from the receive buffer
+	size_t count = 0;
+	size_t allocations;
+
+	ph::TcpClient viewClient;
+	viewClient.setDelimiter("\n");
+	viewClient.sMessageView.connect( [&](const boost::string_ref &msg){ ++count; } );
+
+	double views = receiveAll( viewClient, server.getPort(), count, kMessages, &allocations );
+	double viewAllocations = double(allocations) / count;
+	viewClient.disconnect();
+
+	// messages copied into a string
+	count = 0;
+
+	ph::TcpClient copyClient;
+	copyClient.setDelimiter("\n");
+	copyClient.sMessage.connect( [&](const std::string &msg){ ++count; } );
+
+	double copies = receiveAll( copyClient, server.getPort(), count, kMessages, &allocations );
+	double copyAllocations = double(allocations) / count;
+	copyClient.disconnect();
+
+	// the previous implementation: read each message from a streambuf into a new string
+	count = 0;
+
+	boost::asio::io_service ios;
+	boost::asio::ip::tcp::socket socket(ios);
+	socket.connect( boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), server.getPort()) );
+
+	boost::asio::streambuf buffer;
+	boost::signals2::signal<void(const std::string&)> signal;
+	signal.connect( [&](const std::string &msg){ ++count; } );
+
+	std::function<void(const boost::system::error_code&, size_t)> handler = [&](const boost::system::error_code &error, size_t) {
+		if(error) return;
+
+		std::string msg;
+		std::istream is(&buffer);
+		std::getline(is, msg);
+		signal(msg);
+
+		boost::asio::async_read_until(socket, buffer, "\n", handler);
+	};
+
+	const size_t before = sAllocations;
+
+	Timer timer(true);
+	boost::asio::async_read_until(socket, buffer, "\n", handler);
+	while(count < kMessages && timer.getSeconds() < 10.0)
+		ios.poll();
+
+	double streambuf = timer.getSeconds();
+	double streambufAllocations = double(sAllocations - before) / count;
+	socket.close();
+
+	server.stop();
+
+	console() << "Receiving " << kMessages << " messages of " << kSize << " bytes:" << std::endl;
+	console() << "  views:     " << (kMessages / views) << " msgs/s, " << viewAllocations << " allocations per message" << std::endl;
+	console() << "  copies:    " << (kMessages / copies) << " msgs/s, " << copyAllocations << " allocations per message" << std::endl;
+	console() << "  streambuf: " << (kMessages / streambuf) << " msgs/s, " << streambufAllocations << " allocations per message" << std::endl;
+}
 	
 void TcpClientApp::onConnected(const boost::asio::ip::tcp::endpoint &endpoint)
 {
@@ -103,10 +373,535 @@ void TcpClientApp::onDisconnected(const boost::asio::ip::tcp::endpoint &endpoint
 
 void TcpClientApp::onMessage(const std::string &msg)
 {
+	console() << "Server message:" << msg << std::endl;
+
 	if(mTextBoxRef) {
 		mTextBoxRef->appendText(msg + "\n");
 		mTexture = gl::Texture( mTextBoxRef->render() );
 	}
 }
 
+void TcpClientApp::benchmarkWrite()
+{
+	const size_t	kMessages = 200000;
+	const size_t	kSize = 32;
+	const size_t	kBurst = 100;
+
+	ph::LoopbackServer server;
+	server.start();
+
+	const std::string msg(kSize - 1, 'x');
+	size_t allocations;
+
+	// messages sent together, as soon as possible
+	CountingClient client;
+	client.setDelimiter("\n");
+	client.connect("127.0.0.1", server.getPort());
+	while(!client.isConnected()) client.update();
+
+	double together = writeAll( [&](const std::string &m){ client.write(m); }, [&](){ client.update(); }, server, msg, kMessages, kBurst, &allocations );
+	double togetherAllocations = double(allocations) / kMessages;
+	size_t togetherWrites = client.mWrites;
+
+	// messages held back for at most a millisecond
+	client.mWrites = 0;
+	client.setWriteDelay( std::chrono::milliseconds(1) );
+
+	double delayed = writeAll( [&](const std::string &m){ client.write(m); }, [&](){ client.update(); }, server, msg, kMessages, kBurst, &allocations );
+	double delayedAllocations = double(allocations) / kMessages;
+	size_t delayedWrites = client.mWrites;
+
+	client.disconnect();
+
+	// the previous implementation: one write per message
+	boost::asio::io_service ios;
+	boost::asio::io_service::work work(ios);
+	boost::asio::ip::tcp::socket socket(ios);
+	socket.connect( boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), server.getPort()) );
+
+	SeparateWriter writer(ios, socket);
+
+	double separate = writeAll( [&](const std::string &m){ writer.write(m); }, [&](){ ios.poll(); }, server, msg, kMessages, kBurst, &allocations );
+	double separateAllocations = double(allocations) / kMessages;
+
+	socket.close();
+	server.stop();
+
+	console() << "Writing " << kMessages << " messages of " << kSize << " bytes, in bursts of " << kBurst << ":" << std::endl;
+	console() << "  together:  " << (kMessages / together) << " msgs/s, " << togetherWrites << " writes, " << togetherAllocations << " allocations per message" << std::endl;
+	console() << "  delayed:   " << (kMessages / delayed) << " msgs/s, " << delayedWrites << " writes, " << delayedAllocations << " allocations per message" << std::endl;
+	console() << "  separate:  " << (kMessages / separate) << " msgs/s, " << writer.mWrites << " writes, " << separateAllocations << " allocations per message" << std::endl;
+}
+
+void TcpClientApp::benchmarkFraming()
+{
+	const size_t	kMessages = 200000;
+	const size_t	kSize = 64;
+
+	struct Test {
+		std::string			name;
+		ph::TcpFramingRef	framing;
+		//! TRUE if the messages may contain any byte
+		bool				isBinary;
+	} tests[] = {
+		{ "delimiter", ph::TcpFramingRef( new ph::DelimiterFraming("\n") ), false },
+		{ "u16 (BE)", ph::TcpFramingRef( new ph::LengthPrefixFraming(ph::LengthPrefixFraming::HEADER_U16, true) ), true },
+		{ "u32 (BE)", ph::TcpFramingRef( new ph::LengthPrefixFraming(ph::LengthPrefixFraming::HEADER_U32, true) ), true },
+		{ "u32 (LE)", ph::TcpFramingRef( new ph::LengthPrefixFraming(ph::LengthPrefixFraming::HEADER_U32, false) ), true },
+		{ "varint", ph::TcpFramingRef( new ph::LengthPrefixFraming(ph::LengthPrefixFraming::HEADER_VARINT) ), true }
+	};
+
+	console() << "Receiving " << kMessages << " messages of " << kSize << " bytes:" << std::endl;
+
+	for(size_t t=0;t<sizeof(tests)/sizeof(tests[0]);++t) {
+		const Test &test = tests[t];
+
+		// binary messages contain delimiters and null-bytes, which the length prefix should not care about.
+		// Some of them are empty, which is a valid message if it has a length prefix.
+		std::vector<std::string> messages(kMessages);
+		for(size_t i=0;i<kMessages;++i) {
+			messages[i].resize( (test.isBinary && i % 1000 == 999) ? 0 : kSize );
+			for(size_t j=0;j<messages[i].size();++j)
+				messages[i][j] = test.isBinary ? char((i * 31 + j * 7) & 0xFF) : char('a' + (i + j) % 26);
+		}
+
+		std::vector<char> data;
+		for(size_t i=0;i<kMessages;++i)
+			test.framing->encode(messages[i].data(), messages[i].size(), &data);
+
+		ph::LoopbackServer server;
+		server.setGreeting( std::string(data.begin(), data.end()) );
+		server.start();
+
+		size_t count = 0;
+		size_t errors = 0;
+		size_t allocations;
+
+		ph::TcpClient client;
+		client.setFraming(test.framing);
+		client.sMessageView.connect( [&](const boost::string_ref &msg){ 
+			if(count >= kMessages || msg != boost::string_ref(messages[count])) ++errors;
+			++count; 
+		} );
+
+		double seconds = receiveAll( client, server.getPort(), count, kMessages, &allocations );
+		client.disconnect();
+		server.stop();
+
+		console() << "  " << test.name << ": " << (count / seconds) << " msgs/s, " << (data.size() / seconds / 1048576.0) << " MB/s, " 
+			<< count << " messages, " << errors << " errors" << std::endl;
+	}
+
+	// a frame that exceeds the maximum size should close the connection, instead of growing the buffer
+	ph::LoopbackServer server;
+	server.setGreeting( std::string("\x7F\xFF\xFF\xFF", 4) );
+	server.start();
+
+	bool disconnected = false;
+
+	ph::TcpClient client;
+	client.setFraming( ph::TcpFramingRef( new ph::LengthPrefixFraming(ph::LengthPrefixFraming::HEADER_U32, true, 1024 * 1024) ) );
+	client.sDisconnected.connect( [&](const boost::asio::ip::tcp::endpoint&){ disconnected = true; } );
+	client.connect("127.0.0.1", server.getPort());
+
+	Timer timer(true);
+	while(!disconnected && timer.getSeconds() < 10.0)
+		client.update();
+
+	client.disconnect();
+	server.stop();
+
+	console() << "  oversized frame: " << (disconnected ? "rejected" : "NOT rejected") << std::endl;
+}
+
+void TcpClientApp::benchmarkPool()
+{
+	const size_t	kClients = 100;
+	const size_t	kFrames = 60;
+	const size_t	kMessagesPerFrame = 4;
+	//! time spent by the application on each frame, in milliseconds
+	const int		kFrameTime = 16;
+
+	ph::LoopbackServer server;
+	server.start();
+
+	LatencyStats frameLatency, ioLatency, queueLatency;
+
+	// a client that is polled once per frame
+	ph::TcpClient frameClient;
+	frameClient.setDelimiter("\n");
+	frameClient.sMessageView.connect( [&](const boost::string_ref &msg){ frameLatency.add(msg); } );
+	frameClient.connect("127.0.0.1", server.getPort());
+
+	// clients that are run by the pool
+	size_t connected = 0;
+
+	ph::TcpClientPool pool;
+	pool.sConnected.connect( [&](const ph::TcpClientRef&, const boost::asio::ip::tcp::endpoint&){ ++connected; } );
+	pool.sMessage.connect( [&](const ph::TcpClientRef&, const std::string &msg){ queueLatency.add(msg); } );
+
+	for(size_t i=0;i<kClients;++i) {
+		ph::TcpClientRef client = pool.create();
+		client->setDelimiter("\n");
+		client->sMessageView.connect( [&](const boost::string_ref &msg){ ioLatency.add(msg); } );
+		client->connect("127.0.0.1", server.getPort());
+	}
+
+	Timer timer(true);
+	while((connected < kClients || !frameClient.isConnected()) && timer.getSeconds() < 10.0) {
+		frameClient.update();
+		pool.update();
+	}
+
+	// the server sends timestamps while the application is busy with its frame
+	for(size_t frame=0;frame<kFrames;++frame) {
+		for(size_t i=0;i<kMessagesPerFrame;++i) {
+			boost::this_thread::sleep( boost::posix_time::milliseconds(kFrameTime / kMessagesPerFrame) );
+			server.send( toString( LatencyStats::now() ) + "\n" );
+		}
+
+		frameClient.update();
+		pool.update();
+	}
+
+	// wait for the last messages
+	timer.start();
+	while(queueLatency.getCount() < kClients * kFrames * kMessagesPerFrame && timer.getSeconds() < 10.0) {
+		frameClient.update();
+		pool.update();
+	}
+
+	frameClient.disconnect();
+	server.stop();
+
+	console() << "Receive latency of " << kFrames * kMessagesPerFrame << " messages, at a frame time of " << kFrameTime << " ms:" << std::endl;
+	console() << "  polled per frame:      " << frameLatency.getAverage() << " ms average, " << frameLatency.getMax() << " ms max (" << frameLatency.getCount() << " messages)" << std::endl;
+	console() << "  pool, I/O thread:      " << ioLatency.getAverage() << " ms average, " << ioLatency.getMax() << " ms max (" 
+		<< ioLatency.getCount() << " messages, " << kClients << " clients, " << pool.getNumThreads() << " threads)" << std::endl;
+	console() << "  pool, update() thread: " << queueLatency.getAverage() << " ms average, " << queueLatency.getMax() << " ms max (" << queueLatency.getCount() << " messages)" << std::endl;
+}
+
+void TcpClientApp::benchmarkQueue()
+{
+	const size_t	kUpdates = 20000;
+	const size_t	kUpdatesPerMillisecond = 10;
+	const size_t	kObjects = 100;
+	const size_t	kSize = 64;
+	//! bytes per second
+	const size_t	kLinkRate = 64 * 1024;
+	const size_t	kCapacity = 64 * 1024;
+
+	const char *names[] = { "unbounded", "drop oldest", "drop newest", "block", "coalesce" };
+
+	console() << "Sending " << kUpdates << " state updates of " << kSize << " bytes at " << kUpdatesPerMillisecond << "k/s, over a link of " << kLinkRate / 1024 << " kB/s:" << std::endl;
+
+	for(size_t mode=0;mode<5;++mode) {
+		ph::LoopbackServer server;
+		server.setReadRate(kLinkRate);
+		server.start();
+
+		ph::TcpClient client;
+		client.setDelimiter("\n");
+		client.setSendBufferSize(4096);
+
+		switch(mode) {
+		case 0: client.setQueueCapacity(SIZE_MAX); break;
+		case 1: client.setQueueCapacity(kCapacity); client.setQueuePolicy(ph::TcpClient::DROP_OLDEST); break;
+		case 2: client.setQueueCapacity(kCapacity); client.setQueuePolicy(ph::TcpClient::DROP_NEWEST); break;
+		case 3: client.setQueueCapacity(kCapacity); client.setQueuePolicy(ph::TcpClient::BLOCK); break;
+		case 4: client.setQueueCapacity(kCapacity); break;
+		}
+
+		// a blocked writer can not poll the client, so the client is polled by another thread
+		const bool isBlocking = (mode == 3);
+		std::atomic<bool> isPolling(isBlocking);
+		boost::thread poller;
+		if(isBlocking) {
+			poller = boost::thread( [&]() {
+				while(isPolling) {
+					client.update();
+					boost::this_thread::sleep( boost::posix_time::milliseconds(1) );
+				}
+			} );
+		}
+
+		client.connect("127.0.0.1", server.getPort());
+		while(!client.isConnected()) {
+			if(isBlocking) boost::this_thread::yield();
+			else client.update();
+		}
+
+		size_t maxMessages = 0;
+		size_t maxBytes = 0;
+
+		Timer timer(true);
+		for(size_t i=0;i<kUpdates;++i) {
+			// the state of an object, padded to the message size
+			const size_t object = i % kObjects;
+			std::string msg = "object " + toString(object) + " state " + toString(i) + " ";
+			msg.resize(kSize - 1, '.');
+
+			if(mode == 4) client.writeLatest(toString(object), msg);
+			else client.write(msg);
+
+			if(i % kUpdatesPerMillisecond == kUpdatesPerMillisecond - 1) {
+				ph::TcpClient::QueueStats stats = client.getQueueStats();
+				maxMessages = std::max(maxMessages, stats.messages);
+				maxBytes = std::max(maxBytes, stats.bytes);
+
+				if(!isBlocking) client.update();
+				boost::this_thread::sleep( boost::posix_time::milliseconds(1) );
+			}
+		}
+
+		const double seconds = timer.getSeconds();
+		const ph::TcpClient::QueueStats stats = client.getQueueStats();
+		const size_t received = server.getBytesReceived();
+
+		isPolling = false;
+		if(poller.joinable()) poller.join();
+
+		client.disconnect();
+		server.stop();
+
+		console() << "  " << names[mode] << ": " << (kUpdates / seconds) << " updates/s, max depth " << maxMessages << " messages (" << maxBytes / 1024 << " kB), "
+			<< stats.messages << " left, " << stats.dropped << " dropped, " << stats.coalesced << " coalesced, " << received / 1024 << " kB received" << std::endl;
+	}
+}
+
+void TcpClientApp::benchmarkLoad()
+{
+	ph::LoadGenerator generator;
+	generator.run( ph::LoadGenerator::Options() );
+}
+
+void TcpClientApp::benchmarkHealth()
+{
+	const size_t	kCalls = 1000000;
+
+	// the server echoes the heartbeats, so they are their own reply
+	// a link of 1 MB/s
+	ph::LoopbackServer server;
+	server.setEcho(true);
+	server.setReadRate(1024 * 1024);
+	server.start();
+
+	ph::TcpClient client("PING");
+	client.setDelimiter("\n");
+	client.setHeartBeatInterval( std::chrono::milliseconds(200) );
+	client.setHeartBeatReply("PING");
+	client.setAdaptiveHeartBeat( true, std::chrono::milliseconds(25) );
+	client.connect("127.0.0.1", server.getPort());
+	while(!client.isConnected()) client.update();
+
+	console() << "Heartbeat round trip over a link of 1 MB/s, light traffic for 1.5 seconds, then 1 second of heavy traffic:" << std::endl;
+
+	const std::string small(63, 's');
+	const std::string large(1023, 'l');
+
+	Timer timer(true);
+	double report = 0.0;
+	for(size_t frame=0;timer.getSeconds() < 4.0;++frame) {
+		const double elapsed = timer.getSeconds();
+		const bool isHeavy = elapsed >= 1.5 && elapsed < 2.5;
+
+		// about 6 kB per second, or twice what the link can handle
+		if(isHeavy) {
+			for(size_t i=0;i<2;++i) client.write(large);
+		}
+		else if(frame % 10 == 0)
+			client.write(small);
+
+		client.update();
+		boost::this_thread::sleep( boost::posix_time::milliseconds(1) );
+
+		if(elapsed >= report) {
+			report += 0.25;
+
+			const ph::TcpClient::Stats stats = client.getStats();
+			console() << "  " << elapsed << " s" << (isHeavy ? " (heavy)" : "") << ": round trip " << stats.roundTrip << " ms, average " << stats.roundTripAverage 
+				<< " ms, deviation " << stats.roundTripDeviation << " ms, heartbeat every " << stats.heartBeatInterval << " ms, " 
+				<< stats.messagesInPerSecond << " msgs/s in, " << stats.messagesOutPerSecond << " msgs/s out" << std::endl;
+		}
+	}
+
+	const ph::TcpClient::Stats stats = client.getStats();
+	console() << "  " << stats.heartBeatsSent << " heartbeats, " << stats.heartBeatsLost << " lost, " << stats.messagesIn << " messages in, " << stats.messagesOut << " messages out, " 
+		<< stats.bytesIn / 1048576 << " MB in, " << stats.bytesOut / 1048576 << " MB out, " << stats.connects << " connects" << std::endl;
+	console() << "  round trip: " << client.getRoundTripHistogram().toString() << std::endl;
+
+	// the snapshot should be cheap enough to poll every frame
+	timer.start();
+	double total = 0.0;
+	for(size_t i=0;i<kCalls;++i)
+		total += client.getStats().roundTrip;
+	console() << "  getStats(): " << (timer.getSeconds() * 1.0e9 / kCalls) << " ns per call" << std::endl;
+
+	client.disconnect();
+	server.stop();
+}
+
+//! sends the messages in bursts, polling the server after each burst, and waits until all clients received them.
+//! Returns the elapsed time in seconds and the number of allocations.
+static double broadcastAll( const std::function<void(const std::string&)> &send, ph::TcpServer &server, const std::atomic<size_t> &received, 
+						   size_t expected, const std::string &msg, size_t count, size_t *allocations )
+{
+	const size_t before = sAllocations;
+
+	Timer timer(true);
+
+	for(size_t i=0;i<count;++i) {
+		send(msg);
+		if(i % 10 == 9) server.update();
+	}
+
+	while(received < expected && timer.getSeconds() < 30.0)
+		server.update();
+
+	*allocations = sAllocations - before;
+
+	return timer.getSeconds();
+}
+
+void TcpClientApp::benchmarkBroadcast()
+{
+	const size_t	kClients = 1000;
+	const size_t	kMessages = 1000;
+	const size_t	kSize = 256;
+
+	// the clients are run by their own thread, the server is polled like it would be once per frame
+	boost::asio::io_service ios;
+	boost::scoped_ptr<boost::asio::io_service::work> work( new boost::asio::io_service::work(ios) );
+	boost::thread thread( boost::bind(&boost::asio::io_service::run, &ios) );
+
+	std::atomic<size_t> received(0);
+
+	std::vector<ph::TcpClientRef> clients;
+	for(size_t i=0;i<kClients;++i) {
+		ph::TcpClientRef client( new ph::TcpClient(ios) );
+		client->setDelimiter("\n");
+		client->sMessageView.connect( [&](const boost::string_ref &msg){ ++received; } );
+		clients.push_back(client);
+	}
+
+	{
+		std::vector<ph::TcpServer::ConnectionId> ids;
+
+		ph::TcpServer server;
+		server.setDelimiter("\n");
+		server.sConnected.connect( [&](ph::TcpServer::ConnectionId id, const boost::asio::ip::tcp::endpoint&){ ids.push_back(id); } );
+		server.listen(0);
+
+		Timer timer(true);
+		for(size_t i=0;i<kClients;++i)
+			clients[i]->connect("127.0.0.1", server.getPort());
+		while(ids.size() < kClients && timer.getSeconds() < 10.0)
+			server.update();
+
+		console() << "Broadcasting " << kMessages << " messages of " << kSize << " bytes to " << ids.size() << " clients (connected in " << timer.getSeconds() * 1000.0 << " ms):" << std::endl;
+
+		const std::string msg(kSize - 1, 'x');
+		const double total = double(kMessages * ids.size());
+		size_t allocations;
+
+		// a single buffer, shared by all clients
+		received = 0;
+		double shared = broadcastAll( [&](const std::string &msg){ server.broadcast(msg); }, 
+			server, received, kMessages * ids.size(), msg, kMessages, &allocations );
+		console() << "  shared buffer: " << (total / shared) << " msgs/s, " << (total * kSize / shared / 1048576.0) << " MB/s, " 
+			<< double(allocations) / kMessages << " allocations per broadcast, including the clients" << std::endl;
+
+		// a copy of the message for each client
+		received = 0;
+		double copies = broadcastAll( [&](const std::string &msg){ for(size_t i=0;i<ids.size();++i) server.send(ids[i], msg); }, 
+			server, received, kMessages * ids.size(), msg, kMessages, &allocations );
+		console() << "  copy per client: " << (total / copies) << " msgs/s, " << (total * kSize / copies / 1048576.0) << " MB/s, " 
+			<< double(allocations) / kMessages << " allocations per broadcast, including the clients" << std::endl;
+
+		for(size_t i=0;i<kClients;++i)
+			clients[i]->disconnect();
+
+		server.close();
+		server.update();
+	}
+
+	// a client that stops reading fills its queue, while the other clients should not notice
+	const size_t	kReaders = 10;
+	const size_t	kBurst = 2000;
+	const char		*kPolicies[] = { "disconnect", "drop oldest", "drop newest" };
+
+	console() << "A client that does not read, " << kBurst << " messages of 1 kB to " << kReaders << " other clients at 10k msgs/s, 64 messages per queue:" << std::endl;
+
+	for(int policy=ph::TcpServer::DISCONNECT;policy<=ph::TcpServer::DROP_NEWEST;++policy) {
+		ph::TcpServer server;
+		server.setDelimiter("\n");
+		server.setQueueCapacity(64);
+		server.setSlowConsumerPolicy( ph::TcpServer::SlowConsumerPolicy(policy) );
+		server.setSendBufferSize(16 * 1024);
+		server.listen(0);
+
+		// the slow client only accepts a small amount of data
+		boost::asio::ip::tcp::socket slow(ios);
+		slow.open(boost::asio::ip::tcp::v4());
+		slow.set_option(boost::asio::socket_base::receive_buffer_size(16 * 1024));
+		slow.connect( boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), server.getPort()) );
+
+		// clients on a shared io_service can not reconnect once they have been disconnected
+		std::vector<ph::TcpClientRef> readers;
+		for(size_t i=0;i<kReaders;++i) {
+			ph::TcpClientRef client( new ph::TcpClient(ios) );
+			client->setDelimiter("\n");
+			client->sMessageView.connect( [&](const boost::string_ref &msg){ ++received; } );
+			client->connect("127.0.0.1", server.getPort());
+
+			readers.push_back(client);
+		}
+
+		Timer timer(true);
+		while(server.getStats().connections < kReaders + 1 && timer.getSeconds() < 10.0)
+			server.update();
+
+		received = 0;
+		const std::string msg(1023, 'x');
+
+		// about 10 MB/s per client, which the readers can handle
+		timer.start();
+		for(size_t i=0;i<kBurst;++i) {
+			server.broadcast(msg);
+			if(i % 10 == 9) {
+				server.update();
+				boost::this_thread::sleep( boost::posix_time::milliseconds(1) );
+			}
+		}
+
+		// wait until the readers have received everything that was sent
+		double idle = timer.getSeconds();
+		for(size_t count=0;received < kBurst * kReaders && timer.getSeconds() < idle + 0.5;) {
+			server.update();
+			if(received != count) {
+				count = received;
+				idle = timer.getSeconds();
+			}
+		}
+		const double seconds = idle;
+
+		const ph::TcpServer::Stats stats = server.getStats();
+		console() << "  " << kPolicies[policy] << ": " << received << " of " << kBurst * kReaders << " messages delivered in " << seconds * 1000.0 << " ms, " 
+			<< stats.dropped << " dropped, " << stats.disconnectedSlow << " slow clients disconnected" << std::endl;
+
+		for(size_t i=0;i<kReaders;++i)
+			readers[i]->disconnect();
+
+		// the clients are destroyed after the thread has finished
+		clients.insert(clients.end(), readers.begin(), readers.end());
+
+		slow.close();
+		server.close();
+		server.update();
+	}
+
+	work.reset();
+	thread.join();
+}
+
 CINDER_APP_BASIC( TcpClientApp, RendererGl )
\ No newline at end of file
@@ -0,0 +1,156 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "TcpClientPool.h"
+
+using namespace ci;
+using namespace ci::app;
+
+using namespace ph;
+
+TcpClientPool::TcpClientPool( size_t threads )
+	: mWork( new boost::asio::io_service::work(mIos) ), mNextId(0), mEvents(1024), mFreeEvents(1024)
+{
+	if(threads == 0)
+		threads = std::max( boost::thread::hardware_concurrency(), 1u );
+
+	for(size_t i=0;i<threads;++i)
+		mThreads.push_back( boost::shared_ptr<boost::thread>( new boost::thread( boost::bind(&TcpClientPool::run, this) ) ) );
+}
+
+void TcpClientPool::run()
+{
+	// blocking writes of the clients are rejected on this thread, they would wait for themselves
+	TcpClient::IoThreadScope scope(mIos);
+	mIos.run();
+}
+
+TcpClientPool::~TcpClientPool(void)
+{
+	// close all connections, the threads finish once all handlers have been called
+	for(ClientMap::const_iterator itr=mClientsById.begin();itr!=mClientsById.end();++itr)
+		itr->second->disconnect();
+
+	mWork.reset();
+
+	for(size_t i=0;i<mThreads.size();++i)
+		mThreads[i]->join();
+
+	// the clients can no longer emit signals
+	mClientsById.clear();
+
+	Event *event;
+	while(mEvents.pop(event))
+		delete event;
+	while(mFreeEvents.pop(event))
+		delete event;
+}
+
+TcpClientRef TcpClientPool::create( const std::string &heartbeat )
+{
+	TcpClientRef client( new TcpClient(mIos, heartbeat) );
+
+	// ids are not reused, so events of a removed client can not be mistaken for those of a new one
+	const ClientId id = mNextId++;
+	mClientsById[id] = client;
+
+	// forward the signals of the client, which are emitted on the I/O threads
+	client->sConnected.connect( [=](const boost::asio::ip::tcp::endpoint &endpoint) {
+		Event *event = acquire();
+		event->type = Event::CONNECTED;
+		event->client = id;
+		event->endpoint = endpoint;
+		push(event);
+	} );
+	client->sDisconnected.connect( [=](const boost::asio::ip::tcp::endpoint &endpoint) {
+		Event *event = acquire();
+		event->type = Event::DISCONNECTED;
+		event->client = id;
+		event->endpoint = endpoint;
+		push(event);
+	} );
+	client->sMessageView.connect( [=](const boost::string_ref &msg) {
+		Event *event = acquire();
+		event->type = Event::MESSAGE;
+		event->client = id;
+		event->message.assign(msg.data(), msg.size());
+		push(event);
+	} );
+
+	return client;
+}
+
+void TcpClientPool::update()
+{
+	Event *event;
+	while(mEvents.pop(event)) {
+		ClientMap::const_iterator itr = mClientsById.find(event->client);
+		if(itr == mClientsById.end()) {
+			// the client has been removed
+			mFreeEvents.push(event);
+			continue;
+		}
+
+		const TcpClientRef &client = itr->second;
+
+		switch(event->type) {
+		case Event::CONNECTED:
+			sConnected(client, event->endpoint);
+			break;
+		case Event::DISCONNECTED:
+			sDisconnected(client, event->endpoint);
+			break;
+		case Event::MESSAGE:
+			sMessage(client, event->message);
+			break;
+		}
+
+		mFreeEvents.push(event);
+	}
+}
+
+void TcpClientPool::remove( const TcpClientRef &client )
+{
+	for(ClientMap::iterator itr=mClientsById.begin();itr!=mClientsById.end();++itr) {
+		if(itr->second != client) continue;
+
+		// events that are still queued are dropped by update()
+		client->disconnect();
+		mClientsById.erase(itr);
+		return;
+	}
+}
+
+TcpClientPool::Event* TcpClientPool::acquire()
+{
+	// only allocates if more events are waiting than ever before, or if a message does not fit the recycled string
+	Event *event;
+	if(mFreeEvents.pop(event)) return event;
+
+	return new Event();
+}
+
+void TcpClientPool::push( Event *event )
+{
+	// only allocates if the queue has run out of nodes
+	mEvents.push(event);
+}
@@ -0,0 +1,105 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+// To make sure boost::asio is loaded first, include our header file first
+#include "TcpClient.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <boost/lockfree/queue.hpp>
+#include <boost/thread.hpp>
+
+namespace ph
+{
+
+typedef boost::shared_ptr<class TcpClientPool> TcpClientPoolRef;
+
+//! Runs any number of clients on a shared io_service, which is run by its own threads. 
+//! Network messages are handled as soon as they arrive, instead of once per frame. The client's 
+//! own signals are emitted on the I/O threads, the pool's signals are emitted by update() on the 
+//! thread that calls it.
+class TcpClientPool
+{
+public:
+	//! starts the I/O threads, one per CPU if 'threads' is zero
+	TcpClientPool( size_t threads = 0 );
+	virtual ~TcpClientPool(void);
+
+	//! creates a client that is run by the pool. It should not outlive the pool.
+	TcpClientRef	create( const std::string &heartbeat = "PING" );
+	//! closes the connection of the client and removes it from the pool. Events of the client that 
+	//! have not been handled by update() yet are dropped, including its final sDisconnected.
+	void			remove( const TcpClientRef &client );
+
+	//! emits the signals below for everything that happened since the previous call
+	void	update();
+
+	//! returns the number of clients run by the pool
+	size_t	getNumClients() const { return mClientsById.size(); }
+	//! returns the number of I/O threads
+	size_t	getNumThreads() const { return mThreads.size(); }
+public:
+	// signals
+	boost::signals2::signal<void(const TcpClientRef&, const boost::asio::ip::tcp::endpoint&)>	sConnected;
+	boost::signals2::signal<void(const TcpClientRef&, const boost::asio::ip::tcp::endpoint&)>	sDisconnected;
+	//! passes the messages of all clients, in the order they were received
+	boost::signals2::signal<void(const TcpClientRef&, const std::string&)>						sMessage;
+private:
+	typedef uint32_t										ClientId;
+	typedef std::unordered_map<ClientId, TcpClientRef>	ClientMap;
+
+	struct Event {
+		typedef enum { CONNECTED, DISCONNECTED, MESSAGE } Type;
+
+		Type							type;
+		//! id of the client, which may have been removed by the time the event is handled
+		ClientId						client;
+		boost::asio::ip::tcp::endpoint	endpoint;
+		std::string						message;
+	};
+
+	//! runs the io_service, called by each of the I/O threads
+	void	run();
+	//! called by the I/O threads, returns a recycled event if available
+	Event*	acquire();
+	//! called by the I/O threads
+	void	push( Event *event );
+private:
+	boost::asio::io_service							mIos;
+	//! keeps the threads running while there are no connections
+	boost::scoped_ptr<boost::asio::io_service::work>	mWork;
+	std::vector< boost::shared_ptr<boost::thread> >	mThreads;
+
+	//! only accessed by the thread that calls create(), remove() and update()
+	ClientMap										mClientsById;
+	ClientId										mNextId;
+
+	//! passes events from the I/O threads to update() without locking
+	boost::lockfree::queue<Event*>					mEvents;
+	//! events that have been handled by update(), they keep the capacity of their message
+	boost::lockfree::queue<Event*>					mFreeEvents;
+};
+
+} // namespace
@@ -0,0 +1,158 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "TcpFraming.h"
+
+#include <cstdint>
+#include <cstring>
+
+using namespace ph;
+
+DelimiterFraming::DelimiterFraming( const std::string &delimiter, size_t maxMessageSize )
+	: TcpFraming(maxMessageSize), mDelimiter(delimiter)
+{
+	if(mDelimiter.empty()) mDelimiter = std::string(1, '\0');
+}
+
+TcpFraming::Result DelimiterFraming::decode( const char *data, size_t size, size_t *scanned, boost::string_ref *message, size_t *frameSize ) const
+{
+	const size_t length = mDelimiter.size();
+
+	const char *scan = data + *scanned;
+	const char *end = data + size;
+
+	*frameSize = 0;
+
+	while(scan < end) {
+		// find the first character of the delimiter (memchr is vectorized by the C runtime)
+		const char *found = static_cast<const char*>( std::memchr(scan, mDelimiter[0], end - scan) );
+		if(!found) { scan = end; break; }
+
+		// wait for more data if the delimiter is incomplete
+		if(found + length > end) { scan = found; break; }
+
+		if(length > 1 && std::memcmp(found + 1, mDelimiter.data() + 1, length - 1) != 0) { scan = found + 1; continue; }
+
+		if(size_t(found - data) > mMaxMessageSize) return INVALID;
+
+		*message = boost::string_ref(data, found - data);
+		*frameSize = (found - data) + length;
+		return COMPLETE;
+	}
+
+	*scanned = scan - data;
+
+	// the delimiter is missing or the message is too large
+	if(*scanned > mMaxMessageSize) return INVALID;
+
+	return INCOMPLETE;
+}
+
+bool DelimiterFraming::encode( const char *data, size_t size, std::vector<char> *buffer ) const
+{
+	buffer->insert(buffer->end(), data, data + size);
+	buffer->insert(buffer->end(), mDelimiter.begin(), mDelimiter.end());
+
+	return true;
+}
+
+TcpFraming::Result LengthPrefixFraming::decode( const char *data, size_t size, size_t *scanned, boost::string_ref *message, size_t *frameSize ) const
+{
+	const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data);
+
+	uint64_t length = 0;
+	size_t header = 0;
+
+	*frameSize = 0;
+
+	switch(mHeader) {
+	case HEADER_U16:
+		if(size < 2) return INCOMPLETE;
+		length = mIsBigEndian ? (bytes[0] << 8) | bytes[1] : bytes[0] | (bytes[1] << 8);
+		header = 2;
+		break;
+	case HEADER_U32:
+		if(size < 4) return INCOMPLETE;
+		if(mIsBigEndian)
+			length = (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+		else
+			length = uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+		header = 4;
+		break;
+	case HEADER_VARINT:
+		for(header=0;;++header) {
+			// a 64-bit value needs at most 10 bytes
+			if(header == 10) return INVALID;
+			if(header == size) return INCOMPLETE;
+
+			length |= uint64_t(bytes[header] & 0x7F) << (7 * header);
+			if(!(bytes[header] & 0x80)) break;
+		}
+		header++;
+		break;
+	}
+
+	if(length > mMaxMessageSize) return INVALID;
+
+	// the size of the frame is known, so the caller can make room for it
+	*frameSize = header + size_t(length);
+	if(size < *frameSize) return INCOMPLETE;
+
+	*message = boost::string_ref(data + header, size_t(length));
+	return COMPLETE;
+}
+
+bool LengthPrefixFraming::encode( const char *data, size_t size, std::vector<char> *buffer ) const
+{
+	if(size > mMaxMessageSize) return false;
+
+	unsigned char header[10];
+	size_t count = 0;
+
+	switch(mHeader) {
+	case HEADER_U16:
+		if(size > 0xFFFF) return false;
+		header[0] = (unsigned char) (mIsBigEndian ? size >> 8 : size);
+		header[1] = (unsigned char) (mIsBigEndian ? size : size >> 8);
+		count = 2;
+		break;
+	case HEADER_U32:
+		if(uint64_t(size) > 0xFFFFFFFF) return false;
+		for(count=0;count<4;++count)
+			header[count] = (unsigned char) ( size >> (mIsBigEndian ? 8 * (3 - count) : 8 * count) );
+		break;
+	case HEADER_VARINT: {
+		uint64_t value = size;
+		do {
+			header[count] = (unsigned char) (value & 0x7F);
+			value >>= 7;
+			if(value) header[count] |= 0x80;
+			count++;
+		} while(value);
+		break; }
+	}
+
+	buffer->insert(buffer->end(), header, header + count);
+	buffer->insert(buffer->end(), data, data + size);
+
+	return true;
+}
@@ -0,0 +1,109 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility/string_ref.hpp>
+
+namespace ph
+{
+
+typedef boost::shared_ptr<class TcpFraming> TcpFramingRef;
+
+//! Splits the data stream of a TcpClient into messages and adds the framing bytes to outgoing messages.
+//! Implementations should not keep state, so they can be shared by multiple clients and threads.
+class TcpFraming
+{
+public:
+	//! default maximum size of a message, larger messages are rejected
+	static const size_t	kMaxMessageSize = 16 * 1024 * 1024;
+
+	typedef enum { COMPLETE, INCOMPLETE, INVALID } Result;
+public:
+	TcpFraming( size_t maxMessageSize = kMaxMessageSize ) : mMaxMessageSize(maxMessageSize) {}
+	virtual ~TcpFraming(void) {}
+
+	//! Looks for a complete message at the start of the data. Returns COMPLETE and sets the message and 
+	//! the size of the frame (the message and its framing bytes), INCOMPLETE and sets the size of the frame
+	//! if it is already known (zero otherwise), or INVALID if the data is not a valid frame. The caller keeps
+	//! 'scanned' between calls and resets it to zero after each complete message.
+	virtual Result	decode( const char *data, size_t size, size_t *scanned, boost::string_ref *message, size_t *frameSize ) const = 0;
+	//! appends the message and its framing bytes to the buffer, returns FALSE if the message can not be framed
+	virtual bool	encode( const char *data, size_t size, std::vector<char> *buffer ) const = 0;
+
+	//! returns TRUE if a frame without data is a message that should be passed to the listeners
+	virtual bool	isEmptyMessageValid() const { return true; }
+
+	size_t	getMaxMessageSize() const { return mMaxMessageSize; }
+protected:
+	size_t	mMaxMessageSize;
+};
+
+//! Messages are terminated by a delimiter, like "\r\n" for text protocols. 
+//! The data is scanned for the delimiter, which can not be part of a message.
+class DelimiterFraming
+	: public TcpFraming
+{
+public:
+	//! an empty delimiter is replaced by a null-byte
+	DelimiterFraming( const std::string &delimiter, size_t maxMessageSize = kMaxMessageSize );
+	virtual ~DelimiterFraming(void) {}
+
+	virtual Result	decode( const char *data, size_t size, size_t *scanned, boost::string_ref *message, size_t *frameSize ) const;
+	virtual bool	encode( const char *data, size_t size, std::vector<char> *buffer ) const;
+
+	//! consecutive delimiters (e.g. blank lines) are skipped
+	virtual bool	isEmptyMessageValid() const { return false; }
+
+	std::string	getDelimiter() const { return mDelimiter; }
+protected:
+	std::string	mDelimiter;
+};
+
+//! Messages are preceded by their size, so they can contain any data and the receiver 
+//! does not have to scan for the end of each message.
+class LengthPrefixFraming
+	: public TcpFraming
+{
+public:
+	typedef enum { 
+		//! 16 or 32 bits unsigned integer
+		HEADER_U16, HEADER_U32, 
+		//! 7 bits per byte, least significant group first, the high bit is set on all but the last byte
+		HEADER_VARINT 
+	} Header;
+public:
+	LengthPrefixFraming( Header header = HEADER_U32, bool isBigEndian = true, size_t maxMessageSize = kMaxMessageSize )
+		: TcpFraming(maxMessageSize), mHeader(header), mIsBigEndian(isBigEndian) {}
+	virtual ~LengthPrefixFraming(void) {}
+
+	virtual Result	decode( const char *data, size_t size, size_t *scanned, boost::string_ref *message, size_t *frameSize ) const;
+	virtual bool	encode( const char *data, size_t size, std::vector<char> *buffer ) const;
+protected:
+	Header	mHeader;
+	bool	mIsBigEndian;
+};
+
+} // namespace
@@ -0,0 +1,417 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "TcpServer.h"
+#include "Console.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace ci;
+using namespace ci::app;
+
+using namespace ph;
+
+TcpServer::TcpServer()
+	: mOwnIos(new boost::asio::io_service()), mIos(*mOwnIos), mStrand(mIos), mAcceptor(mIos), mPort(0),
+	mNextId(1), mIsBroadcasting(false), mHasClosed(false), mFraming( new DelimiterFraming( std::string(1, '\0') ) ),
+	mQueueCapacity(kMaxQueueSize), mQueueBytes(kMaxQueueBytes), mSlowConsumerPolicy(DISCONNECT), mSendBufferSize(0),
+	mNumConnections(0), mNumAccepted(0), mNumDropped(0), mNumDisconnectedSlow(0), mHandlers(0)
+{
+}
+
+TcpServer::TcpServer( boost::asio::io_service &ios )
+	: mIos(ios), mStrand(mIos), mAcceptor(mIos), mPort(0),
+	mNextId(1), mIsBroadcasting(false), mHasClosed(false), mFraming( new DelimiterFraming( std::string(1, '\0') ) ),
+	mQueueCapacity(kMaxQueueSize), mQueueBytes(kMaxQueueBytes), mSlowConsumerPolicy(DISCONNECT), mSendBufferSize(0),
+	mNumConnections(0), mNumAccepted(0), mNumDropped(0), mNumDisconnectedSlow(0), mHandlers(0)
+{
+}
+
+TcpServer::~TcpServer(void)
+{
+	// an owned io_service is not running, so we can close right away. The handlers on a shared io_service
+	// refer to this server, the other handlers would have to wait for this one.
+	if(mOwnIos || mStrand.running_in_this_thread()) {
+		do_close();
+		return;
+	}
+
+	// close the connections on the I/O threads, then wait until all handlers have been called
+	mStrand.dispatch(track(boost::bind(&TcpServer::do_close, this)));
+
+	boost::mutex::scoped_lock lock(mHandlerMutex);
+	while(mHandlers > 0 && !mIos.stopped())
+		mHandlerCondition.timed_wait(lock, boost::posix_time::milliseconds(100));
+}
+
+void TcpServer::release()
+{
+	// the destructor may be waiting for the last handler
+	boost::mutex::scoped_lock lock(mHandlerMutex);
+	if(--mHandlers == 0) mHandlerCondition.notify_all();
+}
+
+void TcpServer::update()
+{
+	// calls the poll() function to process network messages, a shared io_service is run by its own threads
+	if(mOwnIos) mIos.poll();
+}
+
+void TcpServer::listen(unsigned short port)
+{
+	listen( boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port) );
+}
+
+void TcpServer::listen(const boost::asio::ip::tcp::endpoint &endpoint)
+{
+	if(mAcceptor.is_open()) return;
+
+	try {
+		mAcceptor.open(endpoint.protocol());
+		mAcceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+		mAcceptor.bind(endpoint);
+		mAcceptor.listen(boost::asio::socket_base::max_connections);
+
+		mPort = mAcceptor.local_endpoint().port();
+	}
+	catch(const std::exception &e) {
+		ph::console() << "Server exception:" << e.what() << std::endl;
+
+		boost::system::error_code ignored;
+		mAcceptor.close(ignored);
+		return;
+	}
+
+	mStrand.post(track(boost::bind(&TcpServer::accept, this)));
+}
+
+void TcpServer::close()
+{
+	// safe way to request the server to close all connections
+	mStrand.post(track(boost::bind(&TcpServer::do_close, this)));
+}
+
+void TcpServer::broadcast(const std::string &msg)
+{
+	BufferRef buffer = encode(msg);
+	if(!buffer) return;
+
+	// the same buffer is queued for all clients, which only adds a reference
+	mStrand.post(track(boost::bind(&TcpServer::do_broadcast, this, buffer)));
+}
+
+void TcpServer::send(ConnectionId id, const std::string &msg)
+{
+	BufferRef buffer = encode(msg);
+	if(!buffer) return;
+
+	mStrand.post(track(boost::bind(&TcpServer::do_send, this, id, buffer)));
+}
+
+TcpServer::Stats TcpServer::getStats()
+{
+	Stats stats;
+	stats.connections = mNumConnections;
+	stats.accepted = mNumAccepted;
+	stats.dropped = mNumDropped;
+	stats.disconnectedSlow = mNumDisconnectedSlow;
+
+	return stats;
+}
+
+TcpServer::BufferRef TcpServer::encode(const std::string &msg)
+{
+	boost::shared_ptr< std::vector<char> > buffer = boost::make_shared< std::vector<char> >();
+
+	if(!mFraming->encode(msg.data(), msg.size(), buffer.get())) {
+		ph::console() << "Server error: message can not be framed" << std::endl;
+		return BufferRef();
+	}
+
+	return buffer;
+}
+
+void TcpServer::accept()
+{
+	if(!mAcceptor.is_open()) return;
+
+	ConnectionRef connection( new Connection(mIos) );
+
+	// wait for the next client, then call handle_accept
+	mAcceptor.async_accept(connection->socket, connection->endpoint,
+		mStrand.wrap(track(boost::bind(&TcpServer::handle_accept, this, connection, boost::asio::placeholders::error))));
+}
+
+void TcpServer::read(ConnectionRef connection)
+{
+	if(connection->isClosed) return;
+
+	// the incomplete message and at least kMinReadSize bytes should fit, or the whole message if its size is known
+	const size_t required = std::max(connection->readRequired, connection->readEnd - connection->readBegin + kMinReadSize);
+
+	// move the incomplete message to the front of the buffer if we run out of space
+	std::vector<char> &buffer = connection->readBuffer;
+	if(buffer.size() - connection->readBegin < required && connection->readBegin > 0) {
+		std::memmove(&buffer[0], &buffer[connection->readBegin], connection->readEnd - connection->readBegin);
+
+		connection->readEnd -= connection->readBegin;
+		connection->readBegin = 0;
+	}
+
+	// grow the buffer if the message does not fit, to its exact size if the framing knows it
+	if(buffer.size() < required)
+		buffer.resize( connection->readRequired == required ? required : std::max(required, buffer.size() * 2) );
+
+	// read as much as is available, then call handle_read
+	connection->socket.async_read_some(boost::asio::buffer(&buffer[connection->readEnd], buffer.size() - connection->readEnd),
+		mStrand.wrap(track(boost::bind(&TcpServer::handle_read, this, connection, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred))));
+}
+
+bool TcpServer::parse(ConnectionRef connection)
+{
+	const char *data = &connection->readBuffer[0];
+
+	boost::string_ref message;
+	size_t frameSize;
+
+	for(;;) {
+		const TcpFraming::Result result = mFraming->decode(data + connection->readBegin, connection->readEnd - connection->readBegin, 
+			&connection->readScan, &message, &frameSize);
+
+		if(result == TcpFraming::INVALID) return false;
+
+		if(result == TcpFraming::INCOMPLETE) {
+			connection->readRequired = frameSize;
+			break;
+		}
+
+		// create signal to notify listeners, skipping empty messages if the framing does not allow them
+		if(!message.empty() || mFraming->isEmptyMessageValid()) sMessageView( connection->id, message );
+
+		connection->readBegin += frameSize;
+		connection->readScan = 0;
+	}
+
+	// start at the front of the buffer again if all data has been processed
+	if(connection->readBegin == connection->readEnd)
+		connection->readBegin = connection->readEnd = connection->readScan = 0;
+
+	return true;
+}
+
+void TcpServer::enqueue(ConnectionRef connection, const BufferRef &buffer)
+{
+	if(connection->isClosed) return;
+
+	// a single message always fits, even if it is larger than the capacity
+	const bool isFull = !connection->queue.empty() && 
+		( connection->queue.size() >= mQueueCapacity || connection->queuedBytes + buffer->size() > mQueueBytes );
+
+	if(isFull) {
+		switch(mSlowConsumerPolicy) {
+		case DISCONNECT:
+			mNumDisconnectedSlow++;
+			do_disconnect(connection);
+			return;
+		case DROP_NEWEST:
+			mNumDropped++;
+			return;
+		case DROP_OLDEST:
+			mNumDropped++;
+
+			// messages that are being written can not be removed
+			if(connection->queue.size() == connection->sending) return;
+
+			connection->queuedBytes -= connection->queue[connection->sending]->size();
+			connection->queue.erase( connection->queue.begin() + connection->sending );
+			break;
+		}
+	}
+
+	connection->queue.push_back(buffer);
+	connection->queuedBytes += buffer->size();
+
+	do_write(connection);
+}
+
+void TcpServer::purge()
+{
+	if(!mHasClosed || mIsBroadcasting) return;
+
+	mConnections.erase( std::remove_if(mConnections.begin(), mConnections.end(), 
+		[](const ConnectionRef &connection){ return connection->isClosed; }), mConnections.end() );
+
+	mHasClosed = false;
+}
+
+// callbacks
+
+void TcpServer::handle_accept(ConnectionRef connection, const boost::system::error_code& error)
+{
+	if(!mAcceptor.is_open()) return;
+
+	if(!error) {
+		boost::system::error_code ignored;
+		connection->socket.set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+
+		if(mSendBufferSize > 0)
+			connection->socket.set_option(boost::asio::socket_base::send_buffer_size(int(mSendBufferSize)), ignored);
+
+		connection->id = mNextId++;
+		mConnections.push_back(connection);
+		mConnectionsById[connection->id] = connection;
+
+		mNumConnections++;
+		mNumAccepted++;
+
+		// let listeners know
+		sConnected(connection->id, connection->endpoint);
+
+		// await the first message
+		read(connection);
+	}
+	else {
+		// running out of file descriptors should not stop the server
+		ph::console() << "Server error:" << error.message() << std::endl;
+	}
+
+	// wait for the next client
+	accept();
+}
+
+void TcpServer::handle_read(ConnectionRef connection, const boost::system::error_code& error, size_t bytes_transferred)
+{
+	if(connection->isClosed) return;
+
+	if(!error) {
+		connection->readEnd += bytes_transferred;
+
+		if(parse(connection)) {
+			// wait for the next message
+			read(connection);
+			return;
+		}
+
+		// the stream can not be recovered once the framing is lost
+		ph::console() << "Server error: invalid message" << std::endl;
+	}
+
+	do_disconnect(connection);
+}
+
+void TcpServer::handle_write(ConnectionRef connection, const boost::system::error_code& error)
+{
+	connection->isWriting = false;
+
+	if(connection->isClosed) return;
+
+	if(error) {
+		do_disconnect(connection);
+		return;
+	}
+
+	// release the messages that have been sent, the last client to send a broadcast frees its buffer
+	for(size_t i=0;i<connection->sending;++i) {
+		connection->queuedBytes -= connection->queue.front()->size();
+		connection->queue.pop_front();
+	}
+	connection->sending = 0;
+
+	// continue with the messages that were queued in the meantime
+	do_write(connection);
+}
+
+void TcpServer::do_broadcast(BufferRef buffer)
+{
+	// connections that are closed while iterating are removed afterwards
+	mIsBroadcasting = true;
+
+	const size_t count = mConnections.size();
+	for(size_t i=0;i<count;++i)
+		enqueue(mConnections[i], buffer);
+
+	mIsBroadcasting = false;
+
+	purge();
+}
+
+void TcpServer::do_send(ConnectionId id, BufferRef buffer)
+{
+	ConnectionMap::const_iterator itr = mConnectionsById.find(id);
+	if(itr != mConnectionsById.end()) enqueue(itr->second, buffer);
+}
+
+void TcpServer::do_write(ConnectionRef connection)
+{
+	if(connection->isWriting || connection->isClosed) return;
+	if(connection->queue.empty()) return;
+
+	// gather up to kMaxBatchSize queued messages into a single write, without copying them
+	connection->sending = std::min(connection->queue.size(), kMaxBatchSize);
+
+	connection->buffers.clear();
+	for(size_t i=0;i<connection->sending;++i)
+		connection->buffers.push_back( boost::asio::buffer(*connection->queue[i]) );
+
+	connection->isWriting = true;
+
+	boost::asio::async_write(connection->socket, connection->buffers,
+		mStrand.wrap(track(boost::bind(&TcpServer::handle_write, this, connection, boost::asio::placeholders::error))));
+}
+
+void TcpServer::do_disconnect(ConnectionRef connection)
+{
+	if(connection->isClosed) return;
+	connection->isClosed = true;
+
+	// pending reads and writes are cancelled, releasing the queued messages once they complete
+	boost::system::error_code ignored;
+	connection->socket.close(ignored);
+
+	mConnectionsById.erase(connection->id);
+
+	mHasClosed = true;
+	mNumConnections--;
+
+	// let listeners know
+	sDisconnected(connection->id, connection->endpoint);
+
+	purge();
+}
+
+void TcpServer::do_close()
+{
+	boost::system::error_code ignored;
+	mAcceptor.close(ignored);
+
+	// removing the connections is deferred until we're done iterating
+	mIsBroadcasting = true;
+
+	const size_t count = mConnections.size();
+	for(size_t i=0;i<count;++i)
+		do_disconnect(mConnections[i]);
+
+	mIsBroadcasting = false;
+
+	purge();
+}
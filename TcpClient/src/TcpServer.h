@@ -0,0 +1,253 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+// defines the value of _WIN32_WINNT needed by boost asio (WINDOWS ONLY)
+#ifdef WIN32
+    #include <sdkddkver.h>
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/signals2.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include "cinder/app/AppBasic.h"
+
+#include "TcpFraming.h"
+
+namespace ph
+{
+
+typedef boost::shared_ptr<class TcpServer> TcpServerRef;
+
+//! Accepts any number of clients and sends messages to all of them. A broadcast message is framed once
+//! and the same immutable buffer is queued for every client, so it is not copied per client. Each client 
+//! has its own bounded queue, clients that can not keep up are disconnected or miss messages.
+class TcpServer
+{
+public:
+	typedef uint32_t ConnectionId;
+
+	//! default maximum number of messages waiting to be sent to a single client
+	static const size_t	kMaxQueueSize = 1024;
+	//! default maximum number of bytes waiting to be sent to a single client
+	static const size_t	kMaxQueueBytes = 4 * 1024 * 1024;
+	//! maximum number of messages sent to a client in a single write
+	static const size_t	kMaxBatchSize = 64;
+	//! initial size of each client's receive buffer, kept small because there may be thousands of clients
+	static const size_t	kReadBufferSize = 4096;
+	//! minimum number of bytes to read at once
+	static const size_t	kMinReadSize = 512;
+
+	//! what happens if the queue of a client is full
+	typedef enum { 
+		//! closes the connection, so the client can reconnect and catch up
+		DISCONNECT, 
+		//! removes the oldest messages that are not being sent yet
+		DROP_OLDEST, 
+		//! drops the new message
+		DROP_NEWEST 
+	} SlowConsumerPolicy;
+
+	//!
+	struct Stats {
+		size_t	connections;
+		size_t	accepted;
+		//! number of messages not sent because a client's queue was full
+		size_t	dropped;
+		//! number of clients disconnected because their queue was full
+		size_t	disconnectedSlow;
+	};
+public:
+	//! creates a server that owns its io_service, call update() to process network messages
+	TcpServer();
+	//! creates a server that runs on a shared io_service, its handlers are serialized by a strand.
+	//! Signals are emitted on the threads that run the io_service. The destructor waits until all
+	//! handlers of the server have been called, unless the io_service has been stopped.
+	TcpServer( boost::asio::io_service &ios );
+	virtual ~TcpServer(void);
+
+	//! processes network messages, does nothing if the server runs on a shared io_service
+	virtual void update();
+
+	//! starts accepting clients on all interfaces, pass 0 to use any free port
+	virtual void listen(unsigned short port);
+	virtual void listen(const boost::asio::ip::tcp::endpoint &endpoint);
+	//! stops accepting clients and closes all connections
+	virtual void close();
+
+	bool isListening(){ return mAcceptor.is_open(); };
+	unsigned short getPort(){ return mPort; };
+
+	//! sends the message to all clients, can be called from any thread
+	virtual void broadcast(const std::string &msg);
+	//! sends the message to a single client, can be called from any thread
+	virtual void send(ConnectionId id, const std::string &msg);
+
+	//! returns the framing used for all clients. Should be set before listening.
+	TcpFramingRef getFraming(){ return mFraming; };
+	void setFraming(const TcpFramingRef &framing){ if(framing) mFraming = framing; };
+	//! messages are terminated by the delimiter, replaces the current framing
+	void setDelimiter(const std::string &delimiter){ mFraming = TcpFramingRef( new DelimiterFraming(delimiter) ); };
+
+	//! limits the number of messages and bytes waiting to be sent to each client, a single message always fits
+	void setQueueCapacity(size_t messages, size_t bytes = kMaxQueueBytes){ mQueueCapacity = messages; mQueueBytes = bytes; };
+	//! sets what happens if a client does not keep up (DISCONNECT by default)
+	void setSlowConsumerPolicy(SlowConsumerPolicy policy){ mSlowConsumerPolicy = policy; };
+	//! limits the send buffer of the OS for new connections, so slow clients are detected sooner. 0 keeps the default.
+	void setSendBufferSize(size_t bytes){ mSendBufferSize = bytes; };
+
+	//! returns the number of clients and the drop counters, can be called from any thread
+	Stats getStats();
+public:
+	// signals
+	boost::signals2::signal<void(ConnectionId, const boost::asio::ip::tcp::endpoint&)>	sConnected;
+	boost::signals2::signal<void(ConnectionId, const boost::asio::ip::tcp::endpoint&)>	sDisconnected;
+	//! passes each message straight from the receive buffer, the data is only valid for the duration of the call
+	boost::signals2::signal<void(ConnectionId, const boost::string_ref&)>					sMessageView;
+protected:
+	//! Calls a handler and counts it as completed, see TcpClient::Tracked. The destructor of a server 
+	//! on a shared io_service waits until none of the handlers refers to the server anymore.
+	template<typename Handler>
+	class Tracked {
+	public:
+		Tracked(TcpServer *server, const Handler &handler) : mServer(server), mHandler(handler) {}
+
+		template<typename... Args>
+		void operator()(const Args&... args) {
+			// also count the handler as completed if a listener throws
+			try { mHandler(args...); }
+			catch(...) { mServer->release(); throw; }
+			mServer->release();
+		}
+	private:
+		TcpServer	*mServer;
+		Handler		mHandler;
+	};
+
+	//! wraps a handler that will be passed to the io_service, see Tracked
+	template<typename Handler>
+	Tracked<Handler> track(const Handler &handler){ mHandlers++; return Tracked<Handler>(this, handler); }
+	//! called after each tracked handler
+	void release();
+
+	//! framed message, shared by all clients it is sent to
+	typedef boost::shared_ptr< const std::vector<char> >	BufferRef;
+
+	struct Connection {
+		Connection(boost::asio::io_service &ios) : socket(ios), id(0), isClosed(false), isWriting(false), 
+			queuedBytes(0), sending(0), readBuffer(kReadBufferSize), readBegin(0), readEnd(0), readScan(0), readRequired(0) {}
+
+		boost::asio::ip::tcp::socket		socket;
+		boost::asio::ip::tcp::endpoint		endpoint;
+		ConnectionId						id;
+		bool								isClosed;
+		bool								isWriting;
+
+		//! messages waiting to be sent, the first 'sending' of them are being written
+		std::deque<BufferRef>				queue;
+		size_t								queuedBytes;
+		size_t								sending;
+		std::vector<boost::asio::const_buffer>	buffers;
+
+		//! received data, see TcpClient
+		std::vector<char>					readBuffer;
+		size_t								readBegin;
+		size_t								readEnd;
+		size_t								readScan;
+		size_t								readRequired;
+	};
+
+	typedef boost::shared_ptr<Connection>	ConnectionRef;
+	typedef std::unordered_map<ConnectionId, ConnectionRef>	ConnectionMap;
+
+	//! frames a message into a new buffer, returns an empty reference if it can not be framed
+	BufferRef	encode(const std::string &msg);
+
+	virtual void accept();
+	virtual void read(ConnectionRef connection);
+	//! passes all complete messages of the connection to the listeners, returns FALSE if the data is invalid
+	virtual bool parse(ConnectionRef connection);
+	//! adds the message to the queue of the connection, applying the slow consumer policy
+	virtual void enqueue(ConnectionRef connection, const BufferRef &buffer);
+	//! removes closed connections, unless a broadcast is iterating over them
+	virtual void purge();
+
+	// callbacks
+	virtual void handle_accept(ConnectionRef connection, const boost::system::error_code& error);
+	virtual void handle_read(ConnectionRef connection, const boost::system::error_code& error, size_t bytes_transferred);
+	virtual void handle_write(ConnectionRef connection, const boost::system::error_code& error);
+
+	virtual void do_broadcast(BufferRef buffer);
+	virtual void do_send(ConnectionId id, BufferRef buffer);
+	virtual void do_write(ConnectionRef connection);
+	virtual void do_disconnect(ConnectionRef connection);
+	virtual void do_close();
+protected:
+	//! only set if the server owns its io_service
+	boost::scoped_ptr<boost::asio::io_service>	mOwnIos;
+	boost::asio::io_service			&mIos;
+	boost::asio::io_service::strand	mStrand;
+	boost::asio::ip::tcp::acceptor	mAcceptor;
+	unsigned short					mPort;
+
+	//! only accessed by the handlers
+	std::vector<ConnectionRef>		mConnections;
+	//! the open connections, so send() does not have to search for them
+	ConnectionMap					mConnectionsById;
+	ConnectionId					mNextId;
+	bool							mIsBroadcasting;
+	bool							mHasClosed;
+
+	TcpFramingRef					mFraming;
+
+	size_t							mQueueCapacity;
+	size_t							mQueueBytes;
+	SlowConsumerPolicy				mSlowConsumerPolicy;
+	size_t							mSendBufferSize;
+
+	std::atomic<size_t>				mNumConnections;
+	std::atomic<size_t>				mNumAccepted;
+	std::atomic<size_t>				mNumDropped;
+	std::atomic<size_t>				mNumDisconnectedSlow;
+
+	//! number of tracked handlers that have not been called yet
+	std::atomic<size_t>				mHandlers;
+	boost::mutex					mHandlerMutex;
+	//! signalled when the last handler has been called
+	boost::condition_variable		mHandlerCondition;
+};
+
+} // namespace
@@ -0,0 +1,179 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "text/DistanceField.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ph { namespace text {
+
+using namespace ci;
+using namespace std;
+
+static const float	kInfinity = 1e20f;
+
+void DistanceField::rasterize( const TrueType::Contours &contours, const Vec2f &scale, const Vec2f &offset, 
+							   int width, int height, std::vector<uint8_t> *mask )
+{
+	mask->assign( size_t(width) * height, 0 );
+
+	// collect all non-horizontal edges in pixel space
+	struct Edge { float x0, y0, x1, y1; int winding; };
+	std::vector<Edge> edges;
+
+	TrueType::Contours::const_iterator citr;
+	for(citr=contours.begin();citr!=contours.end();++citr) {
+		size_t n = citr->size();
+		for(size_t i=0;i<n;++i) {
+			Vec2f a( (*citr)[i].x * scale.x + offset.x, (*citr)[i].y * scale.y + offset.y );
+			Vec2f b( (*citr)[(i + 1) % n].x * scale.x + offset.x, (*citr)[(i + 1) % n].y * scale.y + offset.y );
+			if( a.y == b.y ) continue;
+
+			Edge e;
+			if( a.y < b.y ) { e.x0 = a.x; e.y0 = a.y; e.x1 = b.x; e.y1 = b.y; e.winding = 1; }
+			else { e.x0 = b.x; e.y0 = b.y; e.x1 = a.x; e.y1 = a.y; e.winding = -1; }
+			edges.push_back( e );
+		}
+	}
+
+	// fill each row between the crossings, sampling at the pixel centers
+	std::vector< std::pair<float, int> > crossings;
+	for(int row=0;row<height;++row) {
+		float y = row + 0.5f;
+
+		crossings.clear();
+		for(size_t i=0;i<edges.size();++i) {
+			const Edge &e = edges[i];
+			if( y < e.y0 || y >= e.y1 ) continue;
+
+			float x = e.x0 + (y - e.y0) * (e.x1 - e.x0) / (e.y1 - e.y0);
+			crossings.push_back( std::make_pair( x, e.winding ) );
+		}
+
+		std::sort( crossings.begin(), crossings.end() );
+
+		int winding = 0;
+		for(size_t i=0;i+1<crossings.size();++i) {
+			winding += crossings[i].second;
+			if( winding == 0 ) continue;
+
+			int x0 = max( 0, (int) ceil( crossings[i].first - 0.5f ) );
+			int x1 = min( width, (int) ceil( crossings[i+1].first - 0.5f ) );
+			for(int x=x0;x<x1;++x)
+				(*mask)[size_t(row) * width + x] = 1;
+		}
+	}
+}
+
+void DistanceField::transform( std::vector<float> *grid, int width, int height )
+{
+	int n = max( width, height );
+
+	std::vector<float>	f( n ), d( n ), z( n + 1 );
+	std::vector<int>	v( n );
+
+	// transform along columns
+	for(int x=0;x<width;++x) {
+		for(int y=0;y<height;++y) f[y] = (*grid)[size_t(y) * width + x];
+		transform( &f[0], height, &d[0], &v[0], &z[0] );
+		for(int y=0;y<height;++y) (*grid)[size_t(y) * width + x] = d[y];
+	}
+
+	// transform along rows
+	for(int y=0;y<height;++y) {
+		float *row = &(*grid)[size_t(y) * width];
+		std::copy( row, row + width, f.begin() );
+		transform( &f[0], width, row, &v[0], &z[0] );
+	}
+}
+
+void DistanceField::transform( const float *f, int n, float *d, int *v, float *z )
+{
+	// compute the lower envelope of the parabolas rooted at each sample
+	int k = 0;
+	v[0] = 0;
+	z[0] = -kInfinity;
+	z[1] = kInfinity;
+
+	for(int q=1;q<n;++q) {
+		float s = ((f[q] + float(q) * q) - (f[v[k]] + float(v[k]) * v[k])) / (2.0f * q - 2.0f * v[k]);
+		while( s <= z[k] ) {
+			--k;
+			s = ((f[q] + float(q) * q) - (f[v[k]] + float(v[k]) * v[k])) / (2.0f * q - 2.0f * v[k]);
+		}
+
+		++k;
+		v[k] = q;
+		z[k] = s;
+		z[k+1] = kInfinity;
+	}
+
+	// sample the envelope
+	k = 0;
+	for(int q=0;q<n;++q) {
+		while( z[k+1] < q ) ++k;
+		d[q] = float(q - v[k]) * (q - v[k]) + f[v[k]];
+	}
+}
+
+void DistanceField::create( const std::vector<uint8_t> &mask, int width, int height, float spread, int downsample, 
+							std::vector<uint8_t> *field )
+{
+	size_t size = size_t(width) * height;
+
+	// distance from each outside pixel to the shape, and from each inside pixel to the background
+	std::vector<float> outside( size ), inside( size );
+	for(size_t i=0;i<size;++i) {
+		outside[i] = mask[i] ? 0.0f : kInfinity;
+		inside[i] = mask[i] ? kInfinity : 0.0f;
+	}
+
+	transform( &outside, width, height );
+	transform( &inside, width, height );
+
+	// combine into a signed distance and average each block of samples
+	int w = width / downsample;
+	int h = height / downsample;
+	field->assign( size_t(w) * h, 0 );
+
+	const float normalize = 1.0f / (2.0f * spread);
+	const float samples = float(downsample * downsample);
+
+	for(int y=0;y<h;++y) {
+		for(int x=0;x<w;++x) {
+			float sum = 0.0f;
+			for(int j=0;j<downsample;++j) {
+				for(int i=0;i<downsample;++i) {
+					size_t index = size_t(y * downsample + j) * width + (x * downsample + i);
+					float distance = mask[index] ? -(sqrt( inside[index] ) - 0.5f) : (sqrt( outside[index] ) - 0.5f);
+					sum += 0.5f - distance * normalize;
+				}
+			}
+
+			float value = sum / samples;
+			(*field)[size_t(y) * w + x] = (uint8_t) ( 255.0f * min( max( value, 0.0f ), 1.0f ) + 0.5f );
+		}
+	}
+}
+
+} } // namespace ph::text
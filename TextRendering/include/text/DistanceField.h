@@ -0,0 +1,55 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Vector.h"
+#include "text/TrueType.h"
+
+#include <vector>
+
+namespace ph { namespace text {
+
+//! CPU signed distance field generation. All functions are thread-safe.
+class DistanceField
+{
+public:
+	//! renders the contours into a binary mask (0 or 1) using the non-zero winding rule.
+	//! Points are transformed as: pixel = point * scale + offset.
+	static void		rasterize( const TrueType::Contours &contours, const ci::Vec2f &scale, const ci::Vec2f &offset, 
+							   int width, int height, std::vector<uint8_t> *mask );
+
+	//! replaces each value by its squared distance to the nearest zero value, in linear time.
+	//! See: "Distance Transforms of Sampled Functions" by Felzenszwalb and Huttenlocher.
+	static void		transform( std::vector<float> *grid, int width, int height );
+
+	//! creates a signed distance field from a binary mask, reduced in size by 'downsample'. 
+	//! Distances up to 'spread' pixels (at mask resolution) are mapped to [0, 255], with 128 on the edge.
+	static void		create( const std::vector<uint8_t> &mask, int width, int height, float spread, int downsample, 
+							std::vector<uint8_t> *field );
+private:
+	//! one dimensional squared distance transform
+	static void		transform( const float *f, int n, float *d, int *v, float *z );
+};
+
+} } // namespace ph::text
@@ -21,7 +21,12 @@
 */
 
 #include "text/Font.h"
-#include <boost/algorithm/string.hpp> 
+#include "text/GlyphGenerator.h"
+#include "text/Lz4.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 
 namespace ph { namespace text {
 
@@ -29,10 +34,152 @@ using namespace ci;
 using namespace ci::app;
 using namespace std;
 
+// version 3 and later files start with a fixed size header, followed by 16-byte aligned blocks that can be used in place
+#pragma pack(push, 1)
+struct FontHeader {
+	uint8_t		magic[4];		// 'SDFF'
+	uint16_t	version;		// 0x0003
+	uint16_t	flags;
+	float		leading;
+	float		ascent;
+	float		descent;
+	float		spaceWidth;
+	uint32_t	familyOffset;	// UTF-8, not null terminated
+	uint32_t	familySize;
+	uint32_t	metricsOffset;	// array of GlyphRecord, sorted by character code
+	uint32_t	metricsCount;
+	uint32_t	atlasOffset;	// 8-bit distance field, rows stored top to bottom
+	uint32_t	atlasSize;		// stored size in bytes, which differs from width * height if compressed
+	uint32_t	atlasWidth;
+	uint32_t	atlasHeight;
+};
+
+// added in version 4, directly follows the header
+struct FontTables {
+	uint32_t	kerningOffset;	// array of KerningRecord, sorted by pair
+	uint32_t	kerningCount;
+	uint32_t	ligatureOffset;	// array of LigatureRecord, sorted by pair
+	uint32_t	ligatureCount;
+};
+
+struct KerningRecord {
+	uint16_t	left, right;
+	float		amount;
+};
+
+struct LigatureRecord {
+	uint16_t	left, right;
+	uint16_t	ligature;
+	uint16_t	reserved;
+};
+
+struct GlyphRecord {
+	uint32_t	charcode;
+	float		x1, y1, w, h;
+	float		dx, dy, d;
+};
+#pragma pack(pop)
+
+static const uint16_t	kAtlasCompressed = 0x0001;
+static const uint32_t	kBlockAlignment = 16;
+
+static uint32_t align( uint32_t offset )
+{
+	return (offset + kBlockAlignment - 1) & ~(kBlockAlignment - 1);
+}
+
+// a key or value inside a line of a BMFont text file
+struct Token {
+	const char	*begin;
+	const char	*end;
+
+	bool operator==( const char *str ) const { size_t n = std::strlen(str); return size_t(end - begin) == n && std::strncmp( begin, str, n ) == 0; }
+
+	std::string	str() const { return std::string( begin, end ); }
+	int			toInt() const { return (int) std::strtol( begin, NULL, 10 ); }
+	float		toFloat() const { return (float) std::strtod( begin, NULL ); }
+};
+
+static inline bool isSeparator( char c )
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+//! returns the start of the next non-empty line
+static const char* nextLine( const char *p, const char *end )
+{
+	while( p < end && *p != '\n' && *p != '\r' ) ++p;
+	while( p < end && (*p == '\n' || *p == '\r') ) ++p;
+	return p;
+}
+
+//! reads the next 'key=value' pair on the current line, returns FALSE at the end of the line
+static bool nextPair( const char *&p, const char *end, Token *key, Token *value )
+{
+	for(;;) {
+		while( p < end && (*p == ' ' || *p == '\t') ) ++p;
+		if( p >= end || *p == '\n' || *p == '\r' ) return false;
+
+		key->begin = p;
+		while( p < end && *p != '=' && !isSeparator(*p) ) ++p;
+		key->end = p;
+
+		// skip words without a value, like 'char'
+		if( p >= end || *p != '=' ) continue;
+		++p;
+
+		if( p < end && *p == '"' ) {
+			value->begin = ++p;
+			while( p < end && *p != '"' && *p != '\n' && *p != '\r' ) ++p;
+			value->end = p;
+			if( p < end && *p == '"' ) ++p;
+		}
+		else {
+			value->begin = p;
+			while( p < end && !isSeparator(*p) ) ++p;
+			value->end = p;
+		}
+
+		return true;
+	}
+}
+
+//! finds the value of the specified key on the current line
+static bool findValue( const char *p, const char *end, const char *name, Token *value )
+{
+	Token key;
+	while( nextPair( p, end, &key, value ) )
+		if( key == name ) return true;
+
+	return false;
+}
+
+//! decodes the next code point of a UTF-8 string, returns U+FFFD for invalid sequences
+static inline uint32_t decodeUtf8( const char *&p, const char *end )
+{
+	uint8_t c = (uint8_t) *p++;
+	if( c < 0x80 ) return c;
+
+	int			extra;
+	uint32_t	codepoint;
+	if( (c & 0xE0) == 0xC0 ) { extra = 1; codepoint = c & 0x1F; }
+	else if( (c & 0xF0) == 0xE0 ) { extra = 2; codepoint = c & 0x0F; }
+	else if( (c & 0xF8) == 0xF0 ) { extra = 3; codepoint = c & 0x07; }
+	else return 0xFFFD;
+
+	for(;extra>0;--extra) {
+		if( p >= end || ((uint8_t) *p & 0xC0) != 0x80 ) return 0xFFFD;
+		codepoint = (codepoint << 6) | ((uint8_t) *p++ & 0x3F);
+	}
+
+	return codepoint;
+}
+
 Font::Font(void)
 	: mInvalid(true), mFamily("Unknown"), mFontSize(12.0f), mLeading(0.0f), 
-		mAscent(0.0f), mDescent(0.0f), mSpaceWidth(0.0f)
+		mAscent(0.0f), mDescent(0.0f), mSpaceWidth(0.0f), mRevision(0)
 {
+	clearMetrics();
 }
 
 Font::~Font(void)
@@ -50,7 +197,14 @@ void Font::create(const ci::DataSourceRef png, const ci::DataSourceRef txt)
 	mDescent = 0.0f;
 	mSpaceWidth = 0.0f;
 
-	mMetrics.clear();
+	clearMetrics();
+
+	mGenerator.reset();
+	mRequested.clear();
+	mRevision++;
+
+	mAtlas = Channel8u();
+	mMapping.reset();
 
 	// try to load the font texture
 	try { 
@@ -65,59 +219,80 @@ void Font::create(const ci::DataSourceRef png, const ci::DataSourceRef txt)
 	try { data = loadString( txt ); }
 	catch( ... ) { throw FontInvalidSourceExc();	}
 
-	// parse the file
+	// parse the file in place, without splitting it into separate strings
 	try {
-		// split the file into lines
-		std::vector<std::string> lines = ci::split(data, "\n\r");
-		if(lines.size() < 2) throw;
+		const char *p = data.c_str();
+		const char *end = p + data.size();
 
 		// read the first line, containing the font name
-		std::vector<std::string> tokens = ci::split(lines[0], "=");
-		if(tokens.size() < 2 && tokens[0] != "info face") throw;
-
-		mFamily = boost::algorithm::erase_all_copy( tokens[1], "\"" );
+		Token key, value;
+		if( !findValue( p, end, "face", &value ) ) throw FontInvalidSourceExc();
+		mFamily = value.str();
+		p = nextLine( p, end );
 
 		// read the second containing the number of characters in this font
-		tokens = ci::split(lines[1], "=");
-		if(tokens.size() < 2 && tokens[0] != "chars count") throw;
-
-		int count = boost::lexical_cast<int>( tokens[1] );
-		if(count < 1) throw;
+		if( !findValue( p, end, "count", &value ) ) throw FontInvalidSourceExc();
+		int count = value.toInt();
+		if(count < 1) throw FontInvalidSourceExc();
+		p = nextLine( p, end );
 
 		// create the metrics
+		mMetrics.reserve( count );
+
 		uint32_t charcode = 0;
-		for(int i=2;i<count+2;++i) {
-			tokens = ci::split(lines[i], " ");
+		for(int i=0;i<count && p<end;++i) {
 			Metrics m;
-			for(size_t j=0;j<tokens.size();++j) {
-				std::vector<std::string> kvp = ci::split(tokens[j], "=");
-				if(kvp.size() < 2) continue;
-
-				if(kvp[0] == "id")
-					charcode = boost::lexical_cast<uint32_t>( kvp[1] );
-				else if(kvp[0] == "x")
-					m.x1 = boost::lexical_cast<float>( kvp[1] );
-				else if(kvp[0] == "y")
-					m.y1 = boost::lexical_cast<float>( kvp[1] );
-				else if(kvp[0] == "width")
-					m.w = boost::lexical_cast<float>( kvp[1] );
-				else if(kvp[0] == "height")
-					m.h = boost::lexical_cast<float>( kvp[1] );
-				else if(kvp[0] == "xoffset")
-					m.dx = boost::lexical_cast<float>( kvp[1] );
-				else if(kvp[0] == "yoffset")
-					m.dy = boost::lexical_cast<float>( kvp[1] );
-				else if(kvp[0] == "xadvance")
-					m.d = boost::lexical_cast<float>( kvp[1] );
+			while( nextPair( p, end, &key, &value ) ) {
+				if( key == "id" )
+					charcode = (uint32_t) value.toInt();
+				else if( key == "x" )
+					m.x1 = value.toFloat();
+				else if( key == "y" )
+					m.y1 = value.toFloat();
+				else if( key == "width" )
+					m.w = value.toFloat();
+				else if( key == "height" )
+					m.h = value.toFloat();
+				else if( key == "xoffset" )
+					m.dx = value.toFloat();
+				else if( key == "yoffset" )
+					m.dy = value.toFloat();
+				else if( key == "xadvance" )
+					m.d = value.toFloat();
 			}
+			p = nextLine( p, end );
 
 			m.x2 = m.x1 + m.w;
 			m.y2 = m.y1 + m.h;
 			mMetrics[charcode] = m;
 		} 
+
+		// read the kerning pairs that follow the characters, if any
+		std::vector<KerningTable::Pair> kerning;
+		for(;p<end;p=nextLine( p, end )) {
+			if( std::strncmp( p, "kerning ", 8 ) != 0 ) continue;
+
+			uint32_t first = 0, second = 0;
+			float amount = 0.0f;
+			while( nextPair( p, end, &key, &value ) ) {
+				if( key == "first" )
+					first = (uint32_t) value.toInt();
+				else if( key == "second" )
+					second = (uint32_t) value.toInt();
+				else if( key == "amount" )
+					amount = value.toFloat();
+			}
+
+			if( amount != 0.0f && first <= 0xFFFF && second <= 0xFFFF )
+				kerning.push_back( KerningTable::Pair( KerningTable::key( (uint16_t) first, (uint16_t) second ), amount ) );
+		}
+
+		mKerning.build( kerning );
 	}
 	catch( ... ) { throw FontInvalidSourceExc(); }
 
+	indexMetrics();
+
 	// measure font (standard ASCII range only to prevent weird characters influencing the measurements)
 	for(uint16_t i=33;i<127;++i) {
 		MetricsData::const_iterator itr = mMetrics.find(i);
@@ -132,12 +307,44 @@ void Font::create(const ci::DataSourceRef png, const ci::DataSourceRef txt)
 
 	if( mMetrics.find(32) != mMetrics.end() )
 		mSpaceWidth = mMetrics[32].d;
+
+	mInvalid = false;
 }
 
 void Font::read(const ci::DataSourceRef source)
+{
+	parse( source );
+
+	try { uploadTexture(); }
+	catch( ... ) { throw FontInvalidSourceExc(); }
+}
+
+void Font::parse(const ci::DataSourceRef source)
 {
 	mInvalid = true;
 
+	mGenerator.reset();
+	mRequested.clear();
+	mRevision++;
+
+	mAtlas = Channel8u();
+	mMapping.reset();
+	mTexture.reset();
+
+	// memory map files, so the atlas of a version 3 font can be uploaded straight from the file
+	MappedFileRef mapping;
+	if( !source->getFilePath().empty() ) 
+		mapping = MappedFile::create( source->getFilePath() );
+
+	if( mapping ) {
+		if( readVersion3( mapping->getData(), mapping->getSize(), mapping ) ) { mInvalid = false; return; }
+	}
+	else {
+		Buffer &buffer = source->getBuffer();
+		if( readVersion3( static_cast<const uint8_t*>( buffer.getData() ), buffer.getDataSize(), MappedFileRef() ) ) { mInvalid = false; return; }
+	}
+
+	// older versions are read from a stream
 	IStreamRef	in = source->createStream();
 	size_t		filesize = in->size();
 
@@ -162,7 +369,7 @@ void Font::read(const ci::DataSourceRef source)
 	mFontSize = mAscent + mDescent;
 
 	// read metrics data
-	mMetrics.clear();
+	clearMetrics();
 
 	try {
 		uint16_t count;
@@ -191,6 +398,8 @@ void Font::read(const ci::DataSourceRef source)
 		throw FontInvalidSourceExc();
 	}
 
+	indexMetrics();
+
 	// read image data	
 	try {
 		// reserve memory
@@ -200,68 +409,475 @@ void Font::read(const ci::DataSourceRef source)
 
 		// load image
 		mSurface = Surface( loadImage( DataSourceBuffer::create(buffer), ImageSource::Options(), "png" ) );
-
-		// apply mip-mapping
-		gl::Texture::Format fmt;
-		fmt.enableMipmapping();
-		fmt.setMinFilter( GL_LINEAR_MIPMAP_LINEAR );
-		fmt.setMagFilter( GL_LINEAR );
-
-		mTexture = gl::Texture( mSurface, fmt );
-		mTextureSize = mTexture.getSize();
+		mTextureSize = mSurface.getSize();
 	}
 	catch( ... ) {
 		throw FontInvalidSourceExc();
 	} 
+
+	mInvalid = false;
+}
+
+bool Font::readVersion3( const uint8_t *data, size_t size, const MappedFileRef &mapping )
+{
+	FontHeader header;
+	if( size < sizeof(header) ) return false;
+
+	std::memcpy( &header, data, sizeof(header) );
+	if( std::memcmp( header.magic, "SDFF", 4 ) != 0 || header.version < 0x0003 ) return false;
+
+	// tables were added in version 4
+	FontTables tables = { 0, 0, 0, 0 };
+	if( header.version >= 0x0004 ) {
+		if( size < sizeof(header) + sizeof(tables) ) throw FontInvalidSourceExc();
+		std::memcpy( &tables, data + sizeof(header), sizeof(tables) );
+	}
+
+	// validate the blocks before using them (all values are little endian, like the platforms we run on)
+	const uint64_t metricsSize = uint64_t(header.metricsCount) * sizeof(GlyphRecord);
+	const uint64_t kerningSize = uint64_t(tables.kerningCount) * sizeof(KerningRecord);
+	const uint64_t ligatureSize = uint64_t(tables.ligatureCount) * sizeof(LigatureRecord);
+	const uint64_t pixels = uint64_t(header.atlasWidth) * header.atlasHeight;
+
+	if( uint64_t(header.familyOffset) + header.familySize > size
+		|| uint64_t(header.metricsOffset) + metricsSize > size
+		|| uint64_t(header.atlasOffset) + header.atlasSize > size
+		|| uint64_t(tables.kerningOffset) + kerningSize > size
+		|| uint64_t(tables.ligatureOffset) + ligatureSize > size
+		|| header.metricsOffset % kBlockAlignment != 0
+		|| tables.kerningOffset % kBlockAlignment != 0
+		|| tables.ligatureOffset % kBlockAlignment != 0
+		|| header.atlasWidth == 0 || header.atlasHeight == 0
+		|| ( !(header.flags & kAtlasCompressed) && header.atlasSize != pixels ) )
+		throw FontInvalidSourceExc();
+
+	// read font data
+	mFamily = std::string( reinterpret_cast<const char*>( data + header.familyOffset ), header.familySize );
+
+	mLeading = header.leading;
+	mAscent = header.ascent;
+	mDescent = header.descent;
+	mSpaceWidth = header.spaceWidth;
+	mFontSize = mAscent + mDescent;
+
+	// read metrics data straight from the aligned array
+	const GlyphRecord *records = reinterpret_cast<const GlyphRecord*>( data + header.metricsOffset );
+
+	clearMetrics();
+	mMetrics.reserve( header.metricsCount );
+
+	for(uint32_t i=0;i<header.metricsCount;++i) {
+		const GlyphRecord &r = records[i];
+
+		Metrics m;
+		m.x1 = r.x1;
+		m.y1 = r.y1;
+		m.w = r.w;
+		m.h = r.h;
+		m.dx = r.dx;
+		m.dy = r.dy;
+		m.d = r.d;
+		m.x2 = m.x1 + m.w;
+		m.y2 = m.y1 + m.h;
+		mMetrics[(uint16_t) r.charcode] = m;
+	}
+
+	// compile the pair tables
+	const KerningRecord *kerning = reinterpret_cast<const KerningRecord*>( data + tables.kerningOffset );
+
+	std::vector<KerningTable::Pair> kerningPairs( tables.kerningCount );
+	for(uint32_t i=0;i<tables.kerningCount;++i)
+		kerningPairs[i] = KerningTable::Pair( KerningTable::key( kerning[i].left, kerning[i].right ), kerning[i].amount );
+
+	mKerning.build( kerningPairs );
+
+	const LigatureRecord *ligatures = reinterpret_cast<const LigatureRecord*>( data + tables.ligatureOffset );
+
+	std::vector<LigatureTable::Pair> ligaturePairs( tables.ligatureCount );
+	for(uint32_t i=0;i<tables.ligatureCount;++i)
+		ligaturePairs[i] = LigatureTable::Pair( LigatureTable::key( ligatures[i].left, ligatures[i].right ), ligatures[i].ligature );
+
+	mLigatures.build( ligaturePairs );
+
+	indexMetrics();
+
+	// read image data
+	const uint8_t *atlas = data + header.atlasOffset;
+
+	if( header.flags & kAtlasCompressed ) {
+		mAtlas = Channel8u( header.atlasWidth, header.atlasHeight );
+		if( !Lz4::decompress( atlas, header.atlasSize, mAtlas.getData(), (size_t) pixels ) ) 
+			throw FontInvalidSourceExc();
+	}
+	else if( mapping ) {
+		// refer to the mapped pixels, the mapping is kept alive for as long as the atlas is
+		mAtlas = Channel8u( header.atlasWidth, header.atlasHeight, header.atlasWidth, 1, const_cast<uint8_t*>( atlas ) );
+		mMapping = mapping;
+	}
+	else {
+		mAtlas = Channel8u( header.atlasWidth, header.atlasHeight );
+		std::memcpy( mAtlas.getData(), atlas, (size_t) pixels );
+	}
+
+	mTextureSize = mAtlas.getSize();
+	mSurface = Surface();
+
+	return true;
 }
 
-void Font::write(const ci::DataTargetRef target)
+void Font::uploadTexture()
+{
+	// apply mip-mapping
+	gl::Texture::Format fmt;
+	fmt.enableMipmapping();
+	fmt.setMinFilter( GL_LINEAR_MIPMAP_LINEAR );
+	fmt.setMagFilter( GL_LINEAR );
+
+	if( mAtlas )
+		mTexture = gl::Texture( mAtlas, fmt );
+	else if( mSurface )
+		mTexture = gl::Texture( mSurface, fmt );
+	else return;
+
+	mTextureSize = mTexture.getSize();
+}
+
+void Font::write(const ci::DataTargetRef target, bool compressed)
 {
 	if(!target) throw FontInvalidTargetExc();
 
+	// the atlas of fonts created from an image is stored in the red channel
+	Channel8u atlas = mAtlas ? mAtlas : Channel8u( mSurface.getChannelRed() );
+	if(!atlas) throw FontInvalidTargetExc();
+
+	// make sure the pixels are tightly packed
+	const uint32_t width = atlas.getWidth();
+	const uint32_t height = atlas.getHeight();
+
+	std::vector<uint8_t> pixels( width * height );
+	Channel8u::Iter itr = atlas.getIter();
+	for(uint8_t *ptr=&pixels[0];itr.line();)
+		while( itr.pixel() ) *ptr++ = itr.v();
+
+	std::vector<uint8_t> blob;
+	if( compressed ) Lz4::compress( &pixels[0], pixels.size(), &blob );
+	else blob.swap( pixels );
+
+	// sort the metrics, so the file is identical every time we write it
+	std::vector<GlyphRecord> records;
+	records.reserve( mMetrics.size() );
+
+	MetricsData::const_iterator mitr;
+	for(mitr=mMetrics.begin();mitr!=mMetrics.end();++mitr) {
+		GlyphRecord r;
+		r.charcode = mitr->first;
+		r.x1 = mitr->second.x1;
+		r.y1 = mitr->second.y1;
+		r.w = mitr->second.w;
+		r.h = mitr->second.h;
+		r.dx = mitr->second.dx;
+		r.dy = mitr->second.dy;
+		r.d = mitr->second.d;
+		records.push_back( r );
+	}
+
+	std::sort( records.begin(), records.end(), [](const GlyphRecord &a, const GlyphRecord &b) { return a.charcode < b.charcode; } );
+
+	// pair tables, sorted so the file is identical every time we write it
+	std::vector<KerningRecord> kerning( mKerning.size() );
+	for(size_t i=0;i<kerning.size();++i) {
+		kerning[i].left = KerningTable::left( mKerning.getKeys()[i] );
+		kerning[i].right = KerningTable::right( mKerning.getKeys()[i] );
+		kerning[i].amount = mKerning.getValues()[i];
+	}
+
+	std::sort( kerning.begin(), kerning.end(), [](const KerningRecord &a, const KerningRecord &b) { return a.left < b.left || (a.left == b.left && a.right < b.right); } );
+
+	std::vector<LigatureRecord> ligatures( mLigatures.size() );
+	for(size_t i=0;i<ligatures.size();++i) {
+		ligatures[i].left = LigatureTable::left( mLigatures.getKeys()[i] );
+		ligatures[i].right = LigatureTable::right( mLigatures.getKeys()[i] );
+		ligatures[i].ligature = mLigatures.getValues()[i];
+		ligatures[i].reserved = 0;
+	}
+
+	std::sort( ligatures.begin(), ligatures.end(), [](const LigatureRecord &a, const LigatureRecord &b) { return a.left < b.left || (a.left == b.left && a.right < b.right); } );
+
+	// lay out the file
+	FontHeader header;
+	std::memcpy( header.magic, "SDFF", 4 );
+	header.version = 0x0004;
+	header.flags = compressed ? kAtlasCompressed : 0;
+	header.leading = mLeading;
+	header.ascent = mAscent;
+	header.descent = mDescent;
+	header.spaceWidth = mSpaceWidth;
+	header.familyOffset = sizeof(FontHeader) + sizeof(FontTables);
+	header.familySize = (uint32_t) mFamily.size();
+	header.metricsOffset = align( header.familyOffset + header.familySize );
+	header.metricsCount = (uint32_t) records.size();
+
+	FontTables tables;
+	tables.kerningOffset = align( header.metricsOffset + header.metricsCount * sizeof(GlyphRecord) );
+	tables.kerningCount = (uint32_t) kerning.size();
+	tables.ligatureOffset = align( tables.kerningOffset + tables.kerningCount * sizeof(KerningRecord) );
+	tables.ligatureCount = (uint32_t) ligatures.size();
+
+	header.atlasOffset = align( tables.ligatureOffset + tables.ligatureCount * sizeof(LigatureRecord) );
+	header.atlasSize = (uint32_t) blob.size();
+	header.atlasWidth = width;
+	header.atlasHeight = height;
+
+	// write everything in a few large blocks
 	OStreamRef out = target->getStream();
 
-	// write header
-	out->write( (uint8_t) 'S' );
-	out->write( (uint8_t) 'D' );
-	out->write( (uint8_t) 'F' );
-	out->write( (uint8_t) 'F' );
+	const uint8_t padding[kBlockAlignment] = { 0 };
+	uint32_t offset = 0;
+
+	out->writeData( &header, sizeof(header) );
+	out->writeData( &tables, sizeof(tables) );
+	offset += sizeof(header) + sizeof(tables);
+
+	if( !mFamily.empty() ) out->writeData( mFamily.data(), mFamily.size() );
+	offset += header.familySize;
 
-	uint16_t version = 0x0002;
-	out->writeLittle( version );
+	out->writeData( padding, header.metricsOffset - offset );
+	if( !records.empty() ) out->writeData( &records[0], records.size() * sizeof(GlyphRecord) );
+	offset = header.metricsOffset + header.metricsCount * sizeof(GlyphRecord);
+
+	out->writeData( padding, tables.kerningOffset - offset );
+	if( !kerning.empty() ) out->writeData( &kerning[0], kerning.size() * sizeof(KerningRecord) );
+	offset = tables.kerningOffset + tables.kerningCount * sizeof(KerningRecord);
+
+	out->writeData( padding, tables.ligatureOffset - offset );
+	if( !ligatures.empty() ) out->writeData( &ligatures[0], ligatures.size() * sizeof(LigatureRecord) );
+	offset = tables.ligatureOffset + tables.ligatureCount * sizeof(LigatureRecord);
+
+	out->writeData( padding, header.atlasOffset - offset );
+	if( !blob.empty() ) out->writeData( &blob[0], blob.size() );
+}
+
+void Font::createDynamic( const ci::DataSourceRef ttf, float glyphSize, int atlasSize )
+{
+	// initialize
+	mInvalid = true;
+	mFamily = "Unknown";
+	clearMetrics();
+	mRequested.clear();
+	mRevision++;
+
+	mMapping.reset();
+
+	// parse the TrueType file
+	std::shared_ptr<GlyphGenerator> generator( new GlyphGenerator( glyphSize ) );
+	try {
+		Buffer &buffer = ttf->getBuffer();
+		if( !generator->load( buffer.getData(), buffer.getDataSize() ) ) throw FontInvalidSourceExc();
+	}
+	catch( ... ) { throw FontInvalidSourceExc(); }
 
-	// write font name
-	out->write(mFamily);
+	if( !ttf->getFilePath().empty() )
+		mFamily = ttf->getFilePath().stem().string();
 
-	// write font data
-	out->writeData( (void*) &mLeading, sizeof(mLeading) );
-	out->writeData( (void*) &mAscent, sizeof(mAscent) );
-	out->writeData( (void*) &mDescent, sizeof(mDescent) );
-	out->writeData( (void*) &mSpaceWidth, sizeof(mSpaceWidth) );
+	// font metrics are known up front, glyph metrics are added as soon as they are rendered
+	const TrueType &tt = generator->getTrueType();
+	const float scale = generator->getScale();
 
-	// write metrics data
+	mAscent = tt.getAscender() * scale;
+	mDescent = -tt.getDescender() * scale;
+	mLeading = mAscent + mDescent;
+	mFontSize = mAscent + mDescent;
+	mSpaceWidth = tt.getAdvance( tt.getGlyphIndex(32) ) * scale;
+
+	// create an empty atlas, it will grow in height when it is full
+	mPacker.reset( atlasSize, atlasSize );
+
+	mAtlas = Channel8u( atlasSize, atlasSize );
+	std::memset( mAtlas.getData(), 0, mAtlas.getRowBytes() * mAtlas.getHeight() );
+
+	createAtlasTexture();
+
+	// start rendering the printable ASCII range right away
+	mGenerator = generator;
+	mGenerator->start();
+
+	for(uint16_t i=32;i<127;++i)
+		request(i);
+	mInvalid = false;
+}
+
+void Font::request( uint16_t charcode ) const
+{
+	if( !mGenerator ) return;
+
+	// only request each character once, even if the font does not contain it
+	if( mRequested.insert(charcode).second )
+		mGenerator->request(charcode);
+}
+
+void Font::resolve( const FontRef &font )
+{
+	boost::mutex::scoped_lock lock( mResolveMutex );
+	mResolved = font;
+}
+
+bool Font::update()
+{
+	bool changed = false;
+
+	// take over a font that has finished loading on another thread
+	FontRef resolved;
 	{
-		uint16_t count = (uint16_t) mMetrics.size();
-		out->writeLittle( count );
-
-		MetricsData::const_iterator itr;
-		for(itr=mMetrics.begin();itr!=mMetrics.end();++itr) {
-			// write char code
-			out->writeLittle( itr->first );
-			// write metrics
-			out->writeData( (void*) &(itr->second.x1), sizeof(itr->second.x1) );
-			out->writeData( (void*) &(itr->second.y1), sizeof(itr->second.y1) );
-			out->writeData( (void*) &(itr->second.w), sizeof(itr->second.w) );
-			out->writeData( (void*) &(itr->second.h), sizeof(itr->second.h) );
-			
-			out->writeData( (void*) &(itr->second.dx), sizeof(itr->second.dx) );
-			out->writeData( (void*) &(itr->second.dy), sizeof(itr->second.dy) );
-			out->writeData( (void*) &(itr->second.d), sizeof(itr->second.d) );
+		boost::mutex::scoped_lock lock( mResolveMutex );
+		resolved.swap( mResolved );
+	}
+
+	if( resolved ) {
+		adopt( *resolved );
+		changed = true;
+	}
+
+	// fonts parsed on another thread create their texture on first use
+	if( !mTexture && !mInvalid ) {
+		try { uploadTexture(); }
+		catch( const std::exception &e ) { app::console() << "Error creating font texture: " << e.what() << std::endl; }
+	}
+
+	GlyphGenerator::Glyph glyph;
+	while( mGenerator && mGenerator->tryPop( &glyph ) ) {
+		// characters that are not part of the font stay in the list of requests, so they are not requested again
+		if( !glyph.valid ) continue;
+
+		Metrics m;
+		m.x1 = m.y1 = 0.0f;
+		m.w = glyph.w;
+		m.h = glyph.h;
+		m.dx = glyph.dx;
+		m.dy = glyph.dy;
+		m.d = glyph.d;
+
+		if( glyph.field ) {
+			// find room in the atlas, leave a pixel between glyphs to prevent bleeding
+			int x, y;
+			bool packed;
+			while( !(packed = mPacker.insert( glyph.field.getWidth() + 1, glyph.field.getHeight() + 1, &x, &y )) && growAtlas() )
+				changed = true;
+
+			if( !packed ) {
+				app::console() << "Font atlas is full, could not add character " << glyph.charcode << std::endl;
+				continue;
+			}
+
+			// copy the glyph into the atlas and upload only the area it occupies
+			Area area( x, y, x + glyph.field.getWidth(), y + glyph.field.getHeight() );
+			mAtlas.copyFrom( glyph.field, glyph.field.getBounds(), area.getUL() );
+			mTexture.update( mAtlas, area );
+
+			m.x1 = float(x);
+			m.y1 = float(y);
 		}
+
+		m.x2 = m.x1 + m.w;
+		m.y2 = m.y1 + m.h;
+		mMetrics[glyph.charcode] = m;
+		if( glyph.charcode < 128 ) mAscii[glyph.charcode] = &mMetrics[glyph.charcode];
+
+		changed = true;
 	}
 
-	// write image data
-	writeImage( DataTargetStream::createRef(out), mSurface.getChannelRed(), ImageTarget::Options(), "png" );
+	if( changed ) mRevision++;
+
+	return changed;
+}
+
+void Font::adopt( Font &font )
+{
+	mInvalid = font.mInvalid;
+	mFamily = font.mFamily;
+	mFontSize = font.mFontSize;
+	mLeading = font.mLeading;
+	mAscent = font.mAscent;
+	mDescent = font.mDescent;
+	mSpaceWidth = font.mSpaceWidth;
+
+	mSurface = font.mSurface;
+	mTexture = font.mTexture;
+	mTextureSize = font.mTextureSize;
+
+	mMetrics.swap( font.mMetrics );
+	std::swap( mKerning, font.mKerning );
+	std::swap( mLigatures, font.mLigatures );
+	indexMetrics();
+	font.indexMetrics();
+
+	mGenerator = font.mGenerator;
+	mPacker = font.mPacker;
+	mAtlas = font.mAtlas;
+	mMapping = font.mMapping;
+	mRequested.clear();
+}
+
+void Font::clearMetrics()
+{
+	mMetrics.clear();
+	std::fill( mAscii, mAscii + 128, (const Metrics*) 0 );
+
+	mKerning.clear();
+	mLigatures.clear();
+}
+
+void Font::indexMetrics()
+{
+	for(uint16_t i=0;i<128;++i) {
+		MetricsData::const_iterator itr = mMetrics.find(i);
+		mAscii[i] = ( itr != mMetrics.end() ) ? &(itr->second) : 0;
+	}
+
+	// fonts without a ligature table use the common Latin ligatures, if the font contains their glyphs
+	if( mLigatures.empty() ) {
+		static const uint16_t kLatin[][3] = {
+			{ 'f', 'f', 0xFB00 }, { 'f', 'i', 0xFB01 }, { 'f', 'l', 0xFB02 }, { 0xFB00, 'i', 0xFB03 }, { 0xFB00, 'l', 0xFB04 }
+		};
+
+		std::vector<LigatureTable::Pair> pairs;
+		for(size_t i=0;i<sizeof(kLatin)/sizeof(kLatin[0]);++i)
+			if( contains( kLatin[i][0] ) && contains( kLatin[i][2] ) )
+				pairs.push_back( LigatureTable::Pair( LigatureTable::key( kLatin[i][0], kLatin[i][1] ), kLatin[i][2] ) );
+
+		mLigatures.build( pairs );
+	}
+}
+
+bool Font::growAtlas()
+{
+	GLint maxSize;
+	glGetIntegerv( GL_MAX_TEXTURE_SIZE, &maxSize );
+
+	int height = 2 * mAtlas.getHeight();
+	if( height > maxSize ) return false;
+
+	// double the height of the atlas, which changes all texture coordinates
+	Channel8u atlas( mAtlas.getWidth(), height );
+	std::memset( atlas.getData(), 0, atlas.getRowBytes() * atlas.getHeight() );
+	atlas.copyFrom( mAtlas, mAtlas.getBounds() );
+
+	mAtlas = atlas;
+	mPacker.grow( height );
+
+	createAtlasTexture();
+
+	return true;
+}
+
+void Font::createAtlasTexture()
+{
+	// no mip-mapping, because the atlas is updated one glyph at a time
+	gl::Texture::Format fmt;
+	fmt.setMinFilter( GL_LINEAR );
+	fmt.setMagFilter( GL_LINEAR );
+
+	mTexture = gl::Texture( mAtlas, fmt );
+	mTextureSize = mTexture.getSize();
 }
 
 Font::Metrics Font::getMetrics(uint16_t charcode) const
@@ -322,52 +938,174 @@ float Font::getAdvance(const Metrics &metrics, float fontSize) const
 	return metrics.d * fontSize / mFontSize;
 }
 
-Rectf Font::measure( const std::u16string &text, float fontSize ) const
+// TODO: handle special chars like \t, both overloads of forEachMetrics() skip them for now
+template<typename Visitor>
+void Font::forEachMetrics( const std::string &text, bool ligatures, Visitor visit ) const
 {
-	float offset = 0.0f;
-	Rectf result(0.0f, 0.0f, 0.0f, 0.0f);
+	const char *p = text.data();
+	const char *end = p + text.size();
+
+	if( !ligatures || mLigatures.empty() ) {
+		while( p < end ) {
+			// fast path: test eight bytes at once and look up runs of ASCII characters directly
+			if( end - p >= 8 ) {
+				uint64_t word;
+				std::memcpy( &word, p, sizeof(word) );
+
+				if( (word & 0x8080808080808080ULL) == 0 ) {
+					for(int i=0;i<8;++i) {
+						const Metrics *m = mAscii[(uint8_t) p[i]];
+						if( m ) visit( (uint16_t) p[i], *m );
+					}
+
+					p += 8;
+					continue;
+				}
+			}
 
-	std::u16string::const_iterator citr;
-	for(citr=text.begin();citr!=text.end();++citr) {
-		uint16_t charcode = (uint16_t) *citr;
+			uint32_t codepoint = decodeUtf8( p, end );
+			if( codepoint > 0xFFFF ) continue;
 
-		// TODO: handle special chars like /t
+			const Metrics *m = findMetrics( (uint16_t) codepoint );
+			if( m ) visit( (uint16_t) codepoint, *m );
+		}
 
-		MetricsData::const_iterator itr = mMetrics.find(charcode);
-		if(itr != mMetrics.end()) {
-			result.include( 
-				Rectf(offset + itr->second.dx, -itr->second.dy, 
-				offset + itr->second.dx + itr->second.w, itr->second.h - itr->second.dy) 
-			);
-			offset += itr->second.d;
+		return;
+	}
+
+	// decodes the next character, skipping those outside the Basic Multilingual Plane
+	const uint32_t kEnd = 0xFFFFFFFF;
+	auto next = [&]() -> uint32_t {
+		while( p < end ) {
+			uint32_t codepoint = decodeUtf8( p, end );
+			if( codepoint <= 0xFFFF ) return codepoint;
 		}
+		return kEnd;
+	};
+
+	uint32_t current = next();
+	while( current != kEnd ) {
+		uint32_t following = next();
+
+		// replace pairs of characters by a single glyph, like Text::renderString() does
+		while( following != kEnd ) {
+			uint16_t ligature = getLigature( (uint16_t) current, (uint16_t) following );
+			if( !ligature ) break;
+
+			current = ligature;
+			following = next();
+		}
+
+		const Metrics *m = findMetrics( (uint16_t) current );
+		if( m ) visit( (uint16_t) current, *m );
+
+		current = following;
 	}
+}
+
+template<typename Visitor>
+void Font::forEachMetrics( const std::u16string &text, bool ligatures, Visitor visit ) const
+{
+	const bool substitute = ligatures && !mLigatures.empty();
+
+	for(size_t i=0;i<text.size();++i) {
+		uint16_t charcode = (uint16_t) text[i];
+
+		// replace pairs of characters by a single glyph, like Text::renderString() does
+		while( substitute && i + 1 < text.size() ) {
+			uint16_t ligature = getLigature( charcode, (uint16_t) text[i+1] );
+			if( !ligature ) break;
+
+			charcode = ligature;
+			++i;
+		}
+
+		const Metrics *m = findMetrics( charcode );
+		if( m ) visit( charcode, *m );
+	}
+}
+
+Rectf Font::measure( const std::string &text, float fontSize, bool kerning, bool ligatures ) const
+{
+	float offset = 0.0f;
+	Rectf result(0.0f, 0.0f, 0.0f, 0.0f);
+
+	const bool kern = kerning && !mKerning.empty();
+	uint16_t previous = 0;
+
+	forEachMetrics( text, ligatures, [&]( uint16_t charcode, const Metrics &m ) {
+		if( kern ) offset += findKerning( previous, charcode );
+		previous = charcode;
+
+		result.include( Rectf(offset + m.dx, -m.dy, offset + m.dx + m.w, m.h - m.dy) );
+		offset += m.d;
+	} );
+
+	return result.scaled( fontSize / mFontSize );
+}
+
+float Font::measureWidth( const std::string &text, float fontSize, bool precise, bool kerning, bool ligatures ) const
+{
+	float offset = 0.0f;
+	float adjust = 0.0f;
+
+	const bool kern = kerning && !mKerning.empty();
+	uint16_t previous = 0;
+
+	forEachMetrics( text, ligatures, [&]( uint16_t charcode, const Metrics &m ) {
+		if( kern ) offset += findKerning( previous, charcode );
+		previous = charcode;
+
+		offset += m.d;
+		adjust = m.dx + m.w - m.d;
+	} );
+
+	// precise measurement takes into account that the last character 
+	// contributes to the total width only by its own width, not its advance
+	if( !precise ) adjust = 0.0f;
+
+	return (offset + adjust) * ( fontSize / mFontSize );
+}
+
+Rectf Font::measure( const std::u16string &text, float fontSize, bool kerning, bool ligatures ) const
+{
+	float offset = 0.0f;
+	Rectf result(0.0f, 0.0f, 0.0f, 0.0f);
+
+	const bool kern = kerning && !mKerning.empty();
+	uint16_t previous = 0;
+
+	forEachMetrics( text, ligatures, [&]( uint16_t charcode, const Metrics &m ) {
+		if( kern ) offset += findKerning( previous, charcode );
+		previous = charcode;
+
+		result.include( Rectf(offset + m.dx, -m.dy, offset + m.dx + m.w, m.h - m.dy) );
+		offset += m.d;
+	} );
 
 	// return
 	return result.scaled( fontSize / mFontSize );
 }
 
-float Font::measureWidth( const std::u16string &text, float fontSize, bool precise ) const
+float Font::measureWidth( const std::u16string &text, float fontSize, bool precise, bool kerning, bool ligatures ) const
 {
 	float offset = 0.0f;
 	float adjust = 0.0f;
 
-	std::u16string::const_iterator citr;
-	for(citr=text.begin();citr!=text.end();++citr) {
-		uint16_t charcode = (uint16_t) *citr;
+	const bool kern = kerning && !mKerning.empty();
+	uint16_t previous = 0;
 
-		// TODO: handle special chars like /t
+	forEachMetrics( text, ligatures, [&]( uint16_t charcode, const Metrics &m ) {
+		if( kern ) offset += findKerning( previous, charcode );
+		previous = charcode;
 
-		MetricsData::const_iterator itr = mMetrics.find(charcode);
-		if(itr != mMetrics.end()) {
-			offset += itr->second.d;
-			
-			// precise measurement takes into account that the last character 
-			// contributes to the total width only by its own width, not its advance
-			if( precise )
-				adjust = itr->second.dx + itr->second.w - itr->second.d;
-		}
-	}
+		offset += m.d;
+		adjust = m.dx + m.w - m.d;
+	} );
+
+	// precise measurement takes into account that the last character 
+	// contributes to the total width only by its own width, not its advance
+	if( !precise ) adjust = 0.0f;
 	
 	return (offset + adjust) * ( fontSize / mFontSize );
 }
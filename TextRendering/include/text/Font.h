@@ -29,13 +29,21 @@
 #include "cinder/Utilities.h"
 #include "cinder/app/AppBasic.h"
 #include "cinder/gl/Texture.h"
+#include "text/MappedFile.h"
+#include "text/PairTable.h"
+#include "text/SkylinePacker.h"
+
+#include <boost/thread/mutex.hpp>
 
 #include <unordered_map>
+#include <unordered_set>
 
 namespace ph { namespace text {
 
 typedef std::shared_ptr<class Font> FontRef;
 
+class GlyphGenerator;
+
 class Font
 {
 public:
@@ -53,16 +61,39 @@ public:
 	};
 
 	typedef std::unordered_map<uint16_t, Metrics>	MetricsData;
+	typedef PairTable<float>						KerningTable;
+	typedef PairTable<uint16_t>						LigatureTable;
 public:
 	Font(void);
 	~Font(void);
 
 	//! creates a font from the two files generated by LoneSock's SDFont.exe
 	void create( const ci::DataSourceRef png, const ci::DataSourceRef txt );
-	//! reads a binary font file created using 'writeBinary'
+	//! reads a binary font file created using 'write'. Version 3 files are memory mapped if possible.
 	void read( const ci::DataSourceRef source );
-	//! writes the font to a binary file
-	void write( const ci::DataTargetRef target );
+	//! reads a binary font file without creating the texture, so it can be called from any thread.
+	//! The texture is created by 'update()' on the main thread.
+	void parse( const ci::DataSourceRef source );
+	//! writes the font to a binary file (version 4), optionally compressing the atlas using LZ4
+	void write( const ci::DataTargetRef target, bool compressed = false );
+	//! creates a dynamic font, which renders missing glyphs from a TrueType file on worker threads.
+	//! 'glyphSize' is the em size in pixels of the generated glyphs.
+	void createDynamic( const ci::DataSourceRef ttf, float glyphSize = 32.0f, int atlasSize = 512 );
+
+	//! returns TRUE if missing glyphs are rendered on demand
+	bool		isDynamic() const { return mGenerator != 0; }
+	//! schedules a missing character for rendering (dynamic fonts only)
+	void		request( uint16_t charcode ) const;
+	//! applies a resolved font, creates the texture if necessary and adds rendered glyphs to the atlas.
+	//! Call from the main thread. Returns TRUE if the metrics have changed.
+	bool		update();
+	//! takes over the contents of 'font' on the next call to 'update()'. Can be called from any thread,
+	//! which allows a placeholder to be handed out while the actual font is loading.
+	void		resolve( const FontRef &font );
+	//! returns TRUE if the font has been loaded successfully (placeholders are not valid until resolved)
+	bool		isValid() const { return !mInvalid; }
+	//! incremented whenever glyphs are added or texture coordinates change
+	uint32_t	getRevision() const { return mRevision; }
 
 	//!
 	std::string getFamily() const { return mFamily; }
@@ -95,6 +126,15 @@ public:
 	//!
 	inline float getAdvance(const Metrics &metrics, float fontSize=12.0f) const;
 
+	//! returns the kerning between two characters, which should be added to the advance of 'left'
+	float		getKerning( uint16_t left, uint16_t right, float fontSize=12.0f ) const { return findKerning( left, right ) * (fontSize / mFontSize); }
+	//! returns the glyph that replaces a pair of characters (e.g. 'fi'), or 0 if there is none
+	uint16_t	getLigature( uint16_t left, uint16_t right ) const { const uint16_t *ligature = mLigatures.find( left, right ); return ligature ? *ligature : 0; }
+	//!
+	bool		hasKerning() const { return !mKerning.empty(); }
+	//!
+	bool		hasLigatures() const { return !mLigatures.empty(); }
+
 	//!
 	void		enableAndBind() const { if(mTexture) mTexture.enableAndBind(); }
 	//!
@@ -103,15 +143,57 @@ public:
 	void		unbind(GLuint textureUnit=0) const  { if(mTexture) mTexture.unbind(textureUnit); }
 
 	//!
-	ci::Rectf	measure( const std::string &text, float fontSize=12.0f ) const { return measure( ci::toUtf16(text), fontSize ); }
+	//! measures a UTF-8 string without converting it, so it does not allocate memory.
+	//! Ligatures are substituted like Text does when rendering, so the result matches what is drawn.
+	ci::Rectf	measure( const std::string &text, float fontSize=12.0f, bool kerning=true, bool ligatures=true ) const;
 	//!
-	ci::Rectf	measure( const std::u16string &text, float fontSize=12.0f ) const;
+	ci::Rectf	measure( const std::u16string &text, float fontSize=12.0f, bool kerning=true, bool ligatures=true ) const;
 
 	//!
-	float		measureWidth( const std::string &text, float fontSize=12.0f, bool precise=true ) const { return measureWidth( ci::toUtf16(text), fontSize, precise ); }
+	//! measures a UTF-8 string without converting it, so it does not allocate memory
+	float		measureWidth( const std::string &text, float fontSize=12.0f, bool precise=true, bool kerning=true, bool ligatures=true ) const;
 	//!
-	float		measureWidth( const std::u16string &text, float fontSize = 12.0f, bool precise = true ) const;
+	float		measureWidth( const std::u16string &text, float fontSize = 12.0f, bool precise = true, bool kerning = true, bool ligatures = true ) const;
 
+protected:
+	//! reads a version 3 (or later) font from memory, returns FALSE if the data is of an older version.
+	//! If 'mapping' is specified, the uncompressed atlas is used in place.
+	bool		readVersion3( const uint8_t *data, size_t size, const MappedFileRef &mapping );
+
+	//! removes all metrics
+	void		clearMetrics();
+	//! updates the lookup table for the ASCII range and the default ligatures, call after adding metrics
+	void		indexMetrics();
+
+	//! returns the metrics of a character, or NULL if the font does not contain it
+	const Metrics*	findMetrics( uint16_t charcode ) const
+	{
+		if( charcode < 128 ) return mAscii[charcode];
+
+		MetricsData::const_iterator itr = mMetrics.find(charcode);
+		return ( itr != mMetrics.end() ) ? &(itr->second) : 0;
+	}
+
+	//! returns the kerning between two characters, in pixels of the atlas
+	float		findKerning( uint16_t left, uint16_t right ) const { const float *amount = mKerning.find( left, right ); return amount ? *amount : 0.0f; }
+
+	//! calls 'visit' with the character code and metrics of every character of a UTF-8 string that is part of the font,
+	//! after replacing pairs of characters by their ligature if 'ligatures' is TRUE. Characters without metrics, like tabs, are skipped.
+	template<typename Visitor>
+	void		forEachMetrics( const std::string &text, bool ligatures, Visitor visit ) const;
+	//! same for a UTF-16 string
+	template<typename Visitor>
+	void		forEachMetrics( const std::u16string &text, bool ligatures, Visitor visit ) const;
+
+	//! creates the mip-mapped texture from the atlas. Call from the main thread.
+	void		uploadTexture();
+	//! takes over the contents of another font
+	void		adopt( Font &font );
+
+	//! doubles the height of the dynamic atlas, returns FALSE if it can not grow any further
+	bool		growAtlas();
+	//!
+	void		createAtlasTexture();
 protected:
 	bool				mInvalid;
 
@@ -129,6 +211,24 @@ protected:
 	ci::Vec2f			mTextureSize;
 
 	MetricsData			mMetrics;
+	//! direct lookup of the ASCII range, points into 'mMetrics' (NULL if not available)
+	const Metrics*		mAscii[128];
+
+	KerningTable		mKerning;
+	LigatureTable		mLigatures;
+
+	//! dynamic atlas
+	uint32_t							mRevision;
+	std::shared_ptr<GlyphGenerator>		mGenerator;
+	SkylinePacker						mPacker;
+	ci::Channel8u						mAtlas;
+	//! keeps the memory mapped file alive while the atlas refers to it
+	MappedFileRef						mMapping;
+	mutable std::unordered_set<uint16_t>	mRequested;
+
+	//! font loaded on another thread, applied by 'update()'
+	boost::mutex						mResolveMutex;
+	FontRef								mResolved;
 };
 
 class FontExc : public std::exception {
@@ -20,23 +20,43 @@
  POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include "cinder/Thread.h"
 #include "cinder/Utilities.h"
 #include "cinder/app/AppBasic.h"
 #include "text/FontStore.h"
 
+#include <algorithm>
+
 namespace ph { namespace text {
 
 using namespace ci;
 
+FontStore::~FontStore()
+{
+	// stop loader threads and wait for them to finish
+	FontStoreThreadPool::const_iterator itr;
+	for(itr=mThreads.begin();itr!=mThreads.end();++itr) {
+		(*itr)->interrupt();
+		(*itr)->join();
+	}
+
+	mThreads.clear();
+}
+
 bool	FontStore::hasFont( const std::string &family )
 {
+	boost::shared_lock<boost::shared_mutex> lock(mMutex);
+
 	return (mFonts.find(family) != mFonts.end());
 }
 
 FontRef	FontStore::getFont( const std::string &family )
 {
-	if( hasFont(family) )
-		return mFonts.at(family);
+	boost::shared_lock<boost::shared_mutex> lock(mMutex);
+
+	FontList::const_iterator itr = mFonts.find(family);
+	if( itr != mFonts.end() )
+		return itr->second;
 
 	// return empty font on error
 	return FontRef();
@@ -46,9 +66,17 @@ bool	FontStore::addFont( FontRef font )
 {
 	if(!font) return false;
 
+	return addFont( font->getFamily(), font );
+}
+
+bool	FontStore::addFont( const std::string &family, FontRef font )
+{
+	if(!font) return false;
+
+	boost::unique_lock<boost::shared_mutex> lock(mMutex);
+
 	// check if font family is already known
-	std::string family = font->getFamily();
-	if( ! hasFont( family ) ) {
+	if( mFonts.find(family) == mFonts.end() ) {
 		mFonts[family] = font;
 		return true;
 	}
@@ -56,8 +84,20 @@ bool	FontStore::addFont( FontRef font )
 	return false;
 }
 
+void	FontStore::removeFont( const std::string &family, FontRef font )
+{
+	boost::unique_lock<boost::shared_mutex> lock(mMutex);
+
+	// another font may have been added under the same name
+	FontList::iterator itr = mFonts.find(family);
+	if( itr != mFonts.end() && itr->second == font )
+		mFonts.erase(itr);
+}
+
 std::vector<std::string> FontStore::listFonts()
 {
+	boost::shared_lock<boost::shared_mutex> lock(mMutex);
+
 	std::vector<std::string> keys;
 
 	FontList::const_iterator itr;
@@ -86,4 +126,117 @@ FontRef	FontStore::loadFont( DataSourceRef source )
 	return FontRef();
 }
 
+void FontStore::preload( const std::vector<DataSourceRef> &sources )
+{
+	if( sources.empty() ) return;
+
+	// join the threads of previous calls that have finished, so they do not accumulate
+	FontStoreThreadPool::iterator thread = mThreads.begin();
+	while( thread != mThreads.end() ) {
+		if( (*thread)->try_join_for( boost::chrono::milliseconds(0) ) )
+			thread = mThreads.erase(thread);
+		else ++thread;
+	}
+
+	size_t pending;
+	{
+		boost::mutex::scoped_lock lock(mQueueMutex);
+
+		std::vector<DataSourceRef>::const_iterator itr;
+		for(itr=sources.begin();itr!=sources.end();++itr) {
+			// hand out a placeholder under the file name, so the font can be used right away
+			FontRef placeholder;
+			if( !(*itr)->getFilePath().empty() ) {
+				placeholder = FontRef( new Font() );
+				if( !addFont( (*itr)->getFilePath().stem().string(), placeholder ) )
+					continue;
+			}
+
+			mQueue.push_back( std::make_pair( *itr, placeholder ) );
+			mPending++;
+		}
+
+		pending = mPending;
+	}
+
+	// run a worker thread for each CPU, but not more than there are fonts. Threads that are still running 
+	// also take fonts from the queue.
+	size_t numThreads = std::min<size_t>( std::max( 1u, boost::thread::hardware_concurrency() ), pending );
+	for(size_t i=mThreads.size();i<numThreads;++i)
+		mThreads.push_back( boost::shared_ptr<boost::thread>(new boost::thread(&FontStore::threadLoad, this)) );
+}
+
+bool FontStore::isLoading()
+{
+	boost::mutex::scoped_lock lock(mQueueMutex);
+
+	return mPending > 0;
+}
+
+void FontStore::wait()
+{
+	FontStoreThreadPool::const_iterator itr;
+	for(itr=mThreads.begin();itr!=mThreads.end();++itr)
+		(*itr)->join();
+
+	mThreads.clear();
+}
+
+FontErrorList FontStore::getErrors()
+{
+	boost::mutex::scoped_lock lock(mQueueMutex);
+
+	return mErrors;
+}
+
+void FontStore::threadLoad()
+{
+	// required when using Cinder (e.g. image decoding) from a secondary thread
+	ci::ThreadSetup threadSetup;
+
+	while(true) {
+		// check if thread was interrupted
+		try { boost::this_thread::interruption_point(); }
+		catch(boost::thread_interrupted) { break; }
+
+		std::pair<DataSourceRef, FontRef> item;
+		{
+			boost::mutex::scoped_lock lock(mQueueMutex);
+			if( mQueue.empty() ) break;
+
+			item = mQueue.front();
+			mQueue.pop_front();
+		}
+
+		try {
+			// parse the font, its texture will be created on the main thread
+			FontRef font = FontRef( new Font() );
+			font->parse( item.first );
+
+			if( item.second ) {
+				// also make the font available under its family name
+				addFont( font->getFamily(), item.second );
+				item.second->resolve( font );
+			}
+			else addFont( font );
+		}
+		catch( const std::exception &e ) {
+			const std::string name = item.first->getFilePath().empty() ? "(unnamed)" : item.first->getFilePath().stem().string();
+			app::console() << "Error loading font " << name << ": " << e.what() << std::endl;
+
+			// the placeholder will never be resolved, so stop handing it out
+			if( item.second )
+				removeFont( name, item.second );
+
+			boost::mutex::scoped_lock lock(mQueueMutex);
+			mErrors[name] = e.what();
+		}
+
+		{
+			boost::mutex::scoped_lock lock(mQueueMutex);
+			mPending--;
+		}
+	}
+}
+
 } } // namespace ph::text
\ No newline at end of file
@@ -24,17 +24,25 @@
 
 #include "text/Font.h"
 
+#include <boost/thread.hpp>
+
+#include <deque>
 #include <map>
 
 namespace ph { namespace text {
 
 typedef std::map<std::string, FontRef>	FontList;
+//! maps the name of a font that could not be loaded to the reason
+typedef std::map<std::string, std::string>	FontErrorList;
+
+typedef std::vector< boost::shared_ptr<boost::thread> > FontStoreThreadPool;
 
+//! Thread-safe font registry. Lookups take a shared lock, so many threads can query fonts at the same time.
 class FontStore
 {
 private:
-	FontStore() {};
-	~FontStore() {};
+	FontStore() : mPending(0) {};
+	~FontStore();
 public:
 	// singleton implementation
 	static FontStore& getInstance() { 
@@ -43,6 +51,8 @@ public:
 	};
 
 	bool		hasFont( const std::string &family );
+	//! returns the font, or an empty reference if the family is unknown. Fonts that are still
+	//! being preloaded are returned as a placeholder, which becomes valid once loading has finished.
 	FontRef		getFont( const std::string &family );
 
 	//!
@@ -53,11 +63,43 @@ public:
 
 	//! loads an SDFF file
 	FontRef		loadFont( ci::DataSourceRef source );
+
+	//! parses SDFF files in parallel on worker threads and returns immediately. Until a font has
+	//! been loaded, it is available as a placeholder under its file name (e.g. "Ubuntu-BoldItalic").
+	//! Textures are created on the main thread when the font is first used.
+	void		preload( const std::vector<ci::DataSourceRef> &sources );
+	//! returns TRUE while fonts are being preloaded
+	bool		isLoading();
+	//! blocks until all preloaded fonts have been parsed
+	void		wait();
+	//! returns the preloaded fonts that failed to load. Their placeholders are removed from the store 
+	//! and will never become valid.
+	FontErrorList	getErrors();
+protected:
+	//! adds the font under the specified name, unless a font with that name already exists
+	bool		addFont( const std::string &family, FontRef font );
+
+	//! removes the font with the specified name, if it still is the specified font
+	void		removeFont( const std::string &family, FontRef font );
+
+	//! parses fonts from the queue until it is empty
+	void		threadLoad();
 protected:
-	FontList	mFonts;
+	FontList				mFonts;
+	boost::shared_mutex		mMutex;
+
+	//! fonts waiting to be preloaded and the placeholder they should resolve
+	std::deque< std::pair<ci::DataSourceRef, FontRef> >	mQueue;
+	size_t					mPending;
+	//! fonts that could not be preloaded, guarded by the queue mutex
+	FontErrorList			mErrors;
+	boost::mutex			mQueueMutex;
+
+	//! worker threads, they finish as soon as the queue is empty and are joined by the next preload()
+	FontStoreThreadPool		mThreads;
 };
 
 // helper function(s) for easier access 
 inline FontStore&	fonts() { return FontStore::getInstance(); };
 
-} } // namespace ph::text
\ No newline at end of file
+} } // namespace ph::text
@@ -0,0 +1,171 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "text/GlyphGenerator.h"
+#include "text/DistanceField.h"
+
+namespace ph { namespace text {
+
+using namespace ci;
+using namespace std;
+
+GlyphGenerator::GlyphGenerator( float glyphSize, float spread )
+	: mGlyphSize(glyphSize), mSpread(spread)
+{
+}
+
+GlyphGenerator::~GlyphGenerator(void)
+{
+	stop();
+}
+
+void GlyphGenerator::start( unsigned int numThreads )
+{
+	stop();
+
+	// create worker thread for each CPU
+	if( numThreads == 0 )
+		numThreads = math<unsigned int>::max( boost::thread::hardware_concurrency(), 1 );
+
+	for(unsigned int i=0;i<numThreads;++i)
+		mThreads.push_back( boost::shared_ptr<boost::thread>(new boost::thread(&GlyphGenerator::threadGenerate, this)) );
+}
+
+void GlyphGenerator::stop()
+{
+	// stop worker threads and wait for them to finish
+	GlyphGeneratorThreadPool::const_iterator itr;
+	for(itr=mThreads.begin();itr!=mThreads.end();++itr) {
+		(*itr)->interrupt();
+		(*itr)->join();
+	}
+
+	mThreads.clear();
+}
+
+void GlyphGenerator::request( uint16_t charcode )
+{
+	boost::mutex::scoped_lock lock(mRequestMutex);
+	mRequests.push_back( charcode );
+	lock.unlock();
+
+	mRequestCondition.notify_one();
+}
+
+bool GlyphGenerator::tryPop( Glyph *glyph )
+{
+	boost::mutex::scoped_lock lock(mResultMutex);
+	if( mResults.empty() ) return false;
+
+	*glyph = mResults.front();
+	mResults.pop_front();
+
+	return true;
+}
+
+GlyphGenerator::Glyph GlyphGenerator::generate( uint16_t charcode ) const
+{
+	Glyph glyph;
+	glyph.charcode = charcode;
+
+	uint32_t index = mTrueType.getGlyphIndex( charcode );
+	if( index == 0 ) return glyph;
+
+	TrueType::Contours contours;
+	if( !mTrueType.getContours( index, &contours ) ) return glyph;
+
+	const float scale = getScale();
+
+	glyph.valid = true;
+	glyph.d = mTrueType.getAdvance( index ) * scale;
+
+	if( contours.empty() ) return glyph;
+
+	// determine the bounds of the outline in pixels, with room for the distance field around it
+	Vec2f lower = contours[0][0], upper = contours[0][0];
+
+	TrueType::Contours::const_iterator citr;
+	for(citr=contours.begin();citr!=contours.end();++citr) {
+		TrueType::Contour::const_iterator pitr;
+		for(pitr=citr->begin();pitr!=citr->end();++pitr) {
+			lower.x = math<float>::min( lower.x, pitr->x ); lower.y = math<float>::min( lower.y, pitr->y );
+			upper.x = math<float>::max( upper.x, pitr->x ); upper.y = math<float>::max( upper.y, pitr->y );
+		}
+	}
+
+	const int padding = (int) math<float>::ceil( mSpread );
+	const int left = (int) math<float>::floor( lower.x * scale ) - padding;
+	const int right = (int) math<float>::ceil( upper.x * scale ) + padding;
+	const int top = (int) math<float>::ceil( upper.y * scale ) + padding;
+	const int bottom = (int) math<float>::floor( lower.y * scale ) - padding;
+
+	const int width = right - left;
+	const int height = top - bottom;
+
+	// rasterize at a higher resolution and reduce while computing the distance field
+	const int s = kSupersampling;
+
+	std::vector<uint8_t> mask, field;
+	DistanceField::rasterize( contours, Vec2f( scale * s, -scale * s ), Vec2f( float(-left * s), float(top * s) ), 
+		width * s, height * s, &mask );
+	DistanceField::create( mask, width * s, height * s, mSpread * s, s, &field );
+
+	glyph.field = Channel8u( width, height );
+	for(int y=0;y<height;++y)
+		std::copy( &field[size_t(y) * width], &field[size_t(y) * width] + width, glyph.field.getData( Vec2i(0, y) ) );
+
+	glyph.w = float(width);
+	glyph.h = float(height);
+	glyph.dx = float(left);
+	glyph.dy = float(top);
+
+	return glyph;
+}
+
+void GlyphGenerator::threadGenerate()
+{
+	uint16_t charcode;
+
+	// run until interrupted
+	while(true) {
+		{
+			boost::mutex::scoped_lock lock(mRequestMutex);
+			while( mRequests.empty() )
+				mRequestCondition.wait(lock);
+
+			charcode = mRequests.front();
+			mRequests.pop_front();
+		}
+
+		Glyph glyph = generate( charcode );
+
+		// check if thread was interrupted
+		try { boost::this_thread::interruption_point(); }
+		catch(boost::thread_interrupted) { break; }
+
+		// hand over to main thread
+		boost::mutex::scoped_lock lock(mResultMutex);
+		mResults.push_back( glyph );
+	}
+}
+
+} } // namespace ph::text
@@ -0,0 +1,96 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Channel.h"
+#include "text/TrueType.h"
+
+#include <boost/thread.hpp>
+
+#include <deque>
+
+namespace ph { namespace text {
+
+typedef std::vector< boost::shared_ptr<boost::thread> > GlyphGeneratorThreadPool;
+
+//! Renders signed distance field glyphs from a TrueType font on worker threads.
+class GlyphGenerator
+{
+public:
+	struct Glyph {
+		Glyph() : charcode(0), valid(false), w(0.0f), h(0.0f), dx(0.0f), dy(0.0f), d(0.0f) {}
+
+		uint16_t		charcode;
+		//! FALSE if the font does not contain the character
+		bool			valid;
+		//! metrics in pixels, like Font::Metrics
+		float			w, h, dx, dy, d;
+		//! the signed distance field, empty for characters without outline
+		ci::Channel8u	field;
+	};
+public:
+	//! 'glyphSize' is the em size in pixels, 'spread' the maximum distance in pixels encoded in the field
+	GlyphGenerator( float glyphSize = 32.0f, float spread = 4.0f );
+	~GlyphGenerator(void);
+
+	//! parses the TrueType font, returns FALSE on error
+	bool	load( const void *data, size_t size ) { return mTrueType.load( data, size ); }
+	//! starts the worker threads
+	void	start( unsigned int numThreads = 0 );
+	//! stops the worker threads and waits for them to finish
+	void	stop();
+
+	//!
+	const TrueType&	getTrueType() const { return mTrueType; }
+	//! returns the number of pixels per font unit
+	float	getScale() const { return mGlyphSize / mTrueType.getUnitsPerEm(); }
+
+	//! schedules a character for rendering on one of the worker threads
+	void	request( uint16_t charcode );
+	//! returns a rendered glyph if available
+	bool	tryPop( Glyph *glyph );
+
+	//! renders a glyph on the calling thread
+	Glyph	generate( uint16_t charcode ) const;
+private:
+	void	threadGenerate();
+private:
+	//! supersampling factor used when rasterizing the outlines
+	static const int		kSupersampling = 4;
+
+	TrueType				mTrueType;
+	float					mGlyphSize;
+	float					mSpread;
+
+	GlyphGeneratorThreadPool	mThreads;
+
+	std::deque<uint16_t>		mRequests;
+	boost::mutex				mRequestMutex;
+	boost::condition_variable	mRequestCondition;
+
+	std::deque<Glyph>			mResults;
+	boost::mutex				mResultMutex;
+};
+
+} } // namespace ph::text
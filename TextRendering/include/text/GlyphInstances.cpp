@@ -0,0 +1,130 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "text/GlyphInstances.h"
+
+#include <limits>
+
+namespace ph { namespace text {
+
+using namespace ci;
+using namespace std;
+
+void GlyphInstanceBuilder::clear()
+{
+	mInstances.clear();
+	mBatches.clear();
+	mLabels.clear();
+
+	mLabel = 0;
+	mBounds = Rectf(0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+void GlyphInstanceBuilder::addLabel( const Vec3f &anchor )
+{
+	mLabel = mLabels.size();
+	mLabels.push_back( anchor );
+}
+
+void GlyphInstanceBuilder::addGlyph( const Rectf &bounds, const Rectf &texcoords )
+{
+	// start a new batch if the glyph can not be represented relative to the current one
+	if( mBatches.empty()
+		|| ! fits( bounds.x1, mBatches.back().origin.x )
+		|| ! fits( bounds.y1, mBatches.back().origin.y )
+		|| mLabel - mBatches.back().labelBase > numeric_limits<uint16_t>::max() )
+		addBatch( Vec2f( math<float>::floor( bounds.x1 ), math<float>::floor( bounds.y1 ) ) );
+
+	GlyphInstanceBatch &batch = mBatches.back();
+
+	GlyphInstance g;
+	g.x = toFixed( bounds.x1 - batch.origin.x );
+	g.y = toFixed( bounds.y1 - batch.origin.y );
+	g.w = toUnsignedFixed( bounds.getWidth() );
+	g.h = toUnsignedFixed( bounds.getHeight() );
+	g.s1 = toNormalized( texcoords.x1 );
+	g.t1 = toNormalized( texcoords.y1 );
+	g.s2 = toNormalized( texcoords.x2 );
+	g.t2 = toNormalized( texcoords.y2 );
+	g.label = (uint16_t) ( mLabel - batch.labelBase );
+	g.reserved = 0;
+
+	mInstances.push_back( g );
+	batch.count++;
+
+	// keep track of the bounds, so we don't have to unpack the glyphs later
+	if( mInstances.size() == 1 )
+		mBounds = bounds;
+	else
+		mBounds.include( bounds );
+}
+
+size_t GlyphInstanceBuilder::getByteSize() const
+{
+	return mInstances.size() * sizeof(GlyphInstance) + mLabels.size() * sizeof(Vec3f);
+}
+
+size_t GlyphInstanceBuilder::getUnpackedByteSize( size_t glyphs, bool labels )
+{
+	// 4 positions, 4 texture coordinates and 6 indices per glyph, plus 4 label offsets if applicable
+	size_t bytes = 4 * sizeof(Vec3f) + 4 * sizeof(Vec2f) + 6 * sizeof(uint32_t);
+	if( labels ) bytes += 4 * sizeof(Vec3f);
+
+	return glyphs * bytes;
+}
+
+void GlyphInstanceBuilder::addBatch( const Vec2f &origin )
+{
+	GlyphInstanceBatch batch;
+	batch.origin = origin;
+	batch.first = mInstances.size();
+	batch.count = 0;
+	batch.labelBase = mLabel;
+
+	mBatches.push_back( batch );
+}
+
+bool GlyphInstanceBuilder::fits( float value, float origin )
+{
+	float fixed = (value - origin) * float(1 << kFractionalBits);
+	return fixed >= float( numeric_limits<int16_t>::min() ) && fixed <= float( numeric_limits<int16_t>::max() );
+}
+
+int16_t GlyphInstanceBuilder::toFixed( float value )
+{
+	float fixed = math<float>::floor( value * float(1 << kFractionalBits) + 0.5f );
+	return (int16_t) math<float>::clamp( fixed, numeric_limits<int16_t>::min(), numeric_limits<int16_t>::max() );
+}
+
+uint16_t GlyphInstanceBuilder::toUnsignedFixed( float value )
+{
+	float fixed = math<float>::floor( value * float(1 << kFractionalBits) + 0.5f );
+	return (uint16_t) math<float>::clamp( fixed, 0.0f, numeric_limits<uint16_t>::max() );
+}
+
+uint16_t GlyphInstanceBuilder::toNormalized( float value )
+{
+	float fixed = math<float>::floor( value * numeric_limits<uint16_t>::max() + 0.5f );
+	return (uint16_t) math<float>::clamp( fixed, 0.0f, numeric_limits<uint16_t>::max() );
+}
+
+} } // namespace ph::text
@@ -0,0 +1,121 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Rect.h"
+#include "cinder/Vector.h"
+#include "text/GlyphSink.h"
+
+#include <vector>
+
+namespace ph { namespace text {
+
+// compact glyph record, expanded to a quad by the vertex shader (20 bytes per glyph)
+#pragma pack(push, 1)
+struct GlyphInstance {
+	int16_t		x, y;		// upper left corner, fixed point relative to the batch origin
+	uint16_t	w, h;		// size of the quad, fixed point
+	uint16_t	s1, t1;		// upper left texture coordinate, normalized to [0, 65535]
+	uint16_t	s2, t2;		// lower right texture coordinate, normalized to [0, 65535]
+	uint16_t	label;		// label index relative to the batch label base
+	uint16_t	reserved;
+};
+#pragma pack(pop)
+
+// a range of instances sharing the same origin and label base
+struct GlyphInstanceBatch {
+	ci::Vec2f	origin;
+	size_t		first;
+	size_t		count;
+	size_t		labelBase;
+};
+
+//! Builds packed glyph instances on the CPU. Does not require an OpenGL context.
+class GlyphInstanceBuilder
+	: public GlyphSink
+{
+public:
+	//! number of fractional bits used for positions and sizes (1/8th of a pixel)
+	static const int	kFractionalBits = 3;
+public:
+	GlyphInstanceBuilder(void) : mLabel(0) { clear(); }
+	virtual ~GlyphInstanceBuilder(void) {}
+
+	//! removes all glyphs and labels
+	virtual void	clear();
+	//! reserves memory for the specified number of glyphs
+	virtual void	reserve( size_t glyphs ) { mInstances.reserve( glyphs ); }
+
+	//! adds a label anchor, subsequent glyphs will be attached to it
+	virtual void	addLabel( const ci::Vec3f &anchor );
+	//! adds a glyph quad (in pixels) and its normalized texture coordinates
+	virtual void	addGlyph( const ci::Rectf &bounds, const ci::Rectf &texcoords );
+
+	//!
+	bool	empty() const { return mInstances.empty(); }
+	//!
+	size_t	getNumGlyphs() const { return mInstances.size(); }
+	//!
+	size_t	getNumLabels() const { return mLabels.size(); }
+
+	//!
+	const std::vector<GlyphInstance>&		getInstances() const { return mInstances; }
+	//!
+	const std::vector<GlyphInstanceBatch>&	getBatches() const { return mBatches; }
+	//!
+	const std::vector<ci::Vec3f>&			getLabels() const { return mLabels; }
+
+	//! returns the factor that converts fixed point positions to pixels
+	static float	getPositionScale() { return 1.0f / float(1 << kFractionalBits); }
+
+	//! returns the bounds of all glyphs, in pixels
+	ci::Rectf	getBounds() const { return mBounds; }
+
+	//! returns the number of bytes uploaded to the GPU for the packed format
+	size_t			getByteSize() const;
+	//! returns the number of bytes the unpacked (float) format needs for the same glyphs
+	size_t			getUnpackedByteSize() const { return getUnpackedByteSize( mInstances.size(), ! mLabels.empty() ); }
+	//! returns the number of bytes the unpacked (float) format needs for the specified number of glyphs
+	static size_t	getUnpackedByteSize( size_t glyphs, bool labels );
+private:
+	//! starts a new batch at the specified origin
+	void	addBatch( const ci::Vec2f &origin );
+	//! returns TRUE if the coordinate can be stored relative to the origin
+	static bool	fits( float value, float origin );
+	//!
+	static int16_t	toFixed( float value );
+	//!
+	static uint16_t	toUnsignedFixed( float value );
+	//!
+	static uint16_t	toNormalized( float value );
+private:
+	std::vector<GlyphInstance>		mInstances;
+	std::vector<GlyphInstanceBatch>	mBatches;
+	std::vector<ci::Vec3f>			mLabels;
+
+	size_t							mLabel;
+	ci::Rectf						mBounds;
+};
+
+} } // namespace ph::text
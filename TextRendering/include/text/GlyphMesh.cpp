@@ -0,0 +1,79 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "text/GlyphMesh.h"
+
+namespace ph { namespace text {
+
+using namespace ci;
+using namespace std;
+
+void GlyphMeshBuilder::clear()
+{
+	mVertices.clear();
+	mTexcoords.clear();
+	mIndices.clear();
+	mOffsets.clear();
+	mLabelIndices.clear();
+
+	mNumLabels = 0;
+	mLabel = Vec3f::zero();
+	mBounds = Rectf(0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+void GlyphMeshBuilder::reserve( size_t glyphs )
+{
+	mVertices.reserve( 4 * glyphs );
+	mTexcoords.reserve( 4 * glyphs );
+	mIndices.reserve( 6 * glyphs );
+}
+
+void GlyphMeshBuilder::addGlyph( const Rectf &bounds, const Rectf &texcoords )
+{
+	uint32_t index = (uint32_t) mVertices.size();
+
+	mVertices.push_back( Vec3f(bounds.getUpperLeft()) );
+	mVertices.push_back( Vec3f(bounds.getUpperRight()) );
+	mVertices.push_back( Vec3f(bounds.getLowerRight()) );
+	mVertices.push_back( Vec3f(bounds.getLowerLeft()) );
+
+	mTexcoords.push_back( texcoords.getUpperLeft() );
+	mTexcoords.push_back( texcoords.getUpperRight() );
+	mTexcoords.push_back( texcoords.getLowerRight() );
+	mTexcoords.push_back( texcoords.getLowerLeft() );
+
+	mIndices.push_back(index+0); mIndices.push_back(index+3); mIndices.push_back(index+1);
+	mIndices.push_back(index+1); mIndices.push_back(index+3); mIndices.push_back(index+2);
+
+	if( mNumLabels > 0 ) {
+		mOffsets.insert( mOffsets.end(), 4, mLabel );
+		mLabelIndices.insert( mLabelIndices.end(), 4, Vec2f( float(mNumLabels - 1), 0.0f ) );
+	}
+
+	// keep track of the bounds, so we don't have to iterate the vertices later
+	if( index == 0 )
+		mBounds = bounds;
+	else
+		mBounds.include( bounds );
+}
+
+} } // namespace ph::text
@@ -0,0 +1,79 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "text/GlyphSink.h"
+
+#include <vector>
+
+namespace ph { namespace text {
+
+//! Builds an indexed triangle list with 4 vertices per glyph on the CPU. Does not require an OpenGL context.
+class GlyphMeshBuilder
+	: public GlyphSink
+{
+public:
+	GlyphMeshBuilder(void) { clear(); }
+	virtual ~GlyphMeshBuilder(void) {}
+
+	//! removes all glyphs and labels
+	virtual void	clear();
+	//! reserves memory for the specified number of glyphs
+	virtual void	reserve( size_t glyphs );
+
+	//! adds a label anchor, subsequent glyphs store it as their offset
+	virtual void	addLabel( const ci::Vec3f &anchor ) { mLabel = anchor; mNumLabels++; }
+	//! adds a glyph quad (in pixels) and its normalized texture coordinates
+	virtual void	addGlyph( const ci::Rectf &bounds, const ci::Rectf &texcoords );
+
+	//!
+	bool	empty() const { return mIndices.empty(); }
+	//!
+	size_t	getNumGlyphs() const { return mVertices.size() / 4; }
+
+	//!
+	const std::vector<ci::Vec3f>&	getVertices() const { return mVertices; }
+	//!
+	const std::vector<ci::Vec2f>&	getTexCoords() const { return mTexcoords; }
+	//!
+	const std::vector<uint32_t>&	getIndices() const { return mIndices; }
+	//! label anchor of each vertex, empty if no labels were added
+	const std::vector<ci::Vec3f>&	getOffsets() const { return mOffsets; }
+	//! label index of each vertex (stored in x), empty if no labels were added
+	const std::vector<ci::Vec2f>&	getLabelIndices() const { return mLabelIndices; }
+
+	//! returns the bounds of all glyphs, in pixels
+	ci::Rectf	getBounds() const { return mBounds; }
+private:
+	std::vector<ci::Vec3f>	mVertices;
+	std::vector<ci::Vec2f>	mTexcoords;
+	std::vector<uint32_t>	mIndices;
+	std::vector<ci::Vec3f>	mOffsets;
+	std::vector<ci::Vec2f>	mLabelIndices;
+
+	size_t					mNumLabels;
+	ci::Vec3f				mLabel;
+	ci::Rectf				mBounds;
+};
+
+} } // namespace ph::text
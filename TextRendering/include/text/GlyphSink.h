@@ -0,0 +1,59 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Rect.h"
+#include "cinder/Vector.h"
+
+namespace ph { namespace text {
+
+// describes a single line of laid out text
+struct TextLine {
+	size_t		first;		// index of the first character in the text
+	size_t		length;		// number of characters, including trimmed white space
+	ci::Vec2f	origin;		// position of the baseline at the start of the line, after alignment
+	float		width;		// measured width of the line
+};
+
+//! Receives the output of the text layout. Implementations turn the glyphs into geometry for the GPU,
+//! or simply collect them, so layout can run without an OpenGL context.
+class GlyphSink
+{
+public:
+	virtual ~GlyphSink(void) {}
+
+	//! removes all glyphs
+	virtual void	clear() = 0;
+	//! hint for the number of glyphs that will follow
+	virtual void	reserve( size_t glyphs ) {}
+
+	//! adds a label anchor, subsequent glyphs will be attached to it
+	virtual void	addLabel( const ci::Vec3f &anchor ) {}
+	//! adds a glyph quad (in pixels) and its normalized texture coordinates
+	virtual void	addGlyph( const ci::Rectf &bounds, const ci::Rectf &texcoords ) = 0;
+	//! called after the glyphs of each line have been added
+	virtual void	addLine( const TextLine &line ) {}
+};
+
+} } // namespace ph::text
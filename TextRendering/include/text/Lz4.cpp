@@ -0,0 +1,162 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "text/Lz4.h"
+
+#include <cstring>
+
+namespace ph { namespace text {
+
+using namespace std;
+
+// format constraints: the last 5 bytes are always literals, and the last match starts at least 12 bytes before the end
+static const size_t		kMinMatch = 4;
+static const size_t		kLastLiterals = 5;
+static const size_t		kMatchLimit = 12;
+static const int		kHashBits = 12;
+
+static inline uint32_t read32( const uint8_t *p )
+{
+	uint32_t value;
+	std::memcpy( &value, p, sizeof(value) );
+	return value;
+}
+
+static inline void writeLength( size_t length, std::vector<uint8_t> *out )
+{
+	for(;length>=255;length-=255) out->push_back( 255 );
+	out->push_back( (uint8_t) length );
+}
+
+static void writeSequence( const uint8_t *literals, size_t numLiterals, size_t offset, size_t matchLength, std::vector<uint8_t> *out )
+{
+	// token: literal length in the high bits, match length in the low bits
+	uint8_t token = (uint8_t) ( (numLiterals < 15 ? numLiterals : 15) << 4 );
+	if( matchLength > 0 ) {
+		size_t m = matchLength - kMinMatch;
+		token |= (uint8_t) ( m < 15 ? m : 15 );
+	}
+	out->push_back( token );
+
+	if( numLiterals >= 15 ) writeLength( numLiterals - 15, out );
+	out->insert( out->end(), literals, literals + numLiterals );
+
+	// the last sequence only contains literals
+	if( matchLength == 0 ) return;
+
+	out->push_back( (uint8_t) (offset & 0xFF) );
+	out->push_back( (uint8_t) (offset >> 8) );
+
+	if( matchLength - kMinMatch >= 15 ) writeLength( matchLength - kMinMatch - 15, out );
+}
+
+void Lz4::compress( const uint8_t *data, size_t size, std::vector<uint8_t> *compressed )
+{
+	compressed->clear();
+	compressed->reserve( size + size / 255 + 16 );
+
+	std::vector<size_t> table( 1 << kHashBits, size );
+
+	size_t anchor = 0;
+	size_t ip = 0;
+
+	if( size >= kMatchLimit ) {
+		const size_t limit = size - kMatchLimit;
+		const size_t matchEnd = size - kLastLiterals;
+
+		while( ip <= limit ) {
+			uint32_t sequence = read32( data + ip );
+			uint32_t hash = (sequence * 2654435761u) >> (32 - kHashBits);
+
+			size_t ref = table[hash];
+			table[hash] = ip;
+
+			if( ref < ip && ip - ref <= 0xFFFF && read32( data + ref ) == sequence ) {
+				size_t length = kMinMatch;
+				while( ip + length < matchEnd && data[ref + length] == data[ip + length] ) ++length;
+
+				writeSequence( data + anchor, ip - anchor, ip - ref, length, compressed );
+
+				ip += length;
+				anchor = ip;
+			}
+			else ++ip;
+		}
+	}
+
+	writeSequence( data + anchor, size - anchor, 0, 0, compressed );
+}
+
+bool Lz4::decompress( const uint8_t *compressed, size_t compressedSize, uint8_t *data, size_t size )
+{
+	size_t sp = 0;
+	size_t dp = 0;
+
+	while( sp < compressedSize ) {
+		uint8_t token = compressed[sp++];
+
+		// copy literals
+		size_t numLiterals = token >> 4;
+		if( numLiterals == 15 ) {
+			uint8_t b;
+			do {
+				if( sp >= compressedSize ) return false;
+				b = compressed[sp++];
+				numLiterals += b;
+			} while( b == 255 );
+		}
+
+		if( sp + numLiterals > compressedSize || dp + numLiterals > size ) return false;
+		std::memcpy( data + dp, compressed + sp, numLiterals );
+		sp += numLiterals;
+		dp += numLiterals;
+
+		// the last sequence has no match
+		if( sp >= compressedSize ) break;
+
+		// copy match, which may overlap the output
+		if( sp + 2 > compressedSize ) return false;
+		size_t offset = compressed[sp] | (size_t(compressed[sp+1]) << 8);
+		sp += 2;
+
+		if( offset == 0 || offset > dp ) return false;
+
+		size_t length = token & 0x0F;
+		if( length == 15 ) {
+			uint8_t b;
+			do {
+				if( sp >= compressedSize ) return false;
+				b = compressed[sp++];
+				length += b;
+			} while( b == 255 );
+		}
+		length += kMinMatch;
+
+		if( dp + length > size ) return false;
+		for(size_t i=0;i<length;++i,++dp)
+			data[dp] = data[dp - offset];
+	}
+
+	return dp == size;
+}
+
+} } // namespace ph::text
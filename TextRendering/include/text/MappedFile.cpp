@@ -0,0 +1,103 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "text/MappedFile.h"
+
+#if defined(CINDER_MSW)
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace ph { namespace text {
+
+#if defined(CINDER_MSW)
+
+MappedFile::MappedFile(void)
+	: mFile(INVALID_HANDLE_VALUE), mMapping(NULL), mData(NULL), mSize(0)
+{
+}
+
+MappedFile::~MappedFile(void)
+{
+	if( mData ) UnmapViewOfFile( mData );
+	if( mMapping ) CloseHandle( mMapping );
+	if( mFile != INVALID_HANDLE_VALUE ) CloseHandle( mFile );
+}
+
+MappedFileRef MappedFile::create( const ci::fs::path &path )
+{
+	MappedFileRef file( new MappedFile() );
+
+	file->mFile = CreateFileW( path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( file->mFile == INVALID_HANDLE_VALUE ) return MappedFileRef();
+
+	LARGE_INTEGER size;
+	if( !GetFileSizeEx( file->mFile, &size ) || size.QuadPart == 0 ) return MappedFileRef();
+	file->mSize = (size_t) size.QuadPart;
+
+	file->mMapping = CreateFileMappingW( file->mFile, NULL, PAGE_READONLY, 0, 0, NULL );
+	if( !file->mMapping ) return MappedFileRef();
+
+	file->mData = MapViewOfFile( file->mMapping, FILE_MAP_READ, 0, 0, 0 );
+	if( !file->mData ) return MappedFileRef();
+
+	return file;
+}
+
+#else
+
+MappedFile::MappedFile(void)
+	: mFile(-1), mData(NULL), mSize(0)
+{
+}
+
+MappedFile::~MappedFile(void)
+{
+	if( mData ) munmap( mData, mSize );
+	if( mFile >= 0 ) close( mFile );
+}
+
+MappedFileRef MappedFile::create( const ci::fs::path &path )
+{
+	MappedFileRef file( new MappedFile() );
+
+	file->mFile = open( path.string().c_str(), O_RDONLY );
+	if( file->mFile < 0 ) return MappedFileRef();
+
+	struct stat info;
+	if( fstat( file->mFile, &info ) != 0 || info.st_size == 0 ) return MappedFileRef();
+	file->mSize = (size_t) info.st_size;
+
+	void *data = mmap( NULL, file->mSize, PROT_READ, MAP_PRIVATE, file->mFile, 0 );
+	if( data == MAP_FAILED ) return MappedFileRef();
+	file->mData = data;
+
+	return file;
+}
+
+#endif
+
+} } // namespace ph::text
@@ -0,0 +1,59 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Filesystem.h"
+
+namespace ph { namespace text {
+
+typedef std::shared_ptr<class MappedFile> MappedFileRef;
+
+//! Read-only memory mapped file. The data stays valid as long as the object exists.
+class MappedFile
+{
+public:
+	//! maps the file into memory, returns an empty reference on failure
+	static MappedFileRef	create( const ci::fs::path &path );
+	~MappedFile(void);
+
+	//!
+	const uint8_t*	getData() const { return static_cast<const uint8_t*>(mData); }
+	//!
+	size_t			getSize() const { return mSize; }
+private:
+	MappedFile(void);
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+private:
+#if defined(CINDER_MSW)
+	void		*mFile;
+	void		*mMapping;
+#else
+	int			mFile;
+#endif
+	void		*mData;
+	size_t		mSize;
+};
+
+} } // namespace ph::text
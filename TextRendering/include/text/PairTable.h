@@ -0,0 +1,189 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace ph { namespace text {
+
+//! Read-only table of values for pairs of characters, like kerning amounts or ligatures. The table is
+//! compiled once into a minimal perfect hash (hash and displace), so a lookup costs one displacement
+//! read and a single probe, no matter how many pairs there are.
+template<typename T>
+class PairTable
+{
+public:
+	typedef std::pair<uint32_t, T>	Pair;
+public:
+	PairTable(void) : mSeed(0) {}
+	~PairTable(void) {}
+
+	//! combines two character codes into a key
+	static uint32_t	key( uint16_t left, uint16_t right ) { return (uint32_t(left) << 16) | right; }
+	//!
+	static uint16_t	left( uint32_t key ) { return (uint16_t) (key >> 16); }
+	//!
+	static uint16_t	right( uint32_t key ) { return (uint16_t) (key & 0xFFFF); }
+
+	//! removes all pairs
+	void		clear() { mSeed = 0; mDisplacements.clear(); mKeys.clear(); mValues.clear(); }
+	//! builds the table. If a key occurs more than once, the last value is used.
+	void		build( const std::vector<Pair> &pairs );
+
+	//!
+	bool		empty() const { return mKeys.empty(); }
+	//!
+	size_t		size() const { return mKeys.size(); }
+
+	//! returns the value of the pair, or NULL if the table does not contain it
+	const T*	find( uint16_t left, uint16_t right ) const
+	{
+		if( mKeys.empty() ) return NULL;
+
+		const uint32_t k = key( left, right );
+		const uint32_t d = mDisplacements[ hash( k, mSeed ) % mDisplacements.size() ];
+		const uint32_t slot = hash( k, d ) % mKeys.size();
+
+		return ( mKeys[slot] == k ) ? &mValues[slot] : NULL;
+	}
+
+	//! returns all keys, in table order
+	const std::vector<uint32_t>&	getKeys() const { return mKeys; }
+	//! returns all values, in table order
+	const std::vector<T>&			getValues() const { return mValues; }
+private:
+	//! integer hash (finalizer of MurmurHash3)
+	static uint32_t	hash( uint32_t k, uint32_t seed )
+	{
+		k ^= seed;
+		k ^= k >> 16; k *= 0x85EBCA6B;
+		k ^= k >> 13; k *= 0xC2B2AE35;
+		k ^= k >> 16;
+		return k;
+	}
+
+	//! tries to find a displacement for every bucket, returns FALSE if the seed does not work
+	bool		place( const std::vector<Pair> &pairs, uint32_t seed );
+private:
+	uint32_t				mSeed;
+	std::vector<uint32_t>	mDisplacements;
+	std::vector<uint32_t>	mKeys;
+	std::vector<T>			mValues;
+};
+
+template<typename T>
+void PairTable<T>::build( const std::vector<Pair> &pairs )
+{
+	clear();
+
+	// remove duplicate keys, keeping the last value
+	std::vector<Pair> unique;
+	unique.reserve( pairs.size() );
+
+	std::vector<size_t> order( pairs.size() );
+	for(size_t i=0;i<order.size();++i) order[i] = i;
+	std::stable_sort( order.begin(), order.end(), [&]( size_t a, size_t b ) { return pairs[a].first < pairs[b].first; } );
+
+	for(size_t i=0;i<order.size();++i) {
+		if( i + 1 < order.size() && pairs[order[i]].first == pairs[order[i + 1]].first ) continue;
+		unique.push_back( pairs[order[i]] );
+	}
+
+	if( unique.empty() ) return;
+
+	// try a few seeds, usually the first one succeeds
+	uint32_t seed = 0x9E3779B9;
+	for(int attempt=0;attempt<64;++attempt,seed+=0x9E3779B9)
+		if( place( unique, seed ) ) return;
+
+	// give up, leaving the table empty
+	clear();
+}
+
+template<typename T>
+bool PairTable<T>::place( const std::vector<Pair> &pairs, uint32_t seed )
+{
+	const size_t n = pairs.size();
+	const size_t numBuckets = std::max<size_t>( 1, n / 4 );
+
+	// distribute the keys over the buckets
+	std::vector< std::vector<size_t> > buckets( numBuckets );
+	for(size_t i=0;i<n;++i)
+		buckets[ hash( pairs[i].first, seed ) % numBuckets ].push_back(i);
+
+	// place the largest buckets first, while there is still plenty of room
+	std::vector<size_t> order( numBuckets );
+	for(size_t i=0;i<numBuckets;++i) order[i] = i;
+	std::sort( order.begin(), order.end(), [&]( size_t a, size_t b ) { return buckets[a].size() > buckets[b].size(); } );
+
+	std::vector<uint32_t>	displacements( numBuckets, 0 );
+	std::vector<bool>		occupied( n, false );
+	std::vector<size_t>		slots;
+
+	for(size_t b=0;b<numBuckets;++b) {
+		const std::vector<size_t> &bucket = buckets[ order[b] ];
+		if( bucket.empty() ) break;
+
+		// find a displacement that maps all keys of the bucket to free slots
+		bool found = false;
+		for(uint32_t d=1;d<(1u << 16) && !found;++d) {
+			slots.clear();
+
+			size_t i;
+			for(i=0;i<bucket.size();++i) {
+				size_t slot = hash( pairs[ bucket[i] ].first, d ) % n;
+				if( occupied[slot] || std::find( slots.begin(), slots.end(), slot ) != slots.end() ) break;
+				slots.push_back( slot );
+			}
+
+			if( i == bucket.size() ) {
+				for(i=0;i<slots.size();++i) occupied[ slots[i] ] = true;
+				displacements[ order[b] ] = d;
+				found = true;
+			}
+		}
+
+		if( !found ) return false;
+	}
+
+	// store the pairs in their slots
+	mSeed = seed;
+	mDisplacements.swap( displacements );
+	mKeys.assign( n, 0 );
+	mValues.assign( n, T() );
+
+	for(size_t i=0;i<n;++i) {
+		uint32_t d = mDisplacements[ hash( pairs[i].first, seed ) % numBuckets ];
+		size_t slot = hash( pairs[i].first, d ) % n;
+		mKeys[slot] = pairs[i].first;
+		mValues[slot] = pairs[i].second;
+	}
+
+	return true;
+}
+
+} } // namespace ph::text
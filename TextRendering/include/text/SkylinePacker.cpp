@@ -0,0 +1,119 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "text/SkylinePacker.h"
+
+#include <limits>
+
+namespace ph { namespace text {
+
+using namespace std;
+
+void SkylinePacker::reset( int width, int height )
+{
+	mWidth = width;
+	mHeight = height;
+	mUsedArea = 0;
+
+	mSkyline.clear();
+
+	Node node = { 0, 0, width };
+	mSkyline.push_back( node );
+}
+
+bool SkylinePacker::insert( int width, int height, int *x, int *y )
+{
+	if( width <= 0 || height <= 0 ) return false;
+
+	// find the node that results in the lowest top edge, prefer narrow nodes to reduce waste
+	size_t	best = mSkyline.size();
+	int		bestTop = numeric_limits<int>::max();
+	int		bestWidth = numeric_limits<int>::max();
+	int		bestY = 0;
+
+	for(size_t i=0;i<mSkyline.size();++i) {
+		int top;
+		if( !fits( i, width, height, &top ) ) continue;
+
+		if( top + height < bestTop || (top + height == bestTop && mSkyline[i].width < bestWidth) ) {
+			best = i;
+			bestTop = top + height;
+			bestWidth = mSkyline[i].width;
+			bestY = top;
+		}
+	}
+
+	if( best == mSkyline.size() ) return false;
+
+	// add a new node for the rectangle
+	Node node = { mSkyline[best].x, bestY + height, width };
+	mSkyline.insert( mSkyline.begin() + best, node );
+
+	// shrink or remove the nodes that are now covered by it
+	for(size_t i=best+1;i<mSkyline.size();) {
+		const Node &prev = mSkyline[i-1];
+		int overlap = prev.x + prev.width - mSkyline[i].x;
+		if( overlap <= 0 ) break;
+
+		mSkyline[i].x += overlap;
+		mSkyline[i].width -= overlap;
+
+		if( mSkyline[i].width > 0 ) break;
+		mSkyline.erase( mSkyline.begin() + i );
+	}
+
+	// merge neighbouring nodes at the same height
+	for(size_t i=0;i+1<mSkyline.size();) {
+		if( mSkyline[i].y == mSkyline[i+1].y ) {
+			mSkyline[i].width += mSkyline[i+1].width;
+			mSkyline.erase( mSkyline.begin() + i + 1 );
+		}
+		else ++i;
+	}
+
+	mUsedArea += size_t(width) * height;
+
+	*x = node.x;
+	*y = bestY;
+
+	return true;
+}
+
+bool SkylinePacker::fits( size_t index, int width, int height, int *y ) const
+{
+	int x = mSkyline[index].x;
+	if( x + width > mWidth ) return false;
+
+	int top = 0;
+	int remaining = width;
+	for(size_t i=index;remaining>0 && i<mSkyline.size();++i) {
+		top = max( top, mSkyline[i].y );
+		if( top + height > mHeight ) return false;
+
+		remaining -= mSkyline[i].width;
+	}
+
+	*y = top;
+	return remaining <= 0;
+}
+
+} } // namespace ph::text
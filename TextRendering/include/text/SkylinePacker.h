@@ -0,0 +1,68 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+
+#include <vector>
+
+namespace ph { namespace text {
+
+//! Packs rectangles into a page using the skyline bottom-left heuristic.
+class SkylinePacker
+{
+public:
+	SkylinePacker(void) : mWidth(0), mHeight(0), mUsedArea(0) {}
+	SkylinePacker(int width, int height) { reset(width, height); }
+	~SkylinePacker(void) {}
+
+	//! removes all rectangles and resizes the page
+	void	reset( int width, int height );
+	//! increases the height of the page, keeping all rectangles in place
+	void	grow( int height ) { if( height > mHeight ) mHeight = height; }
+
+	//! finds room for a rectangle of the specified size, returns FALSE if the page is full
+	bool	insert( int width, int height, int *x, int *y );
+
+	//!
+	int		getWidth() const { return mWidth; }
+	//!
+	int		getHeight() const { return mHeight; }
+	//! returns the fraction of the page that is in use
+	float	getOccupancy() const { return (mWidth > 0 && mHeight > 0) ? float(mUsedArea) / (float(mWidth) * mHeight) : 0.0f; }
+private:
+	//! returns TRUE if the rectangle fits at the specified skyline node, and the resulting y-coordinate
+	bool	fits( size_t index, int width, int height, int *y ) const;
+private:
+	struct Node {
+		int x, y, width;
+	};
+
+	int					mWidth;
+	int					mHeight;
+	size_t				mUsedArea;
+
+	std::vector<Node>	mSkyline;
+};
+
+} } // namespace ph::text
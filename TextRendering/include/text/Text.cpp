@@ -28,6 +28,8 @@
 #include <boost/tokenizer.hpp>
 #include <boost/algorithm/string.hpp>
 
+#include <cstddef>
+
 namespace ph { namespace text {
 
 using namespace ci;
@@ -35,13 +37,30 @@ using namespace std;
 
 void Text::draw()
 {
+	updateFont();
+
 	if( mInvalid ) {
 		clearMesh();
 		renderMesh();
-		createMesh();
+
+		if( mPacked )
+			createPackedMesh();
+		else
+			createMesh();
 	}
 
-	if( mVboMesh && mFont && bindShader() ) {
+	if( mPacked ) {
+		if( mInstanceBuffer && mFont ) {
+			glPushAttrib( GL_CURRENT_BIT | GL_TEXTURE_BIT | GL_ENABLE_BIT );
+
+			mFont->enableAndBind();
+			drawPacked();
+			mFont->unbind();
+
+			glPopAttrib();
+		}
+	}
+	else if( mVboMesh && mFont && bindShader() ) {
 		glPushAttrib( GL_CURRENT_BIT | GL_TEXTURE_BIT | GL_ENABLE_BIT );
 
 		mFont->enableAndBind();
@@ -56,31 +75,52 @@ void Text::draw()
 
 void Text::drawWireframe()
 {
+	updateFont();
+
 	if( mInvalid ) {
 		clearMesh();
 		renderMesh();
-		createMesh();
+
+		if( mPacked )
+			createPackedMesh();
+		else
+			createMesh();
 	}
  
-	if(!mVboMesh) return;
+	if( mPacked ? !mInstanceBuffer : !mVboMesh ) return;
 
 	glPushAttrib( GL_POLYGON_BIT | GL_TEXTURE_BIT | GL_ENABLE_BIT );
 
 	gl::enableWireframe();
 	gl::disable( GL_TEXTURE_2D );
 
-	gl::draw(mVboMesh);
+	if( mPacked )
+		drawPacked();
+	else
+		gl::draw(mVboMesh);
 
 	glPopAttrib();
 }
 
+void Text::updateFont()
+{
+	if( !mFont ) return;
+
+	mFont->update();
+
+	if( mFont->getRevision() != mFontRevision ) {
+		mFontRevision = mFont->getRevision();
+		mInvalid = true;
+	}
+}
+
 void Text::clearMesh()
 {
 	mVboMesh.reset();
 	
-	mVertices.clear();
-	mIndices.clear();
-	mTexcoords.clear();
+	mMesh.clear();
+	mInstances.clear();
+	mInstanceBuffer = gl::Vbo();
 
 	mInvalid = true;
 }
@@ -90,6 +130,20 @@ void Text::renderMesh()
 	// prevent errors
 	if(!mInvalid) return;
 	if(!mFont) return;
+
+	if( mPacked )
+		layout( &mInstances );
+	else
+		layout( &mMesh );
+
+	mBoundsInvalid = true;
+}
+
+void Text::layout( GlyphSink *sink )
+{
+	// prevent errors
+	if(!sink) return;
+	if(!mFont) return;
 	if( mText.empty() )	return;
 
 	// initialize variables
@@ -110,10 +164,7 @@ void Text::renderMesh()
 
 	// reserve some room in the buffers, to prevent excessive resizing. Do not use the full string length,
 	// because the text may contain white space characters that don't need to be rendered.
-	size_t sz = mText.length() / 2;
-	mVertices.reserve( 4 * sz );
-	mTexcoords.reserve( 4 * sz );
-	mIndices.reserve( 6 * sz );
+	sink->reserve( mText.length() / 2 );
 
 	// process text in chunks
 	std::vector<size_t>::iterator	mitr = mMust.begin();
@@ -123,22 +174,25 @@ void Text::renderMesh()
 		// calculate the maximum allowed width for this line
 		linewidth = getWidthAt( cursor.y );
 
+		TextLine line;
+		line.first = index;
+
 		switch (mBoundary ) 
 		{
 		case LINE:
 			// render the whole paragraph
 			trimmed = boost::trim_copy( mText.substr(index, *mitr - index + 1) );
-			width = mFont->measureWidth( trimmed, mFontSize, true );
+			width = mFont->measureWidth( trimmed, mFontSize, true, mKerning, mLigatures );
 
-			// advance iterator
-			index = *mitr;
+			// advance iterator, the break position is the last character of the paragraph
+			index = *mitr + 1;
 			++mitr;
 
 			break;
 		case WORD:
 			// measure the first chunk on this line
 			chunk = ( mText.substr(index, *aitr - index + 1) );
-			width = mFont->measureWidth( chunk, mFontSize, false );
+			width = mFont->measureWidth( chunk, mFontSize, false, mKerning, mLigatures );
 
 			// if it fits, add the next chunk until no more chunks fit or are available
 			while( linewidth > 0.0f && width < linewidth && *aitr != *mitr )
@@ -149,11 +203,11 @@ void Text::renderMesh()
 					break;
 				
 				chunk = ( mText.substr(*(aitr-1) + 1, *aitr - *(aitr-1)) );
-				width += mFont->measureWidth( chunk, mFontSize, false );
+				width += mFont->measureWidth( chunk, mFontSize, false, mKerning, mLigatures );
 			}
 
 			// end of line encountered
-			if( aitr == mAllow.begin() || *(aitr-1) <= index )
+			if( aitr == mAllow.begin() || *(aitr-1) < index )
 			{	// not a single chunk fits on this line, just render what we have				
 			}
 			else if( linewidth > 0.0f && width > linewidth )
@@ -165,7 +219,7 @@ void Text::renderMesh()
 			{
 				// 
 				trimmed = boost::trim_copy( mText.substr(index, *aitr - index + 1) );
-				width = mFont->measureWidth( trimmed, mFontSize );
+				width = mFont->measureWidth( trimmed, mFontSize, true, mKerning, mLigatures );
 
 				// end of paragraph encountered, move to next
 				if( *aitr == *mitr )
@@ -183,8 +237,9 @@ void Text::renderMesh()
 					if( stretch > 3.0f ) stretch = 1.0f;
 				}*/
 				
-				// advance iterator
-				index = *aitr;
+				// advance iterator, the break position is the last character on this line. Don't start 
+				// the next line with it: ideographs have no white space between them to trim.
+				index = *aitr + 1;
 				++aitr;	
 			}
 
@@ -202,8 +257,13 @@ void Text::renderMesh()
 			break;
 		}
 
+		line.length = index - line.first;
+		line.origin = cursor;
+		line.width = width;
+
 		// add this fitting part of the text to the mesh 
-		renderString( trimmed, &cursor );
+		renderString( sink, trimmed, &cursor );
+		sink->addLine( line );
 
 		// advance cursor to new line
 		if( !newLine(&cursor) ) break;
@@ -212,53 +272,54 @@ void Text::renderMesh()
 	//app::console() << ( app::getElapsedSeconds() - t ) << std::endl;
 }
 
-void Text::renderString( const std::u16string &str, Vec2f *cursor, float stretch )
+void Text::renderString( GlyphSink *sink, const std::u16string &str, Vec2f *cursor, float stretch )
 {
-	std::u16string::const_iterator itr;
-	for(itr=str.begin();itr!=str.end();++itr) {
+	const bool kerning = mKerning && mFont->hasKerning();
+	const bool ligatures = mLigatures && mFont->hasLigatures();
+
+	uint16_t previous = 0;
+
+	for(size_t i=0;i<str.size();++i) {
 		// retrieve character code
-		uint16_t id = (uint16_t) *itr;
+		uint16_t id = (uint16_t) str[i];
+
+		// replace pairs of characters by a single glyph, ligatures can be chained (e.g. 'ffi')
+		while( ligatures && i + 1 < str.size() ) {
+			uint16_t ligature = mFont->getLigature(id, (uint16_t) str[i+1]);
+			if( !ligature ) break;
+
+			id = ligature;
+			++i;
+		}
 
 		if( mFont->contains(id) ) {
+			// adjust the spacing between this character and the previous one
+			if( kerning ) cursor->x += mFont->getKerning(previous, id, mFontSize);
+			previous = id;
+
 			// get metrics for this character to speed up measurements
 			Font::Metrics m = mFont->getMetrics(id);
 
 			// skip whitespace characters
-			if( ! isWhitespaceUtf16(id) ) {
-				size_t index = mVertices.size();
-
-
-				Rectf bounds = mFont->getBounds(m, mFontSize);
-				mVertices.push_back( Vec3f(*cursor + bounds.getUpperLeft()) );
-				mVertices.push_back( Vec3f(*cursor + bounds.getUpperRight()) );
-				mVertices.push_back( Vec3f(*cursor + bounds.getLowerRight()) );
-				mVertices.push_back( Vec3f(*cursor + bounds.getLowerLeft()) );
-			
-				bounds = mFont->getTexCoords(m);
-				mTexcoords.push_back( bounds.getUpperLeft() );
-				mTexcoords.push_back( bounds.getUpperRight() );
-				mTexcoords.push_back( bounds.getLowerRight() );
-				mTexcoords.push_back( bounds.getLowerLeft() );
-
-				mIndices.push_back(index+0); mIndices.push_back(index+3); mIndices.push_back(index+1);
-				mIndices.push_back(index+1); mIndices.push_back(index+3); mIndices.push_back(index+2);
-			}
+			if( ! isWhitespaceUtf16(id) )
+				sink->addGlyph( mFont->getBounds(m, mFontSize).getOffset(*cursor), mFont->getTexCoords(m) );
 
 			if( id == 32 )
 				cursor->x += stretch * mFont->getAdvance(m, mFontSize);
 			else
 				cursor->x += mFont->getAdvance(m, mFontSize);
 		}
+		else if( ! isWhitespaceUtf16(id) ) {
+			// dynamic fonts will render the character, it will show up once it is done
+			mFont->request(id);
+		}
 	}
-
-	//
-	mBoundsInvalid = true;
 }
 
 void Text::createMesh()
 {
 	//
-	if( mVertices.empty() || mIndices.empty() )
+	if( mMesh.empty() )
 		return;
 
 	//
@@ -268,29 +329,128 @@ void Text::createMesh()
 	layout.setStaticTexCoords2d();
 	//layout.setStaticColorsRGBA();
 
-	mVboMesh = gl::VboMesh( mVertices.size(), mIndices.size(), layout, GL_TRIANGLES );
-	mVboMesh.bufferPositions( &mVertices.front(), mVertices.size() );
-	mVboMesh.bufferIndices( mIndices );
-	mVboMesh.bufferTexCoords2d( 0, mTexcoords );
+	mVboMesh = gl::VboMesh( mMesh.getVertices().size(), mMesh.getIndices().size(), layout, GL_TRIANGLES );
+	mVboMesh.bufferPositions( &mMesh.getVertices().front(), mMesh.getVertices().size() );
+	mVboMesh.bufferIndices( mMesh.getIndices() );
+	mVboMesh.bufferTexCoords2d( 0, mMesh.getTexCoords() );
 	//mVboMesh.bufferColorsRGBA( colors );
 
 	mInvalid = false;
 }
 
+void Text::createPackedMesh()
+{
+	//
+	if( mInstances.empty() )
+		return;
+
+	// the unit quad that is expanded to the size of each glyph in the vertex shader
+	if( ! mCornerBuffer ) {
+		const Vec2f corners[] = { Vec2f(0.0f, 0.0f), Vec2f(1.0f, 0.0f), Vec2f(0.0f, 1.0f), Vec2f(1.0f, 1.0f) };
+
+		mCornerBuffer = gl::Vbo( GL_ARRAY_BUFFER );
+		mCornerBuffer.bufferData( sizeof(corners), corners, GL_STATIC_DRAW );
+	}
+
+	//
+	const std::vector<GlyphInstance> &instances = mInstances.getInstances();
+
+	mInstanceBuffer = gl::Vbo( GL_ARRAY_BUFFER );
+	mInstanceBuffer.bufferData( instances.size() * sizeof(GlyphInstance), &instances.front(), GL_STATIC_DRAW );
+
+	mInvalid = false;
+}
+
+static void enableInstanceAttrib( GLint location, GLint size, GLenum type, GLboolean normalized, size_t offset )
+{
+	if( location < 0 ) return;
+
+	glEnableVertexAttribArray( location );
+	glVertexAttribPointer( location, size, type, normalized, sizeof(GlyphInstance), (const GLvoid*) offset );
+
+	// get the next glyph after each instance, instead of each vertex
+#if defined(CINDER_COCOA)
+	glVertexAttribDivisorARB( location, 1 );
+#else
+	glVertexAttribDivisor( location, 1 );
+#endif
+}
+
+static void disableInstanceAttrib( GLint location )
+{
+	if( location < 0 ) return;
+
+#if defined(CINDER_COCOA)
+	glVertexAttribDivisorARB( location, 0 );
+#else
+	glVertexAttribDivisor( location, 0 );
+#endif
+	glDisableVertexAttribArray( location );
+}
+
+void Text::drawPacked()
+{
+	if( ! mInstanceBuffer || ! mCornerBuffer ) return;
+	if( ! bindPackedShader() ) return;
+
+	GLint corner = mPackedShader.getAttribLocation( "corner" );
+	GLint position = mPackedShader.getAttribLocation( "glyph_position" );
+	GLint size = mPackedShader.getAttribLocation( "glyph_size" );
+	GLint texcoords = mPackedShader.getAttribLocation( "glyph_texcoords" );
+	GLint label = mPackedShader.getAttribLocation( "glyph_label" );
+
+	// the corners are the only per-vertex attribute
+	mCornerBuffer.bind();
+	glEnableVertexAttribArray( corner );
+	glVertexAttribPointer( corner, 2, GL_FLOAT, GL_FALSE, sizeof(Vec2f), (const GLvoid*) 0 );
+
+	// draw the glyphs batch by batch, because each batch has its own origin
+	mInstanceBuffer.bind();
+
+	const std::vector<GlyphInstanceBatch> &batches = mInstances.getBatches();
+	std::vector<GlyphInstanceBatch>::const_iterator itr;
+	for(itr=batches.begin();itr!=batches.end();++itr) {
+		if( itr->count == 0 ) continue;
+
+		size_t offset = itr->first * sizeof(GlyphInstance);
+		enableInstanceAttrib( position, 2, GL_SHORT, GL_FALSE, offset + offsetof(GlyphInstance, x) );
+		enableInstanceAttrib( size, 2, GL_UNSIGNED_SHORT, GL_FALSE, offset + offsetof(GlyphInstance, w) );
+		enableInstanceAttrib( texcoords, 4, GL_UNSIGNED_SHORT, GL_TRUE, offset + offsetof(GlyphInstance, s1) );
+		enableInstanceAttrib( label, 1, GL_UNSIGNED_SHORT, GL_FALSE, offset + offsetof(GlyphInstance, label) );
+
+		mPackedShader.uniform( "origin", itr->origin );
+		if( label >= 0 )
+			mPackedShader.uniform( "label_base", (float) itr->labelBase );
+
+		glDrawArraysInstancedARB( GL_TRIANGLE_STRIP, 0, 4, itr->count );
+	}
+
+	disableInstanceAttrib( position );
+	disableInstanceAttrib( size );
+	disableInstanceAttrib( texcoords );
+	disableInstanceAttrib( label );
+	glDisableVertexAttribArray( corner );
+
+	mInstanceBuffer.unbind();
+
+	mPackedShader.unbind();
+}
+
 Rectf Text::getBounds() const
 {
-	if( mBoundsInvalid )
+	if( mBoundsInvalid && mPacked )
 	{
 		mBounds = Rectf(0.0f, 0.0f, 0.0f, 0.0f);
+		if( ! mInstances.empty() )
+			mBounds.include( mInstances.getBounds() );
 
-		vector< Vec3f >::const_iterator itr = mVertices.begin();
-		while( itr != mVertices.end() ) {
-			mBounds.x1 = ci::math<float>::min( itr->x, mBounds.x1 );
-			mBounds.y1 = ci::math<float>::min( itr->y, mBounds.y1 );
-			mBounds.x2 = ci::math<float>::max( itr->x, mBounds.x2 );
-			mBounds.y2 = ci::math<float>::max( itr->y, mBounds.y2 );
-			++ itr;
-		}
+		mBoundsInvalid = false;
+	}
+	else if( mBoundsInvalid )
+	{
+		mBounds = Rectf(0.0f, 0.0f, 0.0f, 0.0f);
+		if( ! mMesh.empty() )
+			mBounds.include( mMesh.getBounds() );
 
 		mBoundsInvalid = false;
 	}
@@ -315,6 +475,33 @@ std::string Text::getVertexShader() const
 	return std::string(vs);
 }
 
+std::string Text::getPackedVertexShader() const
+{
+	// vertex shader, expands each glyph instance to a quad
+	const char *vs = 
+		"#version 120\n"
+		"\n"
+		"// origin of the current batch and fixed point scale\n"
+		"uniform vec2  origin;\n"
+		"uniform float scale;\n"
+		"\n"
+		"attribute vec2 corner;\n"
+		"attribute vec2 glyph_position;\n"
+		"attribute vec2 glyph_size;\n"
+		"attribute vec4 glyph_texcoords;\n"
+		"\n"
+		"void main()\n"
+		"{\n"
+		"	gl_FrontColor = gl_Color;\n"
+		"	gl_TexCoord[0] = vec4( mix( glyph_texcoords.xy, glyph_texcoords.zw, corner ), 0.0, 1.0 );\n"
+		"\n"
+		"	vec2 vertex = origin + (glyph_position + corner * glyph_size) * scale;\n"
+		"	gl_Position = gl_ModelViewProjectionMatrix * vec4( vertex, 0.0, 1.0 );\n"
+		"}\n";
+
+	return std::string(vs);
+}
+
 std::string Text::getFragmentShader() const
 {
 	// fragment shader
@@ -366,6 +553,27 @@ bool Text::bindShader()
 	return true;
 }
 
+bool Text::bindPackedShader()
+{
+	if( ! mPackedShader ) 
+	{
+		try { 
+			mPackedShader = gl::GlslProg( getPackedVertexShader().c_str(), getFragmentShader().c_str() ); 
+		}
+		catch( const std::exception &e ) { 
+			app::console() << "Could not load&compile shader: " << e.what() << std::endl;
+			mPackedShader = gl::GlslProg(); return false; 
+		}
+	}
+
+	mPackedShader.bind();
+	mPackedShader.uniform( "font_map", 0 );
+	mPackedShader.uniform( "smoothness", 64.0f );
+	mPackedShader.uniform( "scale", GlyphInstanceBuilder::getPositionScale() );
+
+	return true;
+}
+
 bool Text::unbindShader()
 {
 	if( mShader ) 
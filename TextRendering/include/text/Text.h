@@ -27,6 +27,8 @@
 #include "cinder/gl/GlslProg.h"
 #include "cinder/gl/Vbo.h"
 #include "text/Font.h"
+#include "text/GlyphInstances.h"
+#include "text/GlyphMesh.h"
 
 namespace ph { namespace text {
 
@@ -40,13 +42,14 @@ public:
 public:
 	Text(void) : mInvalid(true), mBoundsInvalid(true),
 		mAlignment(LEFT), mBoundary(WORD), 
-		mFontSize(14.0f), mLineSpace(1.0f) {};
+		mFontSize(14.0f), mFontRevision(0), mLineSpace(1.0f), mKerning(true), mLigatures(true), mPacked(false) {};
 	virtual ~Text(void) {};
 
 	virtual void draw();
 	virtual void drawWireframe();
 
 	std::string	getFontFamily() const { if(mFont) return mFont->getFamily(); else return std::string(); }
+	FontRef		getFont() const { return mFont; }
 	void		setFont( FontRef font ) { mFont = font; mInvalid = true; }
 
 	float		getFontSize() const { return mFontSize; }
@@ -66,7 +69,22 @@ public:
 	void		setText(const std::string &text) { setText( ci::toUtf16(text) ); }
 	void		setText( const std::u16string &text ) { mText = text; mMust.clear(); mAllow.clear(); mInvalid = true; }
 
+	//! adjusts the spacing between pairs of characters, if the font contains kerning information
+	bool		isKerning() const { return mKerning; }
+	void		setKerning( bool enable ) { mKerning = enable; mInvalid = true; }
+
+	//! replaces pairs of characters by a single glyph (e.g. 'fi'), if the font contains them
+	bool		isLigatures() const { return mLigatures; }
+	void		setLigatures( bool enable ) { mLigatures = enable; mInvalid = true; }
+
+	//! packed text uploads 20 bytes per glyph instead of 104 and expands the quads in the vertex shader
+	bool		isPacked() const { return mPacked; }
+	void		setPacked( bool enable ) { mPacked = enable; mInvalid = true; }
+
 	ci::Rectf	getBounds() const;		
+
+	//! lays out the text and hands the glyphs and lines to the sink. Does not require an OpenGL context.
+	virtual void	layout( GlyphSink *sink );
 protected:
 	//! get the maximum width of the text at the specified vertical position 
 	virtual float	getWidthAt(float y) { return 0.0f; }
@@ -85,15 +103,26 @@ protected:
 	virtual std::string getFragmentShader() const;
 	virtual bool		bindShader();
 	virtual bool		unbindShader();
+
+	//! shader used to expand packed glyph instances
+	virtual std::string	getPackedVertexShader() const;
+	virtual bool		bindPackedShader();
+	//! draws the packed glyph instances, batch by batch
+	virtual void		drawPacked();
 	
+	//! updates dynamic fonts and invalidates the mesh if glyphs were added to the font
+	void				updateFont();
+
 	//! clears the mesh and the buffers
 	virtual void		clearMesh();
-	//! renders the current contents of mText
+	//! lays out the current contents of mText into the mesh or the packed glyphs
 	virtual void		renderMesh();
 	//! helper to render a non-word-wrapped string
-	virtual void		renderString( const std::u16string &str, ci::Vec2f *cursor, float stretch = 1.0f );
+	virtual void		renderString( GlyphSink *sink, const std::u16string &str, ci::Vec2f *cursor, float stretch = 1.0f );
 	//! creates the VBO from the data in the buffers
 	virtual void		createMesh();
+	//! creates the instance buffer from the packed glyphs
+	virtual void		createPackedMesh();
 public:
 	// special Unicode functions (requires Cinder v0.8.5)
 	void findBreaksUtf8( const std::string &line, std::vector<size_t> *must, std::vector<size_t> *allow );
@@ -116,13 +145,21 @@ protected:
 
 	FontRef					mFont;
 	float					mFontSize;
+	uint32_t				mFontRevision;
 
 	float					mLineSpace;
 
+	bool					mKerning;
+	bool					mLigatures;
+
 	std::vector<size_t>		mMust, mAllow;
-	std::vector<ci::Vec3f>	mVertices;
-	std::vector<uint32_t>	mIndices;
-	std::vector<ci::Vec2f>	mTexcoords;
+	GlyphMeshBuilder		mMesh;
+
+	bool					mPacked;
+	GlyphInstanceBuilder	mInstances;
+	ci::gl::Vbo				mInstanceBuffer;
+	ci::gl::Vbo				mCornerBuffer;
+	ci::gl::GlslProg		mPackedShader;
 };
 
 } } // namespace ph::text
\ No newline at end of file
@@ -45,77 +45,30 @@ void TextLabels::addLabel( const Vec3f &position, const std::u16string &text )
 
 void TextLabels::clearMesh()
 {
-	mVboMesh.reset();
-	
-	mVertices.clear();
-	mIndices.clear();
-	mTexcoords.clear();
-	mOffsets.clear();
+	Text::clearMesh();
 
-	mInvalid = true;
+	mLabelTexture.reset();
 }
 
-void TextLabels::renderMesh()
+void TextLabels::layout( GlyphSink *sink )
 {
+	if(!sink) return;
+
 	// parse all labels
 	TextLabelListIter labelItr;
 	for(labelItr=mLabels.begin();labelItr!=mLabels.end();++labelItr) {
-		// render label
-		mOffset = labelItr->first;
+		// render label, glyphs are stored relative to its anchor
 		setText( labelItr->second );
+		sink->addLabel( labelItr->first );
 
-		Text::renderMesh();
-	}
-}
-
-void TextLabels::renderString( const std::u16string &str, Vec2f *cursor, float stretch )
-{
-	std::u16string::const_iterator itr;
-	for(itr=str.begin();itr!=str.end();++itr) {
-		// retrieve character code
-		uint16_t id = (uint16_t) *itr;
-
-		if( mFont->contains(id) ) {
-			// get metrics for this character to speed up measurements
-			Font::Metrics m = mFont->getMetrics(id);
-
-			// skip whitespace characters
-			if( ! isWhitespaceUtf16(id) ) {
-				size_t index = mVertices.size();
-
-				Rectf bounds = mFont->getBounds(m, mFontSize);
-				mVertices.push_back( Vec3f(*cursor + bounds.getUpperLeft()) );
-				mVertices.push_back( Vec3f(*cursor + bounds.getUpperRight()) );
-				mVertices.push_back( Vec3f(*cursor + bounds.getLowerRight()) );
-				mVertices.push_back( Vec3f(*cursor + bounds.getLowerLeft()) );
-			
-				bounds = mFont->getTexCoords(m);
-				mTexcoords.push_back( bounds.getUpperLeft() );
-				mTexcoords.push_back( bounds.getUpperRight() );
-				mTexcoords.push_back( bounds.getLowerRight() );
-				mTexcoords.push_back( bounds.getLowerLeft() );
-
-				mIndices.push_back(index+0); mIndices.push_back(index+3); mIndices.push_back(index+1);
-				mIndices.push_back(index+1); mIndices.push_back(index+3); mIndices.push_back(index+2);
-			
-				mOffsets.insert(mOffsets.end(), 4, mOffset);
-			}
-
-			if( id == 32 )
-				cursor->x += stretch * mFont->getAdvance(m, mFontSize);
-			else
-				cursor->x += mFont->getAdvance(m, mFontSize);
-		}
+		Text::layout( sink );
 	}
-
-	//
-	mBoundsInvalid = true;
 }
 
 void TextLabels::createMesh()
 {
 	//
-	if( mVertices.empty() || mIndices.empty() )
+	if( mMesh.empty() )
 		return;
 
 	//
@@ -125,17 +78,90 @@ void TextLabels::createMesh()
 	layout.setStaticTexCoords2d(0);
 	//layout.setStaticColorsRGBA();
 	layout.setStaticTexCoords3d(1);
+	layout.setStaticTexCoords2d(2);
 
-	mVboMesh = gl::VboMesh( mVertices.size(), mIndices.size(), layout, GL_TRIANGLES );
-	mVboMesh.bufferPositions( &mVertices.front(), mVertices.size() );
-	mVboMesh.bufferIndices( mIndices );
-	mVboMesh.bufferTexCoords2d( 0, mTexcoords );
+	mVboMesh = gl::VboMesh( mMesh.getVertices().size(), mMesh.getIndices().size(), layout, GL_TRIANGLES );
+	mVboMesh.bufferPositions( &mMesh.getVertices().front(), mMesh.getVertices().size() );
+	mVboMesh.bufferIndices( mMesh.getIndices() );
+	mVboMesh.bufferTexCoords2d( 0, mMesh.getTexCoords() );
 	//mVboMesh.bufferColorsRGBA( colors );
-	mVboMesh.bufferTexCoords3d( 1, mOffsets );
+	mVboMesh.bufferTexCoords3d( 1, mMesh.getOffsets() );
+	mVboMesh.bufferTexCoords2d( 2, mMesh.getLabelIndices() );
 
 	mInvalid = false;
 }
 
+void TextLabels::createPackedMesh()
+{
+	//
+	if( mInstances.empty() )
+		return;
+
+	Text::createPackedMesh();
+
+	// store the label anchors in a floating point texture, so the vertex shader can look them up
+	const std::vector<Vec3f> &labels = mInstances.getLabels();
+
+	const int32_t width = math<int32_t>::min( (int32_t) labels.size(), 1024 );
+	const int32_t height = ( (int32_t) labels.size() + width - 1 ) / width;
+
+	Surface32f surface( width, height, false );
+	float *data = surface.getData();
+	for(size_t i=0;i<labels.size();++i) {
+		data[i * 3 + 0] = labels[i].x;
+		data[i * 3 + 1] = labels[i].y;
+		data[i * 3 + 2] = labels[i].z;
+	}
+
+	gl::Texture::Format fmt;
+	fmt.setInternalFormat( GL_RGB32F_ARB );
+	fmt.setMinFilter( GL_NEAREST );
+	fmt.setMagFilter( GL_NEAREST );
+
+	mLabelTexture = gl::Texture( surface, fmt );
+}
+
+void TextLabels::drawPacked()
+{
+	if( ! mLabelTexture ) return;
+
+	updateVisibility();
+
+	mLabelTexture.bind(1);
+	mVisibilityTexture.bind(2);
+	Text::drawPacked();
+	mVisibilityTexture.unbind(2);
+	mLabelTexture.unbind(1);
+}
+
+void TextLabels::updateVisibility()
+{
+	const int32_t count = (int32_t) math<size_t>::max( mLabels.size(), 1 );
+	const int32_t width = math<int32_t>::min( count, 1024 );
+	const int32_t height = ( count + width - 1 ) / width;
+
+	if( ! mVisibilityTexture || mVisibilityTexture.getWidth() != width || mVisibilityTexture.getHeight() != height ) {
+		gl::Texture::Format fmt;
+		fmt.setInternalFormat( GL_LUMINANCE8 );
+		fmt.setMinFilter( GL_NEAREST );
+		fmt.setMagFilter( GL_NEAREST );
+
+		mVisibilityChannel = Channel8u( width, height );
+		mVisibilityTexture = gl::Texture( mVisibilityChannel, fmt );
+		mVisibilityInvalid = true;
+	}
+
+	if( ! mVisibilityInvalid ) return;
+
+	// labels that are not part of the mask are visible
+	uint8_t *data = mVisibilityChannel.getData();
+	for(int32_t i=0;i<width*height;++i)
+		data[i] = ( (size_t) i < mVisibility.size() ) ? mVisibility[i] : 255;
+
+	mVisibilityTexture.update( mVisibilityChannel, mVisibilityChannel.getBounds() );
+	mVisibilityInvalid = false;
+}
+
 std::string TextLabels::getVertexShader() const
 {
 	// vertex shader
@@ -145,6 +171,10 @@ std::string TextLabels::getVertexShader() const
 		"// viewport parameters (x, y, width, height)\n"
 		"uniform vec4 viewport;\n"
 		"\n"
+		"// visibility of each label, one texel per label\n"
+		"uniform sampler2D visibility;\n"
+		"uniform vec2      visibility_size;\n"
+		"\n"
 		"vec3 toNDC(vec4 vertex)\n"
 		"{\n"
 		"	return vec3( vertex.xyz / vertex.w );\n"
@@ -155,13 +185,20 @@ std::string TextLabels::getVertexShader() const
 		"	return vec2( vertex.xy / vertex.w ) * viewport.zw;\n"
 		"}\n"
 		"\n"
+		"float getVisibility(float index)\n"
+		"{\n"
+		"	vec2 uv = ( vec2( mod( index, visibility_size.x ), floor( index / visibility_size.x ) ) + 0.5 ) / visibility_size;\n"
+		"	return texture2DLod( visibility, uv, 0.0 ).r;\n"
+		"}\n"
+		"\n"
 		"void main()\n"
 		"{\n"
 		"	// pass font texture coordinate to fragment shader\n"
 		"	gl_TexCoord[0] = gl_MultiTexCoord0;\n"
 		"\n"
-		"	// set the color\n"
-		"	gl_FrontColor = gl_Color;\n"
+		"	// set the color, fading out hidden labels\n"
+		"	float visible = getVisibility( gl_MultiTexCoord2.x );\n"
+		"	gl_FrontColor = gl_Color * visible;\n"
 		"\n"
 		"	// convert label position to normalized device coordinates to find the 2D offset\n"
 		"	vec3 offset = toNDC( gl_ModelViewProjectionMatrix * gl_MultiTexCoord1 );\n"
@@ -171,21 +208,123 @@ std::string TextLabels::getVertexShader() const
 		"\n"
 		"	// calculate final vertex position by offsetting it\n"
 		"	gl_Position = vec4( vertex + offset, 1.0 );\n"
+		"\n"
+		"	// hidden labels are moved outside the clip volume, so they don't cost any fill rate\n"
+		"	if( visible == 0.0 ) gl_Position = vec4( 0.0, 0.0, 2.0, 1.0 );\n"
+		"}";
+
+	return std::string(vs);
+}
+
+std::string TextLabels::getPackedVertexShader() const
+{
+	// vertex shader, expands each glyph instance to a quad and offsets it by its label anchor
+	const char *vs = 
+		"#version 120\n"
+		"\n"
+		"// viewport parameters (x, y, width, height)\n"
+		"uniform vec4 viewport;\n"
+		"\n"
+		"// origin of the current batch and fixed point scale\n"
+		"uniform vec2  origin;\n"
+		"uniform float scale;\n"
+		"\n"
+		"// label anchors, one texel per label\n"
+		"uniform sampler2D labels;\n"
+		"uniform vec2      labels_size;\n"
+		"uniform float     label_base;\n"
+		"\n"
+		"// visibility of each label, one texel per label\n"
+		"uniform sampler2D visibility;\n"
+		"uniform vec2      visibility_size;\n"
+		"\n"
+		"attribute vec2  corner;\n"
+		"attribute vec2  glyph_position;\n"
+		"attribute vec2  glyph_size;\n"
+		"attribute vec4  glyph_texcoords;\n"
+		"attribute float glyph_label;\n"
+		"\n"
+		"vec3 toNDC(vec4 vertex)\n"
+		"{\n"
+		"	return vec3( vertex.xyz / vertex.w );\n"
+		"}\n"
+		"\n"
+		"float getVisibility(float index)\n"
+		"{\n"
+		"	vec2 uv = ( vec2( mod( index, visibility_size.x ), floor( index / visibility_size.x ) ) + 0.5 ) / visibility_size;\n"
+		"	return texture2DLod( visibility, uv, 0.0 ).r;\n"
+		"}\n"
+		"\n"
+		"void main()\n"
+		"{\n"
+		"	// pass font texture coordinate to fragment shader\n"
+		"	gl_TexCoord[0] = vec4( mix( glyph_texcoords.xy, glyph_texcoords.zw, corner ), 0.0, 1.0 );\n"
+		"\n"
+		"	// look up the label anchor\n"
+		"	float index = label_base + glyph_label;\n"
+		"	vec2 uv = ( vec2( mod( index, labels_size.x ), floor( index / labels_size.x ) ) + 0.5 ) / labels_size;\n"
+		"	vec4 anchor = vec4( texture2DLod( labels, uv, 0.0 ).xyz, 1.0 );\n"
+		"\n"
+		"	// set the color, fading out hidden labels\n"
+		"	float visible = getVisibility( index );\n"
+		"	gl_FrontColor = gl_Color * visible;\n"
+		"\n"
+		"	// convert label position to normalized device coordinates to find the 2D offset\n"
+		"	vec3 offset = toNDC( gl_ModelViewProjectionMatrix * anchor );\n"
+		"\n"
+		"	// convert vertex from screen space to normalized device coordinates\n"
+		"	vec2 position = origin + (glyph_position + corner * glyph_size) * scale;\n"
+		"	vec3 vertex = vec3( position * vec2(1.0, -1.0) / viewport.zw * 2.0, 0.0 );\n"
+		"\n"
+		"	// calculate final vertex position by offsetting it\n"
+		"	gl_Position = vec4( vertex + offset, 1.0 );\n"
+		"\n"
+		"	// hidden labels are moved outside the clip volume, so they don't cost any fill rate\n"
+		"	if( visible == 0.0 ) gl_Position = vec4( 0.0, 0.0, 2.0, 1.0 );\n"
 		"}";
 
 	return std::string(vs);
 }
 
+bool TextLabels::bindPackedShader()
+{
+	if( Text::bindPackedShader() )
+	{
+		Area viewport = gl::getViewport();
+		mPackedShader.uniform( "viewport", Vec4i( viewport.getX1(), viewport.getY1(), viewport.getWidth(), viewport.getHeight() ) );
+		mPackedShader.uniform( "labels", 1 );
+		mPackedShader.uniform( "labels_size", Vec2f( mLabelTexture.getSize() ) );
+		mPackedShader.uniform( "visibility", 2 );
+		mPackedShader.uniform( "visibility_size", Vec2f( mVisibilityTexture.getSize() ) );
+		return true;
+	}
+
+	return false;
+}
+
 bool TextLabels::bindShader()
 {
 	if( Text::bindShader() )
 	{
 		Area viewport = gl::getViewport();
 		mShader.uniform( "viewport", Vec4i( viewport.getX1(), viewport.getY1(), viewport.getWidth(), viewport.getHeight() ) );
+
+		updateVisibility();
+		mVisibilityTexture.bind(2);
+		mShader.uniform( "visibility", 2 );
+		mShader.uniform( "visibility_size", Vec2f( mVisibilityTexture.getSize() ) );
 		return true;
 	}
 
 	return false;
 }
 
+bool TextLabels::unbindShader()
+{
+	if( mVisibilityTexture )
+		mVisibilityTexture.unbind(2);
+
+	return Text::unbindShader();
+}
+
 } } // namespace ph::text
\ No newline at end of file
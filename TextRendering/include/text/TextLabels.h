@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include "cinder/Channel.h"
 #include "cinder/DataSource.h"
 #include "cinder/TriMesh.h"
 #include "cinder/Utilities.h"
@@ -49,8 +50,7 @@ class TextLabels
 	: public ph::text::Text
 {
 public:
-	TextLabels(void)
-		: mOffset( ci::Vec2f::zero() ) {};
+	TextLabels(void) : mVisibilityInvalid(true) {};
 	virtual ~TextLabels(void) {};
 
 	//! clears all labels
@@ -70,6 +70,13 @@ public:
 	//!	add label
 	void	addLabel( const ci::Vec3f &position, const std::string &text ) { addLabel(position, ci::toUtf16(text)); }
 	void	addLabel( const ci::Vec3f &position, const std::u16string &text );
+
+	//! lays out all labels, each label anchor is passed to the sink before its glyphs
+	virtual void	layout( GlyphSink *sink );
+
+	//! sets the visibility of each label, in the order they were added: 0 hides the label, 255 shows it.
+	//! Labels not in the mask are shown. Changing the mask does not rebuild the mesh.
+	void	setVisibility( const std::vector<uint8_t> &mask ) { mVisibility = mask; mVisibilityInvalid = true; }
 protected:
 	//! get the maximum width of the text at the specified vertical position
 	virtual float getWidthAt(float y) const { return 1000.0f; }
@@ -77,20 +84,32 @@ protected:
 	//! override vertex shader and bind method
 	virtual std::string	getVertexShader() const;
 	virtual bool		bindShader();
+	virtual bool		unbindShader();
+
+	//! override packed vertex shader, bind and draw methods
+	virtual std::string	getPackedVertexShader() const;
+	virtual bool		bindPackedShader();
+	virtual void		drawPacked();
 	
 	//! clears the mesh and the buffers
 	virtual void		clearMesh();
-	//! renders the current contents of mText
-	virtual void		renderMesh();
-	//! helper to render a non-word-wrapped string
-	virtual void		renderString( const std::u16string &str, ci::Vec2f *cursor, float stretch=1.0f );
 	//! creates the VBO from the data in the buffers
 	virtual void		createMesh();
+	//! creates the instance buffer and the label texture from the packed glyphs
+	virtual void		createPackedMesh();
+	//! creates or updates the visibility texture, one texel per label
+	void				updateVisibility();
 private:
 	TextLabelList			mLabels;
-	
-	ci::Vec3f				mOffset;
-	std::vector<ci::Vec3f>	mOffsets;
+
+	//! label anchors of the packed glyphs, one texel per label
+	ci::gl::Texture			mLabelTexture;
+
+	//! visibility of each label, one texel per label
+	std::vector<uint8_t>	mVisibility;
+	bool					mVisibilityInvalid;
+	ci::Channel8u			mVisibilityChannel;
+	ci::gl::Texture			mVisibilityTexture;
 };
 
 } } // namespace ph::text
\ No newline at end of file
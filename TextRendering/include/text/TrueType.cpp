@@ -0,0 +1,373 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "text/TrueType.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ph { namespace text {
+
+using namespace ci;
+using namespace std;
+
+// see: https://developer.apple.com/fonts/TrueType-Reference-Manual/
+
+bool TrueType::load( const void *data, size_t size )
+{
+	if( !data || size < 12 ) return false;
+
+	const uint8_t *bytes = static_cast<const uint8_t*>(data);
+	mData.assign( bytes, bytes + size );
+
+	// of a font collection (.ttc), use the first font
+	mDirectory = 0;
+	if( u32(0) == 0x74746366 /* 'ttcf' */ ) {
+		if( u32(8) == 0 ) return false;
+		mDirectory = u32(12);
+	}
+
+	// only fonts with TrueType outlines are supported
+	uint32_t version = u32(mDirectory);
+	if( version != 0x00010000 && version != 0x74727565 /* 'true' */ ) return false;
+
+	size_t head = findTable("head");
+	size_t maxp = findTable("maxp");
+	size_t hhea = findTable("hhea");
+	mHmtx = findTable("hmtx");
+	mLoca = findTable("loca");
+	mGlyf = findTable("glyf");
+	mCmap = findTable("cmap");
+
+	if( !head || !maxp || !hhea || !mHmtx || !mLoca || !mGlyf || !mCmap ) return false;
+
+	mUnitsPerEm = u16(head + 18);
+	mIndexToLocFormat = i16(head + 50);
+	mNumGlyphs = u16(maxp + 4);
+
+	mAscender = i16(hhea + 4);
+	mDescender = i16(hhea + 6);
+	mLineGap = i16(hhea + 8);
+	mNumHMetrics = u16(hhea + 34);
+
+	if( mUnitsPerEm == 0 || mNumHMetrics == 0 ) return false;
+
+	// find a Unicode character map, prefer the full repertoire (format 12) over the BMP (format 4)
+	size_t	cmap = mCmap;
+	size_t	best = 0;
+	mCmapFormat = 0;
+
+	uint16_t numTables = u16(cmap + 2);
+	for(uint16_t i=0;i<numTables;++i) {
+		size_t		record = cmap + 4 + 8 * i;
+		uint16_t	platform = u16(record);
+		uint16_t	encoding = u16(record + 2);
+		size_t		subtable = cmap + u32(record + 4);
+		uint16_t	format = u16(subtable);
+
+		bool unicode = (platform == 0) || (platform == 3 && (encoding == 1 || encoding == 10));
+		if( !unicode ) continue;
+
+		if( format == 12 || (format == 4 && mCmapFormat != 12) ) {
+			best = subtable;
+			mCmapFormat = format;
+		}
+	}
+
+	if( !best ) return false;
+	mCmap = best;
+
+	return true;
+}
+
+size_t TrueType::findTable( const char *tag ) const
+{
+	uint16_t numTables = u16(mDirectory + 4);
+	for(uint16_t i=0;i<numTables;++i) {
+		size_t record = mDirectory + 12 + 16 * i;
+		if( record + 16 > mData.size() ) break;
+
+		if( std::memcmp( &mData[record], tag, 4 ) == 0 ) {
+			size_t offset = u32(record + 8);
+			return offset < mData.size() ? offset : 0;
+		}
+	}
+
+	return 0;
+}
+
+uint32_t TrueType::getGlyphIndex( uint32_t codepoint ) const
+{
+	if( mCmapFormat == 4 ) {
+		if( codepoint > 0xFFFF ) return 0;
+
+		uint16_t	segCount = u16(mCmap + 6) / 2;
+		size_t		endCodes = mCmap + 14;
+		size_t		startCodes = endCodes + 2 * segCount + 2;
+		size_t		idDeltas = startCodes + 2 * segCount;
+		size_t		idRangeOffsets = idDeltas + 2 * segCount;
+
+		// binary search for the first segment that ends at or after the code point
+		int lo = 0, hi = int(segCount) - 1;
+		while( lo < hi ) {
+			int mid = (lo + hi) / 2;
+			if( u16(endCodes + 2 * mid) < codepoint )
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if( segCount == 0 || u16(endCodes + 2 * lo) < codepoint ) return 0;
+
+		uint16_t start = u16(startCodes + 2 * lo);
+		if( codepoint < start ) return 0;
+
+		uint16_t delta = u16(idDeltas + 2 * lo);
+		uint16_t rangeOffset = u16(idRangeOffsets + 2 * lo);
+		if( rangeOffset == 0 )
+			return (codepoint + delta) & 0xFFFF;
+
+		uint16_t glyph = u16(idRangeOffsets + 2 * lo + rangeOffset + 2 * (codepoint - start));
+		return glyph ? ((glyph + delta) & 0xFFFF) : 0;
+	}
+	else if( mCmapFormat == 12 ) {
+		uint32_t	numGroups = u32(mCmap + 12);
+		size_t		groups = mCmap + 16;
+
+		int lo = 0, hi = int(numGroups) - 1;
+		while( lo <= hi ) {
+			int			mid = (lo + hi) / 2;
+			uint32_t	start = u32(groups + 12 * mid);
+			uint32_t	end = u32(groups + 12 * mid + 4);
+
+			if( codepoint < start )
+				hi = mid - 1;
+			else if( codepoint > end )
+				lo = mid + 1;
+			else
+				return u32(groups + 12 * mid + 8) + (codepoint - start);
+		}
+	}
+
+	return 0;
+}
+
+int TrueType::getAdvance( uint32_t glyph ) const
+{
+	if( glyph < mNumHMetrics )
+		return u16(mHmtx + 4 * glyph);
+
+	// monospaced glyphs at the end of the table share the last advance
+	return u16(mHmtx + 4 * (mNumHMetrics - 1));
+}
+
+bool TrueType::getGlyphRange( uint32_t glyph, size_t *offset, size_t *length ) const
+{
+	if( glyph >= mNumGlyphs ) return false;
+
+	size_t begin, end;
+	if( mIndexToLocFormat == 0 ) {
+		begin = 2 * size_t( u16(mLoca + 2 * glyph) );
+		end = 2 * size_t( u16(mLoca + 2 * glyph + 2) );
+	}
+	else {
+		begin = u32(mLoca + 4 * glyph);
+		end = u32(mLoca + 4 * glyph + 4);
+	}
+
+	if( end < begin || mGlyf + end > mData.size() ) return false;
+
+	*offset = mGlyf + begin;
+	*length = end - begin;
+
+	return true;
+}
+
+bool TrueType::getContours( uint32_t glyph, Contours *contours, int segments ) const
+{
+	if( !contours ) return false;
+	contours->clear();
+
+	const float identity[6] = { 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+	return appendContours( glyph, identity, contours, math<int>::max( segments, 1 ), 0 );
+}
+
+bool TrueType::appendContours( uint32_t glyph, const float m[6], Contours *contours, int segments, int depth ) const
+{
+	size_t offset, length;
+	if( !getGlyphRange( glyph, &offset, &length ) ) return false;
+
+	// glyphs without outline, like the space character
+	if( length == 0 ) return true;
+
+	int16_t numContours = i16(offset);
+
+	if( numContours >= 0 ) {
+		// simple glyph
+		if( numContours == 0 ) return true;
+
+		size_t		endPts = offset + 10;
+		uint16_t	numPoints = u16(endPts + 2 * (numContours - 1)) + 1;
+		size_t		p = endPts + 2 * numContours;
+		p += 2 + u16(p);	// skip instructions
+
+		// read flags
+		std::vector<uint8_t> flags( numPoints );
+		for(uint16_t i=0;i<numPoints;) {
+			uint8_t flag = u8(p++);
+			flags[i++] = flag;
+
+			if( flag & 8 ) {
+				uint8_t repeat = u8(p++);
+				while( repeat-- > 0 && i < numPoints ) flags[i++] = flag;
+			}
+		}
+
+		// read coordinates
+		std::vector<Vec2f> points( numPoints );
+
+		int x = 0;
+		for(uint16_t i=0;i<numPoints;++i) {
+			if( flags[i] & 2 ) { x += (flags[i] & 16) ? u8(p) : -int(u8(p)); p += 1; }
+			else if( !(flags[i] & 16) ) { x += i16(p); p += 2; }
+			points[i].x = float(x);
+		}
+
+		int y = 0;
+		for(uint16_t i=0;i<numPoints;++i) {
+			if( flags[i] & 4 ) { y += (flags[i] & 32) ? u8(p) : -int(u8(p)); p += 1; }
+			else if( !(flags[i] & 32) ) { y += i16(p); p += 2; }
+			points[i].y = float(y);
+		}
+
+		if( p > mData.size() ) return false;
+
+		// transform points
+		for(uint16_t i=0;i<numPoints;++i) {
+			Vec2f pt = points[i];
+			points[i].x = m[0] * pt.x + m[2] * pt.y + m[4];
+			points[i].y = m[1] * pt.x + m[3] * pt.y + m[5];
+		}
+
+		// convert each contour to line segments
+		uint16_t start = 0;
+		for(int16_t c=0;c<numContours;++c) {
+			uint16_t end = u16(endPts + 2 * c);
+			if( end < start || end >= numPoints ) return false;
+
+			// insert the implied on-curve points between two consecutive off-curve points
+			std::vector< std::pair<Vec2f, bool> > outline;
+			size_t count = end - start + 1;
+			for(size_t i=0;i<count;++i) {
+				size_t j = start + i;
+				size_t k = start + (i + 1) % count;
+				bool on = (flags[j] & 1) != 0;
+
+				outline.push_back( std::make_pair( points[j], on ) );
+				if( !on && !(flags[k] & 1) )
+					outline.push_back( std::make_pair( 0.5f * (points[j] + points[k]), true ) );
+			}
+
+			start = end + 1;
+
+			// rotate the outline so that it starts with an on-curve point
+			size_t first = 0;
+			while( first < outline.size() && !outline[first].second ) ++first;
+			if( first == outline.size() ) continue;
+
+			std::rotate( outline.begin(), outline.begin() + first, outline.end() );
+
+			Contour contour;
+			contour.push_back( outline[0].first );
+
+			size_t n = outline.size();
+			for(size_t i=1;i<=n;++i) {
+				const Vec2f &pt = outline[i % n].first;
+
+				if( outline[i % n].second ) {
+					contour.push_back( pt );
+				}
+				else {
+					// quadratic bezier from the previous on-curve point to the next
+					Vec2f p0 = contour.back();
+					Vec2f p2 = outline[(i + 1) % n].first;
+					for(int s=1;s<=segments;++s) {
+						float t = float(s) / segments;
+						float u = 1.0f - t;
+						contour.push_back( u * u * p0 + 2.0f * u * t * pt + t * t * p2 );
+					}
+					++i;
+				}
+			}
+
+			if( contour.size() > 2 )
+				contours->push_back( contour );
+		}
+	}
+	else {
+		// compound glyph, made of transformed copies of other glyphs
+		if( depth > 8 ) return false;
+
+		size_t		p = offset + 10;
+		uint16_t	flags;
+		do {
+			flags = u16(p);
+			uint32_t component = u16(p + 2);
+			p += 4;
+
+			float dx, dy;
+			if( flags & 1 ) { dx = i16(p); dy = i16(p + 2); p += 4; }
+			else { dx = (int8_t) u8(p); dy = (int8_t) u8(p + 1); p += 2; }
+
+			// matching points are not supported, only offsets
+			if( !(flags & 2) ) { dx = 0.0f; dy = 0.0f; }
+
+			float c[6] = { 1.0f, 0.0f, 0.0f, 1.0f, dx, dy };
+			if( flags & 8 ) {
+				c[0] = c[3] = i16(p) / 16384.0f; p += 2;
+			}
+			else if( flags & 0x40 ) {
+				c[0] = i16(p) / 16384.0f; c[3] = i16(p + 2) / 16384.0f; p += 4;
+			}
+			else if( flags & 0x80 ) {
+				c[0] = i16(p) / 16384.0f; c[1] = i16(p + 2) / 16384.0f;
+				c[2] = i16(p + 4) / 16384.0f; c[3] = i16(p + 6) / 16384.0f; p += 8;
+			}
+
+			// combine with the parent transform
+			const float r[6] = {
+				m[0] * c[0] + m[2] * c[1],
+				m[1] * c[0] + m[3] * c[1],
+				m[0] * c[2] + m[2] * c[3],
+				m[1] * c[2] + m[3] * c[3],
+				m[0] * c[4] + m[2] * c[5] + m[4],
+				m[1] * c[4] + m[3] * c[5] + m[5]
+			};
+
+			if( !appendContours( component, r, contours, segments, depth + 1 ) ) return false;
+		} while( (flags & 0x20) && p < mData.size() );
+	}
+
+	return true;
+}
+
+} } // namespace ph::text
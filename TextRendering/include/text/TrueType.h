@@ -0,0 +1,97 @@
+/*
+ Copyright (c) 2010-2012, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this list of conditions and
+	the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+	the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Vector.h"
+
+#include <vector>
+
+namespace ph { namespace text {
+
+//! Minimal reader for TrueType (glyf) font files. Once loaded, all methods are const and
+//! can safely be called from multiple threads. CFF based OpenType fonts are not supported.
+class TrueType
+{
+public:
+	//! a closed outline, flattened to line segments (in font units, y pointing up)
+	typedef std::vector<ci::Vec2f>	Contour;
+	typedef std::vector<Contour>	Contours;
+public:
+	TrueType(void) : mDirectory(0), mUnitsPerEm(0), mNumGlyphs(0), mNumHMetrics(0), mIndexToLocFormat(0),
+		mAscender(0), mDescender(0), mLineGap(0), mGlyf(0), mLoca(0), mHmtx(0), mCmap(0), mCmapFormat(0) {}
+	~TrueType(void) {}
+
+	//! parses the font, returns FALSE if the data is not a supported TrueType font.
+	//! Of a font collection (.ttc), the first font is used.
+	bool		load( const void *data, size_t size );
+
+	//!
+	int			getUnitsPerEm() const { return mUnitsPerEm; }
+	//!
+	int			getAscender() const { return mAscender; }
+	//! negative value, below the baseline
+	int			getDescender() const { return mDescender; }
+	//!
+	int			getLineGap() const { return mLineGap; }
+
+	//! returns the glyph index of a Unicode code point, or 0 (the 'missing' glyph) if not available
+	uint32_t	getGlyphIndex( uint32_t codepoint ) const;
+	//! returns the advance width of a glyph, in font units
+	int			getAdvance( uint32_t glyph ) const;
+	//! returns the outline of a glyph, in font units. Curves are subdivided into 'segments' lines.
+	bool		getContours( uint32_t glyph, Contours *contours, int segments = 8 ) const;
+private:
+	uint8_t		u8( size_t offset ) const { return offset < mData.size() ? mData[offset] : 0; }
+	uint16_t	u16( size_t offset ) const { return (uint16_t(u8(offset)) << 8) | u8(offset + 1); }
+	int16_t		i16( size_t offset ) const { return (int16_t) u16(offset); }
+	uint32_t	u32( size_t offset ) const { return (uint32_t(u16(offset)) << 16) | u16(offset + 2); }
+
+	//! returns the offset of the table with the specified tag, or 0 if not found
+	size_t		findTable( const char *tag ) const;
+	//! returns the offset and length of a glyph in the 'glyf' table
+	bool		getGlyphRange( uint32_t glyph, size_t *offset, size_t *length ) const;
+	//!
+	bool		appendContours( uint32_t glyph, const float matrix[6], Contours *contours, int segments, int depth ) const;
+private:
+	std::vector<uint8_t>	mData;
+	//! offset of the table directory, which is not at the start of a font collection
+	size_t		mDirectory;
+
+	int			mUnitsPerEm;
+	uint32_t	mNumGlyphs;
+	uint32_t	mNumHMetrics;
+	int			mIndexToLocFormat;
+
+	int			mAscender;
+	int			mDescender;
+	int			mLineGap;
+
+	size_t		mGlyf;
+	size_t		mLoca;
+	size_t		mHmtx;
+	size_t		mCmap;
+	int			mCmapFormat;
+};
+
+} } // namespace ph::text
@@ -1,14 +1,76 @@
 #include "cinder/app/AppBasic.h"
 #include "cinder/gl/gl.h"
+#include "cinder/Timer.h"
 
 #include "text/FontStore.h"
 #include "text/TextBox.h"
+#include "text/TextLabels.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <new>
 
 using namespace ci;
 using namespace ci::app;
 using namespace ph::text;
 using namespace std;
 
+// count all memory allocations, so the benchmarks can report them
+static std::atomic<size_t>	sAllocations(0);
+
+void* operator new(size_t size)
+{
+	++sAllocations;
+
+	void *ptr = std::malloc(size ? size : 1);
+	if(!ptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void *ptr) throw()
+{
+	std::free(ptr);
+}
+
+//! Collects the output of the text layout without creating any geometry.
+class LayoutCounter : public GlyphSink {
+public:
+	LayoutCounter(void) { clear(); }
+
+	void	clear() { mGlyphs = 0; mLines = 0; mLabels = 0; mBounds = Rectf(0.0f, 0.0f, 0.0f, 0.0f); }
+
+	void	addLabel( const Vec3f &anchor ) { ++mLabels; }
+	void	addGlyph( const Rectf &bounds, const Rectf &texcoords ) { if( mGlyphs++ == 0 ) mBounds = bounds; else mBounds.include( bounds ); }
+	void	addLine( const TextLine &line ) { ++mLines; }
+
+	//! returns TRUE if both layouts produced the same glyphs, lines and labels, within 'epsilon' pixels
+	bool	matches( const LayoutCounter &other, float epsilon = 0.01f ) const
+	{
+		return mGlyphs == other.mGlyphs && mLines == other.mLines && mLabels == other.mLabels &&
+			math<float>::abs( mBounds.x1 - other.mBounds.x1 ) <= epsilon && math<float>::abs( mBounds.y1 - other.mBounds.y1 ) <= epsilon &&
+			math<float>::abs( mBounds.x2 - other.mBounds.x2 ) <= epsilon && math<float>::abs( mBounds.y2 - other.mBounds.y2 ) <= epsilon;
+	}
+
+	size_t	mGlyphs;
+	size_t	mLines;
+	size_t	mLabels;
+	Rectf	mBounds;
+};
+
+std::ostream& operator<<( std::ostream &os, const LayoutCounter &counter )
+{
+	return os << counter.mGlyphs << " " << counter.mLines << " " << counter.mLabels << " " 
+		<< counter.mBounds.x1 << " " << counter.mBounds.y1 << " " << counter.mBounds.x2 << " " << counter.mBounds.y2;
+}
+
+std::istream& operator>>( std::istream &is, LayoutCounter &counter )
+{
+	return is >> counter.mGlyphs >> counter.mLines >> counter.mLabels 
+		>> counter.mBounds.x1 >> counter.mBounds.y1 >> counter.mBounds.x2 >> counter.mBounds.y2;
+}
+
 class TextRenderingApp : public AppBasic {
 public:
 	void prepareSettings( Settings *settings );
@@ -30,6 +92,20 @@ public:
 protected:
 	Vec3f	constrainAnchor( const Vec3f &pt ) const;
 	void	updateWindowTitle();
+
+	//! prints the time it takes to load each font in the assets folder, in all supported formats
+	void	benchmarkFonts();
+	//! returns the average time in milliseconds it takes to read the font file
+	static double	measureLoadTime( const fs::path &file, int count );
+	//! prints the time it takes to measure short and long strings, as UTF-8 and UTF-16
+	void	benchmarkMeasure();
+	//! prints the layout speed in glyphs per second and the resulting bounds for several kinds of text,
+	//! and compares the results with the golden file of the current font in the assets folder
+	void	benchmarkLayout();
+	//! lays out CJK text using a font of the operating system, returns FALSE if the layout is not correct
+	bool	benchmarkCjkLayout( float size );
+	//! lays out the text 'count' times, prints the results and returns the layout of the last run
+	static LayoutCounter	measureLayout( const std::string &name, Text &text, int count );
 protected:
 	bool			mShowBounds;
 	bool			mShowWireframe;
@@ -76,8 +152,11 @@ void TextRenderingApp::prepareSettings(Settings *settings)
 void TextRenderingApp::setup()
 {
 	try { 
-		// load fonts using the FontStore
-		fonts().loadFont( loadAsset("fonts/Walter Turncoat Regular.sdff") ); 
+		// load fonts in parallel using the FontStore, they can be used right away
+		std::vector<DataSourceRef> sources;
+		sources.push_back( loadAsset("fonts/Walter Turncoat Regular.sdff") );
+		sources.push_back( loadAsset("fonts/Bubblegum Sans Regular.sdff") );
+		fonts().preload( sources ); 
 
 		// create a text box (rectangular text area)
 		mTextBox = TextBox( 400, 500 );
@@ -250,6 +329,20 @@ void TextRenderingApp::keyDown( KeyEvent event )
 	case KeyEvent::KEY_ESCAPE:
 		quit();
 		break;
+	case KeyEvent::KEY_b:
+		benchmarkFonts();
+		break;
+	case KeyEvent::KEY_k:
+		// toggle kerning and ligatures
+		mTextBox.setKerning( !mTextBox.isKerning() );
+		mTextBox.setLigatures( mTextBox.isKerning() );
+		break;
+	case KeyEvent::KEY_m:
+		benchmarkMeasure();
+		break;
+	case KeyEvent::KEY_l:
+		benchmarkLayout();
+		break;
 	case KeyEvent::KEY_d:
 		// load a very long text and hand it to the text box
 		mTextBox.setText( loadString( loadAsset("text/345.txt") ) );
@@ -260,6 +353,10 @@ void TextRenderingApp::keyDown( KeyEvent event )
 	case KeyEvent::KEY_v:
 		gl::enableVerticalSync( !gl::isVerticalSyncEnabled() );
 		break;
+	case KeyEvent::KEY_p:
+		// toggle between the regular and the packed vertex format
+		mTextBox.setPacked( !mTextBox.isPacked() );
+		break;
 	case KeyEvent::KEY_w:
 		mShowWireframe = !mShowWireframe;
 		break;
@@ -368,6 +465,20 @@ void TextRenderingApp::fileDrop( FileDropEvent event )
 				console() << e.what() << std::endl;
 			}
 		}
+		else if(file.extension() == ".ttf") {
+			try {
+				// create a dynamic font, glyphs are rendered on demand
+				ph::text::FontRef font( new ph::text::Font() );
+				font->createDynamic( loadFile(file) );
+				// add font to font manager
+				fonts().addFont( font );
+				// set the text font
+				mTextBox.setFont( font );
+			}
+			catch( const std::exception &e ) {
+				console() << e.what() << std::endl;
+			}
+		}
 		else {
 			// try to render the file as a text
 			mTextBox.setText( loadString( loadFile(file) ) );
@@ -437,12 +548,328 @@ Vec3f TextRenderingApp::constrainAnchor( const Vec3f &pt ) const
 	return result;
 }
 
+void TextRenderingApp::benchmarkFonts()
+{
+	const int count = 10;
+
+	fs::directory_iterator end;
+	for(fs::directory_iterator itr(getAssetPath("fonts"));itr!=end;++itr) {
+		fs::path file = itr->path();
+		if( file.extension() != ".sdff" ) continue;
+
+		try {
+			// convert the font to the uncompressed and compressed version 3 format
+			fs::path uncompressed = getTemporaryDirectory() / (file.stem().string() + " (v3).sdff");
+			fs::path compressed = getTemporaryDirectory() / (file.stem().string() + " (v3 lz4).sdff");
+			{
+				ph::text::Font font;
+				font.read( loadFile(file) );
+				font.write( writeFile(uncompressed) );
+				font.write( writeFile(compressed), true );
+			}
+
+			console() << file.filename().string() << std::endl;
+			console() << "  as shipped:  " << measureLoadTime( file, count ) << " ms (" << fs::file_size(file) << " bytes)" << std::endl;
+			console() << "  v3:          " << measureLoadTime( uncompressed, count ) << " ms (" << fs::file_size(uncompressed) << " bytes)" << std::endl;
+			console() << "  v3 (lz4):    " << measureLoadTime( compressed, count ) << " ms (" << fs::file_size(compressed) << " bytes)" << std::endl;
+
+			fs::remove( uncompressed );
+			fs::remove( compressed );
+		}
+		catch( const std::exception &e ) {
+			console() << e.what() << std::endl;
+		}
+	}
+}
+
+double TextRenderingApp::measureLoadTime( const fs::path &file, int count )
+{
+	Timer timer(true);
+	for(int i=0;i<count;++i) {
+		ph::text::Font font;
+		font.read( loadFile(file) );
+	}
+	// include the texture upload
+	glFinish();
+	timer.stop();
+
+	return 1000.0 * timer.getSeconds() / count;
+}
+
+void TextRenderingApp::benchmarkMeasure()
+{
+	ph::text::FontRef font = fonts().getFont( mTextBox.getFontFamily() );
+	if( !font ) return;
+
+	std::vector<std::string> texts;
+	texts.push_back( "Hello" );
+	texts.push_back( "Ellipsis fitting\xE2\x80\xA6" );
+	texts.push_back( loadString( loadAsset("fonts/readme.txt") ) );
+
+	std::vector<std::string>::const_iterator itr;
+	for(itr=texts.begin();itr!=texts.end();++itr) {
+		// repeat short strings more often, so the measurements take a similar amount of time
+		const int count = (int) math<size_t>::max( 10, 1000000 / (itr->size() + 1) );
+		float width = 0.0f;
+
+		// the old path: convert to UTF-16 first
+		Timer timer(true);
+		for(int i=0;i<count;++i)
+			width += font->measureWidth( toUtf16(*itr), 12.0f, true, false );
+		double utf16 = timer.getSeconds();
+
+		// the new path: measure the UTF-8 string directly
+		timer.start();
+		for(int i=0;i<count;++i)
+			width += font->measureWidth( *itr, 12.0f, true, false );
+		double utf8 = timer.getSeconds();
+
+		// with kerning
+		timer.start();
+		for(int i=0;i<count;++i)
+			width += font->measureWidth( *itr, 12.0f, true, true );
+		double kerning = timer.getSeconds();
+
+		console() << itr->size() << " bytes, " << count << " times:" << std::endl;
+		console() << "  converted to UTF-16: " << (1.0e9 * utf16 / count) << " ns per call" << std::endl;
+		console() << "  UTF-8:               " << (1.0e9 * utf8 / count) << " ns per call" << std::endl;
+		console() << "  UTF-8 with kerning:  " << (1.0e9 * kerning / count) << " ns per call (" << width << ")" << std::endl;
+	}
+}
+
+void TextRenderingApp::benchmarkLayout()
+{
+	ph::text::FontRef font = fonts().getFont( mTextBox.getFontFamily() );
+	if( !font ) return;
+
+	const float size = 14.0f;
+
+	std::map<std::string, LayoutCounter> results;
+	size_t failed = 0;
+
+	// a single line, which should have exactly the size returned by Font::measure()
+	const std::string sentence = "The office staff finished the affidavit with five fine fluffy waffles.";
+
+	TextBox line;
+	line.setFont( font );
+	line.setFontSize( size );
+	line.setBoundary( Text::LINE );
+	line.setSize( 0.0f, 0.0f );
+	line.setText( sentence );
+	results["Single line"] = measureLayout( "Single line", line, 10000 );
+
+	// latin prose
+	TextBox prose;
+	prose.setFont( font );
+	prose.setFontSize( size );
+	prose.setBoundary( Text::WORD );
+	prose.setSize( 400.0f, 0.0f );
+	prose.setText( loadString( loadAsset("fonts/readme.txt") ) );
+	results["Latin prose"] = measureLayout( "Latin prose", prose, 100 );
+
+	// a long unbroken URL forces the layout to split a single word
+	std::string url = "http://www.example.com/";
+	for(int i=0;i<100;++i)
+		url += "some-very-long-path-segment/";
+
+	TextBox unbroken;
+	unbroken.setFont( font );
+	unbroken.setFontSize( size );
+	unbroken.setBoundary( Text::WORD );
+	unbroken.setSize( 400.0f, 0.0f );
+	unbroken.setText( url );
+	results["Unbroken URL"] = measureLayout( "Unbroken URL", unbroken, 1000 );
+
+	// many small labels
+	TextLabels labels;
+	labels.setFont( font );
+	labels.setFontSize( size );
+	for(int i=0;i<5000;++i) {
+		std::stringstream str;
+		str << "Label " << i;
+		labels.addLabel( Vec3f( float(i % 100), float(i / 100), 0.0f ), str.str() );
+	}
+	results["Labels"] = measureLayout( "Labels", labels, 10 );
+
+	// the width of a single line must match the measured width, including kerning and ligatures
+	const float measured = font->measure( sentence, size ).getWidth();
+	const float laidOut = results["Single line"].mBounds.getWidth();
+	if( math<float>::abs( measured - laidOut ) > 0.01f ) {
+		console() << "FAILED: single line is " << laidOut << " pixels wide, measured " << measured << std::endl;
+		++failed;
+	}
+
+	// wrapped text must stay inside the box
+	if( results["Latin prose"].mBounds.x2 > prose.getSize().x + 0.01f ) {
+		console() << "FAILED: latin prose exceeds the box width (" << results["Latin prose"].mBounds << ")" << std::endl;
+		++failed;
+	}
+	if( results["Unbroken URL"].mBounds.x2 > unbroken.getSize().x + 0.01f ) {
+		console() << "FAILED: unbroken URL exceeds the box width (" << results["Unbroken URL"].mBounds << ")" << std::endl;
+		++failed;
+	}
+
+	// CJK text needs a font with ideographs, so it is verified separately
+	if( !benchmarkCjkLayout( size ) )
+		++failed;
+
+	// compare with the golden results of this font. They are kept in the assets folder and are never
+	// recorded here, so a missing file is a failure too: copy the printed results to create one.
+	const fs::path golden = getAssetPath("text") / ("layout " + font->getFamily() + ".golden");
+	if( !fs::exists( golden ) ) {
+		console() << "FAILED: there are no golden layout results for " << font->getFamily() << std::endl;
+		++failed;
+	}
+	else {
+		std::ifstream in( golden.string().c_str() );
+		std::string name;
+		LayoutCounter expected;
+		size_t compared = 0;
+		while( std::getline( in, name, '\t' ) && in >> expected ) {
+			in.ignore( 1 );
+
+			std::map<std::string, LayoutCounter>::const_iterator itr = results.find( name );
+			if( itr == results.end() ) continue;
+
+			++compared;
+			if( !itr->second.matches( expected ) ) {
+				console() << "FAILED: " << name << " laid out as " << itr->second << ", expected " << expected << std::endl;
+				++failed;
+			}
+		}
+
+		if( compared < results.size() ) {
+			console() << "FAILED: " << golden << " misses " << (results.size() - compared) << " results" << std::endl;
+			++failed;
+		}
+	}
+
+	console() << "Layout results: " << (failed ? "FAILED" : "OK") << std::endl;
+}
+
+bool TextRenderingApp::benchmarkCjkLayout( float size )
+{
+	// the bundled fonts contain no ideographs, so create a dynamic font from one of the system fonts
+	std::vector<fs::path> candidates;
+#if defined( CINDER_MSW )
+	candidates.push_back( "C:/Windows/Fonts/msyh.ttc" );
+	candidates.push_back( "C:/Windows/Fonts/simsun.ttc" );
+	candidates.push_back( "C:/Windows/Fonts/simhei.ttf" );
+#elif defined( CINDER_MAC )
+	candidates.push_back( "/Library/Fonts/Arial Unicode.ttf" );
+	candidates.push_back( "/System/Library/Fonts/Supplemental/Arial Unicode.ttf" );
+#endif
+
+	ph::text::FontRef font;
+
+	std::vector<fs::path>::const_iterator itr;
+	for(itr=candidates.begin();itr!=candidates.end() && !font;++itr) {
+		if( !fs::exists( *itr ) ) continue;
+
+		try { 
+			font = ph::text::FontRef( new ph::text::Font() );
+			font->createDynamic( loadFile( *itr ) );
+		}
+		catch( const std::exception & ) { 
+			font.reset();
+		}
+	}
+
+	if( !font ) {
+		console() << "FAILED: CJK text, none of the system fonts with ideographs could be loaded" << std::endl;
+		return false;
+	}
+
+	// request all characters and wait until the worker threads have rendered them, 
+	// so the layout does not depend on how fast the glyphs are created
+	const std::string text = loadString( loadAsset("text/cjk.txt") );
+	const std::u16string chars = toUtf16( text );
+
+	size_t glyphs = 0;
+	std::u16string::const_iterator citr;
+	for(citr=chars.begin();citr!=chars.end();++citr) {
+		if( *citr <= 32 ) continue;
+
+		font->request( *citr );
+		++glyphs;
+	}
+
+	bool complete = false;
+
+	Timer timer(true);
+	while( !complete && timer.getSeconds() < 10.0 ) {
+		font->update();
+
+		complete = true;
+		for(citr=chars.begin();citr!=chars.end() && complete;++citr)
+			complete = ( *citr <= 32 || font->contains( *citr ) );
+
+		if( !complete ) 
+			ci::sleep( 10.0f );
+	}
+
+	if( !complete ) {
+		console() << "FAILED: CJK text, " << font->getFamily() << " does not contain all characters" << std::endl;
+		return false;
+	}
+
+	TextBox cjk;
+	cjk.setFont( font );
+	cjk.setFontSize( size );
+	cjk.setBoundary( Text::WORD );
+	cjk.setSize( 400.0f, 0.0f );
+	cjk.setText( text );
+	const LayoutCounter result = measureLayout( "CJK text (" + font->getFamily() + ")", cjk, 100 );
+
+	// every character is laid out, and lines are broken between the ideographs to fit the box
+	bool valid = true;
+	if( result.mGlyphs != glyphs ) {
+		console() << "FAILED: CJK text has " << result.mGlyphs << " glyphs, expected " << glyphs << std::endl;
+		valid = false;
+	}
+	if( result.mBounds.x2 > cjk.getSize().x + 0.01f ) {
+		console() << "FAILED: CJK text exceeds the box width (" << result.mBounds << ")" << std::endl;
+		valid = false;
+	}
+
+	return valid;
+}
+
+LayoutCounter TextRenderingApp::measureLayout( const std::string &name, Text &text, int count )
+{
+	LayoutCounter counter;
+
+	// the first layout may allocate buffers that are reused afterwards, so it is not counted
+	text.layout( &counter );
+
+	const size_t before = sAllocations;
+
+	Timer timer(true);
+	for(int i=0;i<count;++i) {
+		counter.clear();
+		text.layout( &counter );
+	}
+	timer.stop();
+
+	const double allocations = double(sAllocations - before) / count;
+
+	console() << name << ", " << count << " times:" << std::endl;
+	console() << "  " << counter.mGlyphs << " glyphs, " << counter.mLines << " lines, " << counter.mLabels << " labels" << std::endl;
+	console() << "  " << (1000.0 * timer.getSeconds() / count) << " ms per layout, " << (counter.mGlyphs * count / timer.getSeconds()) << " glyphs/s" << std::endl;
+	console() << "  " << allocations << " allocations per layout" << std::endl;
+	console() << "  bounds: " << counter.mBounds << std::endl;
+
+	return counter;
+}
+
 void TextRenderingApp::updateWindowTitle()
 {
 	std::stringstream str;
 	str << "TextRenderingApp -";
 	str << " Font family: " << mTextBox.getFontFamily();
 	str << " (" << mTextBox.getFontSize() << ")";
+	if( mTextBox.isPacked() ) str << " [packed]";
+	if( !mTextBox.isKerning() ) str << " [no kerning]";
 	
 	getWindow()->setTitle( str.str() );
 }